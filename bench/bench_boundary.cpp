@@ -0,0 +1,25 @@
+#include "benchmark/benchmark.h"
+#include "bench_utils.hpp"
+
+template <typename T>
+static void BM_DividedLineRatio(benchmark::State& state) {
+  const auto mesh = state.range(0), bond = state.range(1), boundary = state.range(2);
+  LS::Boundary<T> box(bench::boundaryType(boundary), bench::cubicMesh(mesh));
+  box.setBox(LS::Vec<T>(T(0)), LS::Vec<T>(T(bench::box_length)));
+  std::vector<LS::Vec<T>> r1, dr;
+  bench::makeContours(mesh, bond, boundary, r1, dr);
+
+  std::size_t num_segments = 0;
+  for (auto _ : state) {
+    for (std::size_t i = 0; i < r1.size(); i++) {
+      const auto ratios = box.getDividedLineRatio(r1[i], dr[i]);
+      num_segments += ratios.size();
+      benchmark::DoNotOptimize(ratios.data());
+    }
+  }
+  state.SetItemsProcessed(state.iterations() * r1.size());
+  state.counters["segments"] = benchmark::Counter(double(num_segments) / (state.iterations() * r1.size()));
+  state.SetLabel(bench::label(mesh, bond, boundary));
+}
+BENCHMARK_TEMPLATE(BM_DividedLineRatio, double)->BENCH_SPREAD_ARGS;
+BENCHMARK_TEMPLATE(BM_DividedLineRatio, float)->BENCH_SPREAD_ARGS;
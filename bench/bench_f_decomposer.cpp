@@ -0,0 +1,40 @@
+#include "benchmark/benchmark.h"
+#include "bench_utils.hpp"
+
+// NOTE: N-body forces summing to zero on random configurations.
+template <typename T, int N>
+static void BM_DecomposeForce(benchmark::State& state) {
+  constexpr int M = N * (N - 1) / 2;
+  std::mt19937 mt(11);
+  std::normal_distribution<T> nd(T(0), T(1));
+  auto randomVec = [&]() { LS::Vec<T> v; for (int32_t a = 0; a < LS::D; a++) v[a] = nd(mt); return v; };
+
+  std::vector<std::array<LS::Vec<T>, N>> forces(bench::num_samples);
+  std::vector<std::array<LS::Vec<T>, M>> drs(bench::num_samples);
+  for (int s = 0; s < bench::num_samples; s++) {
+    std::array<LS::Vec<T>, N> r;
+    for (auto& ri : r) ri = randomVec();
+    LS::Vec<T> fsum;
+    for (int i = 0; i + 1 < N; i++) { forces[s][i] = randomVec(); fsum += forces[s][i]; }
+    forces[s][N - 1] = -fsum;
+    // pair order of calcLocalStressPot3 / Pot4
+    if (N == 3) {
+      drs[s][0] = r[0] - r[1]; drs[s][1] = r[1] - r[2]; drs[s][2] = r[2] - r[0];
+    } else {
+      int k = 0;
+      for (int i = 0; i < N; i++) for (int j = i + 1; j < N; j++) drs[s][k++] = r[i] - r[j];
+    }
+  }
+
+  for (auto _ : state) {
+    for (int s = 0; s < bench::num_samples; s++) {
+      const auto dF = LS::decomposeForce(forces[s], drs[s]);
+      benchmark::DoNotOptimize(dF);
+    }
+  }
+  state.SetItemsProcessed(state.iterations() * bench::num_samples);
+}
+BENCHMARK_TEMPLATE(BM_DecomposeForce, double, 3);
+BENCHMARK_TEMPLATE(BM_DecomposeForce, float, 3);
+BENCHMARK_TEMPLATE(BM_DecomposeForce, double, 4);
+BENCHMARK_TEMPLATE(BM_DecomposeForce, float, 4);
@@ -0,0 +1,101 @@
+#include "benchmark/benchmark.h"
+#include "bench_utils.hpp"
+
+#include <cstdio>
+#include <unistd.h>
+
+namespace {
+  template <typename T>
+  std::unique_ptr<LS::LSCalculator<T>> makeCalculator(const int64_t mesh, const int64_t boundary) {
+    auto calc = LS::CalculatorFactory<T>::create(LS::Vec<T>(T(0)), LS::Vec<T>(T(bench::box_length)),
+                                                 bench::boundaryType(boundary),
+                                                 bench::cubicMesh(mesh), {"Kinetic", "Pair"});
+    calc->disableAutoSave();
+    return calc;
+  }
+}
+
+// NOTE: one pair force spread along its contour (getDividedLineRatio + accumulation).
+template <typename T>
+static void BM_CalcLocalStressPot2(benchmark::State& state) {
+  const auto mesh = state.range(0), bond = state.range(1), boundary = state.range(2);
+  auto calc = makeCalculator<T>(mesh, boundary);
+  std::vector<LS::Vec<T>> r1, dr;
+  bench::makeContours(mesh, bond, boundary, r1, dr);
+  std::vector<LS::Vec<T>> r0(r1.size());
+  for (std::size_t i = 0; i < r1.size(); i++) {
+    r0[i] = r1[i] + dr[i];
+    calc->boundary().adjustBoundary(r0[i]);
+  }
+
+  for (auto _ : state) {
+    for (std::size_t i = 0; i < r1.size(); i++) {
+      const auto F = dr[i] * T(0.5);
+      calc->calcLocalStressPot2NoCheck(r0[i], r1[i], F, -F, 1);
+    }
+  }
+  state.SetItemsProcessed(state.iterations() * r1.size());
+  state.SetLabel(bench::label(mesh, bond, boundary));
+}
+BENCHMARK_TEMPLATE(BM_CalcLocalStressPot2, double)->BENCH_SPREAD_ARGS;
+BENCHMARK_TEMPLATE(BM_CalcLocalStressPot2, float)->BENCH_SPREAD_ARGS;
+
+// NOTE: kinetic binning of all atoms, through the per-atom and the batch (cell cache) interfaces.
+template <typename T, bool batch>
+static void BM_CalcLocalStressKin(benchmark::State& state) {
+  const auto mesh = state.range(0), boundary = state.range(1);
+  auto calc = makeCalculator<T>(mesh, boundary);
+  std::vector<LS::Vec<T>> r, v;
+  bench::makeContours(mesh, 4, boundary, r, v);
+  const LS::VecArrayView<T> pos(&r[0].x), vel(&v[0].x);
+  const int32_t num = r.size();
+
+  for (auto _ : state) {
+    if (batch) {
+      calc->prepareFrame(pos, num);
+      calc->calcLocalStressKin(pos, vel, num, T(1), 0);
+      calc->nextStep();
+    } else {
+      for (int32_t i = 0; i < num; i++) calc->calcLocalStressKin(r[i], v[i], T(1), 0);
+    }
+  }
+  state.SetItemsProcessed(state.iterations() * num);
+  state.SetLabel("mesh=" + std::to_string(mesh) + "^3 " + ((boundary == 0) ? "periodic" : "fixed"));
+}
+BENCHMARK_TEMPLATE(BM_CalcLocalStressKin, double, false)
+->ArgsProduct({{8, 32, 128}, {0, 1}})->ArgNames({"mesh", "boundary"});
+BENCHMARK_TEMPLATE(BM_CalcLocalStressKin, double, true)
+->ArgsProduct({{8, 32, 128}, {0, 1}})->ArgNames({"mesh", "boundary"});
+BENCHMARK_TEMPLATE(BM_CalcLocalStressKin, float, true)
+->ArgsProduct({{8, 32, 128}, {0, 1}})->ArgNames({"mesh", "boundary"});
+
+// NOTE:
+// saveLocalStressDist (normalization + writeStressDistAsBinary) of a filled mesh.
+// Output goes to a temporary directory; throughput is reported in bytes written.
+template <typename T>
+static void BM_WriteStressDist(benchmark::State& state) {
+  const auto mesh = state.range(0);
+  auto calc = makeCalculator<T>(mesh, 0);
+  std::vector<LS::Vec<T>> r, v;
+  bench::makeContours(mesh, 4, 0, r, v);
+  for (std::size_t i = 0; i < r.size(); i++) calc->calcLocalStressKin(r[i], v[i], T(1), 0);
+  calc->nextStep();
+
+  char dir[] = "/tmp/ls_bench_XXXXXX";
+  if (!mkdtemp(dir)) {
+    state.SkipWithError("cannot create a temporary directory");
+    return;
+  }
+  calc->setSaveDir(dir);
+  for (auto _ : state) {
+    calc->saveLocalStressDist();
+  }
+  const auto num_cell = calc->boundary().number_of_cell();
+  state.SetBytesProcessed(state.iterations() * int64_t(num_cell) * LS::D * LS::D * 2 * sizeof(double));
+  std::remove((std::string(dir) + "/local_stress.bin").c_str());
+  rmdir(dir);
+}
+BENCHMARK_TEMPLATE(BM_WriteStressDist, double)->Arg(8)->Arg(32)->Arg(128)->ArgName("mesh")
+->Unit(benchmark::kMillisecond);
+BENCHMARK_TEMPLATE(BM_WriteStressDist, float)->Arg(8)->Arg(32)->Arg(128)->ArgName("mesh")
+->Unit(benchmark::kMillisecond);
@@ -0,0 +1,59 @@
+#if !defined BENCH_UTILS_HPP
+#define BENCH_UTILS_HPP
+
+#include "ls_calculator.hpp"
+
+#include <random>
+
+// NOTE:
+// Common inputs of the benchmarks. Arguments are passed as integers:
+//   mesh     : number of cells along each axis
+//   bond     : contour length in quarters of the cell width
+//   boundary : 0 = PERIODIC_XYZ, 1 = FIXED
+namespace bench {
+  constexpr double box_length = 20.0;
+  constexpr int num_samples   = 4096;
+
+  inline LS::BoundaryType boundaryType(const int64_t b) {
+    return (b == 0) ? LS::BoundaryType::PERIODIC_XYZ : LS::BoundaryType::FIXED;
+  }
+
+  inline std::array<int32_t, LS::D> cubicMesh(const int64_t n) {
+    std::array<int32_t, LS::D> dim;
+    dim.fill(int32_t(n));
+    return dim;
+  }
+
+  // NOTE: random starting points and contours of the given length and random direction.
+  // Without periodic boundaries both ends stay inside of the box.
+  template <typename T>
+  void makeContours(const int64_t mesh, const int64_t bond, const int64_t boundary,
+                    std::vector<LS::Vec<T>>& r1, std::vector<LS::Vec<T>>& dr) {
+    std::mt19937 mt(10);
+    std::uniform_real_distribution<T> urd(T(0), T(1));
+    std::normal_distribution<T> nd(T(0), T(1));
+    const T len = T(box_length) / mesh * bond / T(4);
+    const T margin = (boundary == 0) ? T(0) : len;
+    r1.clear();
+    dr.clear();
+    for (int i = 0; i < num_samples; i++) {
+      LS::Vec<T> r, d;
+      for (int32_t a = 0; a < LS::D; a++) {
+        r[a] = margin + (T(box_length) - 2 * margin) * urd(mt);
+        d[a] = nd(mt);
+      }
+      r1.push_back(r);
+      dr.push_back(d * (len / std::sqrt(d * d)));
+    }
+  }
+
+  inline std::string label(const int64_t mesh, const int64_t bond, const int64_t boundary) {
+    return "mesh=" + std::to_string(mesh) + "^3 bond=" + std::to_string(bond / 4.0).substr(0, 4) +
+      "cell " + ((boundary == 0) ? "periodic" : "fixed");
+  }
+}
+
+#define BENCH_SPREAD_ARGS                                       \
+  ArgsProduct({{8, 32, 128}, {2, 4, 16}, {0, 1}})->ArgNames({"mesh", "bond", "boundary"})
+
+#endif
@@ -0,0 +1,420 @@
+// ls_workload: synthetic end-to-end workload of LSCalculator.
+//
+// usage: ls_workload [--system lj|bilayer|slab] [-n atoms] [-s steps]
+//                    [-m nx,ny,nz] [-t max_threads] [-o dir]
+//
+// Generates a configuration and runs the whole pipeline (cell list pair
+// forces, bonds, angles, dihedrals, kinetic term, nextStep) on slightly
+// perturbed copies of it, once with a single LSCalculator and then through
+// createOMP with 1, 2, 4, ... threads up to max_threads. Throughput is
+// reported in pair contributions (LJ pairs within the cut-off and bonds)
+// per second together with the speedup over one thread.
+//
+// Systems (reduced LJ units, density 0.8, r_cut = 2.5):
+//   lj       LJ fluid in a cubic periodic box
+//   bilayer  bilayer of linear 8-bead chains (bonds, angles, dihedrals)
+//            solvated by LJ beads, normal to z
+//   slab     LJ liquid slab occupying the middle third of a box elongated along z
+// Interaction types are "Kinetic", "LJ", "Bond", "Angle" and "Dihedral".
+// With -o, the single-threaded result is saved to dir. Its instrumentation
+// counters are printed when built with -DLOCAL_STRESS_USE_STATS.
+
+#include <chrono>
+#include <iomanip>
+#include <random>
+
+#ifdef _OPENMP
+#include <omp.h>
+#endif
+
+#include "ls_calculator.hpp"
+
+namespace {
+  typedef double Real;
+  typedef LS::Vec<Real> Vec_t;
+
+  enum InteractionType : int32_t {
+    KINETIC = 0,
+    LJ,
+    BOND,
+    ANGLE,
+    DIHEDRAL,
+  };
+
+  constexpr Real density = 0.8, r_cut = 2.5;
+  constexpr Real bond_k = 100.0, bond_r0 = 0.7;
+  constexpr Real angle_k = 10.0, angle_cos0 = -0.5;
+  constexpr Real dihedral_k = 1.0;
+  constexpr int32_t chain_length = 8;
+
+  struct System {
+    Vec_t low, high;
+    std::vector<Real> pos, vel;  // xyz triplets
+    std::vector<int32_t> types;  // all atoms share LJ type 0
+    std::vector<std::array<int32_t, 2>> bonds;
+    std::vector<std::array<int32_t, 3>> angles;
+    std::vector<std::array<int32_t, 4>> dihedrals;
+
+    int32_t number_of_atoms(void) const { return types.size(); }
+
+    void addAtom(const Vec_t& r) {
+      for (int32_t a = 0; a < LS::D; a++) pos.push_back(r[a]);
+      types.push_back(0);
+    }
+  };
+
+  // NOTE: jittered simple cubic lattice at the given density in [z0, z1) along z.
+  void fillLattice(System& sys, const Real z0, const Real z1, std::mt19937& mt) {
+    std::uniform_real_distribution<Real> jitter(-0.1, 0.1);
+    const Real a = std::cbrt(1.0 / density);
+    const Vec_t len = sys.high - sys.low;
+    const int32_t nx = std::max(int32_t(len.x / a), 1), ny = std::max(int32_t(len.y / a), 1);
+    const int32_t nz = std::max(int32_t((z1 - z0) / a), 1);
+    const Vec_t d(len.x / nx, len.y / ny, (z1 - z0) / nz);
+    for (int32_t iz = 0; iz < nz; iz++) {
+      for (int32_t iy = 0; iy < ny; iy++) {
+        for (int32_t ix = 0; ix < nx; ix++) {
+          sys.addAtom(Vec_t(sys.low.x + (ix + 0.5) * d.x + jitter(mt),
+                            sys.low.y + (iy + 0.5) * d.y + jitter(mt),
+                            z0 + (iz + 0.5) * d.z + jitter(mt)));
+        }
+      }
+    }
+  }
+
+  // NOTE:
+  // One lipid per unit area in each leaflet. Chains zigzag in x so that
+  // angles and dihedrals are well defined; heads face the solvent.
+  void addBilayer(System& sys, const int32_t nl, const Real zc, std::mt19937& mt) {
+    std::uniform_real_distribution<Real> jitter(-0.05, 0.05);
+    for (const int32_t side : {1, -1}) {
+      for (int32_t iy = 0; iy < nl; iy++) {
+        for (int32_t ix = 0; ix < nl; ix++) {
+          const int32_t first = sys.number_of_atoms();
+          for (int32_t k = 0; k < chain_length; k++) {
+            const Real zz = zc + side * (chain_length - k) * 0.6;
+            sys.addAtom(Vec_t(ix + 0.5 + ((k % 2) ? 0.3 : -0.3) + jitter(mt),
+                              iy + 0.5 + 0.1 * ((k / 2) % 2) + jitter(mt),
+                              zz + jitter(mt)));
+          }
+          for (int32_t k = 0; k + 1 < chain_length; k++) sys.bonds.push_back({{first + k, first + k + 1}});
+          for (int32_t k = 0; k + 2 < chain_length; k++) {
+            sys.angles.push_back({{first + k, first + k + 1, first + k + 2}});
+          }
+          for (int32_t k = 0; k + 3 < chain_length; k++) {
+            sys.dihedrals.push_back({{first + k, first + k + 1, first + k + 2, first + k + 3}});
+          }
+        }
+      }
+    }
+  }
+
+  System makeSystem(const std::string& name, const int32_t num_atoms) {
+    std::mt19937 mt(42);
+    System sys;
+    if (name == "lj") {
+      const Real len = std::cbrt(num_atoms / density);
+      sys.low = Vec_t(0.0);
+      sys.high = Vec_t(len);
+      fillLattice(sys, 0.0, len, mt);
+    } else if (name == "slab") {
+      const Real len = std::cbrt(num_atoms / (3.0 * density));
+      sys.low = Vec_t(0.0);
+      sys.high = Vec_t(len, len, 3.0 * len);
+      fillLattice(sys, len, 2.0 * len, mt);
+    } else if (name == "bilayer") {
+      // about one third of the atoms in the bilayer, the rest is solvent
+      const int32_t nl = std::max(int32_t(std::sqrt(num_atoms / (6.0 * chain_length))), 6);
+      const Real thickness = 2.0 * chain_length * 0.6 + 1.0;
+      const Real solvent = (num_atoms - 2.0 * nl * nl * chain_length) / (density * nl * nl);
+      sys.low = Vec_t(0.0);
+      sys.high = Vec_t(nl, nl, thickness + std::max(solvent, 2.0 * r_cut + 1.0));
+      const Real zc = 0.5 * sys.high.z;
+      addBilayer(sys, nl, zc, mt);
+      fillLattice(sys, 0.0, zc - 0.5 * thickness, mt);
+      fillLattice(sys, zc + 0.5 * thickness, sys.high.z, mt);
+    } else {
+      LOCAL_STRESS_ERR("Unknown system " << name);
+    }
+
+    std::normal_distribution<Real> maxwell(0.0, 1.0);
+    sys.vel.resize(sys.pos.size());
+    for (auto& v : sys.vel) v = maxwell(mt);
+    return sys;
+  }
+
+  // NOTE: copies of the configuration displaced randomly and wrapped into the box.
+  std::vector<std::vector<Real>> makeFrames(const System& sys, const int32_t steps) {
+    std::mt19937 mt(43);
+    std::normal_distribution<Real> disp(0.0, 0.02);
+    LS::Boundary<Real> box(LS::BoundaryType::PERIODIC_XYZ, {{1, 1, 1}});
+    box.setBox(sys.low, sys.high);
+    std::vector<std::vector<Real>> frames(steps, sys.pos);
+    for (auto& f : frames) {
+      for (int32_t i = 0; i < sys.number_of_atoms(); i++) {
+        Vec_t r(f[3 * i], f[3 * i + 1], f[3 * i + 2]);
+        for (int32_t a = 0; a < LS::D; a++) r[a] += disp(mt);
+        box.adjustBoundary(r);
+        for (int32_t a = 0; a < LS::D; a++) f[3 * i + a] = r[a];
+      }
+    }
+    return frames;
+  }
+
+  LS::PairTable<Real> makeLJTable(void) {
+    LS::PairTable<Real> table(1, r_cut);
+    table.setForce(0, 0, [](const Real r) {
+      const Real sr6 = std::pow(1.0 / r, 6);
+      return 24.0 * (2.0 * sr6 * sr6 - sr6) / r;
+    });
+    return table;
+  }
+
+  // NOTE: number of distinct pairs within r_cut (the LJ part of the pair stream).
+  int64_t countPairs(const System& sys, const std::vector<Real>& frame) {
+    LS::Boundary<Real> box(LS::BoundaryType::PERIODIC_XYZ, {{1, 1, 1}});
+    box.setBox(sys.low, sys.high);
+    const Vec_t len = sys.high - sys.low;
+    std::array<int32_t, LS::D> dim;
+    std::array<int32_t, LS::D> reach;
+    for (int32_t a = 0; a < LS::D; a++) {
+      dim[a] = int32_t(len[a] / r_cut);
+      if (dim[a] < 3) dim[a] = 1;
+      reach[a] = (dim[a] == 1) ? 0 : 1;
+    }
+    std::vector<std::vector<int32_t>> cells(dim[0] * dim[1] * dim[2]);
+    const LS::VecArrayView<Real> pos(frame.data());
+    auto cellOf = [&](const Vec_t& r, const int32_t a) {
+      return std::min(int32_t((r[a] - sys.low[a]) / len[a] * dim[a]), dim[a] - 1);
+    };
+    for (int32_t i = 0; i < sys.number_of_atoms(); i++) {
+      const auto r = pos[i];
+      cells[cellOf(r, 0) + dim[0] * (cellOf(r, 1) + dim[1] * cellOf(r, 2))].push_back(i);
+    }
+    int64_t num_pairs = 0;
+    for (int32_t i = 0; i < sys.number_of_atoms(); i++) {
+      const auto r = pos[i];
+      for (int32_t dz = -reach[2]; dz <= reach[2]; dz++) {
+        for (int32_t dy = -reach[1]; dy <= reach[1]; dy++) {
+          for (int32_t dx = -reach[0]; dx <= reach[0]; dx++) {
+            const int32_t cx = (cellOf(r, 0) + dx + dim[0]) % dim[0];
+            const int32_t cy = (cellOf(r, 1) + dy + dim[1]) % dim[1];
+            const int32_t cz = (cellOf(r, 2) + dz + dim[2]) % dim[2];
+            for (const auto j : cells[cx + dim[0] * (cy + dim[1] * cz)]) {
+              if (j <= i) continue;
+              auto dr = r - pos[j];
+              box.applyMinimumImage(dr);
+              if (dr * dr < r_cut * r_cut) num_pairs++;
+            }
+          }
+        }
+      }
+    }
+    return num_pairs;
+  }
+
+  // NOTE: U = k (cos theta - cos0)^2 of the angle at j.
+  void angleForces(const Vec_t& dij, const Vec_t& dkj,
+                   Vec_t& Fi, Vec_t& Fj, Vec_t& Fk) {
+    const Real li = std::sqrt(dij * dij), lk = std::sqrt(dkj * dkj);
+    const Real c = (dij * dkj) / (li * lk);
+    const Real dUdc = 2.0 * angle_k * (c - angle_cos0);
+    Fi = -(dkj / (li * lk) - dij * (c / (li * li))) * dUdc;
+    Fk = -(dij / (li * lk) - dkj * (c / (lk * lk))) * dUdc;
+    Fj = -Fi - Fk;
+  }
+
+  Vec_t cross(const Vec_t& a, const Vec_t& b) {
+    return Vec_t(a.y * b.z - a.z * b.y, a.z * b.x - a.x * b.z, a.x * b.y - a.y * b.x);
+  }
+
+  // NOTE: U = k (1 + cos phi) with the gradients of Blondel and Karplus.
+  void dihedralForces(const Vec_t& f, const Vec_t& g, const Vec_t& h,
+                      Vec_t& F0, Vec_t& F1, Vec_t& F2, Vec_t& F3) {
+    const auto A = cross(f, g), B = cross(h, g);
+    const Real a2 = A * A, b2 = B * B, lg = std::sqrt(g * g);
+    const Real sin_phi = (cross(B, A) * g) / (std::sqrt(a2 * b2) * lg);
+    const Real dUdphi = -dihedral_k * sin_phi;
+    const auto dphi0 = A * (-lg / a2);
+    const auto dphi3 = B * (lg / b2);
+    const auto t = A * ((f * g) / (a2 * lg)) - B * ((h * g) / (b2 * lg));
+    F0 = dphi0 * (-dUdphi);
+    F3 = dphi3 * (-dUdphi);
+    F1 = (-dphi0 + t) * (-dUdphi);
+    F2 = (-dphi3 - t) * (-dUdphi);
+  }
+
+  // NOTE: bonded and kinetic contributions of atoms/terms [begin, end) of each list.
+  template <typename Range>
+  void calcBonded(LS::LSCalculator<Real>& calc, const System& sys,
+                  const LS::VecArrayView<Real>& pos, const LS::VecArrayView<Real>& vel,
+                  Range range) {
+    const auto& box = calc.boundary();
+    int32_t b, e;
+    range(int32_t(sys.bonds.size()), b, e);
+    for (int32_t k = b; k < e; k++) {
+      const auto i = sys.bonds[k][0], j = sys.bonds[k][1];
+      auto dr = pos[i] - pos[j];
+      box.applyMinimumImage(dr);
+      const Real r = std::sqrt(dr * dr);
+      const auto F = dr * (-bond_k * (r - bond_r0) / r);
+      calc.calcLocalStressPot2NoCheck(pos, i, j, F, -F, BOND);
+    }
+    range(int32_t(sys.angles.size()), b, e);
+    for (int32_t k = b; k < e; k++) {
+      const auto& t = sys.angles[k];
+      auto dij = pos[t[0]] - pos[t[1]], dkj = pos[t[2]] - pos[t[1]];
+      box.applyMinimumImage(dij);
+      box.applyMinimumImage(dkj);
+      Vec_t Fi, Fj, Fk;
+      angleForces(dij, dkj, Fi, Fj, Fk);
+      calc.calcLocalStressPot3NoCheck(pos, t[0], t[1], t[2], Fi, Fj, Fk, ANGLE);
+    }
+    range(int32_t(sys.dihedrals.size()), b, e);
+    for (int32_t k = b; k < e; k++) {
+      const auto& q = sys.dihedrals[k];
+      auto f = pos[q[0]] - pos[q[1]], g = pos[q[1]] - pos[q[2]], h = pos[q[3]] - pos[q[2]];
+      box.applyMinimumImage(f);
+      box.applyMinimumImage(g);
+      box.applyMinimumImage(h);
+      Vec_t F0, F1, F2, F3;
+      dihedralForces(f, g, h, F0, F1, F2, F3);
+      calc.calcLocalStressPot4NoCheck(pos, q[0], q[1], q[2], q[3], F0, F1, F2, F3, DIHEDRAL);
+    }
+    range(sys.number_of_atoms(), b, e);
+    for (int32_t i = b; i < e; i++) calc.calcLocalStressKin(pos[i], vel[i], 1.0, KINETIC);
+  }
+
+  struct Options {
+    std::string system = "lj", out_dir;
+    int32_t num_atoms = 32000, steps = 10;
+    std::array<int32_t, 3> mesh {{8, 8, 64}};
+    int32_t max_threads = 1;
+  };
+
+  void usage(void) {
+    std::cerr << "usage: ls_workload [--system lj|bilayer|slab] [-n atoms] [-s steps]\n"
+              << "                   [-m nx,ny,nz] [-t max_threads] [-o dir]\n";
+    std::exit(1);
+  }
+
+  Options parseOptions(int argc, char* argv[]) {
+    Options opt;
+#ifdef _OPENMP
+    opt.max_threads = omp_get_max_threads();
+#endif
+    for (int i = 1; i < argc; i++) {
+      const std::string key = argv[i];
+      if (i + 1 >= argc) usage();
+      const std::string val = argv[++i];
+      if (key == "--system") opt.system = val;
+      else if (key == "-n") opt.num_atoms = std::atoi(val.c_str());
+      else if (key == "-s") opt.steps = std::atoi(val.c_str());
+      else if (key == "-t") opt.max_threads = std::atoi(val.c_str());
+      else if (key == "-o") opt.out_dir = val;
+      else if (key == "-m") {
+        if (std::sscanf(val.c_str(), "%d,%d,%d", &opt.mesh[0], &opt.mesh[1], &opt.mesh[2]) != 3) usage();
+      } else {
+        usage();
+      }
+    }
+    if (opt.num_atoms <= 0 || opt.steps <= 0 || opt.max_threads <= 0 ||
+        opt.mesh[0] <= 0 || opt.mesh[1] <= 0 || opt.mesh[2] <= 0) {
+      usage();
+    }
+    return opt;
+  }
+
+  typedef std::chrono::steady_clock Clock;
+
+  double seconds(const Clock::time_point& t0) {
+    return std::chrono::duration<double>(Clock::now() - t0).count();
+  }
+}
+
+int main(int argc, char* argv[]) {
+  const auto opt = parseOptions(argc, argv);
+  const auto sys = makeSystem(opt.system, opt.num_atoms);
+  const auto frames = makeFrames(sys, opt.steps);
+  const auto table = makeLJTable();
+  const int32_t num = sys.number_of_atoms();
+  const LS::VecArrayView<Real> vel(sys.vel.data());
+  const std::vector<std::string> itypes {"Kinetic", "LJ", "Bond", "Angle", "Dihedral"};
+
+  int64_t pairs_per_step = sys.bonds.size();
+  for (const auto& f : frames) pairs_per_step += countPairs(sys, f);
+  pairs_per_step /= opt.steps;
+
+  std::cout << "system " << opt.system << ": " << num << " atoms, box "
+            << sys.high.x << " x " << sys.high.y << " x " << sys.high.z << ", "
+            << sys.bonds.size() << " bonds, " << sys.angles.size() << " angles, "
+            << sys.dihedrals.size() << " dihedrals, " << pairs_per_step << " pairs per step\n";
+
+  // single LSCalculator
+  double t_serial = 0;
+  {
+    auto calc = LS::CalculatorFactory<Real>::create(Vec_t(sys.low), Vec_t(sys.high),
+                                                    LS::BoundaryType::PERIODIC_XYZ,
+                                                    std::array<int32_t, 3>(opt.mesh),
+                                                    std::vector<std::string>(itypes));
+    if (opt.out_dir.empty()) calc->disableAutoSave();
+    else calc->setSaveDir(opt.out_dir);
+    LS::PairEngine<Real> engine(table, LJ);
+    const auto t0 = Clock::now();
+    for (const auto& f : frames) {
+      const LS::VecArrayView<Real> pos(f.data());
+      engine.compute(*calc, pos, sys.types.data(), num);
+      calcBonded(*calc, sys, pos, vel, [](const int32_t n, int32_t& b, int32_t& e) { b = 0; e = n; });
+      calc->nextStep();
+    }
+    t_serial = seconds(t0);
+    std::cout << "serial       " << t_serial / opt.steps * 1e3 << " ms/step, "
+              << pairs_per_step * opt.steps / t_serial << " pairs/s\n";
+    if (!opt.out_dir.empty()) {
+      const auto t1 = Clock::now();
+      calc->saveLocalStressDist();
+      std::cout << "saved to " << opt.out_dir << " in " << seconds(t1) * 1e3 << " ms\n";
+    }
+    calc->reportStats();
+  }
+
+  // createOMP
+  std::vector<int32_t> thread_counts;
+  for (int32_t nt = 1; nt < opt.max_threads; nt *= 2) thread_counts.push_back(nt);
+  thread_counts.push_back(opt.max_threads);
+  double t_one = 0;
+  for (const auto nt : thread_counts) {
+#ifdef _OPENMP
+    omp_set_num_threads(nt);
+#endif
+    auto calcs = LS::CalculatorFactory<Real>::createOMP(nt, Vec_t(sys.low), Vec_t(sys.high),
+                                                        LS::BoundaryType::PERIODIC_XYZ,
+                                                        std::array<int32_t, 3>(opt.mesh),
+                                                        std::vector<std::string>(itypes));
+    for (auto& calc : calcs) calc->disableAutoSave();
+    LS::PairEngine<Real> engine(table, LJ);
+    const auto t0 = Clock::now();
+    for (const auto& f : frames) {
+      const LS::VecArrayView<Real> pos(f.data());
+      engine.compute(calcs, pos, sys.types.data(), num);
+#ifdef _OPENMP
+#pragma omp parallel
+      {
+        const int32_t tid = omp_get_thread_num(), nth = omp_get_num_threads();
+        calcBonded(*calcs[tid], sys, pos, vel, [tid, nth](const int32_t n, int32_t& b, int32_t& e) {
+          b = int64_t(n) * tid / nth;
+          e = int64_t(n) * (tid + 1) / nth;
+        });
+      }
+#else
+      calcBonded(*calcs[0], sys, pos, vel, [](const int32_t n, int32_t& b, int32_t& e) { b = 0; e = n; });
+#endif
+      for (auto& calc : calcs) calc->nextStep();
+    }
+    const double t = seconds(t0);
+    if (nt == 1) t_one = t;
+    std::cout << "threads " << std::setw(4) << nt << " " << t / opt.steps * 1e3 << " ms/step, "
+              << pairs_per_step * opt.steps / t << " pairs/s, speedup " << t_one / t
+              << ", efficiency " << t_one / (t * nt) << "\n";
+  }
+}
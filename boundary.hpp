@@ -6,6 +6,7 @@
 #include <vector>
 #include <utility>
 #include <algorithm>
+#include <numeric>
 
 namespace LocalStress {
   enum class BoundaryType : int32_t {
@@ -34,6 +35,39 @@ namespace LocalStress {
     Vec_t mesh_length_, imesh_length_;
     std::array<int32_t, D> mesh_dim_;
     int32_t number_of_cell_ = -1;
+    // NOTE:
+    // Off-diagonal elements of the upper-triangular h-matrix (xy, xz, yz in 3D).
+    // The box spans low_ + h s for fractional s in [0, 1)^D, and the diagonal of h
+    // is box_length_. Triclinic boxes are handled in fractional coordinates.
+    std::array<T, D * (D - 1) / 2> tilt_;
+    bool is_triclinic_ = false;
+    // NOTE:
+    // Non-uniform axes: cell k spans [edges_[a][k], edges_[a][k + 1]) in
+    // fractional units. edge_lut_[a][j] is the cell of j / L for the
+    // L = edge_lut_[a].size() - 1 uniform bins of the lookup table, so the
+    // cells overlapping bin j lie in edge_lut_[a][j], ..., edge_lut_[a][j + 1].
+    // Empty on uniform axes.
+    std::array<std::vector<T>, D> edges_;
+    std::array<std::vector<int32_t>, D> edge_lut_;
+    static constexpr int32_t lut_bins_per_cell = 4;
+    bool is_nonuniform_ = false;
+#ifdef LOCAL_STRESS_USE_STATS
+    // contours traversed by getDividedLineRatio (a Boundary is used by one thread)
+    mutable LSStats stats_;
+#endif
+
+    static int32_t tiltIndex(const int32_t a, const int32_t b) {
+      return a * D - a * (a + 1) / 2 + (b - a - 1);
+    }
+
+    const Vec_t toCartesian(const Vec_t& frac) const {
+      Vec_t dr;
+      for (int32_t a = 0; a < D; a++) {
+        dr[a] = box_length_[a] * frac[a];
+        for (int32_t b = a + 1; b < D; b++) dr[a] += tilt_[tiltIndex(a, b)] * frac[b];
+      }
+      return dr;
+    }
 
     void calcMeshLengthFromMeshDim(void) {
       for (int32_t i = 0; i < D; i++) {
@@ -114,39 +148,32 @@ namespace LocalStress {
       }
     }
 
-    int32_t getCellPositionHash(std::array<int32_t, D>& idx) const {
-      adjustBoundary(idx);
-      int32_t hash = idx[D - 1];
-      for (int32_t i = D - 2; i >= 0; i--) {
-        hash = hash * mesh_dim_[i] + idx[i];
-      }
-      assert((hash >= 0) && (hash < number_of_cell_));
-      return hash;
-    }
-
-    std::array<int32_t, D> getCellPosition(const Vec_t& pos) const {
-      std::array<int32_t, D> idx;
-      for (int32_t i = 0; i < D; i++) {
-        idx[i] = int32_t(std::floor((pos[i] - low_[i]) * imesh_length_[i]));
-      }
-      return idx;
-    }
-
+    // NOTE:
+    // Unwrapped wall k of axis, i.e. the lower edge of cell k.
+    // Walls of uniform axes are at cell_len * k + origin, those of
+    // non-uniform ones at origin + len * (fractional wall position).
     void calcDividedLineRatioOneAxis(std::vector<T>& ratios,
+                                     const int32_t axis,
                                      const T dx,
                                      const T x_org,
-                                     const int32_t axis,
+                                     const T cell_len,
+                                     const T origin,
+                                     const T len,
                                      const int32_t cell_org,
                                      const int32_t cell_dif) const {
+      const bool uniform = edges_[axis].empty();
+      const auto wall = [&](const int32_t k) {
+        return uniform ? k * cell_len + origin : origin + len * getWallFraction(axis, k);
+      };
       if (cell_dif > 0) {
         for (int32_t i = 0; i < cell_dif; i++) {
-          const auto wall_pos = (cell_org + 1 + i) * mesh_length_[axis] + low_[axis];
+          const auto wall_pos = wall(cell_org + 1 + i);
           const auto ratio = (wall_pos - x_org) / dx;
           ratios.push_back(ratio);
         }
       } else if (cell_dif < 0) {
         for (int32_t i = 0; i < (-cell_dif); i++) {
-          const auto wall_pos = (cell_org - i) * mesh_length_[axis] + low_[axis];
+          const auto wall_pos = wall(cell_org - i);
           const auto ratio = (wall_pos - x_org) / dx;
           ratios.push_back(ratio);
         }
@@ -156,6 +183,7 @@ namespace LocalStress {
   public:
     Boundary(BoundaryType type,
              const std::array<int32_t, D> mdim) : btype_(type), mesh_dim_(mdim) {
+      tilt_.fill(0);
       setPeriodicAxis();
       calcNumberOfCell();
     }
@@ -168,6 +196,115 @@ namespace LocalStress {
       calcMeshLengthFromMeshDim();
     }
 
+    // NOTE:
+    // Tilt factors of a triclinic box, i.e. the upper off-diagonal elements of
+    // the h-matrix (xy, xz, yz in 3D). All zero restores the orthorhombic path.
+    void setTiltFactors(const std::array<T, D * (D - 1) / 2>& tilt) {
+      tilt_ = tilt;
+      is_triclinic_ = std::any_of(tilt_.cbegin(), tilt_.cend(), [](const T t) { return t != T(0); });
+    }
+
+    bool is_triclinic(void) const { return is_triclinic_; }
+
+    // NOTE:
+    // Non-uniform cells along axis: edges are the mesh_dim()[axis] + 1 walls
+    // in fractional units, strictly increasing from 0 to 1. An empty vector
+    // restores uniform cells. Cell lookup goes through a uniform table of at
+    // most lut_bins_per_cell * mesh_dim()[axis] bins, fine enough to hold one
+    // wall per bin unless cells are much narrower than the mean; the walls
+    // in a bin are then binary searched. mesh_length() holds mean cell widths.
+    void setBinEdges(const int32_t axis, const std::vector<T>& edges) {
+      if (axis < 0 || axis >= D) LOCAL_STRESS_ERR("Invalid axis.");
+      edge_lut_[axis].clear();
+      if (edges.empty()) {
+        edges_[axis].clear();
+      } else {
+        const int32_t n = mesh_dim_[axis];
+        if (int32_t(edges.size()) != n + 1) {
+          LOCAL_STRESS_ERR("Bin edges should have mesh_dim + 1 elements.");
+        }
+        if (edges.front() != T(0) || edges.back() != T(1)) {
+          LOCAL_STRESS_ERR("Bin edges should span the box.");
+        }
+        T min_width = T(1);
+        for (int32_t k = 0; k < n; k++) {
+          if (!(edges[k] < edges[k + 1])) LOCAL_STRESS_ERR("Bin edges should be strictly increasing.");
+          min_width = std::min(min_width, edges[k + 1] - edges[k]);
+        }
+        edges_[axis] = edges;
+        const auto lut_size = int32_t(std::min(std::ceil(T(1) / min_width), T(lut_bins_per_cell * n)));
+        auto& lut = edge_lut_[axis];
+        lut.resize(lut_size + 1);
+        int32_t c = 0;
+        for (int32_t j = 0; j < lut_size; j++) {
+          const T u = T(j) / lut_size;
+          while (c < n - 1 && u >= edges[c + 1]) c++;
+          lut[j] = c;
+        }
+        lut[lut_size] = n - 1;
+      }
+      is_nonuniform_ = std::any_of(edges_.cbegin(), edges_.cend(),
+                                   [](const std::vector<T>& e) { return !e.empty(); });
+    }
+
+    bool is_nonuniform(void) const { return is_nonuniform_; }
+    bool is_uniform_axis(const int32_t axis) const { return edges_[axis].empty(); }
+
+    // NOTE: fractional position of the unwrapped wall k of axis (k / mesh_dim on uniform axes).
+    T getWallFraction(const int32_t axis, const int32_t k) const {
+      const int32_t n = mesh_dim_[axis];
+      if (edges_[axis].empty()) return T(k) / n;
+      const int32_t q = (k >= 0) ? k / n : -((n - 1 - k) / n);
+      return q + edges_[axis][k - q * n];
+    }
+
+    // NOTE: unwrapped cell along axis of the fractional coordinate frac.
+    int32_t getCellIndex(const int32_t axis, const T frac) const {
+      const int32_t n = mesh_dim_[axis];
+      if (edges_[axis].empty()) return int32_t(std::floor(frac * n));
+      const T image = std::floor(frac);
+      const T u = frac - image;
+      const auto& e   = edges_[axis];
+      const auto& lut = edge_lut_[axis];
+      const int32_t size = lut.size() - 1;
+      const int32_t j = std::min(int32_t(u * size), size - 1);
+      int32_t c = std::upper_bound(e.cbegin() + lut[j] + 1, e.cbegin() + lut[j + 1] + 1, u) - e.cbegin() - 1;
+      // a step at most, only after rounding at a wall
+      while (c < n - 1 && u >= e[c + 1]) c++;
+      while (c > 0 && u < e[c]) c--;
+      return int32_t(image) * n + c;
+    }
+
+    // NOTE: volume of cell hash relative to the box volume.
+    T getCellVolumeFraction(const int32_t hash) const {
+      if (!is_nonuniform_) return T(1) / number_of_cell_;
+      T frac = T(1);
+      int32_t rest = hash;
+      for (int32_t a = 0; a < D; a++) {
+        const int32_t k = rest % mesh_dim_[a];
+        rest /= mesh_dim_[a];
+        frac *= getWallFraction(a, k + 1) - getWallFraction(a, k);
+      }
+      return frac;
+    }
+#ifdef LOCAL_STRESS_USE_STATS
+    const LSStats& stats(void) const { return stats_; }
+    void clearStats(void) { stats_ = LSStats(); }
+#endif
+    const std::array<T, D * (D - 1) / 2>& tilt_factors(void) const { return tilt_; }
+
+    // NOTE: solves h s = dr by back substitution.
+    const Vec_t toFractional(const Vec_t& dr) const {
+      Vec_t frac;
+      for (int32_t a = D - 1; a >= 0; a--) {
+        T rest = dr[a];
+        for (int32_t b = a + 1; b < D; b++) rest -= tilt_[tiltIndex(a, b)] * frac[b];
+        frac[a] = rest / box_length_[a];
+      }
+      return frac;
+    }
+
+    BoundaryType boundary_type(void) const { return btype_; }
     const Vec_t& low(void) const { return low_; }
     const Vec_t& high(void) const { return high_; }
     const Vec_t& mesh_length(void) const { return mesh_length_; }
@@ -176,8 +313,14 @@ namespace LocalStress {
     const Vec_t& box_length(void) const { return box_length_; }
     const std::array<int32_t, D>& mesh_dim(void) const { return mesh_dim_; }
     int32_t number_of_cell(void) const { return number_of_cell_; }
+    const std::array<bool, D>& is_periodic_axis(void) const { return is_periodic_axis_; }
 
     void applyMinimumImage(Vec_t& dr01) const {
+      if (is_triclinic_) {
+        std::array<int32_t, D> shift;
+        applyMinimumImage(dr01, shift);
+        return;
+      }
       for (int32_t i = 0; i < D; i++) {
         if (is_periodic_axis_[i]) {
           if (dr01[i] < -box_hlength_[i]) dr01[i] += box_length_[i];
@@ -187,6 +330,17 @@ namespace LocalStress {
     }
 
     void adjustBoundary(Vec_t& pos) const {
+      if (is_triclinic_) {
+        auto frac = toFractional(pos - low_);
+        for (int32_t i = 0; i < D; i++) {
+          if (is_periodic_axis_[i]) {
+            if (frac[i] <  T(0)) frac[i] += T(1);
+            if (frac[i] >= T(1)) frac[i] -= T(1);
+          }
+        }
+        pos = low_ + toCartesian(frac);
+        return;
+      }
       for (int32_t i = 0; i < D; i++) {
         if (is_periodic_axis_[i]) {
           if (pos[i] < low_[i] ) pos[i] += box_length_[i];
@@ -196,6 +350,12 @@ namespace LocalStress {
     }
 
     bool isInBox(const Vec_t& pos) const {
+      if (is_triclinic_) {
+        const auto frac = toFractional(pos - low_);
+        bool in_range = true;
+        for (int32_t i = 0; i < D; i++) in_range &= (frac[i] >= T(0)) && (frac[i] < T(1));
+        return in_range;
+      }
       bool in_range = true;
       for (int32_t i = 0; i < D; i++) {
         in_range &= (pos[i] >= low_[i]) && (pos[i] < high_[i]);
@@ -203,21 +363,133 @@ namespace LocalStress {
       return in_range;
     }
 
+    // NOTE: unwrapped cell of pos.
+    std::array<int32_t, D> getCellPosition(const Vec_t& pos) const {
+      std::array<int32_t, D> idx;
+      if (is_triclinic_) {
+        const auto frac = toFractional(pos - low_);
+        for (int32_t i = 0; i < D; i++) idx[i] = getCellIndex(i, frac[i]);
+        return idx;
+      }
+      for (int32_t i = 0; i < D; i++) {
+        if (edges_[i].empty()) {
+          idx[i] = int32_t(std::floor((pos[i] - low_[i]) * imesh_length_[i]));
+        } else {
+          idx[i] = getCellIndex(i, (pos[i] - low_[i]) / box_length_[i]);
+        }
+      }
+      return idx;
+    }
+
+    int32_t getCellPositionHash(std::array<int32_t, D>& idx) const {
+      adjustBoundary(idx);
+      int32_t hash = idx[D - 1];
+      for (int32_t i = D - 2; i >= 0; i--) {
+        hash = hash * mesh_dim_[i] + idx[i];
+      }
+      assert((hash >= 0) && (hash < number_of_cell_));
+      return hash;
+    }
+
     int32_t getCellPositionHash(const Vec_t& pos) const {
       auto idx = getCellPosition(pos);
       return getCellPositionHash(idx);
     }
 
+    // NOTE:
+    // Same as applyMinimumImage(dr01), and also reports the applied image
+    // shift in units of box length (dr01_after = dr01_before + shift * L).
+    void applyMinimumImage(Vec_t& dr01, std::array<int32_t, D>& shift) const {
+      if (is_triclinic_) {
+        auto frac = toFractional(dr01);
+        for (int32_t i = 0; i < D; i++) {
+          shift[i] = 0;
+          if (is_periodic_axis_[i]) {
+            if (frac[i] < T(-0.5)) { frac[i] += T(1); shift[i] =  1; }
+            if (frac[i] > T( 0.5)) { frac[i] -= T(1); shift[i] = -1; }
+          }
+        }
+        dr01 = toCartesian(frac);
+        return;
+      }
+      for (int32_t i = 0; i < D; i++) {
+        shift[i] = 0;
+        if (is_periodic_axis_[i]) {
+          if (dr01[i] < -box_hlength_[i]) { dr01[i] += box_length_[i]; shift[i] =  1; }
+          if (dr01[i] >  box_hlength_[i]) { dr01[i] -= box_length_[i]; shift[i] = -1; }
+        }
+      }
+    }
+
+    // NOTE:
+    // Computes cell coordinates of num positions in one sweep per axis.
+    // Returns false if any position is outside the simulation box.
+    bool getCellPositions(const VecArrayView<T>& pos,
+                          const int32_t num,
+                          std::array<std::vector<int32_t>, D>& cells) const {
+      bool in_range = true;
+      if (is_triclinic_) {
+        for (int32_t a = 0; a < D; a++) cells[a].resize(num);
+        for (int32_t i = 0; i < num; i++) {
+          const auto frac = toFractional(pos[i] - low_);
+          for (int32_t a = 0; a < D; a++) {
+            in_range &= (frac[a] >= T(0)) && (frac[a] < T(1));
+            cells[a][i] = getCellIndex(a, frac[a]);
+          }
+        }
+        return in_range;
+      }
+      for (int32_t a = 0; a < D; a++) {
+        cells[a].resize(num);
+        int32_t* cell = cells[a].data();
+        const T lo = low_[a], hi = high_[a], ih = imesh_length_[a];
+        if (!edges_[a].empty()) {
+          // same arithmetic as getCellPosition, so both agree at the walls
+          const T len = box_length_[a];
+          for (int32_t i = 0; i < num; i++) {
+            const T x = pos(i, a);
+            in_range &= (x >= lo) && (x < hi);
+            cell[i] = getCellIndex(a, (x - lo) / len);
+          }
+          continue;
+        }
+        for (int32_t i = 0; i < num; i++) {
+          const T x = pos(i, a);
+          in_range &= (x >= lo) && (x < hi);
+          cell[i] = int32_t(std::floor((x - lo) * ih));
+        }
+      }
+      return in_range;
+    }
+
+    // NOTE:
+    // cell_pos1 and cell_pos0 are the (unwrapped) cells of r1 and r1 + dr01.
     const std::vector<lineratio_t> getDividedLineRatio(const Vec_t& r1,
                                                        const Vec_t& dr01) const {
-      const auto cell_pos0 = getCellPosition(r1 + dr01);
-      const auto cell_pos1 = getCellPosition(r1);
+      return getDividedLineRatio(r1, dr01, getCellPosition(r1), getCellPosition(r1 + dr01));
+    }
 
+    const std::vector<lineratio_t> getDividedLineRatio(const Vec_t& r1,
+                                                       const Vec_t& dr01,
+                                                       const std::array<int32_t, D>& cell_pos1,
+                                                       const std::array<int32_t, D>& cell_pos0) const {
       std::vector<T> ratios;
       ratios.push_back(0.0);
-      for (int32_t axis = 0; axis < D; axis++) {
-        calcDividedLineRatioOneAxis(ratios, dr01[axis], r1[axis], axis,
-                                    cell_pos1[axis], cell_pos0[axis] - cell_pos1[axis]);
+      LOCAL_STRESS_STATS(T extent = 0);
+      if (is_triclinic_) {
+        // the contour is straight in fractional space too, with walls at k / mesh_dim
+        const auto s1 = toFractional(r1 - low_), ds = toFractional(dr01);
+        for (int32_t axis = 0; axis < D; axis++) {
+          calcDividedLineRatioOneAxis(ratios, axis, ds[axis], s1[axis], T(1) / mesh_dim_[axis], T(0), T(1),
+                                      cell_pos1[axis], cell_pos0[axis] - cell_pos1[axis]);
+          LOCAL_STRESS_STATS(extent = std::max(extent, std::abs(ds[axis]) * mesh_dim_[axis]));
+        }
+      } else {
+        for (int32_t axis = 0; axis < D; axis++) {
+          calcDividedLineRatioOneAxis(ratios, axis, dr01[axis], r1[axis], mesh_length_[axis], low_[axis],
+                                      box_length_[axis], cell_pos1[axis], cell_pos0[axis] - cell_pos1[axis]);
+          LOCAL_STRESS_STATS(extent = std::max(extent, std::abs(dr01[axis]) * imesh_length_[axis]));
+        }
       }
       ratios.push_back(1.0);
       std::sort(ratios.begin(), ratios.end());
@@ -229,6 +501,7 @@ namespace LocalStress {
         div_ratios[i].first  = getCellPositionHash(base_pos);
         div_ratios[i].second = ratios[i + 1] - ratios[i];
       }
+      LOCAL_STRESS_STATS(stats_.addContour(num_divided_line, extent));
       return div_ratios;
     }
   };
@@ -77,14 +77,14 @@ namespace LocalStress {
   }
 
   template <typename T>
-  static inline void write_as_lsbfirst(std::ofstream& fout,
+  static inline void write_as_lsbfirst(std::ostream& fout,
                                        const T in) {
     const auto dat = conv2_lsb_first_if_needed(in);
     fout.write(reinterpret_cast<const char*>(&dat), sizeof(T));
   }
 
   template <>
-  void write_as_lsbfirst<std::string>(std::ofstream& fout, const std::string in) {
+  inline void write_as_lsbfirst<std::string>(std::ostream& fout, const std::string in) {
     fout.write(in.c_str(), in.length() * sizeof(char));
   }
 }
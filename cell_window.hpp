@@ -0,0 +1,121 @@
+#if !defined CELL_WINDOW_HPP
+#define CELL_WINDOW_HPP
+
+namespace LocalStress {
+  // NOTE:
+  // Sub-block of the global mesh stored by a calculator.
+  // The block starts at global cell lo_ (may be negative on periodic axes,
+  // where it wraps around) and has dim_ cells along each axis.
+  // Cells [own_lo_, own_lo_ + own_dim_) are owned; the rest is halo.
+  class CellWindow final {
+    std::array<int32_t, D> global_dim_, lo_, dim_, own_lo_, own_dim_;
+    std::array<bool, D> is_periodic_axis_;
+    bool full_ = true;
+
+    static int32_t wrap(int32_t i, const int32_t n) {
+      i %= n;
+      return (i < 0) ? i + n : i;
+    }
+
+  public:
+    CellWindow(void) {
+      global_dim_.fill(1); lo_.fill(0); dim_.fill(1);
+      own_lo_.fill(0); own_dim_.fill(1); is_periodic_axis_.fill(false);
+    }
+
+    explicit CellWindow(const std::array<int32_t, D>& global_dim) : CellWindow() {
+      global_dim_ = dim_ = own_dim_ = global_dim;
+    }
+
+    CellWindow(const std::array<int32_t, D>& global_dim,
+               const std::array<bool, D>& is_periodic_axis,
+               const std::array<int32_t, D>& own_lo,
+               const std::array<int32_t, D>& own_dim,
+               const int32_t halo)
+      : global_dim_(global_dim), own_lo_(own_lo), own_dim_(own_dim),
+        is_periodic_axis_(is_periodic_axis) {
+      full_ = true;
+      for (int32_t a = 0; a < D; a++) {
+        int32_t lo = own_lo[a] - halo, hi = own_lo[a] + own_dim[a] + halo;
+        if (is_periodic_axis[a]) {
+          if (hi - lo >= global_dim[a]) { lo = 0; hi = global_dim[a]; }
+        } else {
+          lo = std::max(lo, 0);
+          hi = std::min(hi, global_dim[a]);
+        }
+        lo_[a]  = lo;
+        dim_[a] = hi - lo;
+        full_ &= (dim_[a] == global_dim[a]);
+      }
+    }
+
+    bool full(void) const { return full_; }
+    const std::array<int32_t, D>& global_dim(void) const { return global_dim_; }
+    const std::array<int32_t, D>& lo(void) const { return lo_; }
+    const std::array<int32_t, D>& dim(void) const { return dim_; }
+    const std::array<int32_t, D>& own_lo(void) const { return own_lo_; }
+    const std::array<int32_t, D>& own_dim(void) const { return own_dim_; }
+
+    int32_t number_of_cell(void) const {
+      return std::accumulate(dim_.cbegin(), dim_.cend(), 1, std::multiplies<int32_t>());
+    }
+
+    // NOTE: returns -1 if the global cell is outside of this window.
+    int32_t toLocal(int32_t hash) const {
+      if (full_) return hash;
+      int32_t local = 0, mul = 1;
+      for (int32_t a = 0; a < D; a++) {
+        const int32_t idx = hash % global_dim_[a];
+        hash /= global_dim_[a];
+        int32_t d = idx - lo_[a];
+        if (is_periodic_axis_[a]) d = wrap(d, global_dim_[a]);
+        if ((d < 0) || (d >= dim_[a])) return -1;
+        local += d * mul;
+        mul   *= dim_[a];
+      }
+      return local;
+    }
+
+    int32_t toGlobal(int32_t local) const {
+      if (full_) return local;
+      int32_t hash = 0, mul = 1;
+      for (int32_t a = 0; a < D; a++) {
+        const int32_t d = local % dim_[a];
+        local /= dim_[a];
+        hash += wrap(lo_[a] + d, global_dim_[a]) * mul;
+        mul  *= global_dim_[a];
+      }
+      return hash;
+    }
+
+    // NOTE:
+    // Whether the box of (unwrapped) global cells spanned by c0 and c1 overlaps
+    // this window. A cheap test to reject contours before they are split.
+    bool intersects(const std::array<int32_t, D>& c0, const std::array<int32_t, D>& c1) const {
+      if (full_) return true;
+      for (int32_t a = 0; a < D; a++) {
+        const int32_t lo = std::min(c0[a], c1[a]), len = std::max(c0[a], c1[a]) - lo;
+        if (is_periodic_axis_[a]) {
+          if (len + 1 >= global_dim_[a]) continue;
+          const int32_t d = wrap(lo - lo_[a], global_dim_[a]);
+          if ((d >= dim_[a]) && (d + len < global_dim_[a])) return false;
+        } else {
+          if ((lo + len < lo_[a]) || (lo >= lo_[a] + dim_[a])) return false;
+        }
+      }
+      return true;
+    }
+
+    bool isOwned(const int32_t local) const {
+      int32_t rest = local;
+      for (int32_t a = 0; a < D; a++) {
+        const int32_t d = rest % dim_[a];
+        rest /= dim_[a];
+        const int32_t g = lo_[a] + d;
+        if ((g < own_lo_[a]) || (g >= own_lo_[a] + own_dim_[a])) return false;
+      }
+      return true;
+    }
+  };
+}
+#endif
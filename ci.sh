@@ -7,3 +7,21 @@
 ./test/f_decomposer_test
 ./test/boundary_test
 ./test/byte_utils_test
+./test/stress_grid_test
+./test/ls_calculator_test
+./test/shell_calculator_test
+./test/pair_engine_test
+./test/trajectory_reader_test
+./test/concurrent_calculator_test
+./test/ls_stats_test
+./test/pme_stress_test
+./test/lscmd_analyze_test
+if [ -x ./test/ls_calculator_omp_test ]; then
+    OMP_NUM_THREADS=4 ./test/ls_calculator_omp_test
+fi
+if [ -x ./test/pair_engine_omp_test ]; then
+    OMP_NUM_THREADS=4 ./test/pair_engine_omp_test
+fi
+if [ -x ./test/ls_calculator_mpi_test ]; then
+    mpirun --oversubscribe -np 4 ./test/ls_calculator_mpi_test
+fi
@@ -0,0 +1,283 @@
+#if !defined CONCURRENT_CALCULATOR_HPP
+#define CONCURRENT_CALCULATOR_HPP
+
+#include <atomic>
+#include <mutex>
+#include <thread>
+#include <unordered_map>
+
+namespace LocalStress {
+  // NOTE:
+  // LSCalculator that may be called from any thread (std::thread, OpenMP,
+  // or tasks of a work-stealing runtime such as TBB). Each calling thread
+  // checks out a shard, i.e. an LSCalculator of a pool, on its first call in
+  // a frame, so no thread ids have to be passed around. nextStep() is called
+  // once per frame by the driving thread and returns all shards to the pool,
+  // so the pool only grows to the largest number of threads calling within
+  // one frame, however many threads come and go over the run.
+  // saveLocalStressDist() reduces the shards.
+  //
+  // calc* may run concurrently; nextStep, updateBox, setSaveDir, setBinEdges,
+  // enableKineticProfiles, clear and saveLocalStressDist should be called
+  // between frames, when no calc* is in flight. Only the position-based interfaces are provided (the
+  // cell cache of prepareFrame belongs to one calculator).
+  template <typename T, typename Acc = T, class Enable = void>
+  class ConcurrentCalculator;
+
+  template <typename T, typename Acc>
+  class ConcurrentCalculator<T, Acc, typename std::enable_if<std::is_floating_point<T>::value>::type> final {
+    typedef Vec<T> Vec_t;
+    typedef LSCalculator<T, Acc> Calc_t;
+    typedef typename AccumulatorTraits<Acc>::value_type Real_t;
+    typedef Tensor<Real_t> Tensor_t;
+
+    // construction parameters of the shards
+    Vec_t ref_low_, ref_high_;
+    BoundaryType btype_;
+    std::array<int32_t, D> dim_;
+    std::vector<std::string> itypes_;
+    TensorStorage storage_;
+
+    // current box and output directory, applied to shards created later
+    Vec_t low_, high_;
+    std::array<T, D * (D - 1) / 2> tilt_;
+    std::array<std::vector<T>, D> edges_;
+    std::string save_dir_ = "./";
+    bool profiles_enabled_ = false;
+    T sample_prob_ = T(1);
+    uint64_t sample_seed_ = 0;
+
+    // shards_[0] is the root shard receiving the reduction; it exists from
+    // construction so that it counts every frame. shards_[0, num_checked_out_)
+    // are checked out in the current frame (epoch_).
+    std::vector<std::unique_ptr<Calc_t>> shards_;
+    std::unordered_map<std::thread::id, Calc_t*> thread_shards_;
+    std::size_t num_checked_out_ = 0;
+    uint64_t epoch_ = 0;
+    std::mutex mutex_;
+    const uint64_t id_;
+    int32_t num_frames_ = 0;
+    bool auto_save_ = true;
+
+    // NOTE: last (calculator, frame, shard) used by this thread.
+    struct ShardCache {
+      uint64_t owner = 0, epoch = 0;
+      Calc_t* shard = nullptr;
+    };
+
+    static ShardCache& threadCache(void) {
+      static thread_local ShardCache cache;
+      return cache;
+    }
+
+    static uint64_t nextId(void) {
+      static std::atomic<uint64_t> counter(0);
+      return ++counter;
+    }
+
+    std::unique_ptr<Calc_t> newShard(void) const {
+      auto calc = make_unique<Calc_t>(Vec_t(ref_low_), Vec_t(ref_high_), btype_,
+                                      std::array<int32_t, D>(dim_),
+                                      std::vector<std::string>(itypes_), storage_);
+      calc->disableAutoSave();
+      calc->setSaveDir(save_dir_);
+      for (int32_t a = 0; a < D; a++) {
+        if (!edges_[a].empty()) calc->setBinEdges(a, edges_[a]);
+      }
+      calc->updateBox(low_, high_, tilt_);
+      if (profiles_enabled_) calc->enableKineticProfiles();
+      // shard k draws from its own stream, keyed by the global frame
+      calc->setSamplingProbability(sample_prob_, sample_seed_ + shards_.size());
+      calc->setFrameIndex(num_frames_);
+      return calc;
+    }
+
+    Calc_t& shard(void) {
+      auto& cache = threadCache();
+      if (cache.owner == id_ && cache.epoch == epoch_) return *cache.shard;
+
+      std::lock_guard<std::mutex> lock(mutex_);
+      auto& s = thread_shards_[std::this_thread::get_id()];
+      if (s == nullptr) {
+        if (num_checked_out_ == shards_.size()) shards_.push_back(newShard());
+        s = shards_[num_checked_out_++].get();
+      }
+      cache.owner = id_;
+      cache.epoch = epoch_;
+      cache.shard = s;
+      return *s;
+    }
+
+  public:
+    ConcurrentCalculator(Vec_t&& box_low,
+                         Vec_t&& box_high,
+                         const BoundaryType btype,
+                         std::array<int32_t, D>&& dim,
+                         std::vector<std::string>&& itype,
+                         const TensorStorage storage = TensorStorage::FULL)
+      : ref_low_(box_low), ref_high_(box_high), btype_(btype), dim_(dim),
+        itypes_(itype), storage_(storage), low_(box_low), high_(box_high), id_(nextId()) {
+      tilt_.fill(T(0));
+      shards_.push_back(newShard());
+    }
+
+    ~ConcurrentCalculator(void) {
+      if (auto_save_) { saveLocalStressDist(); }
+    }
+
+    ConcurrentCalculator(const ConcurrentCalculator&) = delete;
+    ConcurrentCalculator(ConcurrentCalculator&&) = delete;
+    ConcurrentCalculator& operator = (const ConcurrentCalculator&) = delete;
+    ConcurrentCalculator& operator = (ConcurrentCalculator&&) = delete;
+
+    void setSaveDir(const std::string dir_name) {
+      save_dir_ = dir_name;
+      for (auto& s : shards_) s->setSaveDir(dir_name);
+    }
+
+    void disableAutoSave(void) {
+      auto_save_ = false;
+    }
+
+    // NOTE: see LSCalculator::updateBox; the two-argument form resets the tilt to zero.
+    void updateBox(const Vec_t& box_low, const Vec_t& box_high) {
+      std::array<T, D * (D - 1) / 2> tilt;
+      tilt.fill(T(0));
+      updateBox(box_low, box_high, tilt);
+    }
+
+    void updateBox(const Vec_t& box_low, const Vec_t& box_high,
+                   const std::array<T, D * (D - 1) / 2>& tilt) {
+      low_  = box_low;
+      high_ = box_high;
+      tilt_ = tilt;
+      for (auto& s : shards_) s->updateBox(low_, high_, tilt_);
+    }
+
+    // NOTE: see LSCalculator::setBinEdges. Should be called before the first frame.
+    void setBinEdges(const int32_t axis, const std::vector<T>& edges) {
+      for (auto& s : shards_) s->setBinEdges(axis, edges);
+      edges_[axis] = edges;
+    }
+
+    // NOTE:
+    // See LSCalculator::enableKineticProfiles. The streaming velocity of each
+    // cell is taken over all shards in nextStep(), and the profiles are
+    // recorded in the root shard. Should be called before the first frame.
+    void enableKineticProfiles(void) {
+      profiles_enabled_ = true;
+      for (auto& s : shards_) s->enableKineticProfiles();
+    }
+
+    // NOTE:
+    // See LSCalculator::setSamplingProbability. The calls are keyed by their
+    // order in each shard, so shard k draws with seed + k, and by the frame
+    // counted here, also for shards created later.
+    void setSamplingProbability(const T p, const uint64_t seed = 0) {
+      sample_prob_ = p;
+      sample_seed_ = seed;
+      for (std::size_t k = 0; k < shards_.size(); k++) shards_[k]->setSamplingProbability(p, seed + k);
+    }
+
+    // NOTE: summed over shards (see LSCalculator::sampling_variance).
+    double sampling_variance(void) const {
+      double var = 0.0;
+      for (const auto& s : shards_) var += s->sampling_variance();
+      return var;
+    }
+
+    // NOTE: the root shard, holding the profiles and, after saveLocalStressDist, the reduced grids.
+    const Calc_t& root(void) const { return *shards_[0]; }
+
+    // NOTE: the boundary of the root shard; all shards share its geometry.
+    const Boundary<T>& boundary(void) const { return shards_[0]->boundary(); }
+
+    int32_t number_of_shards(void) const { return shards_.size(); }
+
+    void calcLocalStressPot2(const Vec_t& r0, const Vec_t& r1,
+                             const Vec_t& F0, const Vec_t& F1,
+                             const int32_t type) {
+      shard().calcLocalStressPot2(r0, r1, F0, F1, type);
+    }
+
+    void calcLocalStressPot2NoCheck(const Vec_t& r0, const Vec_t& r1,
+                                    const Vec_t& F0, const Vec_t& F1,
+                                    const int32_t type) {
+      shard().calcLocalStressPot2NoCheck(r0, r1, F0, F1, type);
+    }
+
+    void calcLocalStressPot3(const Vec_t& r0, const Vec_t& r1, const Vec_t& r2,
+                             const Vec_t& F0, const Vec_t& F1, const Vec_t& F2,
+                             const int32_t type) {
+      shard().calcLocalStressPot3(r0, r1, r2, F0, F1, F2, type);
+    }
+
+    void calcLocalStressPot3NoCheck(const Vec_t& r0, const Vec_t& r1, const Vec_t& r2,
+                                    const Vec_t& F0, const Vec_t& F1, const Vec_t& F2,
+                                    const int32_t type) {
+      shard().calcLocalStressPot3NoCheck(r0, r1, r2, F0, F1, F2, type);
+    }
+
+    void calcLocalStressPot4(const Vec_t& r0, const Vec_t& r1, const Vec_t& r2, const Vec_t& r3,
+                             const Vec_t& F0, const Vec_t& F1, const Vec_t& F2, const Vec_t& F3,
+                             const int32_t type) {
+      shard().calcLocalStressPot4(r0, r1, r2, r3, F0, F1, F2, F3, type);
+    }
+
+    void calcLocalStressPot4NoCheck(const Vec_t& r0, const Vec_t& r1, const Vec_t& r2, const Vec_t& r3,
+                                    const Vec_t& F0, const Vec_t& F1, const Vec_t& F2, const Vec_t& F3,
+                                    const int32_t type) {
+      shard().calcLocalStressPot4NoCheck(r0, r1, r2, r3, F0, F1, F2, F3, type);
+    }
+
+    void calcLocalStressKin(const Vec_t& r, const Vec_t& v,
+                            const T mass, const int32_t type) {
+      shard().calcLocalStressKin(r, v, mass, type);
+    }
+
+    // NOTE: counts the frame once; every shard ends its frame and returns to the pool.
+    void nextStep(void) {
+      num_frames_++;
+      LSHelpers<T, Acc>::nextStepOMP(shards_);
+      for (auto& s : shards_) s->setFrameIndex(num_frames_);
+      thread_shards_.clear();
+      num_checked_out_ = 0;
+      epoch_++;
+    }
+
+    int32_t number_of_frames(void) const { return num_frames_; }
+
+    void clear(void) {
+      num_frames_ = 0;
+      for (auto& s : shards_) s->clear();
+    }
+
+    // NOTE: same as LSCalculator::pressure_tot, summed over shards.
+    const Tensor_t pressure_tot(void) const {
+      Tensor_t psum(0.0);
+      Real_t volume = 1.0;
+      for (int32_t a = 0; a < D; a++) volume *= ref_high_[a] - ref_low_[a];
+      for (const auto& s : shards_) {
+        for (std::size_t i = 0; i < itypes_.size(); i++) psum += s->stress_dist(i).sum();
+      }
+      return psum / (volume * num_frames_);
+    }
+
+    const LSStats stats(void) const {
+      LSStats ret;
+      for (const auto& s : shards_) ret += s->stats();
+      return ret;
+    }
+
+    // NOTE: reduces all shards into the root shard and saves it.
+    void saveLocalStressDist(void) {
+      for (std::size_t i = 1; i < shards_.size(); i++) {
+        accumulateResult(*shards_[0], *shards_[i]);
+        shards_[i]->clear();
+      }
+      shards_[0]->saveLocalStressDist();
+      auto_save_ = false;
+    }
+  };
+}
+#endif
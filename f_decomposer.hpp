@@ -62,10 +62,10 @@ namespace LocalStress {
     VEC_TO_MAT(dr_mat, 3, 4, -dr[4]);
     VEC_TO_MAT(dr_mat, 3, 5, -dr[5]);
 
-    Eigen::VectorXd F_vec(nrows);
+    Eigen::Matrix<T, nrows, 1> F_vec;
     std::copy_n(&F[0].x, nrows, F_vec.data());
 
-    Eigen::VectorXd cf_dF = dr_mat.fullPivLu().solve(F_vec);
+    const Eigen::Matrix<T, ncols, 1> cf_dF = dr_mat.fullPivLu().solve(F_vec);
 
     return {cf_dF[0] * dr[0], cf_dF[1] * dr[1], cf_dF[2] * dr[2],
             cf_dF[3] * dr[3], cf_dF[4] * dr[4], cf_dF[5] * dr[5]};
@@ -73,5 +73,55 @@ namespace LocalStress {
 
 #undef VEC_TO_MAT
 #undef DECL_DECOMPOSE_FORCE_FUNC
+
+  // NOTE:
+  // Edge e of an N-body contour runs between atoms a = contourEdge<N>(e)[0]
+  // and b = contourEdge<N>(e)[1], in the order used by decomposeForce.
+  template <std::size_t N>
+  const int32_t* contourEdge(const std::size_t e) {
+    static_assert(N >= 2 && N <= 4, "contours are defined for 2-, 3-, and 4-body terms.");
+    static const int32_t edges2[1][2] = {{0, 1}};
+    static const int32_t edges3[3][2] = {{0, 1}, {1, 2}, {2, 0}};
+    static const int32_t edges4[6][2] = {{0, 1}, {0, 2}, {0, 3}, {1, 2}, {1, 3}, {2, 3}};
+    return (N == 2) ? edges2[e] : (N == 3) ? edges3[e] : edges4[e];
+  }
+
+  // NOTE: pair forces are central and need no decomposition.
+  template <typename T, class Target>
+  std::array<Vec<T>, 1> decomposeContour(Target&,
+                                         const std::array<Vec<T>, 2>& F,
+                                         const std::array<Vec<T>, 1>&) {
+    return {{F[0]}};
+  }
+
+  template <typename T, std::size_t N, std::size_t M, class Target>
+  std::array<Vec<T>, M> decomposeContour(Target& target,
+                                         const std::array<Vec<T>, N>& F,
+                                         const std::array<Vec<T>, M>& dr) {
+    return target.decompose(F, dr);
+  }
+
+  // NOTE:
+  // Shared body of the calcLocalStressPotN interfaces. For each edge (a, b)
+  // dr = r[a] - r[b] is passed to target.minimumImage(dr, e), the forces F
+  // are decomposed along the edges with target.decompose, and every edge is
+  // handed to target.spread(e, a, b, r[b], dr, dF) in decomposeForce order.
+  template <typename T, std::size_t N, class Target>
+  void spreadContours(Target& target,
+                      const std::array<Vec<T>, N>& r,
+                      const std::array<Vec<T>, N>& F) {
+    constexpr std::size_t M = N * (N - 1) / 2;
+    std::array<Vec<T>, M> dr;
+    for (std::size_t e = 0; e < M; e++) {
+      const auto edge = contourEdge<N>(e);
+      dr[e] = r[edge[0]] - r[edge[1]];
+      target.minimumImage(dr[e], e);
+    }
+    const auto dF = decomposeContour(target, F, dr);
+    for (std::size_t e = 0; e < M; e++) {
+      const auto edge = contourEdge<N>(e);
+      target.spread(e, edge[0], edge[1], r[edge[1]], dr[e], dF[e]);
+    }
+  }
 }
 #endif
@@ -0,0 +1,133 @@
+#if !defined FFT_HPP
+#define FFT_HPP
+
+#include <array>
+#include <cmath>
+#include <complex>
+#include <vector>
+
+namespace LocalStress {
+  // NOTE:
+  // Unnormalized complex FFT of any length n:
+  // forward  X_m = sum_k x_k exp(-2 pi i m k / n),
+  // backward x_k = sum_m X_m exp(+2 pi i m k / n) (no 1 / n).
+  // Powers of two use an iterative radix-2 transform, other lengths
+  // Bluestein's algorithm on top of it.
+  template <typename T>
+  class FFT1D final {
+    typedef std::complex<T> Complex;
+
+    int32_t n_, m_;
+    std::vector<Complex> twiddle_;
+    std::vector<int32_t> bitrev_;
+    // Bluestein: chirp exp(-i pi k^2 / n) and the transformed filter
+    std::vector<Complex> chirp_, filter_;
+    mutable std::vector<Complex> work_;
+
+    static bool isPowerOfTwo(const int32_t n) { return (n & (n - 1)) == 0; }
+
+    void radix2(Complex* a, const bool inverse) const {
+      for (int32_t i = 0; i < m_; i++) {
+        if (i < bitrev_[i]) std::swap(a[i], a[bitrev_[i]]);
+      }
+      for (int32_t len = 2; len <= m_; len <<= 1) {
+        const int32_t half = len >> 1, step = m_ / len;
+        for (int32_t i = 0; i < m_; i += len) {
+          for (int32_t j = 0; j < half; j++) {
+            const auto w = inverse ? std::conj(twiddle_[j * step]) : twiddle_[j * step];
+            const auto u = a[i + j], v = a[i + j + half] * w;
+            a[i + j]        = u + v;
+            a[i + j + half] = u - v;
+          }
+        }
+      }
+    }
+
+  public:
+    explicit FFT1D(const int32_t n) : n_(n), m_(1) {
+      if (n <= 0) LOCAL_STRESS_ERR("FFT length should be positive.");
+      const bool direct = isPowerOfTwo(n);
+      while (m_ < (direct ? n : 2 * n - 1)) m_ <<= 1;
+
+      const T pi = std::acos(T(-1));
+      twiddle_.resize(m_ / 2 + 1);
+      for (int32_t j = 0; j <= m_ / 2; j++) twiddle_[j] = std::polar(T(1), -2 * pi * j / m_);
+      bitrev_.assign(m_, 0);
+      for (int32_t i = 1; i < m_; i++) bitrev_[i] = (bitrev_[i >> 1] >> 1) | ((i & 1) ? m_ >> 1 : 0);
+      work_.resize(m_);
+      if (direct) return;
+
+      chirp_.resize(n);
+      for (int64_t k = 0; k < n; k++) {
+        // k^2 mod 2n keeps the phase accurate for large k
+        chirp_[k] = std::polar(T(1), -pi * T((k * k) % (2 * n)) / n);
+      }
+      filter_.assign(m_, Complex(0));
+      filter_[0] = std::conj(chirp_[0]);
+      for (int32_t k = 1; k < n; k++) filter_[k] = filter_[m_ - k] = std::conj(chirp_[k]);
+      radix2(filter_.data(), false);
+    }
+
+    int32_t size(void) const { return n_; }
+
+    // NOTE: in-place transform of x[0], x[stride], ..., x[(n - 1) * stride].
+    void transform(Complex* x, const int32_t stride, const bool inverse) const {
+      if (chirp_.empty()) {
+        for (int32_t k = 0; k < n_; k++) work_[k] = x[k * stride];
+        radix2(work_.data(), inverse);
+        for (int32_t k = 0; k < n_; k++) x[k * stride] = work_[k];
+        return;
+      }
+      // the backward transform is the conjugate of the forward one of conj(x)
+      for (int32_t k = 0; k < n_; k++) {
+        const auto xk = inverse ? std::conj(x[k * stride]) : x[k * stride];
+        work_[k] = xk * chirp_[k];
+      }
+      std::fill(work_.begin() + n_, work_.end(), Complex(0));
+      radix2(work_.data(), false);
+      for (int32_t k = 0; k < m_; k++) work_[k] *= filter_[k];
+      radix2(work_.data(), true);
+      const T scale = T(1) / m_;
+      for (int32_t k = 0; k < n_; k++) {
+        const auto xk = work_[k] * chirp_[k] * scale;
+        x[k * stride] = inverse ? std::conj(xk) : xk;
+      }
+    }
+  };
+
+  // NOTE:
+  // Unnormalized 3D FFT on a grid of dim[0] x dim[1] x dim[2] points stored
+  // with the first index running fastest.
+  template <typename T>
+  class FFT3D final {
+    typedef std::complex<T> Complex;
+
+    std::array<int32_t, 3> dim_;
+    std::vector<FFT1D<T>> axes_;
+
+    void transform(std::vector<Complex>& a, const bool inverse) const {
+      const int32_t n0 = dim_[0], n1 = dim_[1], n2 = dim_[2];
+      for (int32_t k = 0; k < n2; k++) {
+        for (int32_t j = 0; j < n1; j++) axes_[0].transform(&a[n0 * (j + n1 * k)], 1, inverse);
+      }
+      for (int32_t k = 0; k < n2; k++) {
+        for (int32_t i = 0; i < n0; i++) axes_[1].transform(&a[i + n0 * n1 * k], n0, inverse);
+      }
+      for (int32_t j = 0; j < n1; j++) {
+        for (int32_t i = 0; i < n0; i++) axes_[2].transform(&a[i + n0 * j], n0 * n1, inverse);
+      }
+    }
+
+  public:
+    explicit FFT3D(const std::array<int32_t, 3>& dim) : dim_(dim) {
+      for (int32_t a = 0; a < 3; a++) axes_.emplace_back(dim[a]);
+    }
+
+    const std::array<int32_t, 3>& dim(void) const { return dim_; }
+    int32_t size(void) const { return dim_[0] * dim_[1] * dim_[2]; }
+
+    void forward(std::vector<Complex>& a) const { transform(a, false); }
+    void backward(std::vector<Complex>& a) const { transform(a, true); }
+  };
+}
+#endif
@@ -0,0 +1,232 @@
+#if !defined GRID_KERNELS_HPP
+#define GRID_KERNELS_HPP
+
+#include <cstddef>
+#include <cstdlib>
+#include <cstring>
+
+#ifdef __linux__
+#include <sys/mman.h>
+#endif
+
+#if (defined(__GNUC__) || defined(__clang__)) && (defined(__x86_64__) || defined(__i386__))
+#define LOCAL_STRESS_X86_DISPATCH
+#include <immintrin.h>
+#define LOCAL_STRESS_TARGET(isa) __attribute__((target(isa)))
+#endif
+
+namespace LocalStress {
+  // NOTE:
+  // Whole-grid kernels operating on contiguous component planes.
+  // The SIMD variants are compiled with function-level target attributes
+  // and selected at runtime, so no -mavx2/-mavx512f flag is required.
+  enum class SimdLevel : int32_t {
+    SCALAR = 0,
+    AVX2,
+    AVX512,
+  };
+
+  static inline SimdLevel detectSimdLevel(void) {
+#ifdef LOCAL_STRESS_X86_DISPATCH
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx512f")) return SimdLevel::AVX512;
+    if (__builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma")) return SimdLevel::AVX2;
+#endif
+    return SimdLevel::SCALAR;
+  }
+
+  template <typename T>
+  struct GridKernels {
+    void (*scale)(T* x, std::size_t n, T a);
+    void (*axpy)(T* y, const T* x, std::size_t n, T a);
+    T    (*sum)(const T* x, std::size_t n);
+  };
+
+  namespace GridKernelsImpl {
+    template <typename T>
+    void scale_scalar(T* x, std::size_t n, T a) {
+      for (std::size_t i = 0; i < n; i++) x[i] *= a;
+    }
+
+    template <typename T>
+    void axpy_scalar(T* y, const T* x, std::size_t n, T a) {
+      for (std::size_t i = 0; i < n; i++) y[i] += a * x[i];
+    }
+
+    template <typename T>
+    T sum_scalar(const T* x, std::size_t n) {
+      T s[4] = {0, 0, 0, 0};
+      std::size_t i = 0;
+      for (; i + 4 <= n; i += 4) {
+        s[0] += x[i]; s[1] += x[i + 1]; s[2] += x[i + 2]; s[3] += x[i + 3];
+      }
+      for (; i < n; i++) s[0] += x[i];
+      return (s[0] + s[1]) + (s[2] + s[3]);
+    }
+
+#ifdef LOCAL_STRESS_X86_DISPATCH
+#define DEFINE_AVX_KERNELS(ISA, SUFFIX, T, VT, W, SET1, LOAD, STORE, ADD, MUL, FMA, ZERO, HSUM) \
+    LOCAL_STRESS_TARGET(ISA)                                            \
+    static inline void scale_##SUFFIX(T* x, std::size_t n, T a) {       \
+      const VT va = SET1(a);                                            \
+      std::size_t i = 0;                                                \
+      for (; i + W <= n; i += W) STORE(x + i, MUL(LOAD(x + i), va));    \
+      for (; i < n; i++) x[i] *= a;                                     \
+    }                                                                   \
+                                                                        \
+    LOCAL_STRESS_TARGET(ISA)                                            \
+    static inline void axpy_##SUFFIX(T* y, const T* x, std::size_t n, T a) { \
+      const VT va = SET1(a);                                            \
+      std::size_t i = 0;                                                \
+      for (; i + 2 * W <= n; i += 2 * W) {                              \
+        STORE(y + i,     FMA(va, LOAD(x + i),     LOAD(y + i)));        \
+        STORE(y + i + W, FMA(va, LOAD(x + i + W), LOAD(y + i + W)));    \
+      }                                                                 \
+      for (; i < n; i++) y[i] += a * x[i];                              \
+    }                                                                   \
+                                                                        \
+    LOCAL_STRESS_TARGET(ISA)                                            \
+    static inline T sum_##SUFFIX(const T* x, std::size_t n) {           \
+      VT s0 = ZERO(), s1 = ZERO(), s2 = ZERO(), s3 = ZERO();            \
+      std::size_t i = 0;                                                \
+      for (; i + 4 * W <= n; i += 4 * W) {                              \
+        s0 = ADD(s0, LOAD(x + i));                                      \
+        s1 = ADD(s1, LOAD(x + i + W));                                  \
+        s2 = ADD(s2, LOAD(x + i + 2 * W));                              \
+        s3 = ADD(s3, LOAD(x + i + 3 * W));                              \
+      }                                                                 \
+      for (; i + W <= n; i += W) s0 = ADD(s0, LOAD(x + i));             \
+      const VT s = ADD(ADD(s0, s1), ADD(s2, s3));                       \
+      T ret = HSUM(s);                                                  \
+      for (; i < n; i++) ret += x[i];                                   \
+      return ret;                                                       \
+    }
+
+    LOCAL_STRESS_TARGET("avx2,fma")
+    static inline double hsum_avx2_pd(const __m256d v) {
+      const __m128d lo = _mm256_castpd256_pd128(v);
+      const __m128d hi = _mm256_extractf128_pd(v, 1);
+      const __m128d s  = _mm_add_pd(lo, hi);
+      return _mm_cvtsd_f64(_mm_add_sd(s, _mm_unpackhi_pd(s, s)));
+    }
+
+    LOCAL_STRESS_TARGET("avx2,fma")
+    static inline float hsum_avx2_ps(const __m256 v) {
+      const __m128 lo = _mm256_castps256_ps128(v);
+      const __m128 hi = _mm256_extractf128_ps(v, 1);
+      __m128 s = _mm_add_ps(lo, hi);
+      s = _mm_add_ps(s, _mm_movehl_ps(s, s));
+      s = _mm_add_ss(s, _mm_shuffle_ps(s, s, 0x1));
+      return _mm_cvtss_f32(s);
+    }
+
+    // NOTE:
+    // _mm512_reduce_add_* trigger a -Wuninitialized false positive in some GCC headers.
+    LOCAL_STRESS_TARGET("avx512f")
+    static inline double hsum_avx512_pd(const __m512d v) {
+      alignas(64) double buf[8];
+      _mm512_store_pd(buf, v);
+      return ((buf[0] + buf[4]) + (buf[1] + buf[5])) + ((buf[2] + buf[6]) + (buf[3] + buf[7]));
+    }
+
+    LOCAL_STRESS_TARGET("avx512f")
+    static inline float hsum_avx512_ps(const __m512 v) {
+      alignas(64) float buf[16];
+      _mm512_store_ps(buf, v);
+      float ret = 0.0f;
+      for (int i = 0; i < 16; i++) ret += buf[i];
+      return ret;
+    }
+
+    DEFINE_AVX_KERNELS("avx2,fma", avx2_pd, double, __m256d, 4,
+                       _mm256_set1_pd, _mm256_loadu_pd, _mm256_storeu_pd,
+                       _mm256_add_pd, _mm256_mul_pd, _mm256_fmadd_pd,
+                       _mm256_setzero_pd, hsum_avx2_pd)
+    DEFINE_AVX_KERNELS("avx2,fma", avx2_ps, float, __m256, 8,
+                       _mm256_set1_ps, _mm256_loadu_ps, _mm256_storeu_ps,
+                       _mm256_add_ps, _mm256_mul_ps, _mm256_fmadd_ps,
+                       _mm256_setzero_ps, hsum_avx2_ps)
+    DEFINE_AVX_KERNELS("avx512f", avx512_pd, double, __m512d, 8,
+                       _mm512_set1_pd, _mm512_loadu_pd, _mm512_storeu_pd,
+                       _mm512_add_pd, _mm512_mul_pd, _mm512_fmadd_pd,
+                       _mm512_setzero_pd, hsum_avx512_pd)
+    DEFINE_AVX_KERNELS("avx512f", avx512_ps, float, __m512, 16,
+                       _mm512_set1_ps, _mm512_loadu_ps, _mm512_storeu_ps,
+                       _mm512_add_ps, _mm512_mul_ps, _mm512_fmadd_ps,
+                       _mm512_setzero_ps, hsum_avx512_ps)
+#undef DEFINE_AVX_KERNELS
+#endif
+
+    template <typename T>
+    struct Selector {
+      static GridKernels<T> select(const SimdLevel level) {
+        LOCAL_STRESS_UNUSED_VAR(level);
+        return {scale_scalar<T>, axpy_scalar<T>, sum_scalar<T>};
+      }
+    };
+
+#ifdef LOCAL_STRESS_X86_DISPATCH
+#define DEFINE_SELECTOR(T, PD)                                          \
+    template <>                                                         \
+    struct Selector<T> {                                                \
+      static GridKernels<T> select(const SimdLevel level) {             \
+        switch (level) {                                                \
+        case SimdLevel::AVX512:                                         \
+          return {scale_avx512_##PD, axpy_avx512_##PD, sum_avx512_##PD}; \
+        case SimdLevel::AVX2:                                           \
+          return {scale_avx2_##PD, axpy_avx2_##PD, sum_avx2_##PD};      \
+        default:                                                        \
+          return {scale_scalar<T>, axpy_scalar<T>, sum_scalar<T>};      \
+        }                                                               \
+      }                                                                 \
+    };
+    DEFINE_SELECTOR(double, pd)
+    DEFINE_SELECTOR(float, ps)
+#undef DEFINE_SELECTOR
+#endif
+  }
+
+  // NOTE: level must not exceed detectSimdLevel().
+  template <typename T>
+  GridKernels<T> gridKernels(const SimdLevel level) {
+    return GridKernelsImpl::Selector<T>::select(level);
+  }
+
+  template <typename T>
+  const GridKernels<T>& gridKernels(void) {
+    static const GridKernels<T> kernels = gridKernels<T>(detectSimdLevel());
+    return kernels;
+  }
+
+  struct AlignedDeleter {
+    void operator () (void* ptr) const { std::free(ptr); }
+  };
+
+  constexpr std::size_t huge_page_bytes = std::size_t(2) << 20;
+
+  // NOTE:
+  // Zero-filled aligned array. The memset is the first touch, so pages are
+  // placed on the NUMA node of the calling thread. Arrays of at least
+  // huge_page_bytes are aligned to and padded up to huge pages and marked
+  // for transparent huge pages (Linux only).
+  template <typename T>
+  std::unique_ptr<T[], AlignedDeleter> make_aligned_zero(const std::size_t n,
+                                                         std::size_t align = 64) {
+    std::size_t bytes = std::max<std::size_t>(n, 1) * sizeof(T);
+    const bool huge = (bytes >= huge_page_bytes);
+    if (huge) {
+      align = huge_page_bytes;
+      bytes = (bytes + huge_page_bytes - 1) / huge_page_bytes * huge_page_bytes;
+    }
+    void* ptr = nullptr;
+    if (posix_memalign(&ptr, align, bytes) != 0) {
+      LOCAL_STRESS_ERR("Failed to allocate aligned memory.");
+    }
+#if defined(__linux__) && defined(MADV_HUGEPAGE)
+    if (huge) madvise(ptr, bytes, MADV_HUGEPAGE);
+#endif
+    std::memset(ptr, 0, n * sizeof(T));
+    return std::unique_ptr<T[], AlignedDeleter>(static_cast<T*>(ptr));
+  }
+}
+#endif
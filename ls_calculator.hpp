@@ -1,14 +1,32 @@
 #if !defined LS_CALCULATOR_HPP
 #define LS_CALCULATOR_HPP
 
+#ifdef LOCAL_STRESS_USE_MPI
+#include <mpi.h>
+#endif
+
 #include "defs.hpp"
 #include "utils.hpp"
+#include "ls_stats.hpp"
 #include "byte_utils.hpp"
+#include "vec_view.hpp"
 #include "boundary.hpp"
 #include "f_decomposer.hpp"
+#include "stress_grid.hpp"
+#include "cell_window.hpp"
 #include "ls_calculator_impl.hpp"
+#ifdef LOCAL_STRESS_USE_MPI
+#include "ls_helpers_mpi.hpp"
+#endif
 #include "ls_factory.hpp"
 #include "ls_helpers.hpp"
+#include "concurrent_calculator.hpp"
+#include "pair_engine.hpp"
+#ifdef LS_SIMULATION_3D
+#include "shell_geometry.hpp"
+#include "shell_calculator.hpp"
+#include "pme_stress.hpp"
+#endif
 
 namespace LS = LocalStress;
 
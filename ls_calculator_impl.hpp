@@ -2,89 +2,674 @@
 #define LS_CALCULATOR_IMPL_HPP
 
 #include <string>
+#include <unordered_map>
 
 #include "filesystem/path.h"
 
 namespace LocalStress {
-  template <typename T, class Enable = void>
+  template <typename T, typename Acc>
+  class LSHelpersMPI;
+
+  template <typename T, typename Acc>
+  class LSHelpers;
+
+  template <typename T, typename Acc, class Enable>
+  class CalculatorFactory;
+
+  // NOTE:
+  // T is the compute type used for inputs and geometry.
+  // Acc is the accumulator type of the stress grids (float, double or Compensated<S>).
+  template <typename T, typename Acc = T, class Enable = void>
   class LSCalculator;
 
-  template <typename T>
-  class LSCalculator<T, typename std::enable_if<std::is_floating_point<T>::value>::type> final {
+  template <typename T, typename Acc>
+  class LSCalculator<T, Acc, typename std::enable_if<std::is_floating_point<T>::value>::type> final {
     typedef Vec<T> Vec_t;
-    typedef Tensor<T> Tensor_t;
+    typedef typename AccumulatorTraits<Acc>::value_type Real_t;
+    typedef Tensor<Real_t> Tensor_t;
 
-    std::vector<std::unique_ptr<Tensor_t[]>> stress_dist_;
+    std::vector<StressGrid<Acc>> stress_dist_;
+    // Irving-Kirkwood heat flux per interaction type, empty unless enabled
+    std::vector<StressGrid<Acc>> heat_flux_;
+    bool heat_flux_enabled_ = false;
+    // kinetic profiles: per-frame sums of each interaction type (mass, momentum),
+    // per-frame kinetic energy and atom count, and cells touched in this frame
+    bool profiles_enabled_ = false;
+    // set by createOMP: frames are shared with the other calculators of the
+    // vector, so kinetic frames are finished by LSHelpers::nextStepOMP
+    bool shares_frames_ = false;
+    std::vector<std::vector<Real_t>> frame_mass_, frame_momentum_;
+    std::vector<Real_t> frame_energy_;
+    std::vector<int32_t> frame_count_, touched_cells_;
+    // time sums: volume-scaled mass, mass, momentum, thermal kinetic energy, atom count,
+    // thermal degrees of freedom
+    std::vector<Real_t> prof_density_, prof_mass_, prof_momentum_, prof_thermal_, prof_count_, prof_dof_;
     std::unique_ptr<Boundary<T>> boundary_;
+    // box given at construction; the mesh is defined in fractions of the box,
+    // and contributions are scaled by ref_volume_ / (current volume)
+    Vec_t ref_low_, ref_length_;
+    T ref_volume_ = 1.0, volume_scale_ = 1.0;
+    CellWindow window_;
+    // window_ is a region of interest: contributions outside of it are discarded
+    bool roi_ = false;
+    // contributions to cells outside of window_, keyed by global cell
+    std::vector<std::unordered_map<int32_t, Tensor_t>> overflow_;
     int32_t num_frames_ = 0;
     std::vector<std::string> interaction_types_;
     std::string save_dir_ = "./";
     bool auto_save_ = true;
+    TensorStorage storage_ = TensorStorage::FULL;
+    int32_t log2_page_cells_ = StressGrid<Acc>::dense;
+
+    // per-frame cell coordinates of atoms, filled by prepareFrame
+    std::array<std::vector<int32_t>, D> cell_cache_;
+    int32_t num_cached_ = 0;
+    std::unique_ptr<VecArrayView<T>> cached_pos_;
+    // per-atom virials summed over frames, empty unless enableAtomVirial
+    std::vector<Tensor_t> atom_virial_;
+    // stochastic subsampling of potential contributions, see setSamplingProbability
+    T sample_prob_ = T(1);
+    uint64_t sample_seed_ = 0, sample_count_ = 0;
+    // frame keying the draws: the frames counted here unless set by setFrameIndex
+    uint64_t sample_frame_ = 0;
+    // virial of the last accepted sample, summed over its contours, and the
+    // variance estimate of the closed samples
+    Tensor<T> sample_virial_ = Tensor<T>(T(0));
+    bool sample_open_ = false;
+    double sampling_var_ = 0.0;
+#ifdef LOCAL_STRESS_USE_STATS
+    LSStats stats_;
+#endif
 
     void normalizeStress() {
-      const T factor = -1.0 / num_frames_;
+      LOCAL_STRESS_TIMER(stats_, Phase::NORMALIZE);
+      const Real_t factor = -1.0 / num_frames_;
+      for (auto& sdist : stress_dist_) sdist.scale(factor);
+      for (auto& hflux : heat_flux_) hflux.scale(-factor);
+    }
+
+    void allocateStressDist(void) {
+      stress_dist_.clear();
+      stress_dist_.reserve(interaction_types_.size());
+      for (std::size_t i = 0; i < interaction_types_.size(); i++) {
+        stress_dist_.emplace_back(window_.number_of_cell(), storage_, log2_page_cells_);
+      }
+      overflow_.assign(interaction_types_.size(), {});
+
+      allocateProfiles();
+
+      heat_flux_.clear();
+      if (!heat_flux_enabled_) return;
+      if (!window_.full()) {
+        LOCAL_STRESS_ERR("Heat flux is not supported with partial grids.");
+      }
+      heat_flux_.reserve(interaction_types_.size());
+      for (std::size_t i = 0; i < interaction_types_.size(); i++) {
+        heat_flux_.emplace_back(window_.number_of_cell(), TensorStorage::VECTOR, log2_page_cells_);
+      }
+    }
+
+    void allocateProfiles(void) {
+      const std::size_t ncell = profiles_enabled_ ? window_.number_of_cell() : 0;
+      if (profiles_enabled_ && !window_.full()) {
+        LOCAL_STRESS_ERR("Kinetic profiles are not supported with partial grids.");
+      }
+      // per-type frame sums are allocated on the first kinetic contribution of the type
+      frame_mass_.assign(interaction_types_.size(), {});
+      frame_momentum_.assign(interaction_types_.size(), {});
+      frame_energy_.assign(ncell, 0);
+      frame_count_.assign(ncell, 0);
+      touched_cells_.clear();
+      prof_density_.assign(ncell, 0);
+      prof_mass_.assign(ncell, 0);
+      prof_momentum_.assign(ncell * D, 0);
+      prof_thermal_.assign(ncell, 0);
+      prof_count_.assign(ncell, 0);
+      prof_dof_.assign(ncell, 0);
+    }
+
+    // NOTE: cell is a global cell hash.
+    void accumulateKin(const int32_t type, const int32_t cell,
+                       const Vec_t& v, const T mass) {
+      accumulate(type, cell, tensor_dot(v, v), mass);
+      if (!profiles_enabled_) return;
+      if (frame_mass_[type].empty()) {
+        frame_mass_[type].assign(window_.number_of_cell(), 0);
+        frame_momentum_[type].assign(window_.number_of_cell() * D, 0);
+      }
+      const auto local = window_.toLocal(cell);
+      if (frame_count_[local]++ == 0) touched_cells_.push_back(local);
+      frame_mass_[type][local] += mass;
+      for (int32_t a = 0; a < D; a++) frame_momentum_[type][local * D + a] += mass * v[a];
+      frame_energy_[local] += Real_t(0.5) * mass * (v * v);
+    }
+
+    // NOTE:
+    // Subtracts the streaming velocity u of a cell in this frame from the
+    // kinetic stress: sum m (v - u)(v - u) = sum m v v - u P_t - P_t u + M_t u u
+    // for each interaction type t. The correction is linear in the sums M_t
+    // and P_t of this calculator, so calculators sharing the frame each apply
+    // it with the u of all of them.
+    void subtractStreamingVelocity(const int32_t cell, const Vec<Real_t>& u) {
+      const auto num_itypes = interaction_types_.size();
+      for (std::size_t t = 0; t < num_itypes; t++) {
+        if (frame_mass_[t].empty() || frame_mass_[t][cell] == 0) continue;
+        Vec<Real_t> mom_t;
+        for (int32_t a = 0; a < D; a++) mom_t[a] = frame_momentum_[t][cell * D + a];
+        const auto corr = tensor_dot(u, u) * frame_mass_[t][cell] - tensor_dot(u, mom_t) - tensor_dot(mom_t, u);
+        stress_dist_[t].add(cell, corr, Real_t(volume_scale_));
+        frame_mass_[t][cell] = 0;
+        for (int32_t a = 0; a < D; a++) frame_momentum_[t][cell * D + a] = 0;
+      }
+    }
+
+    void frameMassMomentum(const int32_t cell, Real_t& mass, Vec<Real_t>& mom) const {
+      const auto num_itypes = interaction_types_.size();
+      for (std::size_t t = 0; t < num_itypes; t++) {
+        if (frame_mass_[t].empty()) continue;
+        mass += frame_mass_[t][cell];
+        for (int32_t a = 0; a < D; a++) mom[a] += frame_momentum_[t][cell * D + a];
+      }
+    }
+
+    // NOTE:
+    // Ends the kinetic frame of calculators that shared it (calcs[0] alone
+    // for a single calculator): the streaming velocity u = P / M of each cell
+    // is taken over all of them, and the frame is added to the profiles of
+    // calcs[0]. Removing u takes D degrees of freedom from the n atoms of the
+    // cell, so the frame adds D (n - 1) to prof_dof_.
+    static void finishKineticFrame(const std::vector<LSCalculator*>& calcs) {
+      auto& root = *calcs[0];
+      for (std::size_t k = 1; k < calcs.size(); k++) {
+        auto& calc = *calcs[k];
+        if (!calc.profiles_enabled_ || calc.window_.number_of_cell() != root.window_.number_of_cell()) {
+          LOCAL_STRESS_ERR("Calculators sharing frames should all enable kinetic profiles.");
+        }
+        for (const auto cell : calc.touched_cells_) {
+          if (root.frame_count_[cell] == 0) root.touched_cells_.push_back(cell);
+          root.frame_count_[cell]  += calc.frame_count_[cell];
+          root.frame_energy_[cell] += calc.frame_energy_[cell];
+          calc.frame_count_[cell]  = 0;
+          calc.frame_energy_[cell] = 0;
+        }
+      }
+      for (const auto cell : root.touched_cells_) {
+        Real_t mass = 0;
+        Vec<Real_t> mom;
+        for (const auto calc : calcs) calc->frameMassMomentum(cell, mass, mom);
+        const auto u = (mass > 0) ? mom / mass : Vec<Real_t>();
+        for (const auto calc : calcs) calc->subtractStreamingVelocity(cell, u);
+        root.prof_density_[cell] += mass * root.volume_scale_;
+        root.prof_mass_[cell]    += mass;
+        for (int32_t a = 0; a < D; a++) root.prof_momentum_[cell * D + a] += mom[a];
+        root.prof_thermal_[cell] += root.frame_energy_[cell] - Real_t(0.5) * (mom * u);
+        root.prof_count_[cell]   += root.frame_count_[cell];
+        root.prof_dof_[cell]     += D * (root.frame_count_[cell] - 1);
+        root.frame_energy_[cell] = 0;
+        root.frame_count_[cell]  = 0;
+      }
+      for (const auto calc : calcs) calc->touched_cells_.clear();
+    }
+
+    bool hasKineticProfiles(void) const {
+      return profiles_enabled_ &&
+        std::any_of(prof_count_.cbegin(), prof_count_.cend(), [](const Real_t n) { return n > 0; });
+    }
+
+    static void accumulateProfiles(LSCalculator& lsc0, const LSCalculator& lsc1) {
+      if (!lsc0.profiles_enabled_ || !lsc1.profiles_enabled_) return;
+      auto add = [](std::vector<Real_t>& dst, const std::vector<Real_t>& src) {
+        for (std::size_t i = 0; i < dst.size(); i++) dst[i] += src[i];
+      };
+      add(lsc0.prof_density_, lsc1.prof_density_);
+      add(lsc0.prof_mass_, lsc1.prof_mass_);
+      add(lsc0.prof_momentum_, lsc1.prof_momentum_);
+      add(lsc0.prof_thermal_, lsc1.prof_thermal_);
+      add(lsc0.prof_count_, lsc1.prof_count_);
+      add(lsc0.prof_dof_, lsc1.prof_dof_);
+    }
+
+    static void accumulateGrids(LSCalculator& lsc0, const LSCalculator& lsc1) {
+      lsc0.sampling_var_ += lsc1.sampling_variance();
+      const int num_itypes = lsc0.interaction_types_.size();
+      for (int type = 0; type < num_itypes; type++) {
+        lsc0.stress_dist_[type].accumulate(lsc1.stress_dist_[type]);
+        if (lsc0.heat_flux_enabled_ && lsc1.heat_flux_enabled_) {
+          lsc0.heat_flux_[type].accumulate(lsc1.heat_flux_[type]);
+        }
+        for (const auto& ovf : lsc1.overflow_[type]) lsc0.overflow_[type][ovf.first] += ovf.second;
+      }
+      if (lsc0.atom_virial_.size() != lsc1.atom_virial_.size()) {
+        LOCAL_STRESS_ERR("Per-atom virials of " << lsc0.atom_virial_.size() << " and "
+                         << lsc1.atom_virial_.size() << " atoms cannot be reduced.");
+      }
+      for (std::size_t i = 0; i < lsc0.atom_virial_.size(); i++) lsc0.atom_virial_[i] += lsc1.atom_virial_[i];
+    }
+
+    void writeProfilesAsBinary(std::ostream& fout) const {
+      const int32_t num_elem = D + 2;
+      writeHeader(fout, num_elem, 1);
+      const std::string name = "Flow";
+      write_as_lsbfirst(fout, uint32_t(name.length()));
+      write_as_lsbfirst(fout, name);
       const auto num_of_cell = boundary_->number_of_cell();
-      for (auto& sdist : stress_dist_) {
-        std::for_each(sdist.get(), sdist.get() + num_of_cell,
-                      [factor](Tensor_t& val) { val *= factor; });
+      for (int32_t c = 0; c < num_of_cell; c++) {
+        write_as_lsbfirst(fout, double(density(c)));
+        const auto u = streaming_velocity(c);
+        for (int32_t a = 0; a < D; a++) write_as_lsbfirst(fout, double(u[a]));
+        write_as_lsbfirst(fout, double(temperature(c)));
+      }
+    }
+
+    // NOTE: cell is a global cell hash.
+    void accumulate(const int32_t type, const int32_t cell,
+                    const Tensor<T>& val, const T weight) {
+      const auto local = window_.toLocal(cell);
+      const T w = weight * volume_scale_;
+      if (local >= 0) {
+        stress_dist_[type].add(local, val, w);
+      } else if (!roi_) {
+        auto& dst = overflow_[type][cell];
+        for (int32_t e = 0; e < D * D; e++) dst[e] += Real_t(val[e] * w);
+      }
+    }
+
+    void accumulateHeat(const int32_t type, const int32_t cell,
+                        const Vec_t& val, const T weight) {
+      heat_flux_[type].add(window_.toLocal(cell), val, weight * volume_scale_);
+    }
+
+    void checkHeatFlux(void) const {
+      if (!heat_flux_enabled_) {
+        LOCAL_STRESS_ERR("Call enableHeatFlux() before passing velocities.");
+      }
+    }
+
+    template <std::size_t N, std::size_t M>
+    const std::array<Vec_t, M> decompose(const std::array<Vec_t, N>& F,
+                                         const std::array<Vec_t, M>& dr) {
+      LOCAL_STRESS_TIMER(stats_, Phase::DECOMPOSE);
+      LOCAL_STRESS_STATS((N == 3) ? stats_.cfd3++ : stats_.cfd4++);
+      return decomposeForce(F, dr);
+    }
+
+    void spreadLocalStress(const Vec_t& r1,
+                           const Vec_t& dr01,
+                           const Vec_t& dF01,
+                           const int32_t type) {
+      LOCAL_STRESS_TIMER(stats_, Phase::SPREAD);
+      const auto c1 = boundary_->getCellPosition(r1), c0 = boundary_->getCellPosition(r1 + dr01);
+      if (rejectContour(c1, c0)) return;
+      const auto div_ratios = boundary_->getDividedLineRatio(r1, dr01, c1, c0);
+      const auto d_virial   = tensor_dot(dr01, dF01);
+      if (sample_open_) sample_virial_ += d_virial;
+      for (auto it = div_ratios.cbegin(); it != div_ratios.cend(); ++it) {
+        accumulate(type, it->first, d_virial, it->second);
       }
     }
 
+    // NOTE:
+    // Also spreads dr01 (dF01 . v01) into the heat flux along the same contour,
+    // where v01 is the mean velocity of the two atoms.
     void spreadLocalStress(const Vec_t& r1,
                            const Vec_t& dr01,
                            const Vec_t& dF01,
+                           const Vec_t& v01,
                            const int32_t type) {
-      const auto div_ratios = boundary_->getDividedLineRatio(r1, dr01);
+      LOCAL_STRESS_TIMER(stats_, Phase::SPREAD);
+      const auto c1 = boundary_->getCellPosition(r1), c0 = boundary_->getCellPosition(r1 + dr01);
+      if (rejectContour(c1, c0)) return;
+      const auto div_ratios = boundary_->getDividedLineRatio(r1, dr01, c1, c0);
       const auto d_virial   = tensor_dot(dr01, dF01);
+      if (sample_open_) sample_virial_ += d_virial;
+      const auto d_heat     = dr01 * (dF01 * v01);
       for (auto it = div_ratios.cbegin(); it != div_ratios.cend(); ++it) {
-        stress_dist_[type][it->first] += d_virial * it->second;
+        accumulate(type, it->first, d_virial, it->second);
+        accumulateHeat(type, it->first, d_heat, it->second);
+      }
+    }
+
+    // NOTE: half of the virial of the contour between atoms a and b goes to each of them.
+    void addAtomVirial(const int32_t a, const int32_t b, const Vec_t& dr, const Vec_t& dF) {
+      if (atom_virial_.empty()) return;
+      auto& wa = atomVirialOf(a);
+      auto& wb = atomVirialOf(b);
+      const auto half = tensor_dot(dr, dF) * T(0.5);
+      for (int32_t e = 0; e < D * D; e++) {
+        wa[e] += Real_t(half[e]);
+        wb[e] += Real_t(half[e]);
+      }
+    }
+
+    // NOTE: atom ids beyond enableAtomVirial(num_atoms) are errors, not silent writes.
+    Tensor_t& atomVirialOf(const int32_t id) {
+      if (id < 0 || id >= int32_t(atom_virial_.size())) {
+        LOCAL_STRESS_ERR("Atom id " << id << " is out of range of enableAtomVirial("
+                         << atom_virial_.size() << ").");
       }
+      return atom_virial_[id];
     }
 
-    void writeStressDistAsBinary(std::ofstream& fout) const {
+    // NOTE: a and b are positions in ids, the atom ids of a position-based call (may be null).
+    void addAtomVirial(const int32_t* ids, const int32_t a, const int32_t b,
+                       const Vec_t& dr, const Vec_t& dF) {
+      if (ids != nullptr) addAtomVirial(ids[a], ids[b], dr, dF);
+    }
+
+    // NOTE:
+    // Targets of spreadContours (see f_decomposer.hpp). ContourTarget spreads
+    // from positions, keying the per-atom virial by ids and the heat flux by
+    // the velocities v when they are given. CachedContourTarget does the same
+    // for the atoms idx with the cell coordinates of prepareFrame.
+    struct ContourTarget {
+      LSCalculator& calc;
+      const int32_t type;
+      const int32_t* ids;
+      const Vec_t* v;
+
+      void minimumImage(Vec_t& dr, const std::size_t) const {
+        calc.boundary_->applyMinimumImage(dr);
+      }
+
+      template <std::size_t N, std::size_t M>
+      const std::array<Vec_t, M> decompose(const std::array<Vec_t, N>& F,
+                                           const std::array<Vec_t, M>& dr) {
+        return calc.decompose(F, dr);
+      }
+
+      void spread(const std::size_t, const int32_t a, const int32_t b,
+                  const Vec_t& r_b, const Vec_t& dr, const Vec_t& dF) {
+        if (v == nullptr) {
+          calc.spreadLocalStress(r_b, dr, dF, type);
+        } else {
+          calc.spreadLocalStress(r_b, dr, dF, (v[a] + v[b]) * T(0.5), type);
+        }
+        calc.addAtomVirial(ids, a, b, dr, dF);
+      }
+    };
+
+    struct CachedContourTarget {
+      LSCalculator& calc;
+      const int32_t type;
+      const int32_t* idx;
+      const VecArrayView<T>* vel;
+      std::array<std::array<int32_t, D>, 6> shift;
+
+      void minimumImage(Vec_t& dr, const std::size_t e) {
+        calc.boundary_->applyMinimumImage(dr, shift[e]);
+      }
+
+      template <std::size_t N, std::size_t M>
+      const std::array<Vec_t, M> decompose(const std::array<Vec_t, N>& F,
+                                           const std::array<Vec_t, M>& dr) {
+        return calc.decompose(F, dr);
+      }
+
+      void spread(const std::size_t e, const int32_t a, const int32_t b,
+                  const Vec_t& r_b, const Vec_t& dr, const Vec_t& dF) {
+        const auto i = idx[a], j = idx[b];
+        if (vel == nullptr) {
+          calc.spreadLocalStressCached(r_b, dr, i, j, shift[e], dF, type);
+        } else {
+          calc.spreadLocalStressCached(r_b, dr, i, j, shift[e], dF, ((*vel)[i] + (*vel)[j]) * T(0.5), type);
+        }
+        calc.addAtomVirial(i, j, dr, dF);
+      }
+    };
+
+    // NOTE:
+    // Time-averaged per-atom virials (W_i, not divided by any volume), with
+    // the upper triangle only for symmetric storage.
+    void writeAtomVirialAsBinary(std::ostream& fout) const {
+      const bool sym = (storage_ == TensorStorage::SYMMETRIC);
       write_as_lsbfirst(fout, uint32_t(D));
+      write_as_lsbfirst(fout, uint32_t(atom_virial_.size()));
+      write_as_lsbfirst(fout, uint32_t(sym ? D * (D + 1) / 2 : D * D));
+      const Real_t factor = Real_t(1) / num_frames_;
+      for (const auto& w : atom_virial_) {
+        for (int32_t a = 0; a < D; a++) {
+          for (int32_t b = sym ? a : 0; b < D; b++) {
+            const Real_t v = sym ? Real_t(0.5) * (w[a * D + b] + w[b * D + a]) : w[a * D + b];
+            write_as_lsbfirst(fout, double(v * factor));
+          }
+        }
+      }
+    }
+
+    // NOTE: contours between cells c0 and c1 that cannot reach the region of interest.
+    bool rejectContour(const std::array<int32_t, D>& c0, const std::array<int32_t, D>& c1) {
+      if (!roi_ || window_.intersects(c0, c1)) return false;
+      LOCAL_STRESS_STATS(stats_.roi_rejected++);
+      return true;
+    }
+
+    // NOTE:
+    // Weight of a potential contribution under subsampling: 1 / p if it is
+    // kept, 0 if it is dropped. The draw is keyed by (seed, frame, key).
+    T drawSample(const uint64_t key) {
+      closeSample();
+      const uint64_t stream = mix64(sample_seed_ ^ mix64(sample_frame_));
+      const bool accept = counter_uniform(stream, key) < sample_prob_;
+      LOCAL_STRESS_STATS(stats_.sampled++; stats_.accepted += accept);
+      sample_open_ = accept;
+      return accept ? T(1) / sample_prob_ : T(0);
+    }
+
+    // NOTE: position-based calls are keyed by their order in the frame.
+    T sampleWeight(void) {
+      if (sample_prob_ >= T(1)) return T(1);
+      return drawSample(sample_count_++);
+    }
+
+    // NOTE: index-based calls are keyed by the atoms, independent of the call order.
+    template <std::size_t N>
+    T sampleWeight(const int32_t type, const std::array<int32_t, N>& atoms) {
+      if (sample_prob_ >= T(1)) return T(1);
+      uint64_t key = mix64(uint64_t(N) << 32 | uint32_t(type));
+      for (const auto i : atoms) key = mix64(key ^ uint32_t(i));
+      return drawSample(key);
+    }
 
-      const auto box_low = boundary_->low();
+    // NOTE: position-based calls given atom ids are keyed like index-based ones.
+    template <std::size_t N>
+    T sampleWeight(const int32_t type, const int32_t* ids) {
+      if (ids == nullptr) return sampleWeight();
+      std::array<int32_t, N> atoms;
+      std::copy(ids, ids + N, atoms.begin());
+      return sampleWeight(type, atoms);
+    }
+
+    // NOTE:
+    // Unbiased estimate of the variance that dropping contributions adds to
+    // the virial sum: |W / p|^2 (1 - p) per kept sample of virial W.
+    double pendingSampleVariance(void) const {
+      if (!sample_open_) return 0.0;
+      double norm2 = 0.0;
+      for (int32_t e = 0; e < D * D; e++) norm2 += double(sample_virial_[e]) * sample_virial_[e];
+      return norm2 * (1.0 - sample_prob_);
+    }
+
+    void closeSample(void) {
+      if (!sample_open_) return;
+      const auto var = pendingSampleVariance();
+      sampling_var_ += var;
+      LOCAL_STRESS_STATS(stats_.sampling_var += var);
+      sample_virial_ = Tensor<T>(T(0));
+      sample_open_ = false;
+    }
+
+    // NOTE:
+    // The cache is used only for the view given to prepareFrame and for atoms
+    // it covers; other calls take the uncached path (with box checks).
+    bool hasCellCache(const VecArrayView<T>& pos, const int32_t num) const {
+      return (num_cached_ > 0) && (num <= num_cached_) && (*cached_pos_ == pos);
+    }
+
+    template <std::size_t N>
+    bool hasCellCache(const VecArrayView<T>& pos, const int32_t (&ids)[N]) const {
+      if (num_cached_ == 0 || !(*cached_pos_ == pos)) return false;
+      for (const auto i : ids) {
+        if (i < 0 || i >= num_cached_) return false;
+      }
+      return true;
+    }
+
+    std::array<int32_t, D> cachedCell(const int32_t i) const {
+      assert(i < num_cached_);
+      std::array<int32_t, D> c;
+      for (int32_t a = 0; a < D; a++) c[a] = cell_cache_[a][i];
+      return c;
+    }
+
+    // NOTE:
+    // Cell of r_j + dr_ij (the image of atom i closest to atom j)
+    // from the cached cell of atom i and the minimum image shift.
+    std::array<int32_t, D> imageCell(const int32_t i,
+                                     const std::array<int32_t, D>& shift) const {
+      auto c = cachedCell(i);
+      const auto& mdim = boundary_->mesh_dim();
+      for (int32_t a = 0; a < D; a++) c[a] += shift[a] * mdim[a];
+      return c;
+    }
+
+    // NOTE: contour from r_j to r_j + dr_ij, drij already minimum-imaged with shift.
+    void spreadLocalStressCached(const Vec_t& rj, const Vec_t& drij,
+                                 const int32_t i, const int32_t j,
+                                 const std::array<int32_t, D>& shift,
+                                 const Vec_t& dF, const int32_t type) {
+      LOCAL_STRESS_TIMER(stats_, Phase::SPREAD);
+      const auto cj = cachedCell(j), ci = imageCell(i, shift);
+      if (rejectContour(cj, ci)) return;
+      const auto div_ratios = boundary_->getDividedLineRatio(rj, drij, cj, ci);
+      const auto d_virial   = tensor_dot(drij, dF);
+      if (sample_open_) sample_virial_ += d_virial;
+      for (auto it = div_ratios.cbegin(); it != div_ratios.cend(); ++it) {
+        accumulate(type, it->first, d_virial, it->second);
+      }
+    }
+
+    void spreadLocalStressCached(const Vec_t& rj, const Vec_t& drij,
+                                 const int32_t i, const int32_t j,
+                                 const std::array<int32_t, D>& shift,
+                                 const Vec_t& dF, const Vec_t& vij, const int32_t type) {
+      LOCAL_STRESS_TIMER(stats_, Phase::SPREAD);
+      const auto cj = cachedCell(j), ci = imageCell(i, shift);
+      if (rejectContour(cj, ci)) return;
+      const auto div_ratios = boundary_->getDividedLineRatio(rj, drij, cj, ci);
+      const auto d_virial   = tensor_dot(drij, dF);
+      if (sample_open_) sample_virial_ += d_virial;
+      const auto d_heat     = drij * (dF * vij);
+      for (auto it = div_ratios.cbegin(); it != div_ratios.cend(); ++it) {
+        accumulate(type, it->first, d_virial, it->second);
+        accumulateHeat(type, it->first, d_heat, it->second);
+      }
+    }
+
+    void writeHeader(std::ostream& fout) const {
+      writeHeader(fout, number_of_tensor_elem(storage_), interaction_types_.size());
+    }
+
+    void writeHeader(std::ostream& fout, const int32_t num_elem, const uint32_t num_itypes) const {
+      std::array<int32_t, D> lo;
+      lo.fill(0);
+      writeHeader(fout, num_elem, num_itypes, lo, boundary_->mesh_dim());
+    }
+
+    // NOTE: header of the block of dim cells starting at global cell lo.
+    void writeHeader(std::ostream& fout, const int32_t num_elem, const uint32_t num_itypes,
+                     const std::array<int32_t, D>& lo, const std::array<int32_t, D>& dim) const {
+      write_as_lsbfirst(fout, uint32_t(D));
+
+      const auto& mdim = boundary_->mesh_dim();
+      for (int32_t i = 0; i < D; i++) {
+        const auto low = boundary_->is_uniform_axis(i) ? ref_low_[i] + ref_length_[i] * lo[i] / mdim[i]
+          : ref_low_[i] + ref_length_[i] * boundary_->getWallFraction(i, lo[i]);
+        write_as_lsbfirst(fout, double(low));
+      }
       for (int32_t i = 0; i < D; i++) {
-        write_as_lsbfirst(fout, box_low[i]);
+        const auto len = boundary_->is_uniform_axis(i) ? ref_length_[i] * dim[i] / mdim[i]
+          : ref_length_[i] * (boundary_->getWallFraction(i, lo[i] + dim[i]) - boundary_->getWallFraction(i, lo[i]));
+        write_as_lsbfirst(fout, double(len));
       }
-      const auto box_len = boundary_->box_length();
       for (int32_t i = 0; i < D; i++) {
-        write_as_lsbfirst(fout, box_len[i]);
+        write_as_lsbfirst(fout, dim[i]);
       }
-      const auto mdim    = boundary_->mesh_dim();
+      write_as_lsbfirst(fout, uint32_t(num_elem));
+      write_as_lsbfirst(fout, num_itypes);
+    }
+
+    // NOTE: walls of the dim cells starting at global cell lo, per axis (see setBinEdges).
+    void writeBinEdgesAsBinary(std::ostream& fout, const std::array<int32_t, D>& lo,
+                               const std::array<int32_t, D>& dim) const {
+      write_as_lsbfirst(fout, uint32_t(D));
       for (int32_t i = 0; i < D; i++) {
-        write_as_lsbfirst(fout, mdim[i]);
+        write_as_lsbfirst(fout, dim[i]);
+        for (int32_t k = lo[i]; k <= lo[i] + dim[i]; k++) {
+          write_as_lsbfirst(fout, double(ref_low_[i] + ref_length_[i] * boundary_->getWallFraction(i, k)));
+        }
       }
+    }
 
-      const auto num_of_cell = boundary_->number_of_cell();
+    void writeInteractionName(std::ostream& fout, const std::size_t i) const {
+      const auto itype_name_len = uint32_t(interaction_types_[i].length());
+      write_as_lsbfirst(fout, itype_name_len);
+      write_as_lsbfirst(fout, interaction_types_[i]);
+    }
+
+    void writeGridsAsBinary(std::ostream& fout, const std::vector<StressGrid<Acc>>& grids) const {
+      if (!window_.full() && !roi_) {
+        LOCAL_STRESS_ERR("Partial grids should be saved with LSHelpersMPI.");
+      }
+      const auto num_elem    = grids[0].number_of_elem();
+      writeHeader(fout, num_elem, interaction_types_.size(), window_.lo(), window_.dim());
+      const auto num_of_cell = window_.number_of_cell();
       const auto num_itypes  = interaction_types_.size();
-      write_as_lsbfirst(fout, uint32_t(num_itypes));
       for (std::size_t i = 0; i < num_itypes; i++) {
-        const auto itype_name_len = uint32_t(interaction_types_[i].length());
-        write_as_lsbfirst(fout, itype_name_len);
-        write_as_lsbfirst(fout, interaction_types_[i]);
+        writeInteractionName(fout, i);
         for (int32_t j = 0; j < num_of_cell; j++) {
-          for (int axis = 0; axis < D*D; axis++) {
-            write_as_lsbfirst(fout, stress_dist_[i][j][axis]);
+          for (int axis = 0; axis < num_elem; axis++) {
+            write_as_lsbfirst(fout, double(grids[i].elem(axis, j)));
           }
         }
       }
     }
 
+    void writeStressDistAsBinary(std::ostream& fout) const {
+      writeGridsAsBinary(fout, stress_dist_);
+    }
+
   public:
     LSCalculator(Vec_t&& box_low,
                  Vec_t&& box_high,
                  const BoundaryType btype,
                  std::array<int32_t, D>&& dim,
-                 std::vector<std::string>&& itype) {
+                 std::vector<std::string>&& itype,
+                 const TensorStorage storage = TensorStorage::FULL)
+      : LSCalculator(std::move(box_low), std::move(box_high), btype, std::move(dim), std::move(itype),
+                     CellWindow(dim), storage) {}
+
+    // NOTE:
+    // Stores only the cells of window (see setCellWindow) from the start,
+    // so the grids of the whole mesh are never allocated.
+    LSCalculator(Vec_t&& box_low,
+                 Vec_t&& box_high,
+                 const BoundaryType btype,
+                 std::array<int32_t, D>&& dim,
+                 std::vector<std::string>&& itype,
+                 const CellWindow& window,
+                 const TensorStorage storage = TensorStorage::FULL) {
       boundary_ = make_unique<Boundary<T>>(btype, dim);
       boundary_->setBox(box_low, box_high);
+      ref_low_    = boundary_->low();
+      ref_length_ = boundary_->box_length();
+      ref_volume_ = boundary_->box_volume();
       interaction_types_ = itype;
-      stress_dist_.resize(interaction_types_.size());
-      for (auto& sdist : stress_dist_) {
-        sdist = make_unique<Tensor_t[]>(boundary_->number_of_cell());
+      storage_ = storage;
+      if (window.global_dim() != boundary_->mesh_dim()) {
+        LOCAL_STRESS_ERR("Cell window does not match the mesh.");
       }
+      window_ = window;
+      allocateStressDist();
     }
 
     ~LSCalculator(void) {
@@ -99,121 +684,583 @@ namespace LocalStress {
       auto_save_ = false;
     }
 
+    const Boundary<T>& boundary(void) const { return *boundary_; }
+    const StressGrid<Acc>& stress_dist(const int32_t type) const { return stress_dist_[type]; }
+    const StressGrid<Acc>& heat_flux(const int32_t type) const { return heat_flux_[type]; }
+    bool heat_flux_enabled(void) const { return heat_flux_enabled_; }
+    const CellWindow& cell_window(void) const { return window_; }
+
+    // NOTE:
+    // Restricts the stored grids to a sub-block of the mesh. Contributions
+    // outside of it are kept per global cell until they are sent to their
+    // owner (see LSHelpersMPI). Accumulated data is discarded.
+    void setCellWindow(const CellWindow& window) {
+      window_ = window;
+      roi_ = false;
+      allocateStressDist();
+    }
+
+    // NOTE:
+    // Region of interest: only the dim cells starting at cell lo are stored
+    // and saved, and the output header describes that block (its origin,
+    // length and mesh). Contours whose cell bounding boxes miss the region
+    // are rejected before they are split, other contributions outside of it
+    // are discarded. pressure_tot still divides by the whole volume.
+    // Not supported with heat flux or kinetic profiles. Accumulated data is discarded.
+    void setRegionOfInterest(const std::array<int32_t, D>& lo, const std::array<int32_t, D>& dim) {
+      const auto& mdim = boundary_->mesh_dim();
+      for (int32_t a = 0; a < D; a++) {
+        if (dim[a] <= 0 || lo[a] < 0 || lo[a] + dim[a] > mdim[a]) {
+          LOCAL_STRESS_ERR("Region of interest should be inside of the mesh.");
+        }
+      }
+      window_ = CellWindow(mdim, boundary_->is_periodic_axis(), lo, dim, 0);
+      roi_ = !window_.full();
+      allocateStressDist();
+    }
+
+    // NOTE: region of interest of the cells overlapping [low, high) of the initial (orthorhombic) box.
+    void setRegionOfInterest(const Vec_t& low, const Vec_t& high) {
+      if (boundary_->is_triclinic()) {
+        LOCAL_STRESS_ERR("Use cell ranges for regions of interest in triclinic boxes.");
+      }
+      const auto& mdim = boundary_->mesh_dim();
+      std::array<int32_t, D> lo, dim;
+      for (int32_t a = 0; a < D; a++) {
+        const T fl = (low[a] - ref_low_[a]) / ref_length_[a], fh = (high[a] - ref_low_[a]) / ref_length_[a];
+        auto h = boundary_->getCellIndex(a, fh);
+        if (boundary_->getWallFraction(a, h) < fh) h++;
+        const auto l = std::max(boundary_->getCellIndex(a, fl), 0);
+        h = std::min(h, mdim[a]);
+        lo[a]  = l;
+        dim[a] = h - l;
+      }
+      setRegionOfInterest(lo, dim);
+    }
+
+    bool has_region_of_interest(void) const { return roi_; }
+
+    // NOTE:
+    // Non-uniform cells along axis, e.g. fine bins across an interface only.
+    // edges are the mesh_dim[axis] + 1 cell walls in the initial box (along the
+    // box vector of axis for triclinic boxes), strictly increasing from its
+    // low to its high end; an empty vector restores uniform cells. Cells keep
+    // their fractional walls when the box moves. saveLocalStressDist also
+    // writes local_bin_edges.bin with the walls of the saved cells.
+    // Accumulated data is discarded.
+    void setBinEdges(const int32_t axis, const std::vector<T>& edges) {
+      if (axis < 0 || axis >= D) LOCAL_STRESS_ERR("Invalid axis.");
+      std::vector<T> frac(edges.size());
+      const T tol = T(1.0e-6);
+      for (std::size_t k = 0; k < edges.size(); k++) frac[k] = (edges[k] - ref_low_[axis]) / ref_length_[axis];
+      if (!frac.empty()) {
+        if (std::abs(frac.front()) > tol || std::abs(frac.back() - T(1)) > tol) {
+          LOCAL_STRESS_ERR("Bin edges should span the box.");
+        }
+        frac.front() = T(0);
+        frac.back()  = T(1);
+      }
+      boundary_->setBinEdges(axis, frac);
+      num_cached_ = 0;
+      allocateStressDist();
+    }
+
+    // NOTE:
+    // Stochastic subsampling for exploratory runs. Each potential
+    // contribution (one calcLocalStressPot* call) is kept with probability p
+    // and its forces are scaled by 1 / p, so the expected stress field is
+    // unchanged; kinetic contributions are always kept. Draws are
+    // reproducible: index-based calls and position-based calls given atom ids
+    // are keyed by (seed, frame, type, atoms), with or without a cell cache;
+    // other position-based calls by (seed, frame, call order in this
+    // calculator), so give calculators fed by different threads different seeds.
+    // The frame is the global one given by setFrameIndex. The added variance
+    // is estimated by sampling_variance() (and stats().sampling_var).
+    void setSamplingProbability(const T p, const uint64_t seed = 0) {
+      if (!(p > T(0) && p <= T(1))) {
+        LOCAL_STRESS_ERR("Sampling probability should be in (0, 1].");
+      }
+      closeSample();
+      sample_prob_ = p;
+      sample_seed_ = seed;
+    }
+
+    T sampling_probability(void) const { return sample_prob_; }
+
+    // NOTE:
+    // Estimated variance that subsampling added to the accumulated virial
+    // sum (over cells, frames and tensor elements), e.g. for error bars of
+    // pressure_tot. Reset by clear() and summed by the reductions.
+    double sampling_variance(void) const { return sampling_var_ + pendingSampleVariance(); }
+
+    // NOTE:
+    // Global index of the current frame, which keys the subsampling draws.
+    // It defaults to the frames counted by this calculator and advances with
+    // nextStep(). Calculators that see a subset of the frames (workers
+    // reduced with accumulateFrames, shards created mid-run) should be given
+    // the global index, otherwise their draws repeat across frames.
+    void setFrameIndex(const uint64_t frame) {
+      closeSample();
+      sample_frame_ = frame;
+      sample_count_ = 0;
+    }
+
+    // NOTE:
+    // Per-atom virials of atoms 0, ..., num_atoms - 1, accumulated from the
+    // same contributions as the grids. Index-based calls use their atom
+    // indices; position-based calls take optional atom ids (ids[k] is the
+    // atom at rk). The virial dr (x) dF of each (CFD-decomposed) pair goes half
+    // to each atom. saveLocalStressDist also writes local_atom_virial.bin with
+    // the time averages. Accumulated values are discarded.
+    void enableAtomVirial(const int32_t num_atoms) {
+      atom_virial_.assign(num_atoms, Tensor_t(0.0));
+    }
+
+    bool atom_virial_enabled(void) const { return !atom_virial_.empty(); }
+
+    // NOTE: summed over frames.
+    const Tensor_t& atom_virial(const int32_t i) const { return atom_virial_[i]; }
+
+    // NOTE:
+    // Switches to sparse grids whose pages of 2^log2_page_cells cells are
+    // allocated on first touch. Useful for fine meshes of mostly empty boxes.
+    // The output format is unchanged. Accumulated data is discarded.
+    void enableSparseGrid(const int32_t log2_page_cells = 12) {
+      if (log2_page_cells < 0 || log2_page_cells > 30) {
+        LOCAL_STRESS_ERR("log2_page_cells should be in [0, 30].");
+      }
+      log2_page_cells_ = log2_page_cells;
+      allocateStressDist();
+    }
+
+    // NOTE:
+    // Accumulates the Irving-Kirkwood heat flux next to the stress. The
+    // interfaces taking velocities then add dr_ij (F_ij . (v_i + v_j) / 2)
+    // along the same contour segments as the stress, and e_i v_i for the
+    // kinetic (convective) term. Saved as local_heat_flux.bin in the layout
+    // of local_stress.bin with D elements per cell. Not supported with
+    // partial grids. Accumulated data is discarded.
+    void enableHeatFlux(void) {
+      heat_flux_enabled_ = true;
+      allocateStressDist();
+    }
+
+    // NOTE:
+    // Collects per-cell mass, momentum and kinetic energy in the kinetic
+    // pass. nextStep() then subtracts the streaming velocity of each cell
+    // in that frame from the kinetic stress, and accumulates density,
+    // streaming velocity and temperature profiles saved as
+    // local_profiles.bin (elements: density, u_x, ..., temperature).
+    // Calculators created by createOMP share their frames and end them with
+    // LSHelpers::nextStepOMP, which takes the streaming velocity over all of
+    // them; ConcurrentCalculator does the same for its shards. Otherwise all
+    // kinetic contributions of a frame should go to this calculator before
+    // nextStep(). Calculators that saw different frames are reduced with
+    // accumulateFrames. Not supported with partial grids.
+    // Accumulated data is discarded.
+    void enableKineticProfiles(void) {
+      profiles_enabled_ = true;
+      allocateStressDist();
+    }
+
+    // NOTE:
+    // Moves the box for NPT runs. Cells keep their fractional coordinates,
+    // so accumulated grids are untouched, and later contributions are
+    // normalized by the current volume instead of the initial one.
+    // Should be called between frames; the cell cache is invalidated.
+    // The box becomes orthorhombic: tilt factors of an earlier call are reset to zero.
+    void updateBox(const Vec_t& box_low, const Vec_t& box_high) {
+      std::array<T, D * (D - 1) / 2> tilt;
+      tilt.fill(T(0));
+      updateBox(box_low, box_high, tilt);
+    }
+
+    // NOTE:
+    // Triclinic (or Lees-Edwards sheared) box. tilt holds the upper off-diagonal
+    // elements of the h-matrix (xy, xz, yz in 3D) and box_high - box_low its diagonal.
+    void updateBox(const Vec_t& box_low, const Vec_t& box_high,
+                   const std::array<T, D * (D - 1) / 2>& tilt) {
+      boundary_->setTiltFactors(tilt);
+      boundary_->setBox(box_low, box_high);
+      volume_scale_ = ref_volume_ / boundary_->box_volume();
+      num_cached_ = 0;
+    }
+
     LSCalculator(const LSCalculator&) = delete;
     LSCalculator(LSCalculator&&) = delete;
     LSCalculator& operator = (const LSCalculator&) = delete;
     LSCalculator& operator = (LSCalculator&&) = delete;
 
-    void calcLocalStressPot2(Vec_t&& r0,
-                             Vec_t&& r1,
-                             Vec_t&& F0,
-                             Vec_t&& F1,
-                             const int32_t type) {
-      LOCAL_STRESS_UNUSED_VAR(F1);
+    void calcLocalStressPot2(const Vec_t& r0,
+                             const Vec_t& r1,
+                             const Vec_t& F0,
+                             const Vec_t& F1,
+                             const int32_t type, const int32_t* ids = nullptr) {
       if (boundary_->isInBox(r0) &&
           boundary_->isInBox(r1)) {
-        calcLocalStressPot2NoCheck(std::move(r0), std::move(r1),
-                                   std::move(F0), std::move(F1),
-                                   type);
+        calcLocalStressPot2NoCheck(r0, r1, F0, F1, type, ids);
       } else {
         LOCAL_STRESS_ERR("r0 and r1 should be in simulation box.");
       }
     }
 
-    void calcLocalStressPot2NoCheck(Vec_t&& r0, Vec_t&& r1,
-                                    Vec_t&& F0, Vec_t&& F1,
-                                    const int32_t type) {
-      LOCAL_STRESS_UNUSED_VAR(F1);
-      auto dr01 = r0 - r1;
-      boundary_->applyMinimumImage(dr01);
-      spreadLocalStress(r1, dr01, F0, type);
+    void calcLocalStressPot2NoCheck(const Vec_t& r0, const Vec_t& r1,
+                                    const Vec_t& F0, const Vec_t& F1,
+                                    const int32_t type, const int32_t* ids = nullptr) {
+      const T w = sampleWeight<2>(type, ids);
+      if (w == T(0)) return;
+      ContourTarget target {*this, type, ids, nullptr};
+      spreadContours(target, std::array<Vec_t, 2> {{r0, r1}},
+                     std::array<Vec_t, 2> {{F0 * w, F1 * w}});
     }
 
-    void calcLocalStressPot3(Vec_t&& r0, Vec_t&& r1, Vec_t&& r2,
-                             Vec_t&& F0, Vec_t&& F1, Vec_t&& F2,
-                             const int32_t type) {
+    void calcLocalStressPot3(const Vec_t& r0, const Vec_t& r1, const Vec_t& r2,
+                             const Vec_t& F0, const Vec_t& F1, const Vec_t& F2,
+                             const int32_t type, const int32_t* ids = nullptr) {
       if (boundary_->isInBox(r0) &&
           boundary_->isInBox(r1) &&
           boundary_->isInBox(r2)) {
-        calcLocalStressPot3NoCheck(std::move(r0), std::move(r1), std::move(r2),
-                                   std::move(F0), std::move(F1), std::move(F2),
-                                   type);
+        calcLocalStressPot3NoCheck(r0, r1, r2, F0, F1, F2, type, ids);
       } else {
         LOCAL_STRESS_ERR("r0, r1, and r2 should be in simulation box.");
       }
     }
 
-    void calcLocalStressPot3NoCheck(Vec_t&& r0, Vec_t&& r1, Vec_t&& r2,
-                                    Vec_t&& F0, Vec_t&& F1, Vec_t&& F2,
-                                    const int32_t type) {
-      auto dr01 = r0 - r1; boundary_->applyMinimumImage(dr01);
-      auto dr12 = r1 - r2; boundary_->applyMinimumImage(dr12);
-      auto dr20 = r2 - r0; boundary_->applyMinimumImage(dr20);
-      const auto dF = decomposeForce({F0, F1, F2}, {dr01, dr12, dr20});
-      spreadLocalStress(r1, dr01, dF[0], type);
-      spreadLocalStress(r2, dr12, dF[1], type);
-      spreadLocalStress(r0, dr20, dF[2], type);
+    void calcLocalStressPot3NoCheck(const Vec_t& r0, const Vec_t& r1, const Vec_t& r2,
+                                    const Vec_t& F0, const Vec_t& F1, const Vec_t& F2,
+                                    const int32_t type, const int32_t* ids = nullptr) {
+      const T w = sampleWeight<3>(type, ids);
+      if (w == T(0)) return;
+      ContourTarget target {*this, type, ids, nullptr};
+      spreadContours(target, std::array<Vec_t, 3> {{r0, r1, r2}},
+                     std::array<Vec_t, 3> {{F0 * w, F1 * w, F2 * w}});
     }
 
-    void calcLocalStressPot4(Vec_t&& r0, Vec_t&& r1, Vec_t&& r2, Vec_t&& r3,
-                             Vec_t&& F0, Vec_t&& F1, Vec_t&& F2, Vec_t&& F3,
-                             const int32_t type) {
+    void calcLocalStressPot4(const Vec_t& r0, const Vec_t& r1, const Vec_t& r2, const Vec_t& r3,
+                             const Vec_t& F0, const Vec_t& F1, const Vec_t& F2, const Vec_t& F3,
+                             const int32_t type, const int32_t* ids = nullptr) {
       if (boundary_->isInBox(r0) &&
           boundary_->isInBox(r1) &&
           boundary_->isInBox(r2) &&
           boundary_->isInBox(r3)) {
-        calcLocalStressPot4NoCheck(std::move(r0), std::move(r1), std::move(r2), std::move(r3),
-                                   std::move(F0), std::move(F1), std::move(F2), std::move(F3),
-                                   type);
+        calcLocalStressPot4NoCheck(r0, r1, r2, r3, F0, F1, F2, F3, type, ids);
+      } else {
+        LOCAL_STRESS_ERR("r0, r1, r2, and r3 should be in simulation box.");
+      }
+    }
+
+    void calcLocalStressPot4NoCheck(const Vec_t& r0, const Vec_t& r1, const Vec_t& r2, const Vec_t& r3,
+                                    const Vec_t& F0, const Vec_t& F1, const Vec_t& F2, const Vec_t& F3,
+                                    const int32_t type, const int32_t* ids = nullptr) {
+      const T w = sampleWeight<4>(type, ids);
+      if (w == T(0)) return;
+      ContourTarget target {*this, type, ids, nullptr};
+      spreadContours(target, std::array<Vec_t, 4> {{r0, r1, r2, r3}},
+                     std::array<Vec_t, 4> {{F0 * w, F1 * w, F2 * w, F3 * w}});
+    }
+
+    void calcLocalStressKin(const Vec_t& r,
+                            const Vec_t& v,
+                            const T mass,
+                            const int32_t type) {
+      if (boundary_->isInBox(r)) {
+        accumulateKin(type, boundary_->getCellPositionHash(r), v, mass);
+      } else {
+        LOCAL_STRESS_ERR("r should be in simulation box.");
+      }
+    }
+
+    // NOTE:
+    // Adds the per-atom tensor W (e.g. the reciprocal-space virial of
+    // PMEStress) to the cell of r, as the kinetic term does, and to the
+    // per-atom virial of atom id if given.
+    void calcLocalStressAtom(const Vec_t& r, const Tensor<T>& W, const int32_t type,
+                             const int32_t id = -1) {
+      if (boundary_->isInBox(r)) {
+        accumulate(type, boundary_->getCellPositionHash(r), W, T(1));
+        if (id >= 0 && !atom_virial_.empty()) {
+          auto& w = atomVirialOf(id);
+          for (int32_t e = 0; e < D * D; e++) w[e] += Real_t(W[e]);
+        }
+      } else {
+        LOCAL_STRESS_ERR("r should be in simulation box.");
+      }
+    }
+
+    // NOTE:
+    // Same as above, also accumulating the heat flux (see enableHeatFlux).
+    // v0, v1, ... are the velocities of the atoms at r0, r1, ...
+    void calcLocalStressPot2(const Vec_t& r0, const Vec_t& r1,
+                             const Vec_t& v0, const Vec_t& v1,
+                             const Vec_t& F0, const Vec_t& F1,
+                             const int32_t type, const int32_t* ids = nullptr) {
+      if (boundary_->isInBox(r0) &&
+          boundary_->isInBox(r1)) {
+        calcLocalStressPot2NoCheck(r0, r1, v0, v1, F0, F1, type, ids);
+      } else {
+        LOCAL_STRESS_ERR("r0 and r1 should be in simulation box.");
+      }
+    }
+
+    void calcLocalStressPot2NoCheck(const Vec_t& r0, const Vec_t& r1,
+                                    const Vec_t& v0, const Vec_t& v1,
+                                    const Vec_t& F0, const Vec_t& F1,
+                                    const int32_t type, const int32_t* ids = nullptr) {
+      checkHeatFlux();
+      const T w = sampleWeight<2>(type, ids);
+      if (w == T(0)) return;
+      const std::array<Vec_t, 2> v {{v0, v1}};
+      ContourTarget target {*this, type, ids, v.data()};
+      spreadContours(target, std::array<Vec_t, 2> {{r0, r1}},
+                     std::array<Vec_t, 2> {{F0 * w, F1 * w}});
+    }
+
+    void calcLocalStressPot3(const Vec_t& r0, const Vec_t& r1, const Vec_t& r2,
+                             const Vec_t& v0, const Vec_t& v1, const Vec_t& v2,
+                             const Vec_t& F0, const Vec_t& F1, const Vec_t& F2,
+                             const int32_t type, const int32_t* ids = nullptr) {
+      if (boundary_->isInBox(r0) &&
+          boundary_->isInBox(r1) &&
+          boundary_->isInBox(r2)) {
+        calcLocalStressPot3NoCheck(r0, r1, r2, v0, v1, v2, F0, F1, F2, type, ids);
       } else {
         LOCAL_STRESS_ERR("r0, r1, and r2 should be in simulation box.");
       }
     }
 
-    void calcLocalStressPot4NoCheck(Vec_t&& r0, Vec_t&& r1, Vec_t&& r2, Vec_t&& r3,
-                                    Vec_t&& F0, Vec_t&& F1, Vec_t&& F2, Vec_t&& F3,
-                                    const int32_t type) {
-      auto dr01 = r0 - r1; boundary_->applyMinimumImage(dr01);
-      auto dr02 = r0 - r2; boundary_->applyMinimumImage(dr02);
-      auto dr03 = r0 - r3; boundary_->applyMinimumImage(dr03);
-      auto dr12 = r1 - r2; boundary_->applyMinimumImage(dr12);
-      auto dr13 = r1 - r3; boundary_->applyMinimumImage(dr13);
-      auto dr23 = r2 - r3; boundary_->applyMinimumImage(dr23);
-      const auto dF = decomposeForce({F0, F1, F2, F3}, {dr01, dr02, dr03, dr12, dr13, dr23});
-      spreadLocalStress(r1, dr01, dF[0], type);
-      spreadLocalStress(r2, dr02, dF[1], type);
-      spreadLocalStress(r3, dr03, dF[2], type);
-      spreadLocalStress(r2, dr12, dF[3], type);
-      spreadLocalStress(r3, dr13, dF[4], type);
-      spreadLocalStress(r3, dr23, dF[5], type);
-    }
-
-    void calcLocalStressKin(Vec_t&& r,
-                            Vec_t&& v,
+    void calcLocalStressPot3NoCheck(const Vec_t& r0, const Vec_t& r1, const Vec_t& r2,
+                                    const Vec_t& v0, const Vec_t& v1, const Vec_t& v2,
+                                    const Vec_t& F0, const Vec_t& F1, const Vec_t& F2,
+                                    const int32_t type, const int32_t* ids = nullptr) {
+      checkHeatFlux();
+      const T w = sampleWeight<3>(type, ids);
+      if (w == T(0)) return;
+      const std::array<Vec_t, 3> v {{v0, v1, v2}};
+      ContourTarget target {*this, type, ids, v.data()};
+      spreadContours(target, std::array<Vec_t, 3> {{r0, r1, r2}},
+                     std::array<Vec_t, 3> {{F0 * w, F1 * w, F2 * w}});
+    }
+
+    void calcLocalStressPot4(const Vec_t& r0, const Vec_t& r1, const Vec_t& r2, const Vec_t& r3,
+                             const Vec_t& v0, const Vec_t& v1, const Vec_t& v2, const Vec_t& v3,
+                             const Vec_t& F0, const Vec_t& F1, const Vec_t& F2, const Vec_t& F3,
+                             const int32_t type, const int32_t* ids = nullptr) {
+      if (boundary_->isInBox(r0) &&
+          boundary_->isInBox(r1) &&
+          boundary_->isInBox(r2) &&
+          boundary_->isInBox(r3)) {
+        calcLocalStressPot4NoCheck(r0, r1, r2, r3, v0, v1, v2, v3, F0, F1, F2, F3, type, ids);
+      } else {
+        LOCAL_STRESS_ERR("r0, r1, r2, and r3 should be in simulation box.");
+      }
+    }
+
+    void calcLocalStressPot4NoCheck(const Vec_t& r0, const Vec_t& r1, const Vec_t& r2, const Vec_t& r3,
+                                    const Vec_t& v0, const Vec_t& v1, const Vec_t& v2, const Vec_t& v3,
+                                    const Vec_t& F0, const Vec_t& F1, const Vec_t& F2, const Vec_t& F3,
+                                    const int32_t type, const int32_t* ids = nullptr) {
+      checkHeatFlux();
+      const T w = sampleWeight<4>(type, ids);
+      if (w == T(0)) return;
+      const std::array<Vec_t, 4> v {{v0, v1, v2, v3}};
+      ContourTarget target {*this, type, ids, v.data()};
+      spreadContours(target, std::array<Vec_t, 4> {{r0, r1, r2, r3}},
+                     std::array<Vec_t, 4> {{F0 * w, F1 * w, F2 * w, F3 * w}});
+    }
+
+    // NOTE: e_pot is the potential energy assigned to the atom; e = m v^2 / 2 + e_pot.
+    void calcLocalStressKin(const Vec_t& r,
+                            const Vec_t& v,
                             const T mass,
+                            const T e_pot,
                             const int32_t type) {
+      checkHeatFlux();
       if (boundary_->isInBox(r)) {
-        stress_dist_[type][boundary_->getCellPositionHash(r)] += tensor_dot(v, v) * mass;
+        const auto cell = boundary_->getCellPositionHash(r);
+        accumulateKin(type, cell, v, mass);
+        accumulateHeat(type, cell, v, T(0.5) * mass * (v * v) + e_pot);
       } else {
         LOCAL_STRESS_ERR("r should be in simulation box.");
       }
     }
 
-    void nextStep(void) { num_frames_++; }
+    // NOTE:
+    // Computes the cell coordinates of all atoms once per frame and checks
+    // that they are in the box. Until nextStep(), index-based interfaces
+    // called with the same view reuse them and skip per-call box checks.
+    void prepareFrame(const VecArrayView<T>& pos, const int32_t num) {
+      if (!boundary_->getCellPositions(pos, num, cell_cache_)) {
+        LOCAL_STRESS_ERR("All positions should be in simulation box.");
+      }
+      cached_pos_ = make_unique<VecArrayView<T>>(pos);
+      num_cached_ = num;
+    }
+
+    // NOTE:
+    // Index-based interfaces reading atom positions (and velocities)
+    // directly from caller memory through VecArrayView.
+    void calcLocalStressPot2(const VecArrayView<T>& pos,
+                             const int32_t i0, const int32_t i1,
+                             const Vec_t& F0, const Vec_t& F1,
+                             const int32_t type) {
+      const int32_t ids[] = {i0, i1};
+      if (hasCellCache(pos, ids)) {
+        calcLocalStressPot2NoCheck(pos, i0, i1, F0, F1, type);
+      } else {
+        calcLocalStressPot2(pos[i0], pos[i1], F0, F1, type, ids);
+      }
+    }
+
+    void calcLocalStressPot2NoCheck(const VecArrayView<T>& pos,
+                                    const int32_t i0, const int32_t i1,
+                                    const Vec_t& F0, const Vec_t& F1,
+                                    const int32_t type) {
+      const int32_t ids[] = {i0, i1};
+      if (!hasCellCache(pos, ids)) {
+        calcLocalStressPot2NoCheck(pos[i0], pos[i1], F0, F1, type, ids);
+        return;
+      }
+      const T w = sampleWeight(type, std::array<int32_t, 2> {{i0, i1}});
+      if (w == T(0)) return;
+      CachedContourTarget target {*this, type, ids, nullptr, {}};
+      spreadContours(target, std::array<Vec_t, 2> {{pos[i0], pos[i1]}},
+                     std::array<Vec_t, 2> {{F0 * w, F1 * w}});
+    }
+
+    // NOTE: same as above, also accumulating the heat flux with velocities from vel.
+    void calcLocalStressPot2(const VecArrayView<T>& pos, const VecArrayView<T>& vel,
+                             const int32_t i0, const int32_t i1,
+                             const Vec_t& F0, const Vec_t& F1,
+                             const int32_t type) {
+      const int32_t ids[] = {i0, i1};
+      if (hasCellCache(pos, ids)) {
+        calcLocalStressPot2NoCheck(pos, vel, i0, i1, F0, F1, type);
+      } else {
+        calcLocalStressPot2(pos[i0], pos[i1], vel[i0], vel[i1], F0, F1, type, ids);
+      }
+    }
+
+    void calcLocalStressPot2NoCheck(const VecArrayView<T>& pos, const VecArrayView<T>& vel,
+                                    const int32_t i0, const int32_t i1,
+                                    const Vec_t& F0, const Vec_t& F1,
+                                    const int32_t type) {
+      const int32_t ids[] = {i0, i1};
+      if (!hasCellCache(pos, ids)) {
+        calcLocalStressPot2NoCheck(pos[i0], pos[i1], vel[i0], vel[i1], F0, F1, type, ids);
+        return;
+      }
+      checkHeatFlux();
+      const T w = sampleWeight(type, std::array<int32_t, 2> {{i0, i1}});
+      if (w == T(0)) return;
+      CachedContourTarget target {*this, type, ids, &vel, {}};
+      spreadContours(target, std::array<Vec_t, 2> {{pos[i0], pos[i1]}},
+                     std::array<Vec_t, 2> {{F0 * w, F1 * w}});
+    }
+
+    void calcLocalStressPot3(const VecArrayView<T>& pos,
+                             const int32_t i0, const int32_t i1, const int32_t i2,
+                             const Vec_t& F0, const Vec_t& F1, const Vec_t& F2,
+                             const int32_t type) {
+      const int32_t ids[] = {i0, i1, i2};
+      if (hasCellCache(pos, ids)) {
+        calcLocalStressPot3NoCheck(pos, i0, i1, i2, F0, F1, F2, type);
+      } else {
+        calcLocalStressPot3(pos[i0], pos[i1], pos[i2], F0, F1, F2, type, ids);
+      }
+    }
+
+    void calcLocalStressPot3NoCheck(const VecArrayView<T>& pos,
+                                    const int32_t i0, const int32_t i1, const int32_t i2,
+                                    const Vec_t& F0, const Vec_t& F1, const Vec_t& F2,
+                                    const int32_t type) {
+      const int32_t ids[] = {i0, i1, i2};
+      if (!hasCellCache(pos, ids)) {
+        calcLocalStressPot3NoCheck(pos[i0], pos[i1], pos[i2], F0, F1, F2, type, ids);
+        return;
+      }
+      const T w = sampleWeight(type, std::array<int32_t, 3> {{i0, i1, i2}});
+      if (w == T(0)) return;
+      CachedContourTarget target {*this, type, ids, nullptr, {}};
+      spreadContours(target, std::array<Vec_t, 3> {{pos[i0], pos[i1], pos[i2]}},
+                     std::array<Vec_t, 3> {{F0 * w, F1 * w, F2 * w}});
+    }
+
+    void calcLocalStressPot4(const VecArrayView<T>& pos,
+                             const int32_t i0, const int32_t i1, const int32_t i2, const int32_t i3,
+                             const Vec_t& F0, const Vec_t& F1, const Vec_t& F2, const Vec_t& F3,
+                             const int32_t type) {
+      const int32_t ids[] = {i0, i1, i2, i3};
+      if (hasCellCache(pos, ids)) {
+        calcLocalStressPot4NoCheck(pos, i0, i1, i2, i3, F0, F1, F2, F3, type);
+      } else {
+        calcLocalStressPot4(pos[i0], pos[i1], pos[i2], pos[i3], F0, F1, F2, F3, type, ids);
+      }
+    }
+
+    void calcLocalStressPot4NoCheck(const VecArrayView<T>& pos,
+                                    const int32_t i0, const int32_t i1, const int32_t i2, const int32_t i3,
+                                    const Vec_t& F0, const Vec_t& F1, const Vec_t& F2, const Vec_t& F3,
+                                    const int32_t type) {
+      const int32_t ids[] = {i0, i1, i2, i3};
+      if (!hasCellCache(pos, ids)) {
+        calcLocalStressPot4NoCheck(pos[i0], pos[i1], pos[i2], pos[i3], F0, F1, F2, F3, type, ids);
+        return;
+      }
+      const T w = sampleWeight(type, std::array<int32_t, 4> {{i0, i1, i2, i3}});
+      if (w == T(0)) return;
+      CachedContourTarget target {*this, type, ids, nullptr, {}};
+      spreadContours(target, std::array<Vec_t, 4> {{pos[i0], pos[i1], pos[i2], pos[i3]}},
+                     std::array<Vec_t, 4> {{F0 * w, F1 * w, F2 * w, F3 * w}});
+    }
+
+    void calcLocalStressKin(const VecArrayView<T>& pos,
+                            const VecArrayView<T>& vel,
+                            const int32_t num,
+                            const T mass,
+                            const int32_t type) {
+      if (hasCellCache(pos, num)) {
+        for (int32_t i = 0; i < num; i++) {
+          auto cell = cachedCell(i);
+          const auto v = vel[i];
+          accumulateKin(type, boundary_->getCellPositionHash(cell), v, mass);
+        }
+      } else {
+        for (int32_t i = 0; i < num; i++) {
+          calcLocalStressKin(pos[i], vel[i], mass, type);
+        }
+      }
+    }
+
+    void nextStep(void) {
+      if (profiles_enabled_ && !touched_cells_.empty()) {
+        if (shares_frames_) {
+          LOCAL_STRESS_ERR("Kinetic profiles of calculators created by createOMP need LSHelpers::nextStepOMP.");
+        }
+        finishKineticFrame({this});
+      }
+      closeSample();
+      num_frames_++;
+      num_cached_ = 0;
+      sample_count_ = 0;
+      sample_frame_++;
+    }
     void clear(void) {
       num_frames_ = 0;
-      const auto num_of_cell = boundary_->number_of_cell();
-      for (auto& sdist : stress_dist_) {
-        std::for_each(sdist.get(), sdist.get() + num_of_cell,
-                      [](Tensor_t& val) { val.clear(); });
-      }
+      num_cached_ = 0;
+      sample_count_ = 0;
+      sample_frame_ = 0;
+      sample_virial_ = Tensor<T>(T(0));
+      sample_open_ = false;
+      sampling_var_ = 0.0;
+      for (auto& ovf : overflow_) ovf.clear();
+      for (auto& sdist : stress_dist_) sdist.clear();
+      for (auto& hflux : heat_flux_) hflux.clear();
+      std::fill(atom_virial_.begin(), atom_virial_.end(), Tensor_t(0.0));
+      allocateProfiles();
     }
 
     const Tensor_t pressure_tot(const int i) const {
-      const auto num_of_cell = boundary_->number_of_cell();
-      return std::accumulate(stress_dist_[i].get(),
-                             stress_dist_[i].get() + num_of_cell,
-                             Tensor_t(0.0)) / (boundary_->box_volume() * num_frames_);
+      return stress_dist_[i].sum() / (Real_t(ref_volume_) * num_frames_);
     }
 
     const Tensor_t pressure_tot(void) const {
@@ -225,24 +1272,119 @@ namespace LocalStress {
       return psum;
     }
 
+    // NOTE:
+    // Time-averaged profiles of cell c (see enableKineticProfiles).
+    // The temperature is in energy units (k_B = 1). A cell holding n atoms in
+    // a frame has D (n - 1) degrees of freedom after its streaming velocity
+    // is removed, so cells holding a single atom contribute neither thermal
+    // energy nor degrees of freedom.
+    Real_t density(const int32_t c) const {
+      const auto cell_vol = boundary_->is_nonuniform() ? Real_t(ref_volume_ * boundary_->getCellVolumeFraction(c))
+        : Real_t(ref_volume_) / boundary_->number_of_cell();
+      return prof_density_[c] / (cell_vol * num_frames_);
+    }
+
+    const Vec<Real_t> streaming_velocity(const int32_t c) const {
+      Vec<Real_t> u;
+      if (prof_mass_[c] == 0) return u;
+      for (int32_t a = 0; a < D; a++) u[a] = prof_momentum_[c * D + a] / prof_mass_[c];
+      return u;
+    }
+
+    Real_t temperature(const int32_t c) const {
+      return (prof_dof_[c] > 0) ? Real_t(2) * prof_thermal_[c] / prof_dof_[c] : Real_t(0);
+    }
+
+    // NOTE: total heat flux of interaction type i (sum over cells / volume).
+    const Vec<Real_t> heat_flux_tot(const int i) const {
+      return heat_flux_[i].vector_sum() / (Real_t(ref_volume_) * num_frames_);
+    }
+
     void saveLocalStressDist(void) {
       using filesystem::path;
+      LOCAL_STRESS_TIMER(stats_, Phase::SAVE);
       normalizeStress();
-      const std::string fname = (path(save_dir_) / path("local_stress.bin")).filename();
+      const std::string fname = (path(save_dir_) / path("local_stress.bin")).str();
       std::ofstream fout(fname, std::ios::binary);
       writeStressDistAsBinary(fout);
+      LOCAL_STRESS_STATS(if (fout) stats_.bytes_written += fout.tellp());
+      if (profiles_enabled_) {
+        const std::string pname = (path(save_dir_) / path("local_profiles.bin")).str();
+        std::ofstream pout(pname, std::ios::binary);
+        writeProfilesAsBinary(pout);
+        LOCAL_STRESS_STATS(if (pout) stats_.bytes_written += pout.tellp());
+      }
+      if (heat_flux_enabled_) {
+        const std::string hname = (path(save_dir_) / path("local_heat_flux.bin")).str();
+        std::ofstream hout(hname, std::ios::binary);
+        writeGridsAsBinary(hout, heat_flux_);
+        LOCAL_STRESS_STATS(if (hout) stats_.bytes_written += hout.tellp());
+      }
+      if (boundary_->is_nonuniform()) {
+        const std::string ename = (path(save_dir_) / path("local_bin_edges.bin")).str();
+        std::ofstream eout(ename, std::ios::binary);
+        writeBinEdgesAsBinary(eout, window_.lo(), window_.dim());
+        LOCAL_STRESS_STATS(if (eout) stats_.bytes_written += eout.tellp());
+      }
+      if (!atom_virial_.empty()) {
+        const std::string aname = (path(save_dir_) / path("local_atom_virial.bin")).str();
+        std::ofstream aout(aname, std::ios::binary);
+        writeAtomVirialAsBinary(aout);
+        LOCAL_STRESS_STATS(if (aout) stats_.bytes_written += aout.tellp());
+      }
+    }
+
+    // NOTE:
+    // Instrumentation counters of this calculator and its boundary
+    // (empty unless built with -DLOCAL_STRESS_USE_STATS). The save phase
+    // includes normalize. Counters survive clear(); see clearStats().
+    const LSStats stats(void) const {
+      LSStats ret;
+#ifdef LOCAL_STRESS_USE_STATS
+      ret += stats_;
+      ret.sampling_var += pendingSampleVariance();
+      ret += boundary_->stats();
+#endif
+      return ret;
+    }
+
+    void clearStats(void) {
+#ifdef LOCAL_STRESS_USE_STATS
+      stats_ = LSStats();
+      boundary_->clearStats();
+#endif
     }
 
+    void reportStats(std::ostream& os = std::cout) const {
+      stats().report(os);
+    }
+
+    // NOTE:
+    // For calculators that saw the same frames. Their kinetic profiles
+    // cannot be combined when both recorded some, since each subtracted the
+    // streaming velocity of its own share of the atoms; nextStepOMP records
+    // them in one calculator (see enableKineticProfiles).
     friend void accumulateResult(LSCalculator& lsc0,
                                  const LSCalculator& lsc1) {
-      const int num_itypes = lsc0.interaction_types_.size();
-      const int num_of_cell = lsc0.boundary_->number_of_cell();
-      for (int type = 0; type < num_itypes; type++) {
-        for (int at = 0; at < num_of_cell; at++) {
-          lsc0.stress_dist_[type][at] += lsc1.stress_dist_[type][at];
-        }
+      if (lsc0.hasKineticProfiles() && lsc1.hasKineticProfiles()) {
+        LOCAL_STRESS_ERR("Kinetic profiles of calculators sharing frames cannot be reduced.\n"
+                         "Frames of calculators created by createOMP end with LSHelpers::nextStepOMP.");
       }
+      accumulateGrids(lsc0, lsc1);
+      accumulateProfiles(lsc0, lsc1);
     }
+
+    // NOTE: same as accumulateResult for calculators that saw different frames.
+    friend void accumulateFrames(LSCalculator& lsc0,
+                                 const LSCalculator& lsc1) {
+      accumulateGrids(lsc0, lsc1);
+      accumulateProfiles(lsc0, lsc1);
+      lsc0.num_frames_ += lsc1.num_frames_;
+    }
+
+    friend class LSHelpersMPI<T, Acc>;
+    friend class LSHelpers<T, Acc>;
+    friend class CalculatorFactory<T, Acc, void>;
   };
 }
 #endif
@@ -1,40 +1,88 @@
 #if !defined LS_FACTORY_HPP
 #define LS_FACTORY_HPP
 
+#ifdef _OPENMP
+#include <omp.h>
+#endif
+
 namespace LocalStress {
-  template <typename T, class Enable = void>
+  template <typename T, typename Acc = T, class Enable = void>
   class CalculatorFactory;
 
-  template <typename T>
-  class CalculatorFactory<T, typename std::enable_if<std::is_floating_point<T>::value>::type> final {
+  template <typename T, typename Acc>
+  class CalculatorFactory<T, Acc, typename std::enable_if<std::is_floating_point<T>::value>::type> final {
   public:
-    static std::unique_ptr<LSCalculator<T>> create(Vec<T>&& box_low,
+    static std::unique_ptr<LSCalculator<T, Acc>> create(Vec<T>&& box_low,
                                                    Vec<T>&& box_high,
                                                    const BoundaryType btype,
                                                    std::array<int32_t, D>&& dim,
-                                                   std::vector<std::string>&& itype) {
-      return make_unique<LSCalculator<T>>(std::move(box_low), std::move(box_high), btype,
-                                          std::move(dim), std::move(itype));
+                                                   std::vector<std::string>&& itype,
+                                                   const TensorStorage storage = TensorStorage::FULL) {
+      return make_unique<LSCalculator<T, Acc>>(std::move(box_low), std::move(box_high), btype,
+                                          std::move(dim), std::move(itype), storage);
     }
 
-    static std::vector<std::unique_ptr<LSCalculator<T>>> createOMP(const int num_threads,
+    static std::vector<std::unique_ptr<LSCalculator<T, Acc>>> createOMP(const int num_threads,
                                                                    Vec<T>&& box_low,
                                                                    Vec<T>&& box_high,
                                                                    const BoundaryType btype,
                                                                    std::array<int32_t, D>&& dim,
-                                                                   std::vector<std::string>&& itype) {
-      std::vector<std::unique_ptr<LSCalculator<T>>> calculators(num_threads);
+                                                                   std::vector<std::string>&& itype,
+                                                                   const TensorStorage storage = TensorStorage::FULL) {
+      std::vector<std::unique_ptr<LSCalculator<T, Acc>>> calculators(num_threads);
+      auto create_one = [&](const int i) {
+        calculators[i] = make_unique<LSCalculator<T, Acc>>(Vec<T>(box_low), Vec<T>(box_high), btype,
+                                                      std::array<int32_t, D>(dim),
+                                                      std::vector<std::string>(itype), storage);
+      };
+#ifdef _OPENMP
+      // NOTE:
+      // Calculator i is constructed (and its grids first-touched) by OpenMP
+      // thread i, so that the grids live on the NUMA node of the thread
+      // using them. Threads should be pinned (e.g. OMP_PROC_BIND=close).
+#pragma omp parallel num_threads(num_threads)
+      create_one(omp_get_thread_num());
+#endif
+      // without OpenMP, or when fewer threads were given to the region
       for (int i = 0; i < num_threads; i++) {
-        calculators[i] = make_unique<LSCalculator<T>>(std::move(box_low), std::move(box_high), btype,
-                                                      std::move(dim), std::move(itype));
+        if (!calculators[i]) create_one(i);
       }
+      // the calculators split the atoms of each frame (see LSHelpers::nextStepOMP)
+      for (auto& calc : calculators) calc->shares_frames_ = (num_threads > 1);
       return calculators;
     }
 
-    // TODO: support MPI version based on LAMMPS impl
-    // static std::unique_ptr<LSCalculator<T>> createMPI(const int num_procs,
-    //                                                             ) {
-    // }
+#ifdef LOCAL_STRESS_USE_MPI
+    // NOTE:
+    // Each rank of comm stores only its block of a proc_dim process grid
+    // plus halo cells. halo should cover the interaction range in cells;
+    // contributions beyond it are still routed to their owners, only less
+    // efficiently. Results are saved with LSHelpersMPI::saveLocalStressDistMPI.
+    static std::unique_ptr<LSCalculator<T, Acc>> createMPI(MPI_Comm comm,
+                                                           const std::array<int32_t, D>& proc_dim,
+                                                           const int32_t halo,
+                                                           Vec<T>&& box_low,
+                                                           Vec<T>&& box_high,
+                                                           const BoundaryType btype,
+                                                           std::array<int32_t, D>&& dim,
+                                                           std::vector<std::string>&& itype,
+                                                           const TensorStorage storage = TensorStorage::FULL) {
+      int rank = 0, num_procs = 0;
+      MPI_Comm_rank(comm, &rank);
+      MPI_Comm_size(comm, &num_procs);
+      if (std::accumulate(proc_dim.cbegin(), proc_dim.cend(), 1, std::multiplies<int32_t>()) != num_procs) {
+        LOCAL_STRESS_ERR("proc_dim does not match the number of processes.");
+      }
+      // the window is known before the calculator, which allocates its block only
+      const Boundary<T> bnd(btype, dim);
+      const auto window = LSHelpersMPI<T, Acc>::decompose(rank, proc_dim, bnd.mesh_dim(),
+                                                          bnd.is_periodic_axis(), halo);
+      auto calc = make_unique<LSCalculator<T, Acc>>(std::move(box_low), std::move(box_high), btype,
+                                                    std::move(dim), std::move(itype), window, storage);
+      calc->disableAutoSave();
+      return calc;
+    }
+#endif
   };
 }
 
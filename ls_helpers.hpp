@@ -1,32 +1,87 @@
 #if !defined LS_HELPERS_HPP
 #define LS_HELPERS_HPP
 
+#ifdef __linux__
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
 namespace LocalStress {
   enum {
     ROOT_CALCULATOR = 0,
   };
 
-  template <typename T>
+  template <typename T, typename Acc = T>
   class LSHelpers final {
-    static void accumulateRootCalculator(std::vector<std::unique_ptr<LSCalculator<T>>>& calculators) {
+    // NOTE: NUMA node of the CPU running the calling thread (0 if unknown).
+    static int currentNumaNode(void) {
+#if defined(__linux__) && defined(SYS_getcpu)
+      unsigned cpu = 0, node = 0;
+      if (syscall(SYS_getcpu, &cpu, &node, nullptr) == 0) return int(node);
+#endif
+      return 0;
+    }
+
+    // NOTE:
+    // Reduces all calculators into ROOT_CALCULATOR with reduce(dst, src).
+    // With OpenMP, calculator i is assumed to live on the node of thread i
+    // (see createOMP): the calculators of each node are first reduced into the
+    // one of its lowest thread by that thread, then these partial sums into
+    // the root, so that only one grid per node crosses the interconnect.
+    template <class Reduce>
+    static void reduceIntoRoot(std::vector<std::unique_ptr<LSCalculator<T, Acc>>>& calculators,
+                               Reduce reduce) {
       const int num_calculators = calculators.size();
+      // leader[i]: calculator that calculator i is reduced into before the root
+      std::vector<int> leader(num_calculators);
+      for (int i = 0; i < num_calculators; i++) leader[i] = i;
+#ifdef _OPENMP
+      std::vector<int> node(num_calculators);
+#pragma omp parallel num_threads(num_calculators)
+      if (omp_get_num_threads() == num_calculators) {
+        const int tid = omp_get_thread_num();
+        node[tid] = currentNumaNode();
+#pragma omp barrier
+        for (int j = 0; j < tid; j++) {
+          if (node[j] == node[tid]) { leader[tid] = j; break; }
+        }
+#pragma omp barrier
+        for (int i = tid + 1; i < num_calculators; i++) {
+          if (leader[i] == tid) reduce(*calculators[tid], *calculators[i]);
+        }
+      }
+#endif
       for (int i = 0; i < num_calculators; i++) {
-        if (i != ROOT_CALCULATOR) {
-          accumulateResult(*calculators[ROOT_CALCULATOR], *calculators[i]);
+        if (i != ROOT_CALCULATOR && leader[i] == i) {
+          reduce(*calculators[ROOT_CALCULATOR], *calculators[i]);
         }
       }
     }
 
+    static void accumulateRootCalculator(std::vector<std::unique_ptr<LSCalculator<T, Acc>>>& calculators) {
+      reduceIntoRoot(calculators, [](LSCalculator<T, Acc>& dst, const LSCalculator<T, Acc>& src) {
+          accumulateResult(dst, src);
+        });
+    }
+
   public:
-    static void showPressureTotalOMP(std::vector<std::unique_ptr<LSCalculator<T>>>& calculators) {
-      Tensor<T> p_tot(0.0);
+    static void showPressureTotalOMP(std::vector<std::unique_ptr<LSCalculator<T, Acc>>>& calculators) {
+      Tensor<typename AccumulatorTraits<Acc>::value_type> p_tot(0.0);
       for (const auto& calc : calculators) {
         p_tot += calc->pressure_tot();
       }
       std::cout << "pressure total = " << p_tot.trace() / 3.0 << std::endl;
     }
 
-    static void saveLocalStressDistOMP(std::vector<std::unique_ptr<LSCalculator<T>>>& calculators) {
+    // NOTE: merged instrumentation counters of all calculators (see LSCalculator::stats).
+    static void reportStatsOMP(const std::vector<std::unique_ptr<LSCalculator<T, Acc>>>& calculators,
+                               std::ostream& os = std::cout) {
+      LSStats stats;
+      for (const auto& calc : calculators) stats += calc->stats();
+      stats.report(os);
+    }
+
+    static void saveLocalStressDistOMP(std::vector<std::unique_ptr<LSCalculator<T, Acc>>>& calculators) {
       accumulateRootCalculator(calculators);
       calculators[ROOT_CALCULATOR]->saveLocalStressDist();
       for (auto& calc : calculators) {
@@ -34,7 +89,40 @@ namespace LocalStress {
       }
     }
 
-    static void clearLSCalculatorsOMP(std::vector<std::unique_ptr<LSCalculator<T>>>& calculators) {
+    // NOTE: for workers that processed disjoint sets of frames.
+    static void saveLocalStressDistFrames(std::vector<std::unique_ptr<LSCalculator<T, Acc>>>& calculators) {
+      reduceIntoRoot(calculators, [](LSCalculator<T, Acc>& dst, const LSCalculator<T, Acc>& src) {
+          accumulateFrames(dst, src);
+        });
+      calculators[ROOT_CALCULATOR]->saveLocalStressDist();
+      for (auto& calc : calculators) {
+        calc->disableAutoSave();
+      }
+    }
+
+    // NOTE:
+    // Ends the frame of calculators that shared it. With kinetic profiles,
+    // the streaming velocity of each cell is taken over all calculators
+    // before their nextStep(), and the profiles go to ROOT_CALCULATOR.
+    static void nextStepOMP(std::vector<std::unique_ptr<LSCalculator<T, Acc>>>& calculators) {
+      if (calculators[ROOT_CALCULATOR]->profiles_enabled_) {
+        std::vector<LSCalculator<T, Acc>*> calcs;
+        for (auto& calc : calculators) calcs.push_back(calc.get());
+        LSCalculator<T, Acc>::finishKineticFrame(calcs);
+      }
+      for (auto& calc : calculators) {
+        calc->nextStep();
+      }
+    }
+
+    static void updateBoxOMP(std::vector<std::unique_ptr<LSCalculator<T, Acc>>>& calculators,
+                             const Vec<T>& box_low, const Vec<T>& box_high) {
+      for (auto& calc : calculators) {
+        calc->updateBox(box_low, box_high);
+      }
+    }
+
+    static void clearLSCalculatorsOMP(std::vector<std::unique_ptr<LSCalculator<T, Acc>>>& calculators) {
       for (auto& calc : calculators) {
         calc->clear();
       }
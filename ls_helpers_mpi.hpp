@@ -0,0 +1,247 @@
+#if !defined LS_HELPERS_MPI_HPP
+#define LS_HELPERS_MPI_HPP
+
+#include <sstream>
+
+namespace LocalStress {
+  // NOTE:
+  // Helpers for calculators created by CalculatorFactory::createMPI.
+  // Each rank stores only its owned cells plus a halo (see CellWindow).
+  // reduceMPI sends halo cells and out-of-window contributions to their
+  // owners in one batched exchange; saveLocalStressDistMPI writes the
+  // owned cells of every rank into local_stress.bin with MPI-IO.
+  template <typename T, typename Acc = T>
+  class LSHelpersMPI final {
+    typedef LSCalculator<T, Acc> Calc_t;
+    typedef typename AccumulatorTraits<Acc>::value_type Real_t;
+
+    // NOTE: record = {type, global cell, D * D tensor elements}
+    static constexpr int32_t record_size = 2 + D * D;
+
+    // maps global cells to owner ranks from the owned blocks of all ranks.
+    class OwnerMap final {
+      std::array<std::vector<int32_t>, D> axis_lo_;
+      std::vector<int32_t> rank_of_;
+      std::array<int32_t, D> global_dim_;
+
+    public:
+      OwnerMap(const CellWindow& window, MPI_Comm comm) : global_dim_(window.global_dim()) {
+        int num_procs = 0;
+        MPI_Comm_size(comm, &num_procs);
+        const auto& own_lo = window.own_lo();
+        std::vector<int32_t> all_lo(num_procs * D);
+        MPI_Allgather(own_lo.data(), D, MPI_INT32_T, all_lo.data(), D, MPI_INT32_T, comm);
+
+        int32_t num_blocks = 1;
+        for (int32_t a = 0; a < D; a++) {
+          auto& lo = axis_lo_[a];
+          for (int p = 0; p < num_procs; p++) lo.push_back(all_lo[p * D + a]);
+          std::sort(lo.begin(), lo.end());
+          lo.erase(std::unique(lo.begin(), lo.end()), lo.end());
+          num_blocks *= lo.size();
+        }
+        if (num_blocks != num_procs) {
+          LOCAL_STRESS_ERR("Owned blocks should form a regular process grid.");
+        }
+        rank_of_.resize(num_procs);
+        for (int p = 0; p < num_procs; p++) {
+          std::array<int32_t, D> idx;
+          for (int32_t a = 0; a < D; a++) idx[a] = all_lo[p * D + a];
+          rank_of_[blockHash(idx)] = p;
+        }
+      }
+
+      int32_t blockHash(const std::array<int32_t, D>& idx) const {
+        int32_t hash = 0, mul = 1;
+        for (int32_t a = 0; a < D; a++) {
+          const auto& lo = axis_lo_[a];
+          const int32_t c = std::upper_bound(lo.cbegin(), lo.cend(), idx[a]) - lo.cbegin() - 1;
+          hash += c * mul;
+          mul  *= lo.size();
+        }
+        return hash;
+      }
+
+      int32_t owner(int32_t cell) const {
+        std::array<int32_t, D> idx;
+        for (int32_t a = 0; a < D; a++) {
+          idx[a] = cell % global_dim_[a];
+          cell  /= global_dim_[a];
+        }
+        return rank_of_[blockHash(idx)];
+      }
+    };
+
+    static void packRecord(std::vector<double>& buf, const int32_t type,
+                           const int32_t cell, const Tensor<Real_t>& val) {
+      buf.push_back(type);
+      buf.push_back(cell);
+      for (int32_t e = 0; e < D * D; e++) buf.push_back(val[e]);
+    }
+
+    static bool isZero(const Tensor<Real_t>& val) {
+      for (int32_t e = 0; e < D * D; e++) {
+        if (val[e] != Real_t(0)) return false;
+      }
+      return true;
+    }
+
+  public:
+    // NOTE:
+    // Regular block decomposition of the mesh over proc_dim ranks.
+    // rank = c[X] + proc_dim[X] * (c[Y] + proc_dim[Y] * c[Z]).
+    static CellWindow decompose(const int rank,
+                                const std::array<int32_t, D>& proc_dim,
+                                const std::array<int32_t, D>& mesh_dim,
+                                const std::array<bool, D>& is_periodic_axis,
+                                const int32_t halo) {
+      std::array<int32_t, D> own_lo, own_dim;
+      int32_t rest = rank;
+      for (int32_t a = 0; a < D; a++) {
+        const int32_t c = rest % proc_dim[a];
+        rest /= proc_dim[a];
+        if (proc_dim[a] > mesh_dim[a]) {
+          LOCAL_STRESS_ERR("Number of processes along an axis exceeds mesh dimension.");
+        }
+        own_lo[a]  = c * mesh_dim[a] / proc_dim[a];
+        own_dim[a] = (c + 1) * mesh_dim[a] / proc_dim[a] - own_lo[a];
+      }
+      return CellWindow(mesh_dim, is_periodic_axis, own_lo, own_dim, halo);
+    }
+
+    static void reduceMPI(Calc_t& calc, MPI_Comm comm) {
+      int num_procs = 0;
+      MPI_Comm_size(comm, &num_procs);
+      const auto& window = calc.window_;
+      const OwnerMap owner_map(window, comm);
+
+      std::vector<std::vector<double>> send(num_procs);
+      const int32_t num_itypes = calc.interaction_types_.size();
+      const int32_t num_local  = window.number_of_cell();
+      for (int32_t type = 0; type < num_itypes; type++) {
+        auto& grid = calc.stress_dist_[type];
+        for (int32_t local = 0; local < num_local; local++) {
+          if (window.isOwned(local) || !grid.isAllocated(local)) continue;
+          const auto val = grid[local];
+          if (isZero(val)) continue;
+          const auto cell = window.toGlobal(local);
+          packRecord(send[owner_map.owner(cell)], type, cell, val);
+          grid.clear(local);
+        }
+        for (const auto& ovf : calc.overflow_[type]) {
+          packRecord(send[owner_map.owner(ovf.first)], type, ovf.first, ovf.second);
+        }
+        calc.overflow_[type].clear();
+      }
+
+      std::vector<int> send_cnt(num_procs), recv_cnt(num_procs);
+      std::vector<int> send_dsp(num_procs, 0), recv_dsp(num_procs, 0);
+      std::vector<double> send_buf;
+      for (int p = 0; p < num_procs; p++) {
+        send_cnt[p] = send[p].size();
+        send_dsp[p] = send_buf.size();
+        send_buf.insert(send_buf.end(), send[p].cbegin(), send[p].cend());
+      }
+      MPI_Alltoall(send_cnt.data(), 1, MPI_INT, recv_cnt.data(), 1, MPI_INT, comm);
+      for (int p = 1; p < num_procs; p++) recv_dsp[p] = recv_dsp[p - 1] + recv_cnt[p - 1];
+      std::vector<double> recv_buf(recv_dsp.back() + recv_cnt.back());
+      MPI_Alltoallv(send_buf.data(), send_cnt.data(), send_dsp.data(), MPI_DOUBLE,
+                    recv_buf.data(), recv_cnt.data(), recv_dsp.data(), MPI_DOUBLE, comm);
+
+      for (std::size_t i = 0; i < recv_buf.size(); i += record_size) {
+        const auto type  = int32_t(recv_buf[i]);
+        const auto local = window.toLocal(int32_t(recv_buf[i + 1]));
+        assert((local >= 0) && window.isOwned(local));
+        Tensor<double> val;
+        for (int32_t e = 0; e < D * D; e++) val[e] = recv_buf[i + 2 + e];
+        calc.stress_dist_[type].add(local, val);
+      }
+    }
+
+    static void saveLocalStressDistMPI(Calc_t& calc, MPI_Comm comm) {
+      using filesystem::path;
+      reduceMPI(calc, comm);
+      calc.normalizeStress();
+      calc.disableAutoSave();
+
+      int rank = 0;
+      MPI_Comm_rank(comm, &rank);
+      const auto& window = calc.window_;
+      const int32_t num_elem   = number_of_tensor_elem(calc.storage_);
+      const int32_t num_itypes = calc.interaction_types_.size();
+      const MPI_Offset block_size = MPI_Offset(calc.boundary_->number_of_cell()) * num_elem * sizeof(double);
+
+      std::ostringstream header;
+      calc.writeHeader(header);
+      std::vector<MPI_Offset> data_offset(num_itypes);
+      std::vector<std::string> names(num_itypes);
+      MPI_Offset offset = header.str().size();
+      for (int32_t i = 0; i < num_itypes; i++) {
+        std::ostringstream name;
+        calc.writeInteractionName(name, i);
+        names[i] = name.str();
+        data_offset[i] = offset + names[i].size();
+        offset = data_offset[i] + block_size;
+      }
+
+      const std::string fname = (path(calc.save_dir_) / path("local_stress.bin")).str();
+      MPI_File fh;
+      MPI_File_open(comm, const_cast<char*>(fname.c_str()),
+                    MPI_MODE_CREATE | MPI_MODE_WRONLY, MPI_INFO_NULL, &fh);
+      MPI_File_set_size(fh, 0);
+      if (rank == 0) {
+        MPI_File_write_at(fh, 0, const_cast<char*>(header.str().data()),
+                          header.str().size(), MPI_CHAR, MPI_STATUS_IGNORE);
+        for (int32_t i = 0; i < num_itypes; i++) {
+          MPI_File_write_at(fh, data_offset[i] - names[i].size(), const_cast<char*>(names[i].data()),
+                            names[i].size(), MPI_CHAR, MPI_STATUS_IGNORE);
+        }
+      }
+
+      // owned block of cells, axes reversed to C order (X fastest).
+      MPI_Datatype cell_t, block_t;
+      MPI_Type_contiguous(num_elem, MPI_DOUBLE, &cell_t);
+      MPI_Type_commit(&cell_t);
+      int sizes[D], subsizes[D], starts[D];
+      for (int32_t a = 0; a < D; a++) {
+        sizes[D - 1 - a]    = window.global_dim()[a];
+        subsizes[D - 1 - a] = window.own_dim()[a];
+        starts[D - 1 - a]   = window.own_lo()[a];
+      }
+      MPI_Type_create_subarray(D, sizes, subsizes, starts, MPI_ORDER_C, cell_t, &block_t);
+      MPI_Type_commit(&block_t);
+
+      const int32_t num_local = window.number_of_cell();
+      std::vector<int32_t> owned;
+      for (int32_t local = 0; local < num_local; local++) {
+        if (window.isOwned(local)) owned.push_back(local);
+      }
+      std::vector<double> buf(owned.size() * num_elem);
+      for (int32_t i = 0; i < num_itypes; i++) {
+        const auto& grid = calc.stress_dist_[i];
+        for (std::size_t j = 0; j < owned.size(); j++) {
+          for (int32_t e = 0; e < num_elem; e++) {
+            const auto dat = conv2_lsb_first_if_needed(double(grid.elem(e, owned[j])));
+            std::memcpy(&buf[j * num_elem + e], &dat, sizeof(double));
+          }
+        }
+        MPI_File_set_view(fh, data_offset[i], cell_t, block_t,
+                          const_cast<char*>("native"), MPI_INFO_NULL);
+        MPI_File_write_all(fh, buf.data(), owned.size(), cell_t, MPI_STATUS_IGNORE);
+      }
+
+      MPI_Type_free(&block_t);
+      MPI_Type_free(&cell_t);
+      MPI_File_close(&fh);
+
+      if (rank == 0 && calc.boundary_->is_nonuniform()) {
+        std::array<int32_t, D> lo;
+        lo.fill(0);
+        const std::string ename = (path(calc.save_dir_) / path("local_bin_edges.bin")).str();
+        std::ofstream eout(ename, std::ios::binary);
+        calc.writeBinEdgesAsBinary(eout, lo, calc.boundary_->mesh_dim());
+      }
+    }
+  };
+}
+#endif
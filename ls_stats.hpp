@@ -0,0 +1,143 @@
+#if !defined LS_STATS_HPP
+#define LS_STATS_HPP
+
+#include <array>
+#include <chrono>
+#include <iomanip>
+
+// NOTE:
+// Hot path instrumentation, compiled in with -DLOCAL_STRESS_USE_STATS.
+// Without it the macros below expand to nothing and calculators store no counters.
+#ifdef LOCAL_STRESS_USE_STATS
+#define LOCAL_STRESS_STATS(stmt) stmt
+#define LOCAL_STRESS_TIMER(stats, phase)                                \
+  const LocalStress::PhaseTimer LOCAL_STRESS_CONCAT(ls_phase_timer_, __LINE__)((stats), (phase))
+#else
+#define LOCAL_STRESS_STATS(stmt)
+#define LOCAL_STRESS_TIMER(stats, phase)
+#endif
+
+namespace LocalStress {
+  enum class Phase : int32_t {
+    DECOMPOSE = 0,
+    SPREAD,
+    NORMALIZE,
+    SAVE,
+    NUM_PHASES,
+  };
+
+  // NOTE:
+  // Counters of one calculator (i.e. one thread). Contours are the straight
+  // lines along which pair forces are spread; their extent is the largest
+  // number of cell widths they span along one axis (in fractional space for
+  // triclinic boxes). Histogram bins are unit wide, the last one collects the rest.
+  struct LSStats {
+    static constexpr int32_t num_bins = 17;
+    static constexpr int32_t num_phases = int32_t(Phase::NUM_PHASES);
+    typedef std::array<int64_t, num_bins> Histogram;
+
+    int64_t contours = 0, segments = 0, same_cell = 0;
+    int64_t cfd3 = 0, cfd4 = 0, bytes_written = 0, roi_rejected = 0;
+    // subsampled potential contributions and the variance added to the
+    // virial sum (squared Frobenius norm) by dropping them, estimated online
+    int64_t sampled = 0, accepted = 0;
+    double sampling_var = 0.0;
+    Histogram segments_hist {}, extent_hist {};
+    std::array<int64_t, num_phases> phase_ns {}, phase_calls {};
+
+    static int32_t bin(const double x) {
+      return (x < num_bins - 1) ? int32_t(x) : num_bins - 1;
+    }
+
+    void addContour(const int32_t num_segments, const double extent) {
+      contours++;
+      segments += num_segments;
+      if (num_segments == 1) same_cell++;
+      segments_hist[bin(num_segments)]++;
+      extent_hist[bin(extent)]++;
+    }
+
+    void addPhase(const Phase phase, const int64_t ns) {
+      phase_ns[int32_t(phase)] += ns;
+      phase_calls[int32_t(phase)]++;
+    }
+
+    LSStats& operator += (const LSStats& rhs) {
+      contours += rhs.contours;
+      segments += rhs.segments;
+      same_cell += rhs.same_cell;
+      cfd3 += rhs.cfd3;
+      cfd4 += rhs.cfd4;
+      bytes_written += rhs.bytes_written;
+      roi_rejected += rhs.roi_rejected;
+      sampled += rhs.sampled;
+      accepted += rhs.accepted;
+      sampling_var += rhs.sampling_var;
+      for (int32_t i = 0; i < num_bins; i++) {
+        segments_hist[i] += rhs.segments_hist[i];
+        extent_hist[i] += rhs.extent_hist[i];
+      }
+      for (int32_t i = 0; i < num_phases; i++) {
+        phase_ns[i] += rhs.phase_ns[i];
+        phase_calls[i] += rhs.phase_calls[i];
+      }
+      return *this;
+    }
+
+    void report(std::ostream& os) const {
+#ifndef LOCAL_STRESS_USE_STATS
+      os << "LSCMD stats: disabled (build with -DLOCAL_STRESS_USE_STATS)\n";
+#else
+      const auto ratio = [](const int64_t a, const int64_t b) { return (b > 0) ? double(a) / b : 0.0; };
+      os << "LSCMD stats\n"
+         << "  contours            " << contours << "\n"
+         << "  segments / contour  " << ratio(segments, contours) << "\n"
+         << "  same-cell contours  " << 100.0 * ratio(same_cell, contours) << " %\n"
+         << "  CFD solves          " << cfd3 << " (3-body), " << cfd4 << " (4-body)\n"
+         << "  bytes written       " << bytes_written << "\n"
+         << "  rejected by ROI     " << roi_rejected << "\n"
+         << "  sampled / accepted  " << sampled << " / " << accepted << "\n"
+         << "  sampling variance   " << sampling_var << "\n";
+      static const char* names[num_phases] = {"decompose", "spread", "normalize", "save"};
+      os << "  phase          calls     total [ms]   mean [us]\n";
+      for (int32_t i = 0; i < num_phases; i++) {
+        os << "  " << std::left << std::setw(10) << names[i] << std::right
+           << std::setw(10) << phase_calls[i]
+           << std::setw(15) << phase_ns[i] * 1e-6
+           << std::setw(12) << ratio(phase_ns[i], phase_calls[i]) * 1e-3 << "\n";
+      }
+      const auto hist = [&os](const char* name, const Histogram& h) {
+        os << "  " << name << "\n   ";
+        for (int32_t i = 0; i < num_bins; i++) {
+          if (h[i] == 0) continue;
+          os << " " << i << ((i == num_bins - 1) ? "+" : "") << ":" << h[i];
+        }
+        os << "\n";
+      };
+      hist("segments per contour", segments_hist);
+      hist("contour extent in cells", extent_hist);
+#endif
+    }
+  };
+
+  // NOTE: adds the lifetime of the object to a phase of stats.
+  class PhaseTimer final {
+    typedef std::chrono::steady_clock Clock;
+    LSStats& stats_;
+    const Phase phase_;
+    const Clock::time_point start_;
+
+  public:
+    PhaseTimer(LSStats& stats, const Phase phase)
+      : stats_(stats), phase_(phase), start_(Clock::now()) {}
+
+    ~PhaseTimer(void) {
+      const auto ns = std::chrono::duration_cast<std::chrono::nanoseconds>(Clock::now() - start_).count();
+      stats_.addPhase(phase_, ns);
+    }
+
+    PhaseTimer(const PhaseTimer&) = delete;
+    PhaseTimer& operator = (const PhaseTimer&) = delete;
+  };
+}
+#endif
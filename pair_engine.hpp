@@ -0,0 +1,244 @@
+#if !defined PAIR_ENGINE_HPP
+#define PAIR_ENGINE_HPP
+
+#include <vector>
+
+#ifdef _OPENMP
+#include <omp.h>
+#endif
+
+namespace LocalStress {
+  // NOTE:
+  // Tabulated central pair forces for num_types atom types.
+  // Values of F(r) / r are stored on a uniform grid of r^2 in [0, r_cut^2]
+  // and interpolated linearly, so that no square root is needed.
+  // F(r) = -dU/dr, i.e. positive for repulsion.
+  template <typename T, class Enable = void>
+  class PairTable;
+
+  template <typename T>
+  class PairTable<T, typename std::enable_if<std::is_floating_point<T>::value>::type> final {
+    int32_t num_types_, num_bins_;
+    T r_cut_, r_cut2_, dr2_, idr2_;
+    std::vector<T> table_;
+
+    int32_t pairIndex(const int32_t ti, const int32_t tj) const {
+      return ti * num_types_ + tj;
+    }
+
+  public:
+    PairTable(const int32_t num_types, const T r_cut, const int32_t num_bins = 4096)
+      : num_types_(num_types), num_bins_(num_bins), r_cut_(r_cut), r_cut2_(r_cut * r_cut),
+        dr2_(r_cut2_ / num_bins), idr2_(num_bins / r_cut2_),
+        table_(std::size_t(num_types * num_types) * (num_bins + 1), T(0)) {}
+
+    int32_t number_of_types(void) const { return num_types_; }
+    T r_cut(void) const { return r_cut_; }
+
+    // NOTE: force(r) returns F(r). Bin 0 (r = 0) takes the value of bin 1.
+    template <class Func>
+    void setForce(const int32_t ti, const int32_t tj, Func force) {
+      std::vector<T> f_over_r(num_bins_ + 1);
+      for (int32_t k = 1; k <= num_bins_; k++) {
+        const T r = std::sqrt(k * dr2_);
+        f_over_r[k] = force(r) / r;
+      }
+      f_over_r[0] = f_over_r[1];
+      setForceOverR(ti, tj, f_over_r);
+    }
+
+    // NOTE: f_over_r[k] is F(r) / r at r^2 = k * r_cut^2 / num_bins (k = 0, ..., num_bins).
+    void setForceOverR(const int32_t ti, const int32_t tj, const std::vector<T>& f_over_r) {
+      if (int32_t(f_over_r.size()) != num_bins_ + 1) {
+        LOCAL_STRESS_ERR("Table size should be num_bins + 1.");
+      }
+      std::copy(f_over_r.cbegin(), f_over_r.cend(),
+                table_.begin() + std::size_t(pairIndex(ti, tj)) * (num_bins_ + 1));
+      std::copy(f_over_r.cbegin(), f_over_r.cend(),
+                table_.begin() + std::size_t(pairIndex(tj, ti)) * (num_bins_ + 1));
+    }
+
+    // NOTE: zero at and beyond r_cut.
+    T forceOverR(const int32_t ti, const int32_t tj, const T r2) const {
+      if (r2 >= r_cut2_) return T(0);
+      const T x = r2 * idr2_;
+      // x may round up to num_bins_ just below the cutoff
+      const auto k = std::min(int32_t(x), num_bins_ - 1);
+      const T* f = &table_[std::size_t(pairIndex(ti, tj)) * (num_bins_ + 1) + k];
+      return f[0] + (f[1] - f[0]) * (x - k);
+    }
+  };
+
+  // NOTE:
+  // Cell-list pair loop feeding central pair forces of a PairTable into
+  // interaction type itype of LSCalculator. The cell list uses cells no
+  // thinner than r_cut in fractional space of the calculator's box (so that
+  // triclinic boxes work too) and visits every pair once through a half shell
+  // of neighbour cells. Positions should be inside of the box.
+  template <typename T, typename Acc = T, class Enable = void>
+  class PairEngine;
+
+  template <typename T, typename Acc>
+  class PairEngine<T, Acc, typename std::enable_if<std::is_floating_point<T>::value>::type> final {
+    typedef Vec<T> Vec_t;
+    typedef LSCalculator<T, Acc> Calc_t;
+
+    PairTable<T> table_;
+    int32_t itype_;
+
+    std::unique_ptr<Boundary<T>> cells_;
+    std::array<std::vector<int32_t>, D> cell_pos_;
+    std::vector<int32_t> cell_start_, cell_atoms_;
+    std::vector<std::array<int32_t, D>> shell_;
+
+    // NOTE: distance between opposite faces of the box along axis a.
+    static T boxHeight(const Boundary<T>& box, const int32_t a) {
+      T g2 = 0;
+      for (int32_t b = 0; b < D; b++) {
+        Vec_t e;
+        e[b] = T(1);
+        const T g = box.toFractional(e)[a];
+        g2 += g * g;
+      }
+      return T(1) / std::sqrt(g2);
+    }
+
+    void buildCellList(const Boundary<T>& box, const VecArrayView<T>& pos, const int32_t num) {
+      std::array<int32_t, D> dim;
+      std::array<bool, D> single;
+      const auto& periodic = box.is_periodic_axis();
+      for (int32_t a = 0; a < D; a++) {
+        const T height = boxHeight(box, a);
+        if (periodic[a] && (table_.r_cut() * 2 > height)) {
+          LOCAL_STRESS_ERR("r_cut should be shorter than half of the box.");
+        }
+        dim[a] = std::max(int32_t(height / table_.r_cut()), 1);
+        // with less than 3 periodic cells, neighbours would be visited twice
+        if (periodic[a] && dim[a] < 3) dim[a] = 1;
+        single[a] = (dim[a] == 1);
+      }
+
+      cells_ = make_unique<Boundary<T>>(box.boundary_type(), dim);
+      cells_->setBox(box.low(), box.high());
+      cells_->setTiltFactors(box.tilt_factors());
+      if (!cells_->getCellPositions(pos, num, cell_pos_)) {
+        LOCAL_STRESS_ERR("All positions should be in simulation box.");
+      }
+
+      // counting sort of atoms into cells
+      const int32_t num_cell = cells_->number_of_cell();
+      cell_start_.assign(num_cell + 1, 0);
+      std::vector<int32_t> hash(num);
+      for (int32_t i = 0; i < num; i++) {
+        std::array<int32_t, D> c;
+        for (int32_t a = 0; a < D; a++) c[a] = cell_pos_[a][i];
+        hash[i] = cells_->getCellPositionHash(c);
+        cell_start_[hash[i] + 1]++;
+      }
+      for (int32_t c = 0; c < num_cell; c++) cell_start_[c + 1] += cell_start_[c];
+      cell_atoms_.resize(num);
+      std::vector<int32_t> fill(cell_start_.cbegin(), cell_start_.cend() - 1);
+      for (int32_t i = 0; i < num; i++) cell_atoms_[fill[hash[i]]++] = i;
+
+      // neighbour offsets whose last non-zero component is positive
+      shell_.clear();
+      int32_t num_offsets = 1;
+      for (int32_t a = 0; a < D; a++) num_offsets *= 3;
+      for (int32_t k = 0; k < num_offsets; k++) {
+        std::array<int32_t, D> off;
+        int32_t rest = k, last = 0;
+        bool valid = true;
+        for (int32_t a = 0; a < D; a++) {
+          off[a] = rest % 3 - 1;
+          rest /= 3;
+          valid &= !(single[a] && off[a] != 0);
+          if (off[a] != 0) last = off[a];
+        }
+        if (valid && last > 0) shell_.push_back(off);
+      }
+    }
+
+    void calcPair(Calc_t& calc, const Boundary<T>& box,
+                  const VecArrayView<T>& pos, const int32_t* types,
+                  const int32_t i, const int32_t j) const {
+      auto dr = pos[i] - pos[j];
+      box.applyMinimumImage(dr);
+      const T f = table_.forceOverR(types[i], types[j], dr * dr);
+      if (f == T(0)) return;
+      const auto F = dr * f;
+      calc.calcLocalStressPot2NoCheck(pos, i, j, F, -F, itype_);
+    }
+
+    void calcCell(Calc_t& calc, const Boundary<T>& box,
+                  const VecArrayView<T>& pos, const int32_t* types,
+                  const int32_t c) const {
+      const auto& mdim = cells_->mesh_dim();
+      const auto& periodic = cells_->is_periodic_axis();
+      std::array<int32_t, D> coord;
+      for (int32_t a = 0, rest = c; a < D; a++) {
+        coord[a] = rest % mdim[a];
+        rest /= mdim[a];
+      }
+
+      for (int32_t ia = cell_start_[c]; ia < cell_start_[c + 1]; ia++) {
+        for (int32_t ja = ia + 1; ja < cell_start_[c + 1]; ja++) {
+          calcPair(calc, box, pos, types, cell_atoms_[ia], cell_atoms_[ja]);
+        }
+      }
+
+      for (const auto& off : shell_) {
+        std::array<int32_t, D> nc;
+        bool inside = true;
+        for (int32_t a = 0; a < D; a++) {
+          nc[a] = coord[a] + off[a];
+          if (!periodic[a]) inside &= (nc[a] >= 0) && (nc[a] < mdim[a]);
+        }
+        if (!inside) continue;
+        const auto n = cells_->getCellPositionHash(nc);
+        for (int32_t ia = cell_start_[c]; ia < cell_start_[c + 1]; ia++) {
+          for (int32_t ja = cell_start_[n]; ja < cell_start_[n + 1]; ja++) {
+            calcPair(calc, box, pos, types, cell_atoms_[ia], cell_atoms_[ja]);
+          }
+        }
+      }
+    }
+
+  public:
+    PairEngine(const PairTable<T>& table, const int32_t itype)
+      : table_(table), itype_(itype) {}
+
+    const PairTable<T>& table(void) const { return table_; }
+
+    // NOTE: types[i] is the atom type of atom i in the PairTable.
+    void compute(Calc_t& calc, const VecArrayView<T>& pos,
+                 const int32_t* types, const int32_t num) {
+      const auto& box = calc.boundary();
+      buildCellList(box, pos, num);
+      calc.prepareFrame(pos, num);
+      const int32_t num_cell = cells_->number_of_cell();
+      for (int32_t c = 0; c < num_cell; c++) calcCell(calc, box, pos, types, c);
+    }
+
+    // NOTE:
+    // Same as above with one calculator per OpenMP thread (see createOMP),
+    // i.e. calcs.size() threads. Without OpenMP only calcs[0] is used.
+    void compute(std::vector<std::unique_ptr<Calc_t>>& calcs, const VecArrayView<T>& pos,
+                 const int32_t* types, const int32_t num) {
+      const auto& box = calcs[0]->boundary();
+      buildCellList(box, pos, num);
+      for (auto& calc : calcs) calc->prepareFrame(pos, num);
+      const int32_t num_cell = cells_->number_of_cell();
+#ifdef _OPENMP
+#pragma omp parallel num_threads(int(calcs.size()))
+      {
+        auto& calc = *calcs[omp_get_thread_num()];
+#pragma omp for schedule(dynamic, 4)
+        for (int32_t c = 0; c < num_cell; c++) calcCell(calc, box, pos, types, c);
+      }
+#else
+      for (int32_t c = 0; c < num_cell; c++) calcCell(*calcs[0], box, pos, types, c);
+#endif
+    }
+  };
+}
+#endif
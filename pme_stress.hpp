@@ -0,0 +1,228 @@
+#if !defined PME_STRESS_HPP
+#define PME_STRESS_HPP
+
+#include <complex>
+#include <vector>
+
+#include "fft.hpp"
+
+namespace LocalStress {
+  // NOTE:
+  // Reciprocal-space part of the Coulomb local stress with smooth particle
+  // mesh Ewald (Essmann et al., J. Chem. Phys. 103, 8577 (1995)).
+  // Charges are spread onto a PME grid with cardinal B-splines of order
+  // order, and the k-space virial W_ab = (1 / 2 pi V) sum_{m != 0}
+  // exp(-pi^2 m^2 / beta^2) / m^2 |S(m)|^2 (d_ab - 2 (1 + pi^2 m^2 / beta^2) m_a m_b / m^2)
+  // is split into per-atom parts q_i phi_ab(r_i) / 2, where phi_ab is the
+  // matching tensor potential interpolated from the grid (six extra FFTs).
+  // Each part is added to the cell of its atom in interaction type itype of
+  // LSCalculator, like a kinetic contribution, so the cells sum up to W.
+  // The real-space part (erfc(beta r) / r) goes through the pair interfaces,
+  // e.g. PairEngine. The cost is O(N order^3 + K log K) for K grid points.
+  //
+  // beta is the Ewald splitting parameter (1 / length), coulomb the Coulomb
+  // constant of the unit system; the system should be neutral, and the box
+  // periodic along all axes (triclinic boxes are supported).
+  template <typename T, typename Acc = T, class Enable = void>
+  class PMEStress;
+
+  template <typename T, typename Acc>
+  class PMEStress<T, Acc, typename std::enable_if<std::is_floating_point<T>::value>::type> final {
+    typedef Vec<T> Vec_t;
+    typedef LSCalculator<T, Acc> Calc_t;
+    typedef std::complex<T> Complex;
+
+    // xx, yy, zz, xy, xz, yz
+    static constexpr int32_t num_comps = 6;
+
+    std::array<int32_t, D> grid_;
+    T beta_, coulomb_;
+    int32_t order_, itype_;
+    FFT3D<T> fft_;
+    // 1 / |b(m)|^2 of the Euler exponential splines along each axis
+    std::array<std::vector<T>, D> bsp_mod_;
+    std::vector<Complex> charge_;
+    std::array<std::vector<Complex>, num_comps> potential_;
+    // per-atom first grid point and spline weights along each axis
+    std::vector<int32_t> first_;
+    std::vector<T> theta_;
+    T energy_ = 0;
+    Tensor<T> virial_ = Tensor<T>(T(0));
+
+    // NOTE: weights M_n(w + n - 1 - j), j = 0, ..., n - 1, for 0 <= w < 1.
+    static void fillSpline(const T w, const int32_t n, T* theta) {
+      theta[n - 1] = 0;
+      theta[1] = w;
+      theta[0] = 1 - w;
+      for (int32_t k = 3; k <= n; k++) {
+        const T div = T(1) / (k - 1);
+        theta[k - 1] = div * w * theta[k - 2];
+        for (int32_t j = 1; j <= k - 2; j++) {
+          theta[k - j - 1] = div * ((w + j) * theta[k - j - 2] + (k - j - w) * theta[k - j - 1]);
+        }
+        theta[0] = div * (1 - w) * theta[0];
+      }
+    }
+
+    void calcSplineModuli(void) {
+      std::vector<T> m(order_);
+      fillSpline(T(0), order_, m.data());
+      const T pi = std::acos(T(-1));
+      for (int32_t a = 0; a < D; a++) {
+        const int32_t K = grid_[a];
+        auto& mod = bsp_mod_[a];
+        mod.resize(K);
+        for (int32_t i = 0; i < K; i++) {
+          Complex sum(0);
+          // M_n(k + 1) = m[n - 2 - k]
+          for (int32_t k = 0; k <= order_ - 2; k++) {
+            sum += m[order_ - 2 - k] * std::polar(T(1), 2 * pi * i * k / K);
+          }
+          mod[i] = std::norm(sum);
+        }
+        // odd orders vanish at the Nyquist frequency; take the mean of the neighbours
+        for (int32_t i = 0; i < K; i++) {
+          if (mod[i] < T(1.0e-7)) mod[i] = T(0.5) * (mod[(i + K - 1) % K] + mod[(i + 1) % K]);
+        }
+      }
+    }
+
+    int32_t gridIndex(const int32_t i, const int32_t j, const int32_t k) const {
+      return i + grid_[0] * (j + grid_[1] * k);
+    }
+
+    void spreadCharges(const Boundary<T>& box, const VecArrayView<T>& pos,
+                       const T* charges, const int32_t num) {
+      first_.resize(std::size_t(num) * D);
+      theta_.resize(std::size_t(num) * D * order_);
+      std::fill(charge_.begin(), charge_.end(), Complex(0));
+      for (int32_t n = 0; n < num; n++) {
+        const auto frac = box.toFractional(pos[n] - box.low());
+        for (int32_t a = 0; a < D; a++) {
+          T u = frac[a] * grid_[a];
+          u -= std::floor(u / grid_[a]) * grid_[a];
+          const auto i0 = std::min(int32_t(u), grid_[a] - 1);
+          first_[n * D + a] = i0 - order_ + 1 + grid_[a];
+          fillSpline(u - i0, order_, &theta_[(std::size_t(n) * D + a) * order_]);
+        }
+        forEachPoint(n, [&](const int32_t g, const T w) { charge_[g] += charges[n] * w; });
+      }
+    }
+
+    // NOTE: calls f(grid index, weight) for the order^3 grid points of atom n.
+    template <class Func>
+    void forEachPoint(const int32_t n, Func f) const {
+      const T* tx = &theta_[(std::size_t(n) * D + 0) * order_];
+      const T* ty = &theta_[(std::size_t(n) * D + 1) * order_];
+      const T* tz = &theta_[(std::size_t(n) * D + 2) * order_];
+      for (int32_t z = 0; z < order_; z++) {
+        const int32_t k = (first_[n * D + 2] + z) % grid_[2];
+        for (int32_t y = 0; y < order_; y++) {
+          const int32_t j = (first_[n * D + 1] + y) % grid_[1];
+          const T wyz = ty[y] * tz[z];
+          for (int32_t x = 0; x < order_; x++) {
+            const int32_t i = (first_[n * D + 0] + x) % grid_[0];
+            f(gridIndex(i, j, k), tx[x] * wyz);
+          }
+        }
+      }
+    }
+
+    // NOTE: convolutions of the transformed charges with the virial kernel.
+    void solve(const Boundary<T>& box) {
+      const T pi = std::acos(T(-1));
+      const T volume = box.box_volume();
+      const T pre = coulomb_ / (pi * volume);
+      // rows of the inverse box matrix, i.e. reciprocal vectors without 2 pi
+      std::array<Vec_t, D> recip;
+      for (int32_t b = 0; b < D; b++) {
+        Vec_t e;
+        e[b] = T(1);
+        const auto f = box.toFractional(e);
+        for (int32_t a = 0; a < D; a++) recip[a][b] = f[a];
+      }
+
+      fft_.forward(charge_);
+      energy_ = 0;
+      virial_ = Tensor<T>(T(0));
+      for (int32_t k = 0; k < grid_[2]; k++) {
+        const int32_t mz = (k <= grid_[2] / 2) ? k : k - grid_[2];
+        for (int32_t j = 0; j < grid_[1]; j++) {
+          const int32_t my = (j <= grid_[1] / 2) ? j : j - grid_[1];
+          for (int32_t i = 0; i < grid_[0]; i++) {
+            const int32_t mx = (i <= grid_[0] / 2) ? i : i - grid_[0];
+            const int32_t g = gridIndex(i, j, k);
+            if (mx == 0 && my == 0 && mz == 0) {
+              for (auto& p : potential_) p[g] = Complex(0);
+              continue;
+            }
+            const Vec_t m = recip[0] * T(mx) + recip[1] * T(my) + recip[2] * T(mz);
+            const T m2 = m * m;
+            const T x = pi * pi * m2 / (beta_ * beta_);
+            const T G = pre * std::exp(-x) / (m2 * bsp_mod_[0][i] * bsp_mod_[1][j] * bsp_mod_[2][k]);
+            const T fac = 2 * (1 + x) / m2;
+            const std::array<T, num_comps> kernel {{
+                G * (1 - fac * m[0] * m[0]), G * (1 - fac * m[1] * m[1]), G * (1 - fac * m[2] * m[2]),
+                -G * fac * m[0] * m[1], -G * fac * m[0] * m[2], -G * fac * m[1] * m[2]}};
+            const auto q = charge_[g];
+            const T q2 = std::norm(q);
+            energy_ += T(0.5) * G * q2;
+            for (int32_t c = 0; c < num_comps; c++) potential_[c][g] = kernel[c] * q;
+            virial_.xx += T(0.5) * kernel[0] * q2;
+            virial_.yy += T(0.5) * kernel[1] * q2;
+            virial_.zz += T(0.5) * kernel[2] * q2;
+            virial_.xy += T(0.5) * kernel[3] * q2;
+            virial_.xz += T(0.5) * kernel[4] * q2;
+            virial_.yz += T(0.5) * kernel[5] * q2;
+          }
+        }
+      }
+      virial_.yx = virial_.xy;
+      virial_.zx = virial_.xz;
+      virial_.zy = virial_.yz;
+      for (auto& p : potential_) fft_.backward(p);
+    }
+
+  public:
+    PMEStress(const std::array<int32_t, D>& grid, const T beta, const int32_t order,
+              const int32_t itype, const T coulomb = T(1))
+      : grid_(grid), beta_(beta), coulomb_(coulomb), order_(order), itype_(itype), fft_(grid) {
+      if (order < 3) {
+        LOCAL_STRESS_ERR("PME order should be 3 or more.");
+      }
+      for (int32_t a = 0; a < D; a++) {
+        if (grid[a] < order) LOCAL_STRESS_ERR("PME grid should have at least order points per axis.");
+      }
+      calcSplineModuli();
+      charge_.resize(fft_.size());
+      for (auto& p : potential_) p.resize(fft_.size());
+    }
+
+    // NOTE: reciprocal-space energy and virial of the last compute().
+    T energy(void) const { return energy_; }
+    const Tensor<T>& virial(void) const { return virial_; }
+
+    // NOTE: charges[i] is the charge of atom i; positions should be inside of the box.
+    void compute(Calc_t& calc, const VecArrayView<T>& pos, const T* charges, const int32_t num) {
+      const auto& box = calc.boundary();
+      for (int32_t a = 0; a < D; a++) {
+        if (!box.is_periodic_axis()[a]) LOCAL_STRESS_ERR("PME needs a box periodic along all axes.");
+      }
+      spreadCharges(box, pos, charges, num);
+      solve(box);
+
+      for (int32_t n = 0; n < num; n++) {
+        std::array<T, num_comps> phi {};
+        forEachPoint(n, [&](const int32_t g, const T w) {
+            for (int32_t c = 0; c < num_comps; c++) phi[c] += w * potential_[c][g].real();
+          });
+        const T h = T(0.5) * charges[n];
+        const Tensor<T> w_atom(h * phi[0], h * phi[3], h * phi[4],
+                               h * phi[3], h * phi[1], h * phi[5],
+                               h * phi[4], h * phi[5], h * phi[2]);
+        calc.calcLocalStressAtom(pos[n], w_atom, itype_, n);
+      }
+    }
+  };
+}
+#endif
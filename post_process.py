@@ -12,6 +12,17 @@ class StressBinParser:
     def __init__(self, input_dir):
         self.input_dir = input_dir
 
+    def expand_symmetric(self, virial_raw):
+        # symmetric output stores the upper triangle (xx, xy, xz, yy, yz, zz).
+        if self.num_elem == self.sim_dim * self.sim_dim:
+            return virial_raw
+        upper = [(i, j) for i in range(self.sim_dim) for j in range(i, self.sim_dim)]
+        full = np.zeros((virial_raw.shape[0], self.sim_dim * self.sim_dim))
+        for (e, (i, j)) in enumerate(upper):
+            full[:, i * self.sim_dim + j] = virial_raw[:, e]
+            full[:, j * self.sim_dim + i] = virial_raw[:, e]
+        return full
+
     def read_bindata(self):
         fname = os.path.join(self.input_dir, "local_stress.bin")
         if not os.path.exists(fname):
@@ -25,8 +36,9 @@ class StressBinParser:
             self.box_len = unpack_from(vec_format, f.read(self.sim_dim * sizeof(c_double)))
             self.mesh_dim = unpack_from('<' + 'i' * self.sim_dim,
                                         f.read(self.sim_dim * sizeof(c_int32)))
+            self.num_elem = int(unpack_from('<I', f.read(sizeof(c_uint32)))[0])
             self.num_itypes = int(unpack_from('<I', f.read(sizeof(c_uint32)))[0])
-            number_of_cells = reduce(lambda x, y: x*y, self.mesh_dim)
+            number_of_cells = int(np.prod(self.mesh_dim))
 
             tot_virial = np.zeros((number_of_cells, self.sim_dim*self.sim_dim))
             self.virial = {}
@@ -34,51 +46,202 @@ class StressBinParser:
                 itype_name_len = int(unpack_from('<I',
                                                  f.read(sizeof(c_uint32)))[0])
                 itype = unpack_from('<' + str(itype_name_len) + 's',
-                                          f.read(sizeof(c_char) * (itype_name_len)))[0]
-                tensor_dim = self.sim_dim * self.sim_dim
-                tot_elem = number_of_cells * tensor_dim
+                                          f.read(sizeof(c_char) * (itype_name_len)))[0].decode()
+                tot_elem = number_of_cells * self.num_elem
                 virial_raw = np.fromfile(f, dtype='<d', count=tot_elem)
                 virial_raw = np.reshape(virial_raw,
-                                        (virial_raw.size / tensor_dim, tensor_dim))
+                                        (virial_raw.size // self.num_elem, self.num_elem))
+                virial_raw = self.expand_symmetric(virial_raw)
                 tot_virial   += virial_raw
                 self.virial[itype] = virial_raw
             self.virial["total"] = tot_virial
 
 
-def save_stress(sbparser):
-    mdim = sbparser.mesh_dim
+class ShellBinParser(StressBinParser):
+    shell_axes = {0: ["r", "t", "p"], 1: ["r", "p", "z"]}
+
+    def read_bindata(self):
+        fname = os.path.join(self.input_dir, "local_stress_shell.bin")
+        with open(fname, "rb") as f:
+            self.sim_dim = int(unpack_from('<I', f.read(sizeof(c_uint32)))[0])
+            self.shell_type = int(unpack_from('<I', f.read(sizeof(c_uint32)))[0])
+            self.shell_width = unpack_from('<d', f.read(sizeof(c_double)))[0]
+            self.num_shell = int(unpack_from('<i', f.read(sizeof(c_int32)))[0])
+            self.shell_vol = np.array(unpack_from('<' + 'd' * self.num_shell,
+                                                  f.read(self.num_shell * sizeof(c_double))))
+            self.num_elem = int(unpack_from('<I', f.read(sizeof(c_uint32)))[0])
+            self.num_itypes = int(unpack_from('<I', f.read(sizeof(c_uint32)))[0])
+
+            tot_virial = np.zeros((self.num_shell, self.sim_dim*self.sim_dim))
+            self.virial = {}
+            for i in range(self.num_itypes):
+                itype_name_len = int(unpack_from('<I',
+                                                 f.read(sizeof(c_uint32)))[0])
+                itype = unpack_from('<' + str(itype_name_len) + 's',
+                                    f.read(sizeof(c_char) * (itype_name_len)))[0].decode()
+                virial_raw = np.fromfile(f, dtype='<d', count=self.num_shell * self.num_elem)
+                virial_raw = np.reshape(virial_raw, (self.num_shell, self.num_elem))
+                virial_raw = self.expand_symmetric(virial_raw)
+                tot_virial += virial_raw
+                self.virial[itype] = virial_raw
+            self.virial["total"] = tot_virial
+
+
+class FieldBinParser(StressBinParser):
+    # local_heat_flux.bin and local_profiles.bin have the layout of local_stress.bin
+    # with num_elem values per cell.
+    def __init__(self, input_dir, bin_name):
+        StressBinParser.__init__(self, input_dir)
+        self.bin_name = bin_name
 
-    cell_len = [l / d for (l, d) in zip(sbparser.box_len, mdim)]
-    cell_vol = reduce(lambda x,y: x*y, cell_len)
-    number_of_cells = reduce(lambda x, y: x*y, mdim)
+    def read_bindata(self):
+        fname = os.path.join(self.input_dir, self.bin_name)
+        with open(fname, "rb") as f:
+            self.sim_dim = int(unpack_from('<I', f.read(sizeof(c_uint32)))[0])
+            vec_format = '<' + 'd' * self.sim_dim
+            self.box_low = unpack_from(vec_format, f.read(self.sim_dim * sizeof(c_double)))
+            self.box_len = unpack_from(vec_format, f.read(self.sim_dim * sizeof(c_double)))
+            self.mesh_dim = unpack_from('<' + 'i' * self.sim_dim,
+                                        f.read(self.sim_dim * sizeof(c_int32)))
+            self.num_elem = int(unpack_from('<I', f.read(sizeof(c_uint32)))[0])
+            self.num_itypes = int(unpack_from('<I', f.read(sizeof(c_uint32)))[0])
+            number_of_cells = int(np.prod(self.mesh_dim))
+
+            self.field = {}
+            tot_field = np.zeros((number_of_cells, self.num_elem))
+            for i in range(self.num_itypes):
+                itype_name_len = int(unpack_from('<I',
+                                                 f.read(sizeof(c_uint32)))[0])
+                itype = unpack_from('<' + str(itype_name_len) + 's',
+                                    f.read(sizeof(c_char) * (itype_name_len)))[0].decode()
+                field = np.fromfile(f, dtype='<d', count=number_of_cells * self.num_elem)
+                field = np.reshape(field, (number_of_cells, self.num_elem))
+                tot_field += field
+                self.field[itype] = field
+            if self.num_itypes > 1:
+                self.field["total"] = tot_field
+
+
+class AtomVirialBinParser(StressBinParser):
+    # local_atom_virial.bin: dimension, number of atoms, values per atom,
+    # then the time-averaged virial of each atom.
+    def read_bindata(self):
+        fname = os.path.join(self.input_dir, "local_atom_virial.bin")
+        with open(fname, "rb") as f:
+            (self.sim_dim, self.num_atoms, self.num_elem) = unpack_from('<III', f.read(3 * sizeof(c_uint32)))
+            virial_raw = np.fromfile(f, dtype='<d', count=self.num_atoms * self.num_elem)
+            self.virial = self.expand_symmetric(np.reshape(virial_raw, (self.num_atoms, self.num_elem)))
+
+
+def cell_geometry(parser):
+    # absolute cell centers (the header origin is that of the region of
+    # interest, if any) and volumes; walls come from local_bin_edges.bin when
+    # some axes have non-uniform cells, otherwise from the header.
+    mdim = parser.mesh_dim
+    fname = os.path.join(parser.input_dir, "local_bin_edges.bin")
+    if os.path.exists(fname):
+        walls = []
+        with open(fname, "rb") as f:
+            sim_dim = int(unpack_from('<I', f.read(sizeof(c_uint32)))[0])
+            for a in range(sim_dim):
+                num = int(unpack_from('<i', f.read(sizeof(c_int32)))[0])
+                walls.append(np.fromfile(f, dtype='<d', count=num + 1))
+    else:
+        walls = [low + np.arange(d + 1) * (l / d)
+                 for (low, l, d) in zip(parser.box_low, parser.box_len, mdim)]
+    idx = np.arange(int(np.prod(mdim)))
+    coords = [idx % mdim[0], (idx // mdim[0]) % mdim[1]]
+    if parser.sim_dim == 3:
+        coords.append(idx // (mdim[0] * mdim[1]))
+    centers = [0.5 * (w[1:] + w[:-1]) for w in walls]
+    widths = [w[1:] - w[:-1] for w in walls]
+    cell_pos = np.array([centers[a][c] for (a, c) in enumerate(coords)]).T
+    cell_vol = np.prod([widths[a][c] for (a, c) in enumerate(coords)], axis=0)
+    return (cell_pos, cell_vol)
+
+
+def save_atom_virial(avparser):
+    axes = ["x", "y", "z"][:avparser.sim_dim]
+    description = np.array(["#id"] + ["W" + a + b for a in axes for b in axes])
+    description.shape = (1, len(description))
+    out_path = os.path.join(avparser.input_dir, "atom_virial.txt")
+    np.savetxt(out_path, description, fmt="%s", delimiter="\t")
+    ids = np.arange(avparser.num_atoms, dtype=float)[:, np.newaxis]
+    with open(out_path, 'a') as f:
+        np.savetxt(f, np.hstack((ids, avparser.virial)), delimiter=" ")
+
+
+def save_field(fparser, suffix, columns, per_volume):
+    (cell_pos, cell_vol) = cell_geometry(fparser)
+    if not per_volume:
+        cell_vol = np.ones_like(cell_vol)
+    axes = ["X", "Y", "Z"][:fparser.sim_dim]
+    description = np.array(["#" + axes[0]] + axes[1:] + columns)
+    description.shape = (1, len(description))
+    for (name, field) in fparser.field.items():
+        out_path = os.path.join(fparser.input_dir, name + suffix)
+        np.savetxt(out_path, description, fmt="%s", delimiter="\t")
+        with open(out_path, 'a') as f:
+            np.savetxt(f, np.hstack((cell_pos, field / cell_vol[:, np.newaxis])), delimiter=" ")
+
+
+def save_shell_stress(sbparser):
+    axes = sbparser.shell_axes[sbparser.shell_type]
+    description = np.array(["#R"] + ["s" + a + b for a in axes for b in axes])
+    description.shape = (1, len(description))
+    radius = (np.arange(sbparser.num_shell) + 0.5) * sbparser.shell_width
+    for (name, vir) in sbparser.virial.items():
+        out_path = os.path.join(sbparser.input_dir, name + "_shell.txt")
+        np.savetxt(out_path, description, fmt="%s", delimiter="\t")
+        stress = vir / sbparser.shell_vol[:, np.newaxis]
+        with open(out_path, 'a') as f:
+            np.savetxt(f, np.hstack((radius[:, np.newaxis], stress)), delimiter=" ")
+
+
+def save_stress(sbparser):
+    (cell_pos, cell_vol) = cell_geometry(sbparser)
     if sbparser.sim_dim == 3:
-        cell_pos = np.array(map(lambda x: [x % mdim[0], (x / mdim[0]) % mdim[1], x / (mdim[0] * mdim[1])],
-                            range(number_of_cells)), dtype=np.float)
         description = np.array(["#X", "Y", "Z",
                                 "sxx", "sxy", "sxz",
                                 "syx", "syy", "syz",
                                 "szx", "szy", "szz"])
         description.shape = (1, 12)
     else:
-        cell_pos = np.array(map(lambda x: [x % mdim[0], (x / mdim[0]) % mdim[1]],
-                            range(number_of_cells)), dtype=np.float)
         description = np.array(["#X", "Y",
                                 "sxx", "sxy",
                                 "syx", "syy"])
         description.shape = (1, 6)
-    cell_pos += 0.5
-    cell_pos *= cell_len
 
     for (name, vir) in sbparser.virial.items():
         out_fname = name + ".txt"
         out_path = os.path.join(sbparser.input_dir, out_fname)
         np.savetxt(out_path, description, fmt="%s", delimiter="\t")
-        stress = vir / cell_vol
+        stress = vir / cell_vol[:, np.newaxis]
         stress_pos = np.hstack((cell_pos, stress))
-        np.savetxt(open(out_path, 'a'), stress_pos, delimiter=" ")
+        with open(out_path, 'a') as f:
+            np.savetxt(f, stress_pos, delimiter=" ")
 
 
 def main(input_dir):
+    if os.path.exists(os.path.join(input_dir, "local_stress_shell.bin")):
+        shparser = ShellBinParser(input_dir)
+        shparser.read_bindata()
+        save_shell_stress(shparser)
+        if not os.path.exists(os.path.join(input_dir, "local_stress.bin")):
+            return
+    axes = ["x", "y", "z"]
+    if os.path.exists(os.path.join(input_dir, "local_heat_flux.bin")):
+        hfparser = FieldBinParser(input_dir, "local_heat_flux.bin")
+        hfparser.read_bindata()
+        save_field(hfparser, "_heat_flux.txt", ["j" + a for a in axes[:hfparser.sim_dim]], True)
+    if os.path.exists(os.path.join(input_dir, "local_profiles.bin")):
+        prparser = FieldBinParser(input_dir, "local_profiles.bin")
+        prparser.read_bindata()
+        save_field(prparser, "_profile.txt", ["rho"] + ["u" + a for a in axes[:prparser.sim_dim]] + ["T"], False)
+    if os.path.exists(os.path.join(input_dir, "local_atom_virial.bin")):
+        avparser = AtomVirialBinParser(input_dir)
+        avparser.read_bindata()
+        save_atom_virial(avparser)
     sbparser = StressBinParser(input_dir)
     sbparser.read_bindata()
     save_stress(sbparser)
@@ -0,0 +1,259 @@
+#if !defined SHELL_CALCULATOR_HPP
+#define SHELL_CALCULATOR_HPP
+
+#include <string>
+
+#include "filesystem/path.h"
+
+namespace LocalStress {
+  // NOTE:
+  // Local stress binned into shells of Geometry around a centre that may be
+  // moved every frame with setCenter (e.g. to the centre of mass of a vesicle).
+  // Positions relative to the centre follow the minimum image convention
+  // of the box. Each contour is split at shell crossings, and its tensor is
+  // rotated into the local frame of the geometry at the midpoint of each part.
+  // Contributions beyond the outermost shell are discarded.
+  template <typename T, class Geometry, typename Acc = T, class Enable = void>
+  class ShellCalculator;
+
+  template <typename T, class Geometry, typename Acc>
+  class ShellCalculator<T, Geometry, Acc, typename std::enable_if<std::is_floating_point<T>::value>::type> final {
+    typedef Vec<T> Vec_t;
+    typedef typename AccumulatorTraits<Acc>::value_type Real_t;
+    typedef Tensor<Real_t> Tensor_t;
+
+    std::vector<StressGrid<Acc>> stress_dist_;
+    Boundary<T> box_;
+    Geometry geometry_;
+    int32_t num_frames_ = 0;
+    std::vector<std::string> interaction_types_;
+    std::string save_dir_ = "./";
+    bool auto_save_ = true;
+    TensorStorage storage_ = TensorStorage::FULL;
+
+    static std::array<int32_t, D> singleCell(void) {
+      std::array<int32_t, D> dim;
+      dim.fill(1);
+      return dim;
+    }
+
+    const Vec_t relative(const Vec_t& r) const {
+      auto p = r - geometry_.center();
+      box_.applyMinimumImage(p);
+      return p;
+    }
+
+    void accumulate(const int32_t type, const int32_t cell,
+                    const Tensor<T>& val, const T weight) {
+      stress_dist_[type].add(cell, val, weight);
+    }
+
+    void spreadLocalStress(const Vec_t& r1,
+                           const Vec_t& dr01,
+                           const Vec_t& dF01,
+                           const int32_t type) {
+      const auto segs = geometry_.getDividedLineRatio(relative(r1), dr01);
+      for (const auto& seg : segs) {
+        const auto d_virial = tensor_dot(geometry_.toLocal(seg.mid, dr01),
+                                         geometry_.toLocal(seg.mid, dF01));
+        accumulate(type, seg.cell, d_virial, seg.ratio);
+      }
+    }
+
+    // NOTE: target of spreadContours (see f_decomposer.hpp).
+    struct ShellTarget {
+      ShellCalculator& calc;
+      const int32_t type;
+
+      void minimumImage(Vec_t& dr, const std::size_t) const {
+        calc.box_.applyMinimumImage(dr);
+      }
+
+      template <std::size_t N, std::size_t M>
+      const std::array<Vec_t, M> decompose(const std::array<Vec_t, N>& F,
+                                           const std::array<Vec_t, M>& dr) const {
+        return decomposeForce(F, dr);
+      }
+
+      void spread(const std::size_t, const int32_t, const int32_t,
+                  const Vec_t& r_b, const Vec_t& dr, const Vec_t& dF) {
+        calc.spreadLocalStress(r_b, dr, dF, type);
+      }
+    };
+
+    // NOTE:
+    // Header: uint32 D; uint32 shell type; double shell width; int32 number of shells;
+    //         double volume of each shell; uint32 num_elem; uint32 number of interaction types.
+    void writeHeader(std::ostream& fout) const {
+      write_as_lsbfirst(fout, uint32_t(D));
+      write_as_lsbfirst(fout, uint32_t(geometry_.type()));
+      write_as_lsbfirst(fout, double(geometry_.shell_width()));
+      const auto num_shell = geometry_.number_of_cell();
+      write_as_lsbfirst(fout, num_shell);
+      for (int32_t k = 0; k < num_shell; k++) {
+        write_as_lsbfirst(fout, double(geometry_.cell_volume(k, box_)));
+      }
+      write_as_lsbfirst(fout, uint32_t(number_of_tensor_elem(storage_)));
+      write_as_lsbfirst(fout, uint32_t(interaction_types_.size()));
+    }
+
+    void writeStressDistAsBinary(std::ostream& fout) const {
+      writeHeader(fout);
+      const auto num_elem  = number_of_tensor_elem(storage_);
+      const auto num_shell = geometry_.number_of_cell();
+      for (std::size_t i = 0; i < interaction_types_.size(); i++) {
+        write_as_lsbfirst(fout, uint32_t(interaction_types_[i].length()));
+        write_as_lsbfirst(fout, interaction_types_[i]);
+        for (int32_t k = 0; k < num_shell; k++) {
+          for (int32_t e = 0; e < num_elem; e++) {
+            write_as_lsbfirst(fout, double(stress_dist_[i].elem(e, k)));
+          }
+        }
+      }
+    }
+
+  public:
+    ShellCalculator(Vec_t&& box_low,
+                    Vec_t&& box_high,
+                    const BoundaryType btype,
+                    Geometry&& geometry,
+                    std::vector<std::string>&& itype,
+                    const TensorStorage storage = TensorStorage::FULL)
+      : box_(btype, singleCell()), geometry_(std::move(geometry)),
+        interaction_types_(std::move(itype)), storage_(storage) {
+      box_.setBox(box_low, box_high);
+      for (std::size_t i = 0; i < interaction_types_.size(); i++) {
+        stress_dist_.emplace_back(geometry_.number_of_cell(), storage_);
+      }
+    }
+
+    ~ShellCalculator(void) {
+      if (auto_save_) { saveLocalStressDist(); }
+    }
+
+    ShellCalculator(const ShellCalculator&) = delete;
+    ShellCalculator(ShellCalculator&&) = delete;
+    ShellCalculator& operator = (const ShellCalculator&) = delete;
+    ShellCalculator& operator = (ShellCalculator&&) = delete;
+
+    void setSaveDir(const std::string dir_name) {
+      save_dir_ = dir_name;
+    }
+
+    void disableAutoSave(void) {
+      auto_save_ = false;
+    }
+
+    void setCenter(const Vec_t& center) { geometry_.setCenter(center); }
+
+    const Boundary<T>& boundary(void) const { return box_; }
+    const Geometry& geometry(void) const { return geometry_; }
+    const StressGrid<Acc>& stress_dist(const int32_t type) const { return stress_dist_[type]; }
+
+    void calcLocalStressPot2(const Vec_t& r0, const Vec_t& r1,
+                             const Vec_t& F0, const Vec_t& F1,
+                             const int32_t type) {
+      if (box_.isInBox(r0) && box_.isInBox(r1)) {
+        calcLocalStressPot2NoCheck(r0, r1, F0, F1, type);
+      } else {
+        LOCAL_STRESS_ERR("r0 and r1 should be in simulation box.");
+      }
+    }
+
+    void calcLocalStressPot2NoCheck(const Vec_t& r0, const Vec_t& r1,
+                                    const Vec_t& F0, const Vec_t& F1,
+                                    const int32_t type) {
+      ShellTarget target {*this, type};
+      spreadContours(target, std::array<Vec_t, 2> {{r0, r1}},
+                     std::array<Vec_t, 2> {{F0, F1}});
+    }
+
+    void calcLocalStressPot3(const Vec_t& r0, const Vec_t& r1, const Vec_t& r2,
+                             const Vec_t& F0, const Vec_t& F1, const Vec_t& F2,
+                             const int32_t type) {
+      if (box_.isInBox(r0) && box_.isInBox(r1) && box_.isInBox(r2)) {
+        calcLocalStressPot3NoCheck(r0, r1, r2, F0, F1, F2, type);
+      } else {
+        LOCAL_STRESS_ERR("r0, r1, and r2 should be in simulation box.");
+      }
+    }
+
+    void calcLocalStressPot3NoCheck(const Vec_t& r0, const Vec_t& r1, const Vec_t& r2,
+                                    const Vec_t& F0, const Vec_t& F1, const Vec_t& F2,
+                                    const int32_t type) {
+      ShellTarget target {*this, type};
+      spreadContours(target, std::array<Vec_t, 3> {{r0, r1, r2}},
+                     std::array<Vec_t, 3> {{F0, F1, F2}});
+    }
+
+    void calcLocalStressPot4(const Vec_t& r0, const Vec_t& r1, const Vec_t& r2, const Vec_t& r3,
+                             const Vec_t& F0, const Vec_t& F1, const Vec_t& F2, const Vec_t& F3,
+                             const int32_t type) {
+      if (box_.isInBox(r0) && box_.isInBox(r1) && box_.isInBox(r2) && box_.isInBox(r3)) {
+        calcLocalStressPot4NoCheck(r0, r1, r2, r3, F0, F1, F2, F3, type);
+      } else {
+        LOCAL_STRESS_ERR("r0, r1, r2, and r3 should be in simulation box.");
+      }
+    }
+
+    void calcLocalStressPot4NoCheck(const Vec_t& r0, const Vec_t& r1, const Vec_t& r2, const Vec_t& r3,
+                                    const Vec_t& F0, const Vec_t& F1, const Vec_t& F2, const Vec_t& F3,
+                                    const int32_t type) {
+      ShellTarget target {*this, type};
+      spreadContours(target, std::array<Vec_t, 4> {{r0, r1, r2, r3}},
+                     std::array<Vec_t, 4> {{F0, F1, F2, F3}});
+    }
+
+    void calcLocalStressKin(const Vec_t& r,
+                            const Vec_t& v,
+                            const T mass,
+                            const int32_t type) {
+      if (!box_.isInBox(r)) {
+        LOCAL_STRESS_ERR("r should be in simulation box.");
+      }
+      const auto p    = relative(r);
+      const auto cell = geometry_.getCellPositionHash(p);
+      if (cell < 0) return;
+      const auto v_loc = geometry_.toLocal(p, v);
+      accumulate(type, cell, tensor_dot(v_loc, v_loc), mass);
+    }
+
+    void nextStep(void) {
+      num_frames_++;
+    }
+
+    void clear(void) {
+      num_frames_ = 0;
+      for (auto& sdist : stress_dist_) sdist.clear();
+    }
+
+    // NOTE: local-frame pressure tensor of shell k.
+    const Tensor_t pressure(const int32_t type, const int32_t k) const {
+      return stress_dist_[type][k] / (Real_t(geometry_.cell_volume(k, box_)) * num_frames_);
+    }
+
+    const Tensor_t pressure(const int32_t k) const {
+      Tensor_t psum(0.0);
+      for (std::size_t i = 0; i < interaction_types_.size(); i++) psum += pressure(i, k);
+      return psum;
+    }
+
+    void saveLocalStressDist(void) {
+      using filesystem::path;
+      const Real_t factor = -1.0 / num_frames_;
+      for (auto& sdist : stress_dist_) sdist.scale(factor);
+      const std::string fname = (path(save_dir_) / path("local_stress_shell.bin")).str();
+      std::ofstream fout(fname, std::ios::binary);
+      writeStressDistAsBinary(fout);
+    }
+
+    friend void accumulateResult(ShellCalculator& sc0,
+                                 const ShellCalculator& sc1) {
+      const int num_itypes = sc0.interaction_types_.size();
+      for (int type = 0; type < num_itypes; type++) {
+        sc0.stress_dist_[type].accumulate(sc1.stress_dist_[type]);
+      }
+    }
+  };
+}
+#endif
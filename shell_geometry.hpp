@@ -0,0 +1,263 @@
+#if !defined SHELL_GEOMETRY_HPP
+#define SHELL_GEOMETRY_HPP
+
+#include <cmath>
+#include <vector>
+#include <limits>
+#include <algorithm>
+
+namespace LocalStress {
+  enum class ShellType : int32_t {
+    SPHERICAL = 0,
+    CYLINDRICAL,
+  };
+
+  // NOTE:
+  // Part of a contour inside one shell. mid is the midpoint of the part
+  // relative to the centre, where the local frame is evaluated.
+  template <typename T>
+  struct ShellSegment {
+    int32_t cell;
+    T ratio;
+    Vec<T> mid;
+  };
+
+  // NOTE:
+  // Appends ratios t in (0, 1) where |q0 + t * dq| crosses k * width (k = 1, ..., num_shell).
+  // q0 and dq are the start and the direction of a contour projected onto the radial space.
+  template <typename T>
+  static inline void calcShellCrossings(std::vector<T>& ratios,
+                                        const Vec<T>& q0,
+                                        const Vec<T>& dq,
+                                        const T width,
+                                        const int32_t num_shell) {
+    const T a = dq * dq, b = q0 * dq, c = q0 * q0;
+    if (a == T(0)) return;
+    const T s1 = a + T(2) * b + c;
+    T smin = std::min(c, s1);
+    const T smax = std::max(c, s1);
+    const T t_closest = -b / a;
+    if ((t_closest > T(0)) && (t_closest < T(1))) smin = std::max(c - b * b / a, T(0));
+
+    const int32_t k_lo = int32_t(std::sqrt(smin) / width) + 1;
+    const int32_t k_hi = std::min(int32_t(std::sqrt(smax) / width), num_shell);
+    for (int32_t k = k_lo; k <= k_hi; k++) {
+      const T rad  = k * width;
+      const T disc = b * b - a * (c - rad * rad);
+      if (disc < T(0)) continue;
+      const T sq = std::sqrt(disc);
+      const T t0 = (-b - sq) / a, t1 = (-b + sq) / a;
+      if ((t0 > T(0)) && (t0 < T(1))) ratios.push_back(t0);
+      if ((t1 > T(0)) && (t1 < T(1))) ratios.push_back(t1);
+    }
+  }
+
+  // NOTE: ratios should start with 0 and end with 1.
+  template <typename T, class Geometry>
+  static inline std::vector<ShellSegment<T>> makeShellSegments(const Geometry& geom,
+                                                               std::vector<T>& ratios,
+                                                               const Vec<T>& p1,
+                                                               const Vec<T>& dr01) {
+    std::sort(ratios.begin(), ratios.end());
+    std::vector<ShellSegment<T>> segs;
+    segs.reserve(ratios.size() - 1);
+    for (std::size_t i = 0; i + 1 < ratios.size(); i++) {
+      const T ratio = ratios[i + 1] - ratios[i];
+      if (ratio <= T(0)) continue;
+      const auto mid  = p1 + dr01 * ((ratios[i + 1] + ratios[i]) * T(0.5));
+      const auto cell = geom.getCellPositionHash(mid);
+      if (cell < 0) continue;
+      segs.push_back({cell, ratio, mid});
+    }
+    return segs;
+  }
+
+  // NOTE:
+  // Concentric spherical shells of equal width around a movable centre.
+  // Tensors are expressed in the local (r, theta, phi) frame, with the polar
+  // axis along z, so that xx, yy and zz of a cell are p_rr, p_tt and p_pp.
+  // Positions relative to the centre lie in the minimum-image cell
+  // |p_a| <= L_a / 2 of the periodic axes, so shells reaching beyond half a
+  // periodic box length are clipped to that cell: their volumes count only
+  // the part where contributions can occur.
+  template <typename T, class Enable = void>
+  class SphericalShells;
+
+  template <typename T>
+  class SphericalShells<T, typename std::enable_if<std::is_floating_point<T>::value>::type> final {
+    typedef Vec<T> Vec_t;
+
+    Vec_t center_;
+    T width_, iwidth_;
+    int32_t num_shell_;
+
+    // NOTE:
+    // Area of the disc of radius rho in the quadrant x, y >= 0 with
+    // x <= a and y <= b.
+    static T clippedQuarterDisc(const T rho, const T a, const T b) {
+      const auto F = [rho](const T x) {
+        const T u = std::min(x / rho, T(1));
+        return T(0.5) * (x * std::sqrt(std::max(rho * rho - x * x, T(0))) + rho * rho * std::asin(u));
+      };
+      const T xa = std::min(a, rho);
+      if (rho <= b) return F(xa);
+      const T xb = std::sqrt(rho * rho - b * b);
+      if (xa <= xb) return b * xa;
+      return b * xb + F(xa) - F(xb);
+    }
+
+    // NOTE:
+    // Volume of the ball of radius rad inside |p_a| <= h_a, summed over
+    // slices normal to z (Simpson's rule in s, where z = rad sin(s)).
+    static T clippedBallVolume(const T rad, const std::array<T, D>& h) {
+      if (rad <= *std::min_element(h.cbegin(), h.cend())) return T(4.0 * M_PI / 3.0) * rad * rad * rad;
+      const int32_t num_slices = 2048;
+      const T s_max = std::asin(std::min(h[Z] / rad, T(1)));
+      const T ds = T(2) * s_max / num_slices;
+      T sum = T(0);
+      for (int32_t i = 0; i <= num_slices; i++) {
+        const T c = std::cos(-s_max + i * ds);
+        const T w = (i == 0 || i == num_slices) ? T(1) : T((i % 2) ? 4 : 2);
+        sum += w * T(4) * clippedQuarterDisc(rad * c, h[X], h[Y]) * rad * c;
+      }
+      return sum * ds / T(3);
+    }
+
+  public:
+    SphericalShells(const T r_max, const int32_t num_shell)
+      : width_(r_max / num_shell), iwidth_(num_shell / r_max), num_shell_(num_shell) {
+      if (!(r_max > T(0) && num_shell > 0)) {
+        LOCAL_STRESS_ERR("r_max and the number of shells should be positive.");
+      }
+    }
+
+    ShellType type(void) const { return ShellType::SPHERICAL; }
+    void setCenter(const Vec_t& center) { center_ = center; }
+    const Vec_t& center(void) const { return center_; }
+    int32_t number_of_cell(void) const { return num_shell_; }
+    T shell_width(void) const { return width_; }
+
+    // NOTE: clipped to the minimum-image cell of box (see above).
+    T cell_volume(const int32_t k, const Boundary<T>& box) const {
+      std::array<T, D> h;
+      for (int32_t a = 0; a < D; a++) {
+        h[a] = box.is_periodic_axis()[a] ? T(0.5) * box.box_length()[a] : std::numeric_limits<T>::max();
+      }
+      return clippedBallVolume((k + 1) * width_, h) - clippedBallVolume(k * width_, h);
+    }
+
+    // NOTE: p is relative to the centre. Returns -1 beyond the outermost shell.
+    int32_t getCellPositionHash(const Vec_t& p) const {
+      const auto k = int32_t(p.norm() * iwidth_);
+      return (k < num_shell_) ? k : -1;
+    }
+
+    // NOTE: (r, theta, phi) components of v at p.
+    const Vec_t toLocal(const Vec_t& p, const Vec_t& v) const {
+      const T r = p.norm();
+      if (r == T(0)) return v;
+      const Vec_t er = p / r;
+      const T rho = std::sqrt(p.x * p.x + p.y * p.y);
+      const Vec_t ep = (rho > T(0)) ? Vec_t(-p.y / rho, p.x / rho, T(0)) : Vec_t(T(0), T(1), T(0));
+      const Vec_t et(ep.y * er.z - ep.z * er.y,
+                     ep.z * er.x - ep.x * er.z,
+                     ep.x * er.y - ep.y * er.x);
+      return Vec_t(v * er, v * et, v * ep);
+    }
+
+    // NOTE: contour from p1 to p1 + dr01, p1 relative to the centre.
+    const std::vector<ShellSegment<T>> getDividedLineRatio(const Vec_t& p1,
+                                                           const Vec_t& dr01) const {
+      std::vector<T> ratios {T(0)};
+      calcShellCrossings(ratios, p1, dr01, width_, num_shell_);
+      ratios.push_back(T(1));
+      return makeShellSegments(*this, ratios, p1, dr01);
+    }
+  };
+
+  // NOTE:
+  // Concentric cylindrical shells of equal width around an axis through a
+  // movable centre. Tensors are expressed in the local (r, phi, z) frame, so
+  // that xx, yy and zz of a cell are p_rr, p_pp and p_zz.
+  // Shell volumes use the length of the axis chord through the box, which is
+  // the box length for an axis parallel to a box edge.
+  template <typename T, class Enable = void>
+  class CylindricalShells;
+
+  template <typename T>
+  class CylindricalShells<T, typename std::enable_if<std::is_floating_point<T>::value>::type> final {
+    typedef Vec<T> Vec_t;
+
+    Vec_t center_, axis_, e_ref_;
+    T width_, iwidth_;
+    int32_t num_shell_;
+
+    // NOTE: component of p perpendicular to the axis.
+    const Vec_t radial(const Vec_t& p) const {
+      return p - axis_ * (p * axis_);
+    }
+
+    static const Vec_t cross(const Vec_t& a, const Vec_t& b) {
+      return Vec_t(a.y * b.z - a.z * b.y,
+                   a.z * b.x - a.x * b.z,
+                   a.x * b.y - a.y * b.x);
+    }
+
+  public:
+    CylindricalShells(const Vec_t& axis, const T r_max, const int32_t num_shell)
+      : axis_(normalize(axis)), width_(r_max / num_shell), iwidth_(num_shell / r_max),
+        num_shell_(num_shell) {
+      if (!(r_max > T(0) && num_shell > 0)) {
+        LOCAL_STRESS_ERR("r_max and the number of shells should be positive.");
+      }
+      // radial direction used on the axis itself
+      const Vec_t ex(T(1), T(0), T(0)), ey(T(0), T(1), T(0));
+      e_ref_ = normalize(radial((std::abs(axis_.x) < T(0.9)) ? ex : ey));
+    }
+
+    ShellType type(void) const { return ShellType::CYLINDRICAL; }
+    void setCenter(const Vec_t& center) { center_ = center; }
+    const Vec_t& center(void) const { return center_; }
+    const Vec_t& axis(void) const { return axis_; }
+    int32_t number_of_cell(void) const { return num_shell_; }
+    T shell_width(void) const { return width_; }
+
+    T axis_length(const Boundary<T>& box) const {
+      const auto& len = box.box_length();
+      T chord = std::numeric_limits<T>::max();
+      for (int32_t a = 0; a < D; a++) {
+        if (std::abs(axis_[a]) > T(0)) chord = std::min(chord, len[a] / std::abs(axis_[a]));
+      }
+      return chord;
+    }
+
+    T cell_volume(const int32_t k, const Boundary<T>& box) const {
+      return T(M_PI) * width_ * width_ * T(2 * k + 1) * axis_length(box);
+    }
+
+    // NOTE: p is relative to the centre. Returns -1 beyond the outermost shell.
+    int32_t getCellPositionHash(const Vec_t& p) const {
+      const auto k = int32_t(radial(p).norm() * iwidth_);
+      return (k < num_shell_) ? k : -1;
+    }
+
+    // NOTE: (r, phi, z) components of v at p.
+    const Vec_t toLocal(const Vec_t& p, const Vec_t& v) const {
+      const auto q = radial(p);
+      const T rho = q.norm();
+      const Vec_t er = (rho > T(0)) ? q / rho : e_ref_;
+      const Vec_t ep = cross(axis_, er);
+      return Vec_t(v * er, v * ep, v * axis_);
+    }
+
+    // NOTE: contour from p1 to p1 + dr01, p1 relative to the centre.
+    const std::vector<ShellSegment<T>> getDividedLineRatio(const Vec_t& p1,
+                                                           const Vec_t& dr01) const {
+      std::vector<T> ratios {T(0)};
+      calcShellCrossings(ratios, radial(p1), radial(dr01), width_, num_shell_);
+      ratios.push_back(T(1));
+      return makeShellSegments(*this, ratios, p1, dr01);
+    }
+  };
+}
+#endif
@@ -0,0 +1,316 @@
+#if !defined STRESS_GRID_HPP
+#define STRESS_GRID_HPP
+
+#include <algorithm>
+#include <vector>
+
+#include "grid_kernels.hpp"
+
+namespace LocalStress {
+  // NOTE:
+  // SYMMETRIC stores only the upper triangle (xx, xy, xz, yy, yz, zz in 3D).
+  // It is exact when every contribution is symmetric, i.e. kinetic terms and
+  // central pair/CFD forces. Otherwise the symmetric part is accumulated.
+  // VECTOR stores a vector field (e.g. heat flux) of D components per cell.
+  enum class TensorStorage : int32_t {
+    FULL = 0,
+    SYMMETRIC,
+    VECTOR,
+  };
+
+  static inline int32_t number_of_tensor_elem(const TensorStorage storage) {
+    switch (storage) {
+    case TensorStorage::SYMMETRIC: return D * (D + 1) / 2;
+    case TensorStorage::VECTOR:    return D;
+    default:                       return D * D;
+    }
+  }
+
+  // NOTE:
+  // Accumulator tag for Kahan-compensated summation in S.
+  // The compensation is destroyed by -ffast-math / -fassociative-math.
+  template <typename S>
+  struct Compensated {
+    static_assert(std::is_floating_point<S>::value, "S should be floating point.");
+  };
+
+  template <typename Acc>
+  struct AccumulatorTraits {
+    static_assert(std::is_floating_point<Acc>::value, "Acc should be floating point.");
+    typedef Acc value_type;
+    static constexpr bool compensated = false;
+  };
+
+  template <typename S>
+  struct AccumulatorTraits<Compensated<S>> {
+    typedef S value_type;
+    static constexpr bool compensated = true;
+  };
+
+  // NOTE:
+  // Paged structure-of-arrays storage of a tensor field.
+  // Cells are grouped into pages of 2^page_shift_ cells. Inside a page,
+  // component e of cell i is stored at page[e * page_stride_ + i] and, with a
+  // Compensated<S> accumulator, its Kahan correction at
+  // page[(num_elem_ + e) * page_stride_ + i].
+  // A dense grid is a single page allocated up front. A sparse grid allocates
+  // its pages on first touch, so memory scales with the occupied volume.
+  template <typename Acc>
+  class StressGrid final {
+    typedef typename AccumulatorTraits<Acc>::value_type T;
+    typedef Tensor<T> Tensor_t;
+    typedef std::unique_ptr<T[], AlignedDeleter> Page_t;
+    static constexpr bool compensated = AccumulatorTraits<Acc>::compensated;
+    static constexpr int32_t dense_shift = 31;
+
+    TensorStorage storage_ = TensorStorage::FULL;
+    int32_t num_elem_ = D * D;
+    std::array<int32_t, D * D> sym_row_, sym_col_;
+    int32_t num_cell_ = 0;
+    int32_t page_shift_ = dense_shift, page_mask_ = 0x7fffffff, page_cells_ = 0;
+    std::size_t page_stride_ = 0, page_size_ = 0;
+    std::vector<Page_t> pages_;
+
+    static std::size_t calcStride(const int32_t num_cell) {
+      constexpr std::size_t pad = 64 / sizeof(T);
+      return (std::size_t(num_cell) + pad - 1) / pad * pad;
+    }
+
+    void setSymmetricIndex(void) {
+      int32_t e = 0;
+      for (int32_t i = 0; i < D; i++) {
+        for (int32_t j = i; j < D; j++) {
+          sym_row_[e] = i * D + j;
+          sym_col_[e] = j * D + i;
+          e++;
+        }
+      }
+    }
+
+    T* allocatePage(const int32_t p) {
+      pages_[p] = make_aligned_zero<T>(page_size_);
+      return pages_[p].get();
+    }
+
+    T* touchPage(const int32_t p) {
+      T* page = pages_[p].get();
+      return page ? page : allocatePage(p);
+    }
+
+    int32_t cellsInPage(const int32_t p) const {
+      return std::min(page_cells_, num_cell_ - p * page_cells_);
+    }
+
+    void addElem(T* page, const std::size_t i, const T v) {
+      if (compensated) {
+        T& c = page[i + num_elem_ * page_stride_];
+        const T y = v - c;
+        const T t = page[i] + y;
+        c = (t - page[i]) - y;
+        page[i] = t;
+      } else {
+        page[i] += v;
+      }
+    }
+
+  public:
+    static constexpr int32_t dense = -1;
+
+    // NOTE:
+    // log2_page_cells < 0 selects the dense layout.
+    explicit StressGrid(const int32_t num_cell,
+                        const TensorStorage storage = TensorStorage::FULL,
+                        const int32_t log2_page_cells = dense)
+      : storage_(storage), num_elem_(number_of_tensor_elem(storage)), num_cell_(num_cell) {
+      if (log2_page_cells >= 0 && log2_page_cells < dense_shift) {
+        page_shift_ = log2_page_cells;
+        page_mask_  = (1 << page_shift_) - 1;
+        page_cells_ = std::min(1 << page_shift_, num_cell);
+        pages_.resize((num_cell + page_mask_) >> page_shift_);
+      } else {
+        page_cells_ = num_cell;
+        pages_.resize(1);
+      }
+      page_stride_ = calcStride(page_cells_);
+      page_size_   = page_stride_ * num_elem_ * (compensated ? 2 : 1);
+      if (!is_sparse()) allocatePage(0);
+      setSymmetricIndex();
+    }
+
+    StressGrid(StressGrid&&) = default;
+    StressGrid& operator = (StressGrid&&) = default;
+    StressGrid(const StressGrid&) = delete;
+    StressGrid& operator = (const StressGrid&) = delete;
+
+    int32_t number_of_cell(void) const { return num_cell_; }
+    int32_t number_of_elem(void) const { return num_elem_; }
+    TensorStorage storage(void) const { return storage_; }
+    bool is_symmetric(void) const { return storage_ == TensorStorage::SYMMETRIC; }
+    bool is_vector(void) const { return storage_ == TensorStorage::VECTOR; }
+    bool is_sparse(void) const { return page_shift_ != dense_shift; }
+
+    int32_t number_of_page(void) const { return pages_.size(); }
+    int32_t number_of_allocated_page(void) const {
+      return std::count_if(pages_.cbegin(), pages_.cend(),
+                           [](const Page_t& p) { return p != nullptr; });
+    }
+    std::size_t allocated_bytes(void) const {
+      return number_of_allocated_page() * page_size_ * sizeof(T);
+    }
+    bool isAllocated(const int32_t cell) const {
+      return pages_[cell >> page_shift_] != nullptr;
+    }
+
+    // NOTE: contiguous planes are only available in the dense layout.
+    T* plane(const int32_t e) {
+      assert(!is_sparse());
+      return pages_[0].get() + e * page_stride_;
+    }
+    const T* plane(const int32_t e) const {
+      assert(!is_sparse());
+      return pages_[0].get() + e * page_stride_;
+    }
+
+    template <typename U>
+    void add(const int32_t cell, const Tensor<U>& val) {
+      add(cell, val, U(1));
+    }
+
+    template <typename U>
+    void add(const int32_t cell, const Tensor<U>& val, const U weight) {
+      assert(!is_vector());
+      T* page = touchPage(cell >> page_shift_);
+      const std::size_t off = cell & page_mask_;
+      if (is_symmetric()) {
+        const T hw = T(0.5) * T(weight);
+        for (int32_t e = 0; e < num_elem_; e++) {
+          addElem(page, e * page_stride_ + off, (T(val[sym_row_[e]]) + T(val[sym_col_[e]])) * hw);
+        }
+      } else {
+        for (int32_t e = 0; e < num_elem_; e++) {
+          addElem(page, e * page_stride_ + off, T(val[e]) * T(weight));
+        }
+      }
+    }
+
+    template <typename U>
+    void add(const int32_t cell, const Vec<U>& val, const U weight) {
+      assert(is_vector());
+      T* page = touchPage(cell >> page_shift_);
+      const std::size_t off = cell & page_mask_;
+      for (int32_t e = 0; e < D; e++) {
+        addElem(page, e * page_stride_ + off, T(val[e]) * T(weight));
+      }
+    }
+
+    // NOTE: e is an index into the stored (possibly symmetric) layout.
+    T elem(const int32_t e, const int32_t cell) const {
+      const T* page = pages_[cell >> page_shift_].get();
+      if (!page) return T(0);
+      const std::size_t i = e * page_stride_ + (cell & page_mask_);
+      return compensated ? page[i] - page[i + num_elem_ * page_stride_] : page[i];
+    }
+
+    // NOTE: e is an index into the full D * D layout of a tensor.
+    T full_elem(const int32_t e, const int32_t cell) const {
+      return elem(full_to_stored(e), cell);
+    }
+
+    int32_t full_to_stored(const int32_t e) const {
+      assert(!is_vector());
+      if (!is_symmetric()) return e;
+      const int32_t i = std::min(e / D, e % D), j = std::max(e / D, e % D);
+      return i * D - i * (i - 1) / 2 + (j - i);
+    }
+
+    const Tensor_t operator [] (const int32_t cell) const {
+      Tensor_t ret;
+      for (int32_t e = 0; e < D * D; e++) ret[e] = full_elem(e, cell);
+      return ret;
+    }
+
+    // NOTE: a sparse grid releases its pages.
+    void clear(void) {
+      if (is_sparse()) {
+        for (auto& p : pages_) p.reset();
+      } else {
+        std::memset(pages_[0].get(), 0, page_size_ * sizeof(T));
+      }
+    }
+
+    void clear(const int32_t cell) {
+      T* page = pages_[cell >> page_shift_].get();
+      if (!page) return;
+      const std::size_t off = cell & page_mask_;
+      for (int32_t e = 0; e < num_elem_; e++) {
+        page[e * page_stride_ + off] = T(0);
+        if (compensated) page[(num_elem_ + e) * page_stride_ + off] = T(0);
+      }
+    }
+
+    void scale(const T factor) {
+      for (auto& p : pages_) {
+        if (p) gridKernels<T>().scale(p.get(), page_size_, factor);
+      }
+    }
+
+    void accumulate(const StressGrid& src, const T factor = T(1)) {
+      assert(src.num_cell_ == num_cell_);
+      assert(src.storage_ == storage_);
+      assert(src.page_shift_ == page_shift_);
+      const std::size_t n = page_stride_ * num_elem_;
+      for (std::size_t p = 0; p < pages_.size(); p++) {
+        const T* sp = src.pages_[p].get();
+        if (!sp) continue;
+        T* dp = touchPage(p);
+        if (compensated) {
+          for (std::size_t i = 0; i < n; i++) addElem(dp, i, (sp[i] - sp[i + n]) * factor);
+        } else {
+          gridKernels<T>().axpy(dp, sp, n, factor);
+        }
+      }
+    }
+
+    const Vec<T> vector(const int32_t cell) const {
+      assert(is_vector());
+      Vec<T> ret;
+      for (int32_t e = 0; e < D; e++) ret[e] = elem(e, cell);
+      return ret;
+    }
+
+    const Vec<T> vector_sum(void) const {
+      assert(is_vector());
+      Vec<T> ret;
+      for (std::size_t p = 0; p < pages_.size(); p++) {
+        const T* page = pages_[p].get();
+        if (!page) continue;
+        const auto ncell = cellsInPage(p);
+        for (int32_t e = 0; e < D; e++) {
+          ret[e] += gridKernels<T>().sum(page + e * page_stride_, ncell);
+          if (compensated) {
+            ret[e] -= gridKernels<T>().sum(page + (num_elem_ + e) * page_stride_, ncell);
+          }
+        }
+      }
+      return ret;
+    }
+
+    const Tensor_t sum(void) const {
+      Tensor_t ret(T(0));
+      for (std::size_t p = 0; p < pages_.size(); p++) {
+        const T* page = pages_[p].get();
+        if (!page) continue;
+        const auto ncell = cellsInPage(p);
+        for (int32_t e = 0; e < D * D; e++) {
+          const auto ofs = full_to_stored(e) * page_stride_;
+          ret[e] += gridKernels<T>().sum(page + ofs, ncell);
+          if (compensated) {
+            ret[e] -= gridKernels<T>().sum(page + ofs + num_elem_ * page_stride_, ncell);
+          }
+        }
+      }
+      return ret;
+    }
+  };
+}
+#endif
@@ -51,7 +51,8 @@ namespace LocalStress {
     }
 
     const Tensor2& operator += (const Tensor2& rhs) {
-      *this = (*this) + rhs;
+      xx += rhs.xx; xy += rhs.xy;
+      yx += rhs.yx; yy += rhs.yy;
       return *this;
     }
 
@@ -61,7 +62,8 @@ namespace LocalStress {
     }
 
     const Tensor2& operator -= (const Tensor2& rhs) {
-      *this = (*this) - rhs;
+      xx -= rhs.xx; xy -= rhs.xy;
+      yx -= rhs.yx; yy -= rhs.yy;
       return *this;
     }
 
@@ -76,7 +78,8 @@ namespace LocalStress {
     }
 
     const Tensor2& operator *= (const T c) {
-      *this = (*this) * c;
+      xx *= c; xy *= c;
+      yx *= c; yy *= c;
       return *this;
     }
 
@@ -86,7 +89,8 @@ namespace LocalStress {
     }
 
     const Tensor2& operator /= (const T c) {
-      *this = (*this) / c;
+      xx /= c; xy /= c;
+      yx /= c; yy /= c;
       return *this;
     }
 
@@ -59,7 +59,9 @@ namespace LocalStress {
     }
 
     const Tensor3& operator += (const Tensor3& rhs) {
-      *this = (*this) + rhs;
+      xx += rhs.xx; xy += rhs.xy; xz += rhs.xz;
+      yx += rhs.yx; yy += rhs.yy; yz += rhs.yz;
+      zx += rhs.zx; zy += rhs.zy; zz += rhs.zz;
       return *this;
     }
 
@@ -70,7 +72,9 @@ namespace LocalStress {
     }
 
     const Tensor3& operator -= (const Tensor3& rhs) {
-      *this = (*this) - rhs;
+      xx -= rhs.xx; xy -= rhs.xy; xz -= rhs.xz;
+      yx -= rhs.yx; yy -= rhs.yy; yz -= rhs.yz;
+      zx -= rhs.zx; zy -= rhs.zy; zz -= rhs.zz;
       return *this;
     }
 
@@ -87,7 +91,9 @@ namespace LocalStress {
     }
 
     const Tensor3& operator *= (const T c) {
-      *this = (*this) * c;
+      xx *= c; xy *= c; xz *= c;
+      yx *= c; yy *= c; yz *= c;
+      zx *= c; zy *= c; zz *= c;
       return *this;
     }
 
@@ -98,7 +104,9 @@ namespace LocalStress {
     }
 
     const Tensor3& operator /= (const T c) {
-      *this = (*this) / c;
+      xx /= c; xy /= c; xz /= c;
+      yx /= c; yy /= c; yz /= c;
+      zx /= c; zy /= c; zz /= c;
       return *this;
     }
 
@@ -216,3 +216,153 @@ TEST(Utils, get_lineratio1) {
   ASSERT_EQ(lratios0[1].first, 1210 + 9 - 110 + 100 - 110 - 1);
   ASSERT_EQ(lratios0[0].first, 1210 + 9 - 110 + 100 - 110 - 1 - 110);
 }
+
+TEST(Utils, minimum_image_shift) {
+  Boundary<double> boundary(BoundaryType::PERIODIC_XY, {10, 10, 10});
+  boundary.setBox({2.0, 3.0, 4.0}, {12.0, 23.0, 34.0});
+  Vector3<double> dr01 {-6.0, 18.0, -28.0};
+  std::array<int32_t, D> shift;
+  boundary.applyMinimumImage(dr01, shift);
+  ASSERT_EQ(dr01.x, 4.0);
+  ASSERT_EQ(dr01.y, -2.0);
+  ASSERT_EQ(dr01.z, -28.0);
+  ASSERT_EQ(shift[X], 1);
+  ASSERT_EQ(shift[Y], -1);
+  ASSERT_EQ(shift[Z], 0);
+}
+
+TEST(Utils, get_cellpositions) {
+  Boundary<double> boundary(BoundaryType::PERIODIC_XYZ, {10, 12, 14});
+  boundary.setBox({1.0, 1.0, 1.0}, {11.0, 25.0, 43.0}); // mesh_len = {1.0, 2.0, 3.0};
+  std::vector<double> pos {1.5, 16.0, 32.0, 10.9, 1.0, 42.9};
+  std::array<std::vector<int32_t>, D> cells;
+  ASSERT_TRUE(boundary.getCellPositions(VecArrayView<double>(pos.data()), 2, cells));
+  ASSERT_EQ(cells[X][0], 0); ASSERT_EQ(cells[Y][0], 7); ASSERT_EQ(cells[Z][0], 10);
+  ASSERT_EQ(cells[X][1], 9); ASSERT_EQ(cells[Y][1], 0); ASSERT_EQ(cells[Z][1], 13);
+
+  pos[1] = 25.0;
+  ASSERT_FALSE(boundary.getCellPositions(VecArrayView<double>(pos.data()), 2, cells));
+}
+
+TEST(Triclinic, minimum_image_and_cell) {
+  Boundary<double> boundary(BoundaryType::PERIODIC_XYZ, {10, 10, 10});
+  boundary.setBox({0.0, 0.0, 0.0}, {4.0, 4.0, 4.0});
+  boundary.setTiltFactors({0.0, 0.0, 0.0});
+  ASSERT_FALSE(boundary.is_triclinic());
+  boundary.setTiltFactors({1.0, 0.0, 0.0});
+  ASSERT_TRUE(boundary.is_triclinic());
+  ASSERT_DOUBLE_EQ(boundary.box_volume(), 64.0);
+
+  // dr - b with b = (1, 4, 0)
+  Vector3<double> dr01 {0.0, 3.5, 0.0};
+  std::array<int32_t, D> shift;
+  boundary.applyMinimumImage(dr01, shift);
+  ASSERT_NEAR(dr01.x, -1.0, err_fp);
+  ASSERT_NEAR(dr01.y, -0.5, err_fp);
+  ASSERT_NEAR(dr01.z, 0.0, err_fp);
+  ASSERT_EQ(shift[Y], -1);
+
+  // low + h * (0.35, 0.65, 0.15)
+  const Vector3<double> r {4.0 * 0.35 + 1.0 * 0.65, 4.0 * 0.65, 4.0 * 0.15};
+  ASSERT_TRUE(boundary.isInBox(r));
+  ASSERT_EQ(boundary.getCellPositionHash(r), 3 + 10 * (6 + 10 * 1));
+  // outside of the sheared box although inside of its orthorhombic bounds
+  ASSERT_FALSE(boundary.isInBox(Vector3<double>(0.1, 3.9, 1.0)));
+  Vector3<double> wrapped(0.1, 3.9, 1.0);
+  boundary.adjustBoundary(wrapped);
+  ASSERT_TRUE(boundary.isInBox(wrapped));
+  ASSERT_NEAR(wrapped.x, 4.1, err_fp);
+}
+
+TEST(Triclinic, get_lineratio) {
+  Boundary<double> boundary(BoundaryType::PERIODIC_XYZ, {4, 4, 4});
+  boundary.setBox({0.0, 0.0, 0.0}, {4.0, 4.0, 4.0});
+  boundary.setTiltFactors({2.0, 0.0, 0.0});
+
+  // along b: fractional y goes from 0.1 to 0.9, fractional x stays at 0.3
+  const Vector3<double> r1 {4.0 * 0.3 + 2.0 * 0.1, 4.0 * 0.1, 2.0};
+  const Vector3<double> dr01 {2.0 * 0.8, 4.0 * 0.8, 0.0};
+  const auto lratios = boundary.getDividedLineRatio(r1, dr01);
+  ASSERT_EQ(lratios.size(), 4u);
+  const double ref[] = {0.15 / 0.8, 0.25 / 0.8, 0.25 / 0.8, 0.15 / 0.8};
+  for (int32_t i = 0; i < 4; i++) {
+    ASSERT_EQ(lratios[i].first, 1 + 4 * (i + 4 * 2));
+    ASSERT_NEAR(lratios[i].second, ref[i], err_fp);
+  }
+}
+
+TEST(NonUniform, cell_lookup) {
+  Boundary<double> boundary(BoundaryType::PERIODIC_XYZ, {4, 4, 5});
+  boundary.setBox({0.0, 0.0, 0.0}, {4.0, 4.0, 10.0});
+  // fine cells of 0.5 across 4 < z < 5.5
+  boundary.setBinEdges(Z, {0.0, 0.4, 0.45, 0.5, 0.55, 1.0});
+  ASSERT_TRUE(boundary.is_nonuniform());
+  ASSERT_TRUE(boundary.is_uniform_axis(X));
+  ASSERT_FALSE(boundary.is_uniform_axis(Z));
+
+  const std::vector<double> z   {0.1, 3.99, 4.0, 4.49, 4.5, 5.2, 5.5, 9.99, 10.5, -0.1, -6.0};
+  const std::vector<int32_t> c  {0,   0,    1,   1,    2,   3,   4,   4,    5,    -1,   -4};
+  std::vector<double> pos;
+  for (std::size_t i = 0; i < z.size(); i++) {
+    const Vector3<double> r {0.5, 0.5, z[i]};
+    ASSERT_EQ(boundary.getCellPosition(r)[Z], c[i]);
+    pos.push_back(r.x); pos.push_back(r.y); pos.push_back(r.z);
+  }
+  std::array<std::vector<int32_t>, D> cells;
+  ASSERT_FALSE(boundary.getCellPositions(VecArrayView<double>(pos.data()), z.size(), cells));
+  for (std::size_t i = 0; i < z.size(); i++) ASSERT_EQ(cells[Z][i], c[i]);
+
+  ASSERT_NEAR(boundary.getWallFraction(Z, 2), 0.45, err_fp);
+  ASSERT_NEAR(boundary.getWallFraction(Z, -2), -0.5, err_fp);
+  ASSERT_NEAR(boundary.getWallFraction(Z, 7), 1.45, err_fp);
+  ASSERT_NEAR(boundary.getCellVolumeFraction(0 + 4 * (0 + 4 * 2)), 0.05 / 16.0, err_fp);
+
+  boundary.setBinEdges(Z, {});
+  ASSERT_FALSE(boundary.is_nonuniform());
+  ASSERT_EQ(boundary.getCellPosition(Vector3<double>(0.5, 0.5, 4.5))[Z], 2);
+}
+
+// NOTE: cells far narrower than the lookup table bins are binary searched.
+TEST(NonUniform, narrow_cells) {
+  Boundary<double> boundary(BoundaryType::PERIODIC_XYZ, {4, 4, 8});
+  boundary.setBox({0.0, 0.0, 0.0}, {4.0, 4.0, 10.0});
+  const std::vector<double> edges {0.0, 1.0e-9, 2.0e-9, 3.0e-9, 0.5, 0.5 + 1.0e-7, 0.9, 0.95, 1.0};
+  boundary.setBinEdges(Z, edges);
+  for (int32_t image = -1; image <= 1; image++) {
+    for (int32_t k = 0; k < 8; k++) {
+      const double u = 0.5 * (edges[k] + edges[k + 1]);
+      const Vector3<double> r {0.5, 0.5, 10.0 * (u + image)};
+      ASSERT_EQ(boundary.getCellPosition(r)[Z], 8 * image + k);
+    }
+  }
+  for (int32_t i = 0; i < 1000; i++) {
+    const double u = (i + 0.5) / 1000.0;
+    const int32_t k = std::upper_bound(edges.cbegin(), edges.cend(), u) - edges.cbegin() - 1;
+    ASSERT_EQ(boundary.getCellPosition(Vector3<double>(0.5, 0.5, 10.0 * u))[Z], k);
+  }
+}
+
+TEST(NonUniform, get_lineratio) {
+  Boundary<double> boundary(BoundaryType::PERIODIC_XYZ, {4, 4, 5});
+  boundary.setBox({0.0, 0.0, 0.0}, {4.0, 4.0, 10.0});
+  boundary.setBinEdges(Z, {0.0, 0.4, 0.45, 0.5, 0.55, 1.0});
+
+  // from z = 3 to z = 6 (walls at 4, 4.5, 5, 5.5), and across the periodic wall
+  const Vector3<double> r1 {0.5, 0.5, 3.0}, dr01 {0.0, 0.0, 3.0};
+  const auto lratios = boundary.getDividedLineRatio(r1, dr01);
+  const double ref[] {1.0 / 3.0, 0.5 / 3.0, 0.5 / 3.0, 0.5 / 3.0, 0.5 / 3.0};
+  ASSERT_EQ(lratios.size(), 5);
+  for (int32_t i = 0; i < 5; i++) {
+    ASSERT_EQ(lratios[i].first, 4 * 4 * i);
+    ASSERT_NEAR(lratios[i].second, ref[i], err_fp);
+  }
+
+  const Vector3<double> r2 {0.5, 0.5, 9.0}, dr23 {0.0, 0.0, 4.8};
+  const auto wrapped = boundary.getDividedLineRatio(r2, dr23);
+  const double ref_w[] {1.0 / 4.8, 3.8 / 4.8};
+  ASSERT_EQ(wrapped.size(), 2);
+  for (int32_t i = 0; i < 2; i++) {
+    ASSERT_EQ(wrapped[i].first, 4 * 4 * 4 * (1 - i));
+    ASSERT_NEAR(wrapped[i].second, ref_w[i], err_fp);
+  }
+}
@@ -0,0 +1,162 @@
+#include "gtest/gtest.h"
+#include "../ls_calculator.hpp"
+
+#include <cstring>
+#include <fstream>
+#include <random>
+#include <thread>
+#include <sys/stat.h>
+#include <unistd.h>
+
+using namespace LS;
+
+namespace {
+  struct Pair {
+    Vector3<double> r0, r1, F;
+  };
+
+  std::vector<Pair> make_pairs(const int n, const double len, const int seed) {
+    std::mt19937 mt(seed);
+    std::uniform_real_distribution<> urd(0.0, 1.0);
+    std::vector<Pair> pairs(n);
+    for (auto& p : pairs) {
+      for (int32_t a = 0; a < D; a++) {
+        p.r0[a] = len * urd(mt);
+        p.r1[a] = len * urd(mt);
+        p.F[a]  = urd(mt) - 0.5;
+      }
+    }
+    return pairs;
+  }
+
+  std::vector<double> read_doubles(const std::string& fname) {
+    std::ifstream fin(fname, std::ios::binary);
+    std::vector<char> bytes((std::istreambuf_iterator<char>(fin)), std::istreambuf_iterator<char>());
+    // skip the header (dimension, box, mesh, number of elements and interaction types)
+    // and the name of the single interaction type
+    const std::size_t offset = 4 + 8 * D * 2 + 4 * D + 4 + 4 + 4 + 4;
+    std::vector<double> vals((bytes.size() - offset) / sizeof(double));
+    std::memcpy(vals.data(), bytes.data() + offset, vals.size() * sizeof(double));
+    return vals;
+  }
+}
+
+TEST(ConcurrentCalculator, matches_serial) {
+  const int num_threads = 4, num_frames = 3;
+  const auto pairs = make_pairs(400, 6.0, 1);
+
+  auto serial = CalculatorFactory<double>::create({0.0, 0.0, 0.0}, {6.0, 6.0, 6.0},
+                                                  BoundaryType::PERIODIC_XYZ,
+                                                  {3, 3, 3}, {"Pair"});
+  serial->setSaveDir("serial_out");
+  ConcurrentCalculator<double> conc({0.0, 0.0, 0.0}, {6.0, 6.0, 6.0},
+                                    BoundaryType::PERIODIC_XYZ,
+                                    {3, 3, 3}, {"Pair"});
+  conc.setSaveDir("conc_out");
+
+  for (int f = 0; f < num_frames; f++) {
+    for (const auto& p : pairs) serial->calcLocalStressPot2(p.r0, p.r1, p.F, -p.F, 0);
+    serial->nextStep();
+
+    std::vector<std::thread> threads;
+    for (int t = 0; t < num_threads; t++) {
+      threads.emplace_back([&, t]() {
+        for (std::size_t k = t; k < pairs.size(); k += num_threads) {
+          conc.calcLocalStressPot2(pairs[k].r0, pairs[k].r1, pairs[k].F, -pairs[k].F, 0);
+        }
+      });
+    }
+    for (auto& th : threads) th.join();
+    conc.nextStep();
+  }
+
+  EXPECT_EQ(conc.number_of_frames(), num_frames);
+  EXPECT_GE(conc.number_of_shards(), 1);
+  // new threads in every frame reuse the shards returned by nextStep
+  EXPECT_LE(conc.number_of_shards(), num_threads);
+  const auto p_serial = serial->pressure_tot(), p_conc = conc.pressure_tot();
+  for (int32_t e = 0; e < D * D; e++) EXPECT_NEAR(p_serial[e], p_conc[e], 1.0e-12);
+
+  mkdir("serial_out", 0755);
+  mkdir("conc_out", 0755);
+  serial->saveLocalStressDist();
+  serial->disableAutoSave();
+  conc.saveLocalStressDist();
+  const auto v_serial = read_doubles("serial_out/local_stress.bin");
+  const auto v_conc = read_doubles("conc_out/local_stress.bin");
+  ASSERT_EQ(v_serial.size(), v_conc.size());
+  ASSERT_EQ(v_serial.size(), std::size_t(27 * D * D));
+  for (std::size_t i = 0; i < v_serial.size(); i++) EXPECT_NEAR(v_serial[i], v_conc[i], 1.0e-12);
+
+  std::remove("serial_out/local_stress.bin");
+  std::remove("conc_out/local_stress.bin");
+  rmdir("serial_out");
+  rmdir("conc_out");
+}
+
+TEST(ConcurrentCalculator, same_thread_same_shard) {
+  ConcurrentCalculator<double> conc({0.0, 0.0, 0.0}, {6.0, 6.0, 6.0},
+                                    BoundaryType::PERIODIC_XYZ,
+                                    {3, 3, 3}, {"Pair"});
+  conc.disableAutoSave();
+  const Vector3<double> r0 {1.0, 1.0, 1.0}, r1 {1.5, 1.0, 1.0}, F {1.0, 0.0, 0.0};
+  for (int i = 0; i < 10; i++) conc.calcLocalStressPot2(r0, r1, F, -F, 0);
+  EXPECT_EQ(conc.number_of_shards(), 1);
+  std::thread([&]() { conc.calcLocalStressPot2(r0, r1, F, -F, 0); }).join();
+  EXPECT_EQ(conc.number_of_shards(), 2);
+  conc.nextStep();
+  EXPECT_NEAR(conc.pressure_tot()[0], -11 * 0.5 / 216.0, 1.0e-14);
+
+  // a new thread in the next frame takes a returned shard
+  std::thread([&]() { conc.calcLocalStressPot2(r0, r1, F, -F, 0); }).join();
+  conc.calcLocalStressPot2(r0, r1, F, -F, 0);
+  EXPECT_EQ(conc.number_of_shards(), 2);
+  conc.nextStep();
+  EXPECT_NEAR(conc.pressure_tot()[0], -13 * 0.5 / (2 * 216.0), 1.0e-14);
+}
+
+TEST(ConcurrentCalculator, kinetic_profiles) {
+  const int num_threads = 3, num_atoms = 60;
+  auto serial = CalculatorFactory<double>::create({0.0, 0.0, 0.0}, {4.0, 4.0, 4.0},
+                                                  BoundaryType::PERIODIC_XYZ,
+                                                  {2, 2, 2}, {"Kin"});
+  serial->disableAutoSave();
+  serial->enableKineticProfiles();
+  ConcurrentCalculator<double> conc({0.0, 0.0, 0.0}, {4.0, 4.0, 4.0},
+                                    BoundaryType::PERIODIC_XYZ,
+                                    {2, 2, 2}, {"Kin"});
+  conc.disableAutoSave();
+  conc.enableKineticProfiles();
+
+  // shear flow u_x = y on top of random velocities; the shards see parts of each cell
+  std::mt19937 mt(5);
+  std::uniform_real_distribution<> urd(0.0, 1.0);
+  for (int f = 0; f < 2; f++) {
+    std::vector<Vector3<double>> r(num_atoms), v(num_atoms);
+    for (int i = 0; i < num_atoms; i++) {
+      for (int32_t a = 0; a < D; a++) {
+        r[i][a] = 4.0 * urd(mt);
+        v[i][a] = urd(mt) - 0.5;
+      }
+      v[i].x += r[i].y;
+      serial->calcLocalStressKin(r[i], v[i], 2.0, 0);
+    }
+    serial->nextStep();
+
+    std::vector<std::thread> threads;
+    for (int t = 0; t < num_threads; t++) {
+      threads.emplace_back([&, t]() {
+        for (int i = t; i < num_atoms; i += num_threads) conc.calcLocalStressKin(r[i], v[i], 2.0, 0);
+      });
+    }
+    for (auto& th : threads) th.join();
+    conc.nextStep();
+  }
+
+  const auto p_serial = serial->pressure_tot(), p_conc = conc.pressure_tot();
+  for (int32_t e = 0; e < D * D; e++) EXPECT_NEAR(p_serial[e], p_conc[e], 1.0e-12);
+  for (int32_t c = 0; c < 8; c++) {
+    EXPECT_NEAR(conc.root().density(c), serial->density(c), 1.0e-12);
+    EXPECT_NEAR(conc.root().temperature(c), serial->temperature(c), 1.0e-12);
+  }
+}
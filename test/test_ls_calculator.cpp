@@ -0,0 +1,1033 @@
+#include "gtest/gtest.h"
+#include "../ls_calculator.hpp"
+
+#include <algorithm>
+#include <random>
+
+using namespace LS;
+
+namespace {
+  constexpr double err_fp = 1.0e-12;
+
+  struct Particles {
+    std::vector<Vector3<double>> r, v;
+  };
+
+  Particles make_particles(const int n, const Vector3<double>& low,
+                           const Vector3<double>& high, const int seed) {
+    std::mt19937 mt(seed);
+    std::uniform_real_distribution<> urd(0.0, 1.0);
+    Particles p;
+    for (int i = 0; i < n; i++) {
+      Vector3<double> r, v;
+      for (int32_t a = 0; a < D; a++) {
+        r[a] = low[a] + (high[a] - low[a]) * urd(mt);
+        v[a] = urd(mt) - 0.5;
+      }
+      p.r.push_back(r);
+      p.v.push_back(v);
+    }
+    return p;
+  }
+}
+
+TEST(LSCalculator, pressure_tot) {
+  const Vector3<double> low {0.0, 0.0, 0.0}, high {4.0, 5.0, 6.0};
+  auto calc = CalculatorFactory<double>::create({0.0, 0.0, 0.0}, {4.0, 5.0, 6.0},
+                                                BoundaryType::PERIODIC_XYZ,
+                                                {4, 5, 6},
+                                                {"Kinetic", "Pair"});
+  calc->disableAutoSave();
+
+  const auto p = make_particles(20, low, high, 3);
+  const Boundary<double>& bnd = calc->boundary();
+  Tensor<double> ref_kin(0.0), ref_pot(0.0);
+  for (std::size_t i = 0; i < p.r.size(); i++) {
+    calc->calcLocalStressKin(Vector3<double>(p.r[i]), Vector3<double>(p.v[i]), 2.0, 0);
+    ref_kin += tensor_dot(p.v[i], p.v[i]) * 2.0;
+    for (std::size_t j = i + 1; j < p.r.size(); j++) {
+      auto dr = p.r[i] - p.r[j];
+      bnd.applyMinimumImage(dr);
+      const auto F = dr * 0.1;
+      calc->calcLocalStressPot2(Vector3<double>(p.r[i]), Vector3<double>(p.r[j]),
+                                Vector3<double>(F), Vector3<double>(-F), 1);
+      ref_pot += tensor_dot(dr, F);
+    }
+  }
+  calc->nextStep();
+
+  const auto vol = bnd.box_volume();
+  const auto p_kin = calc->pressure_tot(0);
+  const auto p_pot = calc->pressure_tot(1);
+  for (int32_t e = 0; e < D * D; e++) {
+    ASSERT_NEAR(p_kin[e], ref_kin[e] / vol, err_fp);
+    ASSERT_NEAR(p_pot[e], ref_pot[e] / vol, err_fp);
+  }
+}
+
+TEST(LSCalculator, accumulate_result) {
+  auto calcs = CalculatorFactory<double>::createOMP(2, {0.0, 0.0, 0.0}, {4.0, 4.0, 4.0},
+                                                    BoundaryType::PERIODIC_XYZ,
+                                                    {2, 2, 2},
+                                                    {"Kinetic"});
+  for (auto& c : calcs) c->disableAutoSave();
+  calcs[0]->calcLocalStressKin({0.5, 0.5, 0.5}, {1.0, 0.0, 0.0}, 1.0, 0);
+  calcs[1]->calcLocalStressKin({3.5, 0.5, 0.5}, {0.0, 2.0, 0.0}, 1.0, 0);
+  calcs[0]->nextStep();
+  accumulateResult(*calcs[0], *calcs[1]);
+  const auto p = calcs[0]->pressure_tot(0);
+  ASSERT_NEAR(p.xx, 1.0 / 64.0, err_fp);
+  ASSERT_NEAR(p.yy, 4.0 / 64.0, err_fp);
+  ASSERT_NEAR(p.xy, 0.0, err_fp);
+}
+
+TEST(LSHelpers, save_omp_reduction) {
+  const int num_calcs = 5;
+  auto calcs = CalculatorFactory<double>::createOMP(num_calcs, {0.0, 0.0, 0.0}, {4.0, 4.0, 4.0},
+                                                    BoundaryType::PERIODIC_XYZ,
+                                                    {2, 2, 2},
+                                                    {"Kinetic"});
+  for (int i = 0; i < num_calcs; i++) {
+    ASSERT_TRUE(calcs[i] != nullptr);
+    calcs[i]->setSaveDir(".");
+    calcs[i]->calcLocalStressKin({0.5 + 0.5 * i, 0.5, 0.5}, {i + 1.0, 0.0, 0.0}, 1.0, 0);
+  }
+  calcs[0]->nextStep();
+  LSHelpers<double>::saveLocalStressDistOMP(calcs);
+  // 1 + 4 + 9 + 16 + 25, normalized by -1 / frames
+  ASSERT_NEAR(calcs[0]->stress_dist(0).sum().xx, -55.0, err_fp);
+  std::remove("local_stress.bin");
+}
+
+TEST(LSCalculator, symmetric_storage) {
+  const Vector3<double> low {0.0, 0.0, 0.0}, high {3.0, 3.0, 3.0};
+  auto full = CalculatorFactory<double>::create({0.0, 0.0, 0.0}, {3.0, 3.0, 3.0},
+                                                BoundaryType::PERIODIC_XYZ,
+                                                {3, 3, 3}, {"Pair"});
+  auto sym = CalculatorFactory<double>::create({0.0, 0.0, 0.0}, {3.0, 3.0, 3.0},
+                                               BoundaryType::PERIODIC_XYZ,
+                                               {3, 3, 3}, {"Pair"},
+                                               TensorStorage::SYMMETRIC);
+  full->disableAutoSave();
+  sym->setSaveDir(".");
+
+  const auto p = make_particles(10, low, high, 7);
+  for (std::size_t i = 0; i < p.r.size(); i++) {
+    for (std::size_t j = i + 1; j < p.r.size(); j++) {
+      auto dr = p.r[i] - p.r[j];
+      full->boundary().applyMinimumImage(dr);
+      const auto F = dr * 0.3;
+      full->calcLocalStressPot2(Vector3<double>(p.r[i]), Vector3<double>(p.r[j]),
+                                Vector3<double>(F), Vector3<double>(-F), 0);
+      sym->calcLocalStressPot2(Vector3<double>(p.r[i]), Vector3<double>(p.r[j]),
+                               Vector3<double>(F), Vector3<double>(-F), 0);
+    }
+  }
+  full->nextStep();
+  sym->nextStep();
+  const auto p_full = full->pressure_tot();
+  const auto p_sym  = sym->pressure_tot();
+  for (int32_t e = 0; e < D * D; e++) ASSERT_NEAR(p_full[e], p_sym[e], err_fp);
+
+  sym->saveLocalStressDist();
+  sym->disableAutoSave();
+  std::ifstream fin("./local_stress.bin", std::ios::binary);
+  ASSERT_TRUE(fin.good());
+  fin.seekg(sizeof(uint32_t) + 2 * D * sizeof(double) + D * sizeof(int32_t));
+  uint32_t num_elem = 0;
+  fin.read(reinterpret_cast<char*>(&num_elem), sizeof(num_elem));
+  ASSERT_EQ(num_elem, uint32_t(D * (D + 1) / 2));
+  fin.seekg(0, std::ios::end);
+  const std::size_t header = sizeof(uint32_t) * 4 + 2 * D * sizeof(double) + D * sizeof(int32_t) + 4;
+  ASSERT_EQ(std::size_t(fin.tellg()), header + 27 * num_elem * sizeof(double));
+}
+
+static std::string read_file(const std::string& fname) {
+  std::ifstream fin(fname, std::ios::binary);
+  return std::string(std::istreambuf_iterator<char>(fin), std::istreambuf_iterator<char>());
+}
+
+TEST(LSCalculator, sparse_grid) {
+  const Vector3<double> low {0.0, 0.0, 0.0}, high {10.0, 10.0, 10.0};
+  auto dense = CalculatorFactory<double>::create({0.0, 0.0, 0.0}, {10.0, 10.0, 10.0},
+                                                 BoundaryType::PERIODIC_XYZ,
+                                                 {20, 20, 20}, {"Pair"});
+  auto sparse = CalculatorFactory<double>::create({0.0, 0.0, 0.0}, {10.0, 10.0, 10.0},
+                                                  BoundaryType::PERIODIC_XYZ,
+                                                  {20, 20, 20}, {"Pair"});
+  sparse->enableSparseGrid(6);
+
+  // a small cluster in a large box touches only a few pages
+  const auto p = make_particles(8, Vector3<double>{4.0, 4.0, 4.0},
+                                Vector3<double>{5.0, 5.0, 5.0}, 11);
+  for (std::size_t i = 0; i < p.r.size(); i++) {
+    for (std::size_t j = i + 1; j < p.r.size(); j++) {
+      const auto F = (p.r[i] - p.r[j]) * 0.7;
+      dense->calcLocalStressPot2(p.r[i], p.r[j], F, -F, 0);
+      sparse->calcLocalStressPot2(p.r[i], p.r[j], F, -F, 0);
+    }
+  }
+  const auto& grid = sparse->stress_dist(0);
+  ASSERT_GT(grid.number_of_allocated_page(), 0);
+  ASSERT_LT(grid.number_of_allocated_page(), grid.number_of_page() / 4);
+  dense->nextStep();
+  sparse->nextStep();
+
+  dense->setSaveDir(".");
+  sparse->setSaveDir(".");
+  dense->saveLocalStressDist();
+  dense->disableAutoSave();
+  const auto b0 = read_file("./local_stress.bin");
+  sparse->saveLocalStressDist();
+  sparse->disableAutoSave();
+  const auto b1 = read_file("./local_stress.bin");
+  // untouched dense cells hold -0.0 after normalization, sparse ones +0.0
+  ASSERT_EQ(b0.size(), b1.size());
+  const std::size_t header = sizeof(uint32_t) * 4 + 2 * D * sizeof(double) + D * sizeof(int32_t) + 4;
+  ASSERT_EQ(b0.size(), header + 8000 * D * D * sizeof(double));
+  ASSERT_EQ(b0.substr(0, header), b1.substr(0, header));
+  for (std::size_t ofs = header; ofs < b0.size(); ofs += sizeof(double)) {
+    double v0, v1;
+    std::memcpy(&v0, &b0[ofs], sizeof(double));
+    std::memcpy(&v1, &b1[ofs], sizeof(double));
+    ASSERT_EQ(v0, v1);
+  }
+}
+
+template <typename Acc>
+static void check_mixed_precision(void) {
+  auto calc_f = CalculatorFactory<float, Acc>::create({0.0f, 0.0f, 0.0f}, {3.0f, 3.0f, 3.0f},
+                                                      BoundaryType::PERIODIC_XYZ,
+                                                      {3, 3, 3}, {"Bond", "Angle", "Dihedral"});
+  auto calc_d = CalculatorFactory<double>::create({0.0, 0.0, 0.0}, {3.0, 3.0, 3.0},
+                                                  BoundaryType::PERIODIC_XYZ,
+                                                  {3, 3, 3}, {"Bond", "Angle", "Dihedral"});
+  calc_f->disableAutoSave();
+  calc_d->disableAutoSave();
+
+  // forces on the 4 atoms sum to zero.
+  const std::array<Vector3<double>, 4> r {{{0.2, 0.4, 0.5}, {1.1, 0.9, 1.4},
+                                           {2.1, 1.2, 0.7}, {2.8, 2.3, 1.6}}};
+  const std::array<Vector3<double>, 4> F {{{0.3, -0.2, 0.1}, {-0.5, 0.4, 0.2},
+                                           {0.1, 0.1, -0.6}, {0.1, -0.3, 0.3}}};
+  auto to_f = [](const Vector3<double>& v) { return Vector3<float>(v.x, v.y, v.z); };
+  const Vector3<double> f3 = -(F[0] + F[1]);
+  for (int step = 0; step < 100; step++) {
+    calc_f->calcLocalStressPot2(to_f(r[0]), to_f(r[1]), to_f(F[0]), to_f(-F[0]), 0);
+    calc_d->calcLocalStressPot2(Vector3<double>(r[0]), Vector3<double>(r[1]),
+                                Vector3<double>(F[0]), Vector3<double>(-F[0]), 0);
+    calc_f->calcLocalStressPot3(to_f(r[0]), to_f(r[1]), to_f(r[2]),
+                                to_f(F[0]), to_f(F[1]), to_f(f3), 1);
+    calc_d->calcLocalStressPot3(Vector3<double>(r[0]), Vector3<double>(r[1]), Vector3<double>(r[2]),
+                                Vector3<double>(F[0]), Vector3<double>(F[1]), Vector3<double>(f3), 1);
+    calc_f->calcLocalStressPot4(to_f(r[0]), to_f(r[1]), to_f(r[2]), to_f(r[3]),
+                                to_f(F[0]), to_f(F[1]), to_f(F[2]), to_f(F[3]), 2);
+    calc_d->calcLocalStressPot4(Vector3<double>(r[0]), Vector3<double>(r[1]),
+                                Vector3<double>(r[2]), Vector3<double>(r[3]),
+                                Vector3<double>(F[0]), Vector3<double>(F[1]),
+                                Vector3<double>(F[2]), Vector3<double>(F[3]), 2);
+    calc_f->nextStep();
+    calc_d->nextStep();
+  }
+
+  for (int type = 0; type < 3; type++) {
+    const auto p_f = calc_f->pressure_tot(type);
+    const auto p_d = calc_d->pressure_tot(type);
+    for (int32_t e = 0; e < D * D; e++) ASSERT_NEAR(p_f[e], p_d[e], 1.0e-5);
+  }
+}
+
+TEST(LSCalculator, mixed_precision) {
+  check_mixed_precision<double>();
+  check_mixed_precision<Compensated<float>>();
+  check_mixed_precision<float>();
+}
+
+TEST(LSCalculator, strided_view) {
+  struct Atom {
+    int32_t id;
+    double qx, qy, qz;
+    double px, py, pz;
+  };
+  const Vector3<double> low {0.0, 0.0, 0.0}, high {3.0, 4.0, 5.0};
+  const auto p = make_particles(8, low, high, 11);
+  std::vector<Atom> atoms(p.r.size());
+  std::vector<double> x, y, z;
+  for (std::size_t i = 0; i < p.r.size(); i++) {
+    atoms[i] = {int32_t(i), p.r[i].x, p.r[i].y, p.r[i].z, p.v[i].x, p.v[i].y, p.v[i].z};
+    x.push_back(p.r[i].x); y.push_back(p.r[i].y); z.push_back(p.r[i].z);
+  }
+  const VecArrayView<double> q_aos(&atoms[0].qx, sizeof(Atom));
+  const VecArrayView<double> p_aos(&atoms[0].px, sizeof(Atom));
+  const VecArrayView<double> q_soa({x.data(), y.data(), z.data()});
+  ASSERT_EQ(q_aos[5].z, p.r[5].z);
+  ASSERT_EQ(q_soa[5].y, p.r[5].y);
+
+  std::array<std::unique_ptr<LSCalculator<double>>, 3> calcs;
+  for (auto& c : calcs) {
+    c = CalculatorFactory<double>::create({0.0, 0.0, 0.0}, {3.0, 4.0, 5.0},
+                                          BoundaryType::PERIODIC_XYZ,
+                                          {3, 4, 5}, {"Kinetic", "Pair", "Angle"});
+    c->disableAutoSave();
+  }
+
+  const int32_t n = p.r.size();
+  calcs[0]->calcLocalStressKin(q_aos, p_aos, n, 1.5, 0);
+  calcs[1]->calcLocalStressKin(q_soa, p_aos, n, 1.5, 0);
+  for (int32_t i = 0; i < n; i++) {
+    calcs[2]->calcLocalStressKin(p.r[i], p.v[i], 1.5, 0);
+  }
+  for (int32_t i = 0; i + 1 < n; i++) {
+    const Vector3<double> F {0.1 * i, -0.2, 0.3};
+    calcs[0]->calcLocalStressPot2(q_aos, i, i + 1, F, -F, 1);
+    calcs[1]->calcLocalStressPot2NoCheck(q_soa, i, i + 1, F, -F, 1);
+    calcs[2]->calcLocalStressPot2(p.r[i], p.r[i + 1], F, -F, 1);
+  }
+  const Vector3<double> F0 {0.1, 0.2, -0.1}, F1 {-0.3, 0.1, 0.2};
+  const Vector3<double> F2 = -(F0 + F1);
+  calcs[0]->calcLocalStressPot3(q_aos, 0, 3, 6, F0, F1, F2, 2);
+  calcs[1]->calcLocalStressPot3NoCheck(q_soa, 0, 3, 6, F0, F1, F2, 2);
+  calcs[2]->calcLocalStressPot3({p.r[0].x, p.r[0].y, p.r[0].z}, p.r[3], p.r[6], F0, F1, F2, 2);
+
+  for (auto& c : calcs) c->nextStep();
+  for (int type = 0; type < 3; type++) {
+    const auto ref = calcs[2]->pressure_tot(type);
+    for (int k = 0; k < 2; k++) {
+      const auto pt = calcs[k]->pressure_tot(type);
+      for (int32_t e = 0; e < D * D; e++) ASSERT_NEAR(pt[e], ref[e], err_fp);
+    }
+  }
+}
+
+TEST(LSCalculator, cell_cache) {
+  const Vector3<double> low {-1.0, 0.0, 2.0}, high {3.0, 5.0, 8.0};
+  const auto p = make_particles(30, low, high, 5);
+  std::vector<double> buf;
+  for (const auto& r : p.r) { buf.push_back(r.x); buf.push_back(r.y); buf.push_back(r.z); }
+  std::vector<double> vbuf;
+  for (const auto& v : p.v) { vbuf.push_back(v.x); vbuf.push_back(v.y); vbuf.push_back(v.z); }
+  const VecArrayView<double> pos(buf.data()), vel(vbuf.data());
+
+  std::array<std::unique_ptr<LSCalculator<double>>, 4> calcs;
+  for (auto& c : calcs) {
+    c = CalculatorFactory<double>::create({-1.0, 0.0, 2.0}, {3.0, 5.0, 8.0},
+                                          BoundaryType::PERIODIC_XYZ,
+                                          {4, 5, 6}, {"Kinetic", "Pair", "Angle", "Dihedral"});
+    c->disableAutoSave();
+  }
+  calcs[1]->prepareFrame(pos, p.r.size());
+  // atoms outside of the cache and other views take the uncached path
+  calcs[2]->prepareFrame(pos, p.r.size() / 2);
+  const std::vector<double> other(buf);
+  calcs[3]->prepareFrame(VecArrayView<double>(other.data()), p.r.size());
+
+  const int32_t n = p.r.size();
+  for (auto& c : calcs) {
+    c->calcLocalStressKin(pos, vel, n, 1.0, 0);
+    for (int32_t i = 0; i < n; i++) {
+      for (int32_t j = i + 1; j < n; j++) {
+        const Vector3<double> F {0.01 * i, 0.02 * j, -0.03};
+        c->calcLocalStressPot2(pos, i, j, F, -F, 1);
+      }
+    }
+    for (int32_t i = 0; i + 3 < n; i++) {
+      const Vector3<double> F0 {0.1, 0.2, -0.1}, F1 {-0.3, 0.1, 0.2}, F2 {0.05, -0.1, 0.3};
+      c->calcLocalStressPot3(pos, i, i + 1, i + 2, F0, F1, -(F0 + F1), 2);
+      c->calcLocalStressPot4NoCheck(pos, i, i + 1, i + 2, i + 3, F0, F1, F2, -(F0 + F1 + F2), 3);
+    }
+    c->nextStep();
+  }
+
+  const auto num_cell = calcs[0]->boundary().number_of_cell();
+  for (int type = 0; type < 4; type++) {
+    for (int32_t cell = 0; cell < num_cell; cell++) {
+      const auto t0 = calcs[0]->stress_dist(type)[cell];
+      for (int k = 1; k < 4; k++) {
+        const auto t1 = calcs[k]->stress_dist(type)[cell];
+        for (int32_t e = 0; e < D * D; e++) ASSERT_NEAR(t0[e], t1[e], err_fp);
+      }
+    }
+  }
+}
+
+TEST(LSCalculator, update_box) {
+  auto calcs = CalculatorFactory<double>::createOMP(2, {0.0, 0.0, 0.0}, {4.0, 4.0, 4.0},
+                                                    BoundaryType::PERIODIC_XYZ,
+                                                    {4, 4, 4}, {"Pair"});
+  for (auto& c : calcs) c->disableAutoSave();
+  auto& calc = *calcs[0];
+
+  // the same fractional configuration in a box of length 4 and then 5
+  const Vector3<double> s0(0.3, 0.55, 0.6), s1(0.6, 0.55, 0.6), F(1.0, 0.5, 0.0);
+  double ref = 0.0;
+  for (const double len : {4.0, 5.0}) {
+    const Vector3<double> low(-0.5 * len), high(0.5 * len);
+    LSHelpers<double>::updateBoxOMP(calcs, low, high);
+    ASSERT_DOUBLE_EQ(calcs[1]->boundary().box_length().x, len);
+    const auto r0 = low + s0 * len, r1 = low + s1 * len;
+    calc.calcLocalStressPot2(r0, r1, F, -F, 0);
+    calc.nextStep();
+    ref += (r0 - r1).x * F.x / (len * len * len);
+  }
+  ASSERT_NEAR(calc.pressure_tot().xx, 0.5 * ref, err_fp);
+
+  // cells keep their fractional coordinates: the contour crosses one wall at s = 0.5
+  const auto& grid = calc.stress_dist(0);
+  const int32_t c_lo = 1 + 4 * (2 + 4 * 2), c_hi = 2 + 4 * (2 + 4 * 2);
+  ASSERT_NEAR(grid[c_lo].xx, 64.0 * ref * (2.0 / 3.0), err_fp);
+  ASSERT_NEAR(grid[c_hi].xx, 64.0 * ref * (1.0 / 3.0), err_fp);
+}
+
+TEST(LSCalculator, triclinic) {
+  const double len = 5.0;
+  const std::array<double, 3> tilt {{1.5, -0.5, 0.75}};
+  auto calc = CalculatorFactory<double>::create({0.0, 0.0, 0.0}, {len, len, len},
+                                                BoundaryType::PERIODIC_XYZ,
+                                                {5, 5, 5}, {"Pair"});
+  auto cached = CalculatorFactory<double>::create({0.0, 0.0, 0.0}, {len, len, len},
+                                                  BoundaryType::PERIODIC_XYZ,
+                                                  {5, 5, 5}, {"Pair"});
+  calc->disableAutoSave();
+  cached->disableAutoSave();
+  calc->updateBox(Vector3<double>(0.0), Vector3<double>(len), tilt);
+  cached->updateBox(Vector3<double>(0.0), Vector3<double>(len), tilt);
+
+  // positions inside of the sheared box
+  const auto p = make_particles(12, Vector3<double>(0.0), Vector3<double>(len), 13);
+  std::vector<Vector3<double>> r(p.r);
+  for (auto& ri : r) calc->boundary().adjustBoundary(ri);
+
+  Tensor<double> ref(0.0);
+  const VecArrayView<double> view(&r[0].x);
+  cached->prepareFrame(view, r.size());
+  for (std::size_t i = 0; i < r.size(); i++) {
+    for (std::size_t j = i + 1; j < r.size(); j++) {
+      auto dr = r[i] - r[j];
+      calc->boundary().applyMinimumImage(dr);
+      const auto F = dr * 0.3;
+      calc->calcLocalStressPot2(r[i], r[j], F, -F, 0);
+      cached->calcLocalStressPot2NoCheck(view, i, j, F, -F, 0);
+      ref += tensor_dot(dr, F);
+    }
+  }
+  const auto sum = calc->stress_dist(0).sum();
+  for (int32_t e = 0; e < D * D; e++) ASSERT_NEAR(sum[e], ref[e], 1.0e-10);
+  const auto& g0 = calc->stress_dist(0);
+  const auto& g1 = cached->stress_dist(0);
+  for (int32_t c = 0; c < g0.number_of_cell(); c++) {
+    for (int32_t e = 0; e < D * D; e++) ASSERT_NEAR(g0.elem(e, c), g1.elem(e, c), 1.0e-12);
+  }
+}
+
+TEST(LSCalculator, update_box_resets_tilt) {
+  const double len = 5.0;
+  const std::array<double, 3> tilt {{1.5, -0.5, 0.75}};
+  auto calc = CalculatorFactory<double>::create({0.0, 0.0, 0.0}, {len, len, len},
+                                                BoundaryType::PERIODIC_XYZ,
+                                                {5, 5, 5}, {"Pair"});
+  calc->disableAutoSave();
+  calc->updateBox(Vector3<double>(0.0), Vector3<double>(len), tilt);
+  calc->updateBox(Vector3<double>(0.0), Vector3<double>(2.0 * len));
+  for (const auto t : calc->boundary().tilt_factors()) ASSERT_EQ(t, 0.0);
+
+  auto dr = Vector3<double>(6.0, 1.0, 7.0);
+  calc->boundary().applyMinimumImage(dr);
+  ASSERT_NEAR(dr.x, -4.0, 1.0e-12);
+  ASSERT_NEAR(dr.y,  1.0, 1.0e-12);
+  ASSERT_NEAR(dr.z, -3.0, 1.0e-12);
+}
+
+TEST(LSCalculator, heat_flux) {
+  const Vector3<double> low {0.0, 0.0, 0.0}, high {4.0, 5.0, 6.0};
+  auto calc = CalculatorFactory<double>::create({0.0, 0.0, 0.0}, {4.0, 5.0, 6.0},
+                                                BoundaryType::PERIODIC_XYZ,
+                                                {4, 5, 6}, {"Kinetic", "Pair", "Angle"});
+  auto plain = CalculatorFactory<double>::create({0.0, 0.0, 0.0}, {4.0, 5.0, 6.0},
+                                                 BoundaryType::PERIODIC_XYZ,
+                                                 {4, 5, 6}, {"Kinetic", "Pair", "Angle"});
+  calc->disableAutoSave();
+  plain->disableAutoSave();
+  calc->enableHeatFlux();
+  ASSERT_TRUE(calc->heat_flux_enabled());
+
+  const auto p = make_particles(16, low, high, 17);
+  const int32_t n = p.r.size();
+  const Boundary<double>& bnd = calc->boundary();
+  Vector3<double> ref_kin, ref_pair, ref_angle;
+  for (int32_t i = 0; i < n; i++) {
+    const auto& v = p.v[i];
+    calc->calcLocalStressKin(p.r[i], v, 2.0, 0.1 * i, 0);
+    plain->calcLocalStressKin(p.r[i], v, 2.0, 0);
+    ref_kin += v * ((v * v) + 0.1 * i);
+    for (int32_t j = i + 1; j < n; j++) {
+      auto dr = p.r[i] - p.r[j];
+      bnd.applyMinimumImage(dr);
+      const auto F = dr * 0.1;
+      calc->calcLocalStressPot2(p.r[i], p.r[j], p.v[i], p.v[j], F, -F, 1);
+      plain->calcLocalStressPot2(p.r[i], p.r[j], F, -F, 1);
+      ref_pair += dr * (F * (p.v[i] + p.v[j]) * 0.5);
+    }
+  }
+  // a three-body force: the heat flux of each decomposed pair uses its own velocities
+  const Vector3<double> F0 {0.2, -0.1, 0.05}, F1 {-0.1, 0.3, 0.1};
+  calc->calcLocalStressPot3(p.r[0], p.r[1], p.r[2], p.v[0], p.v[1], p.v[2], F0, F1, -(F0 + F1), 2);
+  plain->calcLocalStressPot3(p.r[0], p.r[1], p.r[2], F0, F1, -(F0 + F1), 2);
+  {
+    auto dr01 = p.r[0] - p.r[1]; bnd.applyMinimumImage(dr01);
+    auto dr12 = p.r[1] - p.r[2]; bnd.applyMinimumImage(dr12);
+    auto dr20 = p.r[2] - p.r[0]; bnd.applyMinimumImage(dr20);
+    const auto dF = decomposeForce(std::array<Vector3<double>, 3> {{F0, F1, -(F0 + F1)}},
+                                   std::array<Vector3<double>, 3> {{dr01, dr12, dr20}});
+    ref_angle += dr01 * (dF[0] * (p.v[0] + p.v[1]) * 0.5);
+    ref_angle += dr12 * (dF[1] * (p.v[1] + p.v[2]) * 0.5);
+    ref_angle += dr20 * (dF[2] * (p.v[2] + p.v[0]) * 0.5);
+  }
+  calc->nextStep();
+  plain->nextStep();
+
+  const auto vol = bnd.box_volume();
+  const Vector3<double> refs[] = {ref_kin, ref_pair, ref_angle};
+  for (int type = 0; type < 3; type++) {
+    const auto j = calc->heat_flux_tot(type);
+    for (int32_t a = 0; a < D; a++) ASSERT_NEAR(j[a], refs[type][a] / vol, err_fp);
+  }
+
+  // the stress is unchanged, and the heat flux follows the same contour split
+  const auto num_cell = bnd.number_of_cell();
+  for (int type = 0; type < 3; type++) {
+    for (int32_t c = 0; c < num_cell; c++) {
+      const auto t0 = calc->stress_dist(type)[c];
+      const auto t1 = plain->stress_dist(type)[c];
+      for (int32_t e = 0; e < D * D; e++) ASSERT_NEAR(t0[e], t1[e], err_fp);
+    }
+  }
+  auto one = CalculatorFactory<double>::create({0.0, 0.0, 0.0}, {4.0, 4.0, 4.0},
+                                               BoundaryType::PERIODIC_XYZ,
+                                               {4, 1, 1}, {"Pair"});
+  one->disableAutoSave();
+  one->enableHeatFlux();
+  const Vector3<double> r0 {0.5, 1.0, 1.0}, r1 {2.0, 1.0, 1.0}, F {1.0, 0.0, 0.0}, v {2.0, 0.0, 0.0};
+  one->calcLocalStressPot2(r0, r1, v, v, F, -F, 0);
+  const auto& hflux = one->heat_flux(0);
+  const auto& sdist = one->stress_dist(0);
+  for (int32_t c = 0; c < 4; c++) {
+    ASSERT_NEAR(hflux.vector(c).x, 2.0 * sdist[c].xx, err_fp);
+  }
+  ASSERT_NEAR(hflux.vector(0).x, -1.0, err_fp);
+  ASSERT_NEAR(hflux.vector(1).x, -2.0, err_fp);
+}
+
+TEST(LSCalculator, heat_flux_output) {
+  {
+    auto calc = CalculatorFactory<double>::create({0.0, 0.0, 0.0}, {2.0, 2.0, 2.0},
+                                                  BoundaryType::PERIODIC_XYZ,
+                                                  {2, 1, 1}, {"Kinetic"});
+    calc->enableHeatFlux();
+    calc->calcLocalStressKin({0.5, 0.5, 0.5}, {1.0, 0.0, 0.0}, 2.0, 1.0, 0);
+    calc->nextStep();
+  }
+  std::ifstream fin("local_heat_flux.bin", std::ios::binary);
+  ASSERT_TRUE(fin.is_open());
+  fin.seekg(4 + 3 * 8 * 2 + 3 * 4);
+  uint32_t num_elem = 0, num_itypes = 0, len = 0;
+  fin.read(reinterpret_cast<char*>(&num_elem), 4);
+  fin.read(reinterpret_cast<char*>(&num_itypes), 4);
+  fin.read(reinterpret_cast<char*>(&len), 4);
+  ASSERT_EQ(num_elem, 3u);
+  ASSERT_EQ(num_itypes, 1u);
+  fin.seekg(len, std::ios::cur);
+  double j[6];
+  fin.read(reinterpret_cast<char*>(j), sizeof(j));
+  ASSERT_DOUBLE_EQ(j[0], 2.0);
+  ASSERT_DOUBLE_EQ(j[1], 0.0);
+  ASSERT_DOUBLE_EQ(j[3], 0.0);
+  fin.close();
+  std::remove("local_heat_flux.bin");
+  std::remove("local_stress.bin");
+}
+
+TEST(LSCalculator, kinetic_profiles) {
+  const Vector3<double> low {0.0, 0.0, 0.0}, high {4.0, 4.0, 4.0};
+  auto calc = CalculatorFactory<double>::create({0.0, 0.0, 0.0}, {4.0, 4.0, 4.0},
+                                                BoundaryType::PERIODIC_XYZ,
+                                                {2, 2, 2}, {"KinA", "KinB"});
+  calc->disableAutoSave();
+  calc->enableKineticProfiles();
+  const Boundary<double>& bnd = calc->boundary();
+  const int32_t num_cell = bnd.number_of_cell();
+
+  // the same frames split over two workers, reduced with accumulateFrames
+  std::vector<std::unique_ptr<LSCalculator<double>>> workers;
+  for (int k = 0; k < 2; k++) {
+    workers.push_back(CalculatorFactory<double>::create({0.0, 0.0, 0.0}, {4.0, 4.0, 4.0},
+                                                        BoundaryType::PERIODIC_XYZ,
+                                                        {2, 2, 2}, {"KinA", "KinB"}));
+  }
+  // the atoms of each frame split over two calculators, ended with nextStepOMP
+  auto shards = CalculatorFactory<double>::createOMP(2, {0.0, 0.0, 0.0}, {4.0, 4.0, 4.0},
+                                                     BoundaryType::PERIODIC_XYZ,
+                                                     {2, 2, 2}, {"KinA", "KinB"});
+  for (auto& w : workers) {
+    w->disableAutoSave();
+    w->enableKineticProfiles();
+  }
+  for (auto& sh : shards) {
+    sh->disableAutoSave();
+    sh->enableKineticProfiles();
+  }
+
+  // shear flow u_x = y on top of random thermal velocities, two frames
+  std::vector<Tensor<double>> ref_kin(2 * num_cell, Tensor<double>(0.0));
+  std::vector<double> ref_mass(num_cell, 0.0), ref_ke(num_cell, 0.0), ref_dof(num_cell, 0.0);
+  std::vector<Vector3<double>> ref_mom(num_cell);
+  for (int frame = 0; frame < 2; frame++) {
+    auto p = make_particles(40, low, high, 21 + frame);
+    std::vector<double> mass(p.r.size());
+    for (std::size_t i = 0; i < p.r.size(); i++) {
+      p.v[i].x += p.r[i].y;
+      mass[i] = (i % 2) ? 1.0 : 3.0;
+      calc->calcLocalStressKin(p.r[i], p.v[i], mass[i], i % 2);
+      workers[frame]->calcLocalStressKin(p.r[i], p.v[i], mass[i], i % 2);
+      shards[(i / 3) % 2]->calcLocalStressKin(p.r[i], p.v[i], mass[i], i % 2);
+    }
+    calc->nextStep();
+    workers[frame]->nextStep();
+    LSHelpers<double>::nextStepOMP(shards);
+
+    // two-pass reference: cell mean velocity, then sum m (v - u)(v - u)
+    std::vector<double> m(num_cell, 0.0);
+    std::vector<int> n(num_cell, 0);
+    std::vector<Vector3<double>> mom(num_cell);
+    for (std::size_t i = 0; i < p.r.size(); i++) {
+      const auto c = bnd.getCellPositionHash(p.r[i]);
+      m[c] += mass[i];
+      mom[c] += p.v[i] * mass[i];
+      n[c]++;
+    }
+    for (std::size_t i = 0; i < p.r.size(); i++) {
+      const auto c = bnd.getCellPositionHash(p.r[i]);
+      const auto w = p.v[i] - mom[c] / m[c];
+      ref_kin[(i % 2) * num_cell + c] += tensor_dot(w, w) * mass[i];
+      ref_ke[c] += 0.5 * mass[i] * (w * w);
+    }
+    // the streaming velocity of each cell takes D degrees of freedom per frame
+    for (int32_t c = 0; c < num_cell; c++) {
+      if (n[c] > 0) ref_dof[c] += 3.0 * (n[c] - 1);
+      ref_mass[c] += m[c];
+      ref_mom[c] += mom[c];
+    }
+  }
+
+  const double cell_vol = 8.0;
+  for (int type = 0; type < 2; type++) {
+    for (int32_t c = 0; c < num_cell; c++) {
+      const auto t = calc->stress_dist(type)[c];
+      for (int32_t e = 0; e < D * D; e++) ASSERT_NEAR(t[e], ref_kin[type * num_cell + c][e], 1.0e-10);
+    }
+  }
+  for (int32_t c = 0; c < num_cell; c++) {
+    ASSERT_NEAR(calc->density(c), ref_mass[c] / (2.0 * cell_vol), err_fp);
+    const auto u = calc->streaming_velocity(c);
+    for (int32_t a = 0; a < D; a++) ASSERT_NEAR(u[a], ref_mom[c][a] / ref_mass[c], err_fp);
+    ASSERT_NEAR(calc->temperature(c), 2.0 * ref_ke[c] / ref_dof[c], err_fp);
+  }
+  // the cells at y < 2 flow slower than those at y > 2
+  ASSERT_LT(calc->streaming_velocity(0).x, calc->streaming_velocity(2).x);
+
+  accumulateFrames(*workers[0], *workers[1]);
+  accumulateResult(*shards[0], *shards[1]);
+  for (int32_t c = 0; c < num_cell; c++) {
+    ASSERT_NEAR(workers[0]->density(c), calc->density(c), err_fp);
+    ASSERT_NEAR(workers[0]->temperature(c), calc->temperature(c), err_fp);
+    ASSERT_NEAR(shards[0]->density(c), calc->density(c), err_fp);
+    ASSERT_NEAR(shards[0]->temperature(c), calc->temperature(c), err_fp);
+    for (int type = 0; type < 2; type++) {
+      const auto t = shards[0]->stress_dist(type)[c], t_ref = calc->stress_dist(type)[c];
+      for (int32_t e = 0; e < D * D; e++) ASSERT_NEAR(t[e], t_ref[e], 1.0e-10);
+    }
+  }
+}
+
+TEST(LSCalculator, region_of_interest) {
+  const Vector3<double> low {0.0, 0.0, 0.0}, high {4.0, 4.0, 4.0};
+  const std::array<int32_t, D> mdim {4, 4, 4}, lo {1, 0, 2}, dim {2, 4, 1};
+  const std::array<bool, D> periodic {true, true, false};
+  const CellWindow window(mdim, periodic, lo, dim, 0);
+
+  // x wraps around, z does not
+  ASSERT_TRUE(window.intersects({3, 0, 2}, {4, 0, 2}) == false);
+  ASSERT_TRUE(window.intersects({3, 0, 2}, {5, 0, 2}));
+  ASSERT_TRUE(window.intersects({-1, 0, 2}, {0, 0, 2}) == false);
+  ASSERT_TRUE(window.intersects({-3, 0, 2}, {-2, 0, 2}));
+  ASSERT_TRUE(window.intersects({0, 0, 0}, {1, 0, 1}) == false);
+  ASSERT_TRUE(window.intersects({1, 5, 1}, {1, 7, 3}));
+  ASSERT_TRUE(window.intersects({1, 0, 3}, {1, 0, 5}) == false);
+
+  const auto p = make_particles(30, low, high, 11);
+  std::vector<double> buf;
+  for (const auto& r : p.r) { buf.push_back(r.x); buf.push_back(r.y); buf.push_back(r.z); }
+  const VecArrayView<double> pos(buf.data());
+
+  std::array<std::unique_ptr<LSCalculator<double>>, 3> calcs;
+  for (auto& c : calcs) {
+    c = CalculatorFactory<double>::create({0.0, 0.0, 0.0}, {4.0, 4.0, 4.0},
+                                          BoundaryType::PERIODIC_XY,
+                                          {4, 4, 4}, {"Kinetic", "Pair"});
+    c->disableAutoSave();
+  }
+  calcs[1]->setRegionOfInterest(lo, dim);
+  calcs[2]->setRegionOfInterest(Vector3<double>(1.5, 0.0, 2.0), Vector3<double>(2.5, 4.0, 2.5));
+  ASSERT_FALSE(calcs[0]->has_region_of_interest());
+  ASSERT_TRUE(calcs[2]->has_region_of_interest());
+  calcs[2]->prepareFrame(pos, p.r.size());
+
+  const int32_t n = p.r.size();
+  for (auto& c : calcs) {
+    for (int32_t i = 0; i < n; i++) {
+      c->calcLocalStressKin(Vector3<double>(p.r[i]), Vector3<double>(p.v[i]), 1.0, 0);
+      for (int32_t j = i + 1; j < n; j++) {
+        auto dr = p.r[i] - p.r[j];
+        c->boundary().applyMinimumImage(dr);
+        const auto F = dr * 0.2;
+        if (c == calcs[2]) {
+          c->calcLocalStressPot2(pos, i, j, F, -F, 1);
+        } else {
+          c->calcLocalStressPot2(Vector3<double>(p.r[i]), Vector3<double>(p.r[j]),
+                                 Vector3<double>(F), Vector3<double>(-F), 1);
+        }
+      }
+    }
+    c->nextStep();
+  }
+
+  ASSERT_EQ(calcs[1]->stress_dist(0).number_of_cell(), window.number_of_cell());
+  for (int type = 0; type < 2; type++) {
+    for (int32_t l = 0; l < window.number_of_cell(); l++) {
+      const auto t0 = calcs[0]->stress_dist(type)[window.toGlobal(l)];
+      for (int k = 1; k < 3; k++) {
+        const auto t1 = calcs[k]->stress_dist(type)[l];
+        for (int32_t e = 0; e < D * D; e++) ASSERT_NEAR(t0[e], t1[e], err_fp);
+      }
+    }
+  }
+
+  // the header describes the region only
+  calcs[1]->setSaveDir(".");
+  calcs[1]->saveLocalStressDist();
+  std::ifstream fin("./local_stress.bin", std::ios::binary);
+  ASSERT_TRUE(fin.good());
+  uint32_t d = 0;
+  std::array<double, D> box_low, box_len;
+  std::array<int32_t, D> box_mesh;
+  fin.read(reinterpret_cast<char*>(&d), sizeof(d));
+  fin.read(reinterpret_cast<char*>(box_low.data()), sizeof(box_low));
+  fin.read(reinterpret_cast<char*>(box_len.data()), sizeof(box_len));
+  fin.read(reinterpret_cast<char*>(box_mesh.data()), sizeof(box_mesh));
+  for (int32_t a = 0; a < D; a++) {
+    ASSERT_NEAR(box_low[a], lo[a], err_fp);
+    ASSERT_NEAR(box_len[a], dim[a], err_fp);
+    ASSERT_EQ(box_mesh[a], dim[a]);
+  }
+  fin.close();
+  std::remove("local_stress.bin");
+}
+
+TEST(LSCalculator, subsampling) {
+  const Vector3<double> low {0.0, 0.0, 0.0}, high {4.0, 4.0, 4.0};
+  const auto p = make_particles(40, low, high, 13);
+  std::vector<double> buf;
+  for (const auto& r : p.r) { buf.push_back(r.x); buf.push_back(r.y); buf.push_back(r.z); }
+  const VecArrayView<double> pos(buf.data());
+  const int32_t n = p.r.size();
+
+  std::array<std::unique_ptr<LSCalculator<double>>, 4> calcs;
+  for (auto& c : calcs) {
+    c = CalculatorFactory<double>::create({0.0, 0.0, 0.0}, {4.0, 4.0, 4.0},
+                                          BoundaryType::PERIODIC_XYZ,
+                                          {2, 2, 2}, {"Pair"});
+    c->disableAutoSave();
+  }
+  for (int k = 1; k < 4; k++) calcs[k]->setSamplingProbability(0.5, 7);
+  const auto force = [&](const int32_t i, const int32_t j) {
+    auto dr = p.r[i] - p.r[j];
+    calcs[0]->boundary().applyMinimumImage(dr);
+    return dr * 0.1;
+  };
+
+  // index-based draws do not depend on the call order
+  const int num_frames = 400;
+  for (int f = 0; f < num_frames; f++) {
+    calcs[1]->prepareFrame(pos, n);
+    calcs[2]->prepareFrame(pos, n);
+    for (int32_t i = 0; i < n; i++) {
+      for (int32_t j = i + 1; j < n; j++) {
+        if (f == 0) calcs[0]->calcLocalStressPot2(pos, i, j, force(i, j), -force(i, j), 0);
+        calcs[1]->calcLocalStressPot2(pos, i, j, force(i, j), -force(i, j), 0);
+        const int32_t ri = n - 1 - i, rj = n - 1 - j;
+        calcs[2]->calcLocalStressPot2(pos, rj, ri, force(rj, ri), -force(rj, ri), 0);
+      }
+    }
+    for (int k = 1; k < 3; k++) calcs[k]->nextStep();
+  }
+  calcs[0]->nextStep();
+  for (int32_t cell = 0; cell < 8; cell++) {
+    const auto t1 = calcs[1]->stress_dist(0)[cell], t2 = calcs[2]->stress_dist(0)[cell];
+    for (int32_t e = 0; e < D * D; e++) ASSERT_NEAR(t1[e], t2[e], 1.0e-9);
+  }
+
+  // reweighting keeps the mean unbiased
+  const auto exact = calcs[0]->pressure_tot(), sampled = calcs[1]->pressure_tot();
+  for (int32_t a = 0; a < D; a++) {
+    const int32_t e = a * (D + 1);
+    ASSERT_NEAR(sampled[e], exact[e], 0.02 * std::abs(exact[e]));
+  }
+
+  // position-based draws are keyed by the call order
+  for (int32_t i = 0; i < n; i++) {
+    for (int32_t j = i + 1; j < n; j++) {
+      for (int k = 1; k < 4; k += 2) {
+        calcs[k]->calcLocalStressPot2(Vector3<double>(p.r[i]), Vector3<double>(p.r[j]),
+                                      force(i, j), -force(i, j), 0);
+      }
+    }
+  }
+  calcs[1]->clear();
+  for (int32_t i = 0; i < n; i++) {
+    for (int32_t j = i + 1; j < n; j++) {
+      calcs[1]->calcLocalStressPot2(Vector3<double>(p.r[i]), Vector3<double>(p.r[j]),
+                                    force(i, j), -force(i, j), 0);
+    }
+  }
+  for (int32_t cell = 0; cell < 8; cell++) {
+    const auto t1 = calcs[1]->stress_dist(0)[cell], t3 = calcs[3]->stress_dist(0)[cell];
+    for (int32_t e = 0; e < D * D; e++) ASSERT_NEAR(t1[e], t3[e], 1.0e-9);
+  }
+
+  // index-based calls without a cell cache are keyed by the atoms too
+  std::vector<std::pair<int32_t, int32_t>> pairs;
+  for (int32_t i = 0; i < n; i++) {
+    for (int32_t j = i + 1; j < n; j++) pairs.emplace_back(i, j);
+  }
+  auto shuffled = pairs;
+  std::shuffle(shuffled.begin(), shuffled.end(), std::mt19937(3));
+  for (int k = 1; k < 4; k++) calcs[k]->clear();
+  calcs[2]->prepareFrame(pos, n);
+  for (std::size_t k = 0; k < pairs.size(); k++) {
+    const auto a = pairs[k], b = shuffled[k];
+    calcs[1]->calcLocalStressPot2(pos, a.first, a.second, force(a.first, a.second), -force(a.first, a.second), 0);
+    calcs[2]->calcLocalStressPot2(pos, a.first, a.second, force(a.first, a.second), -force(a.first, a.second), 0);
+    calcs[3]->calcLocalStressPot2(pos, b.first, b.second, force(b.first, b.second), -force(b.first, b.second), 0);
+  }
+  double kept = 0.0;
+  for (int32_t cell = 0; cell < 8; cell++) {
+    const auto t1 = calcs[1]->stress_dist(0)[cell];
+    for (int k = 2; k < 4; k++) {
+      const auto t = calcs[k]->stress_dist(0)[cell];
+      for (int32_t e = 0; e < D * D; e++) ASSERT_NEAR(t1[e], t[e], 1.0e-9);
+    }
+    kept += std::abs(t1.xx);
+  }
+  ASSERT_GT(kept, 0.0);
+}
+
+TEST(LSCalculator, subsampling_frames) {
+  const Vector3<double> low {0.0, 0.0, 0.0}, high {4.0, 4.0, 4.0};
+  const auto make = [&]() {
+    auto c = CalculatorFactory<double>::create({0.0, 0.0, 0.0}, {4.0, 4.0, 4.0},
+                                               BoundaryType::PERIODIC_XYZ,
+                                               {2, 2, 2}, {"Pair"});
+    c->disableAutoSave();
+    c->setSamplingProbability(0.5, 11);
+    return c;
+  };
+  // one calculator for all frames, and two workers taking every other frame
+  auto serial = make();
+  std::array<std::unique_ptr<LSCalculator<double>>, 2> workers {{make(), make()}};
+  const int num_frames = 6;
+  for (int f = 0; f < num_frames; f++) {
+    const auto p = make_particles(20, low, high, 31 + f);
+    auto& w = *workers[f % 2];
+    w.setFrameIndex(f);
+    for (std::size_t i = 0; i + 1 < p.r.size(); i++) {
+      const auto F = (p.r[i + 1] - p.r[i]) * 0.1;
+      serial->calcLocalStressPot2(p.r[i], p.r[i + 1], F, -F, 0);
+      w.calcLocalStressPot2(p.r[i], p.r[i + 1], F, -F, 0);
+    }
+    serial->nextStep();
+    w.nextStep();
+  }
+  accumulateFrames(*workers[0], *workers[1]);
+  for (int32_t cell = 0; cell < 8; cell++) {
+    const auto t0 = serial->stress_dist(0)[cell], t1 = workers[0]->stress_dist(0)[cell];
+    for (int32_t e = 0; e < D * D; e++) ASSERT_NEAR(t0[e], t1[e], 1.0e-12);
+  }
+  // the variance estimate does not need LOCAL_STRESS_USE_STATS
+  ASSERT_GT(serial->sampling_variance(), 0.0);
+  ASSERT_NEAR(workers[0]->sampling_variance(), serial->sampling_variance(), 1.0e-12);
+  serial->clear();
+  ASSERT_EQ(serial->sampling_variance(), 0.0);
+}
+
+TEST(LSCalculator, atom_virial) {
+  const Vector3<double> low {0.0, 0.0, 0.0}, high {3.0, 4.0, 5.0};
+  const auto p = make_particles(12, low, high, 19);
+  std::vector<double> buf;
+  for (const auto& r : p.r) { buf.push_back(r.x); buf.push_back(r.y); buf.push_back(r.z); }
+  const VecArrayView<double> pos(buf.data());
+  const int32_t n = p.r.size();
+
+  // cached index-based, index-based without cache, position-based with ids
+  std::array<std::unique_ptr<LSCalculator<double>>, 3> calcs;
+  for (auto& c : calcs) {
+    c = CalculatorFactory<double>::create({0.0, 0.0, 0.0}, {3.0, 4.0, 5.0},
+                                          BoundaryType::PERIODIC_XYZ,
+                                          {3, 4, 5}, {"Pair", "Angle", "Dihedral"});
+    c->disableAutoSave();
+    c->enableAtomVirial(n);
+  }
+  calcs[0]->prepareFrame(pos, n);
+
+  const Vector3<double> F0 {0.1, 0.2, -0.1}, F1 {-0.3, 0.1, 0.2}, F2 {0.05, -0.1, 0.3};
+  for (int32_t i = 0; i < n; i++) {
+    for (int32_t j = i + 1; j < n; j++) {
+      const Vector3<double> F {0.01 * i, 0.02 * j, -0.03};
+      calcs[0]->calcLocalStressPot2(pos, i, j, F, -F, 0);
+      calcs[1]->calcLocalStressPot2(pos, i, j, F, -F, 0);
+      const int32_t ids[] = {i, j};
+      calcs[2]->calcLocalStressPot2(p.r[i], p.r[j], F, -F, 0, ids);
+    }
+  }
+  for (int32_t i = 0; i + 3 < n; i++) {
+    for (int k = 0; k < 2; k++) {
+      calcs[k]->calcLocalStressPot3(pos, i, i + 1, i + 2, F0, F1, -(F0 + F1), 1);
+      calcs[k]->calcLocalStressPot4(pos, i, i + 1, i + 2, i + 3, F0, F1, F2, -(F0 + F1 + F2), 2);
+    }
+    const int32_t ids[] = {i, i + 1, i + 2, i + 3};
+    calcs[2]->calcLocalStressPot3(p.r[i], p.r[i + 1], p.r[i + 2], F0, F1, -(F0 + F1), 1, ids);
+    calcs[2]->calcLocalStressPot4(p.r[i], p.r[i + 1], p.r[i + 2], p.r[i + 3],
+                                  F0, F1, F2, -(F0 + F1 + F2), 2, ids);
+  }
+  for (auto& c : calcs) c->nextStep();
+
+  // the atoms share the whole virial
+  Tensor<double> grid_sum(0.0), atom_sum(0.0);
+  for (int type = 0; type < 3; type++) grid_sum += calcs[0]->stress_dist(type).sum();
+  for (int32_t i = 0; i < n; i++) atom_sum += calcs[0]->atom_virial(i);
+  for (int32_t e = 0; e < D * D; e++) ASSERT_NEAR(atom_sum[e], grid_sum[e], err_fp);
+  for (int32_t i = 0; i < n; i++) {
+    for (int k = 1; k < 3; k++) {
+      for (int32_t e = 0; e < D * D; e++) {
+        ASSERT_NEAR(calcs[k]->atom_virial(i)[e], calcs[0]->atom_virial(i)[e], err_fp);
+      }
+    }
+  }
+
+  // a single pair is split equally
+  calcs[1]->clear();
+  const Vector3<double> F {0.5, -0.25, 1.0};
+  calcs[1]->calcLocalStressPot2(pos, 3, 7, F, -F, 0);
+  calcs[1]->nextStep();
+  auto dr = p.r[3] - p.r[7];
+  calcs[1]->boundary().applyMinimumImage(dr);
+  const auto half = tensor_dot(dr, F) * 0.5;
+  for (int32_t e = 0; e < D * D; e++) {
+    ASSERT_NEAR(calcs[1]->atom_virial(3)[e], half[e], err_fp);
+    ASSERT_NEAR(calcs[1]->atom_virial(7)[e], half[e], err_fp);
+    ASSERT_NEAR(calcs[1]->atom_virial(0)[e], 0.0, err_fp);
+  }
+
+  calcs[1]->setSaveDir(".");
+  calcs[1]->saveLocalStressDist();
+  std::ifstream fin("./local_atom_virial.bin", std::ios::binary);
+  ASSERT_TRUE(fin.good());
+  uint32_t header[3];
+  fin.read(reinterpret_cast<char*>(header), sizeof(header));
+  ASSERT_EQ(header[0], uint32_t(D));
+  ASSERT_EQ(header[1], uint32_t(n));
+  ASSERT_EQ(header[2], uint32_t(D * D));
+  std::vector<double> data(n * D * D);
+  fin.read(reinterpret_cast<char*>(data.data()), data.size() * sizeof(double));
+  ASSERT_TRUE(fin.good());
+  for (int32_t e = 0; e < D * D; e++) ASSERT_NEAR(data[3 * D * D + e], half[e], err_fp);
+  fin.close();
+  std::remove("local_stress.bin");
+  std::remove("local_atom_virial.bin");
+}
+
+TEST(LSCalculator, bin_edges) {
+  const Vector3<double> low {0.0, 0.0, 0.0}, high {4.0, 4.0, 4.0};
+  const auto p = make_particles(30, low, high, 19);
+  std::vector<double> buf;
+  for (const auto& r : p.r) { buf.push_back(r.x); buf.push_back(r.y); buf.push_back(r.z); }
+  const VecArrayView<double> pos(buf.data());
+
+  // uniform fine cells along z, and cells that are fine only for 1.5 < z < 2.5
+  const std::vector<double> edges {0.0, 0.5, 1.0, 1.5, 1.75, 2.0, 2.25, 2.5, 3.0, 3.5, 4.0};
+  const std::vector<int32_t> fine_edges {0, 2, 4, 6, 7, 8, 9, 10, 12, 14, 16};
+  std::array<std::unique_ptr<LSCalculator<double>>, 3> calcs;
+  calcs[0] = CalculatorFactory<double>::create({0.0, 0.0, 0.0}, {4.0, 4.0, 4.0},
+                                               BoundaryType::PERIODIC_XYZ,
+                                               {2, 2, 16}, {"Kinetic", "Pair"});
+  for (int k = 1; k < 3; k++) {
+    calcs[k] = CalculatorFactory<double>::create({0.0, 0.0, 0.0}, {4.0, 4.0, 4.0},
+                                                 BoundaryType::PERIODIC_XYZ,
+                                                 {2, 2, 10}, {"Kinetic", "Pair"});
+    calcs[k]->setBinEdges(Z, edges);
+  }
+  for (auto& c : calcs) c->disableAutoSave();
+  calcs[2]->prepareFrame(pos, p.r.size());
+
+  const int32_t n = p.r.size();
+  for (auto& c : calcs) {
+    for (int32_t i = 0; i < n; i++) {
+      c->calcLocalStressKin(Vector3<double>(p.r[i]), Vector3<double>(p.v[i]), 1.0, 0);
+      for (int32_t j = i + 1; j < n; j++) {
+        auto dr = p.r[i] - p.r[j];
+        c->boundary().applyMinimumImage(dr);
+        const auto F = dr * 0.3;
+        if (c == calcs[2]) {
+          c->calcLocalStressPot2(pos, i, j, F, -F, 1);
+        } else {
+          c->calcLocalStressPot2(Vector3<double>(p.r[i]), Vector3<double>(p.r[j]),
+                                 Vector3<double>(F), Vector3<double>(-F), 1);
+        }
+      }
+    }
+    c->nextStep();
+  }
+
+  // each coarse cell holds the sum of the fine cells it covers
+  for (int type = 0; type < 2; type++) {
+    for (int32_t z = 0; z < 10; z++) {
+      for (int32_t xy = 0; xy < 4; xy++) {
+        Tensor<double> sum(0.0);
+        for (int32_t f = fine_edges[z]; f < fine_edges[z + 1]; f++) sum += calcs[0]->stress_dist(type)[xy + 4 * f];
+        for (int k = 1; k < 3; k++) {
+          const auto t = calcs[k]->stress_dist(type)[xy + 4 * z];
+          for (int32_t e = 0; e < D * D; e++) ASSERT_NEAR(t[e], sum[e], err_fp);
+        }
+      }
+    }
+  }
+
+  // the walls of the saved cells
+  calcs[1]->setSaveDir(".");
+  calcs[1]->saveLocalStressDist();
+  std::ifstream fin("./local_bin_edges.bin", std::ios::binary);
+  ASSERT_TRUE(fin.good());
+  uint32_t d = 0;
+  fin.read(reinterpret_cast<char*>(&d), sizeof(d));
+  ASSERT_EQ(d, uint32_t(D));
+  for (int32_t a = 0; a < D; a++) {
+    int32_t num = 0;
+    fin.read(reinterpret_cast<char*>(&num), sizeof(num));
+    std::vector<double> walls(num + 1);
+    fin.read(reinterpret_cast<char*>(walls.data()), walls.size() * sizeof(double));
+    const auto& ref = (a == Z) ? edges : std::vector<double> {0.0, 2.0, 4.0};
+    ASSERT_EQ(walls.size(), ref.size());
+    for (std::size_t k = 0; k < ref.size(); k++) ASSERT_NEAR(walls[k], ref[k], err_fp);
+  }
+  fin.close();
+  std::remove("local_bin_edges.bin");
+  std::remove("local_stress.bin");
+}
@@ -0,0 +1,135 @@
+#include "gtest/gtest.h"
+#include "../ls_calculator.hpp"
+
+#include <random>
+#include <sys/stat.h>
+
+using namespace LS;
+
+// NOTE: run with mpirun -np 4 ./ls_calculator_mpi_test
+
+namespace {
+  std::vector<char> read_file(const std::string& fname) {
+    std::ifstream fin(fname, std::ios::binary);
+    return std::vector<char>(std::istreambuf_iterator<char>(fin), std::istreambuf_iterator<char>());
+  }
+
+  void run_case(const int32_t halo, const TensorStorage storage, const std::string& tag) {
+    int rank = 0, num_procs = 0;
+    MPI_Comm_rank(MPI_COMM_WORLD, &rank);
+    MPI_Comm_size(MPI_COMM_WORLD, &num_procs);
+    int dims[D] = {0};
+    MPI_Dims_create(num_procs, D, dims);
+    std::array<int32_t, D> proc_dim;
+    for (int32_t a = 0; a < D; a++) proc_dim[a] = dims[a];
+
+    const std::string mpi_dir = "mpi_out_" + tag, serial_dir = "serial_out_" + tag;
+    if (rank == 0) {
+      mkdir(mpi_dir.c_str(), 0755);
+      mkdir(serial_dir.c_str(), 0755);
+    }
+    MPI_Barrier(MPI_COMM_WORLD);
+
+    auto calc = CalculatorFactory<double>::createMPI(MPI_COMM_WORLD, proc_dim, halo,
+                                                     {0.0, 0.0, 0.0}, {6.0, 7.0, 8.0},
+                                                     BoundaryType::PERIODIC_XY,
+                                                     {6, 7, 8}, {"Kinetic", "Pair", "Angle"},
+                                                     storage);
+    calc->setSaveDir(mpi_dir);
+    // only the block of this rank is allocated
+    const auto window = LSHelpersMPI<double>::decompose(rank, proc_dim, {6, 7, 8},
+                                                        calc->boundary().is_periodic_axis(), halo);
+    const StressGrid<double> block(window.number_of_cell(), storage);
+    for (int type = 0; type < 3; type++) {
+      ASSERT_EQ(calc->stress_dist(type).number_of_cell(), window.number_of_cell());
+      ASSERT_EQ(calc->stress_dist(type).allocated_bytes(), block.allocated_bytes());
+    }
+    std::unique_ptr<LSCalculator<double>> serial;
+    if (rank == 0) {
+      serial = CalculatorFactory<double>::create({0.0, 0.0, 0.0}, {6.0, 7.0, 8.0},
+                                                 BoundaryType::PERIODIC_XY,
+                                                 {6, 7, 8}, {"Kinetic", "Pair", "Angle"},
+                                                 storage);
+      serial->setSaveDir(serial_dir);
+    }
+
+    std::mt19937 mt(42);
+    std::uniform_real_distribution<> urd(0.0, 1.0);
+    std::vector<Vector3<double>> r(24), v(24);
+    for (std::size_t i = 0; i < r.size(); i++) {
+      r[i] = {6.0 * urd(mt), 7.0 * urd(mt), 8.0 * urd(mt)};
+      v[i] = {urd(mt) - 0.5, urd(mt) - 0.5, urd(mt) - 0.5};
+    }
+
+    for (int step = 0; step < 2; step++) {
+      int k = 0;
+      for (std::size_t i = 0; i < r.size(); i++, k++) {
+        if (k % num_procs == rank) calc->calcLocalStressKin(r[i], v[i], 1.0, 0);
+        if (serial) serial->calcLocalStressKin(r[i], v[i], 1.0, 0);
+      }
+      for (std::size_t i = 0; i < r.size(); i++) {
+        for (std::size_t j = i + 1; j < r.size(); j++, k++) {
+          const auto F = (r[i] - r[j]) * 0.01;
+          if (k % num_procs == rank) calc->calcLocalStressPot2(r[i], r[j], F, -F, 1);
+          if (serial) serial->calcLocalStressPot2(r[i], r[j], F, -F, 1);
+        }
+      }
+      for (std::size_t i = 0; i + 2 < r.size(); i++, k++) {
+        const Vector3<double> F0 {0.1, 0.2, -0.1}, F1 {-0.3, 0.1, 0.2};
+        if (k % num_procs == rank) calc->calcLocalStressPot3(r[i], r[i + 1], r[i + 2], F0, F1, -(F0 + F1), 2);
+        if (serial) serial->calcLocalStressPot3(r[i], r[i + 1], r[i + 2], F0, F1, -(F0 + F1), 2);
+      }
+      calc->nextStep();
+      if (serial) serial->nextStep();
+    }
+
+    LSHelpersMPI<double>::saveLocalStressDistMPI(*calc, MPI_COMM_WORLD);
+    if (rank != 0) return;
+    serial->saveLocalStressDist();
+    serial->disableAutoSave();
+
+    const auto f_mpi = read_file(mpi_dir + "/local_stress.bin");
+    const auto f_ser = read_file(serial_dir + "/local_stress.bin");
+    ASSERT_EQ(f_mpi.size(), f_ser.size());
+    ASSERT_GT(f_mpi.size(), 0u);
+
+    // header and interaction names are byte-identical; data agree up to summation order.
+    const std::size_t header = 4 + 2 * D * 8 + D * 4 + 4 + 4;
+    ASSERT_TRUE(std::equal(f_mpi.begin(), f_mpi.begin() + header, f_ser.begin()));
+    std::size_t pos = header;
+    const int32_t num_elem = number_of_tensor_elem(storage);
+    for (int type = 0; type < 3; type++) {
+      uint32_t len = 0;
+      std::memcpy(&len, &f_ser[pos], sizeof(len));
+      ASSERT_TRUE(std::equal(f_mpi.begin() + pos, f_mpi.begin() + pos + 4 + len, f_ser.begin() + pos));
+      pos += 4 + len;
+      for (int32_t i = 0; i < 6 * 7 * 8 * num_elem; i++, pos += 8) {
+        double a, b;
+        std::memcpy(&a, &f_mpi[pos], 8);
+        std::memcpy(&b, &f_ser[pos], 8);
+        ASSERT_NEAR(a, b, 1.0e-12);
+      }
+    }
+    ASSERT_EQ(pos, f_ser.size());
+  }
+}
+
+TEST(LSCalculatorMPI, no_halo) {
+  run_case(0, TensorStorage::FULL, "h0");
+}
+
+TEST(LSCalculatorMPI, halo) {
+  run_case(2, TensorStorage::FULL, "h2");
+}
+
+TEST(LSCalculatorMPI, symmetric) {
+  run_case(1, TensorStorage::SYMMETRIC, "sym");
+}
+
+int main(int argc, char* argv[]) {
+  MPI_Init(&argc, &argv);
+  ::testing::InitGoogleTest(&argc, argv);
+  const int ret = RUN_ALL_TESTS();
+  MPI_Finalize();
+  return ret;
+}
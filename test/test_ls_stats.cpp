@@ -0,0 +1,96 @@
+#include "gtest/gtest.h"
+#include "../ls_calculator.hpp"
+
+#include <fstream>
+#include <sstream>
+
+using namespace LS;
+
+TEST(LSStats, counters) {
+  auto calc = CalculatorFactory<double>::create({0.0, 0.0, 0.0}, {4.0, 4.0, 4.0},
+                                                BoundaryType::FIXED,
+                                                {4, 4, 4},
+                                                {"Pair", "Angle"});
+  calc->disableAutoSave();
+  const Vector3<double> F {1.0, 0.5, 0.0};
+
+  // same cell
+  calc->calcLocalStressPot2({0.2, 0.2, 0.2}, {0.5, 0.5, 0.5}, F, -F, 0);
+  // three segments, spanning two cell widths along x
+  calc->calcLocalStressPot2({2.5, 0.5, 0.5}, {0.5, 0.5, 0.5}, F, -F, 0);
+  // three contours inside of one cell
+  const Vector3<double> r0 {1.1, 1.1, 1.1}, r1 {1.5, 1.2, 1.1}, r2 {1.2, 1.6, 1.1};
+  const Vector3<double> F0 = (r0 - r1) + (r0 - r2), F1 = (r1 - r0) + (r1 - r2);
+  calc->calcLocalStressPot3(r0, r1, r2, F0, F1, -F0 - F1, 1);
+
+  const auto st = calc->stats();
+  EXPECT_EQ(st.contours, 5);
+  EXPECT_EQ(st.segments, 7);
+  EXPECT_EQ(st.same_cell, 4);
+  EXPECT_EQ(st.cfd3, 1);
+  EXPECT_EQ(st.cfd4, 0);
+  EXPECT_EQ(st.segments_hist[1], 4);
+  EXPECT_EQ(st.segments_hist[3], 1);
+  EXPECT_EQ(st.extent_hist[0], 4);
+  EXPECT_EQ(st.extent_hist[2], 1);
+  EXPECT_EQ(st.phase_calls[int32_t(Phase::SPREAD)], 5);
+  EXPECT_EQ(st.phase_calls[int32_t(Phase::DECOMPOSE)], 1);
+
+  calc->nextStep();
+  calc->saveLocalStressDist();
+  std::ifstream fin("local_stress.bin", std::ios::binary | std::ios::ate);
+  EXPECT_EQ(calc->stats().bytes_written, int64_t(fin.tellg()));
+  EXPECT_EQ(calc->stats().phase_calls[int32_t(Phase::SAVE)], 1);
+  EXPECT_EQ(calc->stats().phase_calls[int32_t(Phase::NORMALIZE)], 1);
+  std::remove("local_stress.bin");
+
+  calc->clearStats();
+  EXPECT_EQ(calc->stats().contours, 0);
+  EXPECT_EQ(calc->stats().bytes_written, 0);
+}
+
+TEST(LSStats, report_omp) {
+  auto calcs = CalculatorFactory<double>::createOMP(2, {0.0, 0.0, 0.0}, {4.0, 4.0, 4.0},
+                                                    BoundaryType::PERIODIC_XYZ,
+                                                    {4, 4, 4},
+                                                    {"Pair"});
+  const Vector3<double> F {1.0, 0.0, 0.0};
+  for (auto& calc : calcs) {
+    calc->disableAutoSave();
+    calc->calcLocalStressPot2({3.9, 0.5, 0.5}, {0.1, 0.5, 0.5}, F, -F, 0);
+  }
+
+  std::ostringstream os;
+  LSHelpers<double>::reportStatsOMP(calcs, os);
+  EXPECT_NE(os.str().find("contours            2"), std::string::npos);
+  EXPECT_NE(os.str().find("segments per contour\n    2:2"), std::string::npos);
+}
+
+TEST(LSStats, sampling_variance) {
+  auto calc = CalculatorFactory<double>::create({0.0, 0.0, 0.0}, {4.0, 4.0, 4.0},
+                                                BoundaryType::PERIODIC_XYZ,
+                                                {4, 4, 4},
+                                                {"Pair"});
+  calc->disableAutoSave();
+  const double p = 0.25;
+  calc->setSamplingProbability(p, 42);
+  const Vector3<double> r0 {0.6, 0.5, 0.5}, r1 {0.2, 0.3, 0.5}, F {1.0, 0.5, 0.0};
+  for (int i = 0; i < 1000; i++) calc->calcLocalStressPot2(r0, r1, F, -F, 0);
+
+  const auto st = calc->stats();
+  EXPECT_EQ(st.sampled, 1000);
+  EXPECT_GT(st.accepted, 200);
+  EXPECT_LT(st.accepted, 300);
+  EXPECT_EQ(st.contours, st.accepted);
+  // |W / p|^2 (1 - p) per kept sample
+  const auto W = tensor_dot(r0 - r1, F);
+  double norm2 = 0.0;
+  for (int32_t e = 0; e < D * D; e++) norm2 += W[e] * W[e];
+  EXPECT_NEAR(st.sampling_var, st.accepted * norm2 * (1.0 - p) / (p * p), 1.0e-8);
+
+  calc->nextStep();
+  calc->setSamplingProbability(1.0);
+  calc->calcLocalStressPot2(r0, r1, F, -F, 0);
+  EXPECT_EQ(calc->stats().sampled, 1000);
+  EXPECT_NEAR(calc->stats().sampling_var, st.sampling_var, 1.0e-8);
+}
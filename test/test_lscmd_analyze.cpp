@@ -0,0 +1,181 @@
+#include "gtest/gtest.h"
+#include "../tools/lscmd_analyze.hpp"
+
+#include <fstream>
+
+using namespace LS;
+using namespace LSCmd;
+
+namespace {
+  void write_file(const std::string& fname, const std::string& content) {
+    std::ofstream fout(fname);
+    fout << content;
+  }
+
+  double angle_energy(const HarmonicAngle& st, const std::array<Vec_t, 3>& r) {
+    const auto rij = r[0] - r[1], rkj = r[2] - r[1];
+    const double theta = std::acos((rij * rkj) / (rij.norm() * rkj.norm()));
+    return st.k * (theta - st.theta0) * (theta - st.theta0);
+  }
+
+  double dihedral_energy(const HarmonicDihedral& st, const std::array<Vec_t, 4>& r) {
+    const auto b1 = r[1] - r[0], b2 = r[2] - r[1], b3 = r[3] - r[2];
+    const auto m = cross(b1, b2), n = cross(b2, b3);
+    const double phi = std::atan2(b2.norm() * (b1 * n), m * n);
+    return st.k * (1.0 + st.sign * std::cos(st.n * phi));
+  }
+
+  // NOTE: F = -dE/dr by central differences.
+  template <std::size_t N, class Energy>
+  std::array<Vec_t, N> numerical_forces(std::array<Vec_t, N> r, Energy energy) {
+    const double h = 1.0e-6;
+    std::array<Vec_t, N> F;
+    for (std::size_t a = 0; a < N; a++) {
+      for (int32_t axis = 0; axis < 3; axis++) {
+        double& x = (&r[a].x)[axis];
+        const double x0 = x;
+        x = x0 + h; const double ep = energy(r);
+        x = x0 - h; const double em = energy(r);
+        x = x0;
+        (&F[a].x)[axis] = -(ep - em) / (2.0 * h);
+      }
+    }
+    return F;
+  }
+}
+
+TEST(LSCmd, angle_forces) {
+  HarmonicAngle st;
+  st.k = 50.0;
+  st.theta0 = 1.9;
+  const std::array<Vec_t, 3> r {{Vec_t(0.1, 0.2, -0.3), Vec_t(1.0, 0.1, 0.2), Vec_t(1.4, 1.2, -0.1)}};
+  const auto F = angleForces(st, r[0] - r[1], r[2] - r[1]);
+  const auto ref = numerical_forces(r, [&st](const std::array<Vec_t, 3>& q) { return angle_energy(st, q); });
+  for (std::size_t a = 0; a < 3; a++) {
+    for (int32_t axis = 0; axis < 3; axis++) {
+      ASSERT_NEAR((&F[a].x)[axis], (&ref[a].x)[axis], 1.0e-6);
+    }
+  }
+}
+
+TEST(LSCmd, dihedral_forces) {
+  HarmonicDihedral st;
+  st.k = 2.0;
+  st.sign = -1.0;
+  st.n = 3;
+  const std::array<Vec_t, 4> r {{Vec_t(0.1, 0.2, -0.3), Vec_t(1.0, 0.1, 0.2),
+                                 Vec_t(1.4, 1.2, -0.1), Vec_t(2.3, 1.1, 0.6)}};
+  const auto F = dihedralForces(st, r[1] - r[0], r[2] - r[1], r[3] - r[2]);
+  const auto ref = numerical_forces(r, [&st](const std::array<Vec_t, 4>& q) { return dihedral_energy(st, q); });
+  for (std::size_t a = 0; a < 4; a++) {
+    for (int32_t axis = 0; axis < 3; axis++) {
+      ASSERT_NEAR((&F[a].x)[axis], (&ref[a].x)[axis], 1.0e-6);
+    }
+  }
+}
+
+TEST(LSCmd, force_field) {
+  write_file("lscmd_angles.txt", "1 2 3 1  # comment\n");
+  write_file("lscmd_dihedrals.txt", "1 2 3 4 2\n");
+  write_file("lscmd_ff.txt",
+             "# test force field\n"
+             "types A B\n"
+             "cutoff 2.5\n"
+             "pair A B lj 1.0 1.0\n"
+             "mass B 2.0\n"
+             "angle 1 harmonic 50 90\n"
+             "angles lscmd_angles.txt\n"
+             "dihedral 2 harmonic 1.5 -1 3\n"
+             "dihedrals lscmd_dihedrals.txt\n");
+  const auto ff = readForceField("lscmd_ff.txt");
+  ASSERT_EQ(ff.num_types, 2);
+  ASSERT_DOUBLE_EQ(ff.r_cut, 2.5);
+  ASSERT_EQ(ff.pairs.size(), 1u);
+  ASSERT_EQ(ff.pairs[0][2], "lj");
+  ASSERT_DOUBLE_EQ(ff.mass[0], 0.0);
+  ASSERT_DOUBLE_EQ(ff.mass[1], 2.0);
+  ASSERT_DOUBLE_EQ(ff.angle_styles[0].theta0, std::acos(-1.0) / 2.0);
+  ASSERT_EQ(ff.angles.size(), 1u);
+  ASSERT_EQ(ff.angles[0].ids[1], 2);
+  ASSERT_EQ(ff.angles[0].type, 0);
+  ASSERT_EQ(ff.dihedral_styles.size(), 2u);
+  ASSERT_DOUBLE_EQ(ff.dihedral_styles[1].k, 1.5);
+  ASSERT_DOUBLE_EQ(ff.dihedral_styles[1].sign, -1.0);
+  ASSERT_EQ(ff.dihedral_styles[1].n, 3);
+  ASSERT_EQ(ff.dihedrals[0].type, 1);
+}
+
+// NOTE: a four-atom chain over two frames, one per worker.
+TEST(LSCmd, analyze) {
+  const std::array<std::array<Vec_t, 4>, 2> r {{
+    {{Vec_t(4.0, 4.0, 5.0), Vec_t(5.0, 4.2, 5.1), Vec_t(5.3, 5.2, 5.0), Vec_t(6.1, 5.4, 5.9)}},
+    {{Vec_t(4.1, 3.9, 5.0), Vec_t(5.1, 4.3, 5.2), Vec_t(5.2, 5.3, 4.9), Vec_t(6.0, 5.6, 5.8)}},
+  }};
+  std::ostringstream traj;
+  for (std::size_t f = 0; f < r.size(); f++) {
+    traj << "ITEM: TIMESTEP\n" << f << "\nITEM: NUMBER OF ATOMS\n4\n"
+         << "ITEM: BOX BOUNDS pp pp pp\n0 10\n0 10\n0 10\n"
+         << "ITEM: ATOMS id type x y z\n";
+    for (int32_t i = 0; i < 4; i++) {
+      traj << i + 1 << " 1 " << r[f][i].x << " " << r[f][i].y << " " << r[f][i].z << "\n";
+    }
+  }
+  write_file("lscmd_traj.dump", traj.str());
+  write_file("lscmd_bonds.txt", "1 2 1\n2 3 1\n3 4 1\n");
+  write_file("lscmd_angles.txt", "1 2 3 1\n2 3 4 1\n");
+  write_file("lscmd_dihedrals.txt", "1 2 3 4 1\n");
+  write_file("lscmd_ff.txt",
+             "cutoff 2.5\n"
+             "pair 1 1 lj 1.0 1.0\n"
+             "bond 1 harmonic 100 1.0\n"
+             "bonds lscmd_bonds.txt\n"
+             "angle 1 harmonic 50 109.5\n"
+             "angles lscmd_angles.txt\n"
+             "dihedral 1 harmonic 3 1 3\n"
+             "dihedrals lscmd_dihedrals.txt\n");
+
+  Options opt;
+  opt.traj = "lscmd_traj.dump";
+  opt.force_field = "lscmd_ff.txt";
+  opt.mesh = {{4, 4, 4}};
+  opt.workers = 2;
+  auto calcs = analyze(opt);
+  ASSERT_EQ(calcs.size(), 2u);
+
+  // virials summed over the frames
+  const auto ff = readForceField(opt.force_field);
+  const auto table = makePairTable(ff);
+  std::array<Tensor<double>, 5> ref;
+  for (auto& w : ref) w = Tensor<double>(0.0);
+  for (const auto& p : r) {
+    for (int32_t i = 0; i < 4; i++) {
+      for (int32_t j = i + 1; j < 4; j++) {
+        const auto dr = p[i] - p[j];
+        ref[PAIR] += tensor_dot(dr, dr * table.forceOverR(0, 0, dr * dr));
+      }
+    }
+    for (const auto& b : ff.bonds) {
+      const auto dr = p[b.i - 1] - p[b.j - 1];
+      const auto F = dr * (-100.0 * (dr.norm() - 1.0) / dr.norm());
+      ref[BOND] += tensor_dot(dr, F);
+    }
+    for (const auto& a : ff.angles) {
+      const auto rij = p[a.ids[0] - 1] - p[a.ids[1] - 1], rkj = p[a.ids[2] - 1] - p[a.ids[1] - 1];
+      const auto F = angleForces(ff.angle_styles[a.type], rij, rkj);
+      ref[ANGLE] += tensor_dot(rij, F[0]) + tensor_dot(rkj, F[2]);
+    }
+    const auto b1 = p[1] - p[0], b2 = p[2] - p[1], b3 = p[3] - p[2];
+    const auto F = dihedralForces(ff.dihedral_styles[0], b1, b2, b3);
+    ref[DIHEDRAL] += tensor_dot(-b1, F[0]) + tensor_dot(b2, F[2]) + tensor_dot(b2 + b3, F[3]);
+  }
+
+  for (int32_t type = PAIR; type <= DIHEDRAL; type++) {
+    Tensor<double> sum(0.0);
+    for (const auto& calc : calcs) sum += calc->stress_dist(type).sum();
+    for (int32_t e = 0; e < D * D; e++) ASSERT_NEAR(sum[e], ref[type][e], 1.0e-8) << type;
+  }
+
+  LSHelpers<double>::saveLocalStressDistFrames(calcs);
+  std::ifstream fin("local_stress.bin", std::ios::binary);
+  ASSERT_TRUE(bool(fin));
+}
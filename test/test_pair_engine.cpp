@@ -0,0 +1,140 @@
+#include "gtest/gtest.h"
+#include "../ls_calculator.hpp"
+
+#include <random>
+
+using namespace LS;
+
+namespace {
+  double lj_force(const double r) {
+    const double ir6 = 1.0 / std::pow(r, 6);
+    return 24.0 * ir6 * (2.0 * ir6 - 1.0) / r;
+  }
+
+  PairTable<double> make_table(void) {
+    PairTable<double> table(2, 2.5);
+    table.setForce(0, 0, lj_force);
+    table.setForce(0, 1, [](const double r) { return 0.5 * lj_force(r); });
+    table.setForce(1, 1, [](const double r) { return 2.0 * (2.5 - r); });
+    return table;
+  }
+
+  void check_engine(const BoundaryType btype, const std::array<double, 3>& tilt, const int seed) {
+    const double len = 9.0;
+    const int32_t num = 300;
+    auto ref = CalculatorFactory<double>::create({0.0, 0.0, 0.0}, {len, len, len}, btype,
+                                                 {6, 6, 6}, {"Pair"});
+    auto calc = CalculatorFactory<double>::create({0.0, 0.0, 0.0}, {len, len, len}, btype,
+                                                  {6, 6, 6}, {"Pair"});
+    ref->disableAutoSave();
+    calc->disableAutoSave();
+    ref->updateBox(Vector3<double>(0.0), Vector3<double>(len), tilt);
+    calc->updateBox(Vector3<double>(0.0), Vector3<double>(len), tilt);
+
+    std::mt19937 mt(seed);
+    std::uniform_real_distribution<> urd(0.0, len);
+    std::vector<Vector3<double>> r(num);
+    std::vector<int32_t> types(num);
+    for (int32_t i = 0; i < num; i++) {
+      r[i] = Vector3<double>(urd(mt), urd(mt), urd(mt));
+      calc->boundary().adjustBoundary(r[i]);
+      types[i] = i % 2;
+    }
+
+    const auto table = make_table();
+    const VecArrayView<double> view(&r[0].x);
+    int32_t num_pairs = 0;
+    for (int32_t i = 0; i < num; i++) {
+      for (int32_t j = i + 1; j < num; j++) {
+        auto dr = r[i] - r[j];
+        ref->boundary().applyMinimumImage(dr);
+        const auto f = table.forceOverR(types[i], types[j], dr * dr);
+        if (f == 0.0) continue;
+        ref->calcLocalStressPot2NoCheck(r[i], r[j], dr * f, -dr * f, 0);
+        num_pairs++;
+      }
+    }
+    ASSERT_GT(num_pairs, 0);
+
+    PairEngine<double> engine(table, 0);
+    engine.compute(*calc, view, types.data(), num);
+
+    const auto& g0 = ref->stress_dist(0);
+    const auto& g1 = calc->stress_dist(0);
+    for (int32_t c = 0; c < g0.number_of_cell(); c++) {
+      for (int32_t e = 0; e < D * D; e++) {
+        ASSERT_NEAR(g0.elem(e, c), g1.elem(e, c), 1.0e-12 * std::max(1.0, std::abs(g0.elem(e, c))));
+      }
+    }
+  }
+}
+
+TEST(PairTable, interpolation) {
+  const auto table = make_table();
+  for (const double r : {0.95, 1.0, 1.12, 1.5, 2.0, 2.49}) {
+    ASSERT_NEAR(table.forceOverR(0, 0, r * r) * r, lj_force(r), 1.0e-3 * std::abs(lj_force(0.95)));
+    ASSERT_DOUBLE_EQ(table.forceOverR(1, 0, r * r), table.forceOverR(0, 1, r * r));
+  }
+  ASSERT_EQ(table.forceOverR(0, 0, 2.5 * 2.5), 0.0);
+  ASSERT_EQ(table.forceOverR(1, 1, 9.0), 0.0);
+}
+
+TEST(PairTable, cutoff_rounding) {
+  // r^2 just below the cutoff may map to x = num_bins in float
+  int32_t num_rounded = 0;
+  for (int i = 1; i < 200; i++) {
+    const float r_cut = 0.05f * i, r_cut2 = r_cut * r_cut;
+    PairTable<float> table(2, r_cut, 3);
+    table.setForceOverR(0, 0, {1.0f, 2.0f, 3.0f, 4.0f});
+    table.setForceOverR(0, 1, std::vector<float>(4, std::nanf("")));
+    const float r2 = std::nextafter(r_cut2, 0.0f);
+    if (r2 * (3.0f / r_cut2) >= 3.0f) num_rounded++;
+    ASSERT_FLOAT_EQ(table.forceOverR(0, 0, r2), 4.0f);
+  }
+  ASSERT_GT(num_rounded, 0);
+}
+
+TEST(PairEngine, periodic) {
+  check_engine(BoundaryType::PERIODIC_XYZ, {{0.0, 0.0, 0.0}}, 1);
+}
+
+TEST(PairEngine, slab) {
+  check_engine(BoundaryType::PERIODIC_XY, {{0.0, 0.0, 0.0}}, 2);
+}
+
+TEST(PairEngine, triclinic) {
+  check_engine(BoundaryType::PERIODIC_XYZ, {{1.5, -1.0, 0.5}}, 3);
+}
+
+TEST(PairEngine, calculators) {
+  const double len = 6.0;
+#ifdef _OPENMP
+  // more threads than calculators
+  omp_set_num_threads(4);
+#endif
+  auto calc = CalculatorFactory<double>::create({0.0, 0.0, 0.0}, {len, len, len},
+                                                BoundaryType::PERIODIC_XYZ,
+                                                {3, 3, 3}, {"Pair"});
+  calc->disableAutoSave();
+
+  std::mt19937 mt(4);
+  std::uniform_real_distribution<> urd(0.0, len);
+  std::vector<double> r(3 * 50);
+  for (auto& x : r) x = urd(mt);
+  const std::vector<int32_t> types(50, 1);
+  const VecArrayView<double> view(r.data());
+
+  PairEngine<double> engine(make_table(), 0);
+  engine.compute(*calc, view, types.data(), 50);
+  const auto p1 = calc->stress_dist(0).sum();
+  for (const int num_calcs : {1, 2}) {
+    auto calcs = CalculatorFactory<double>::createOMP(num_calcs, {0.0, 0.0, 0.0}, {len, len, len},
+                                                      BoundaryType::PERIODIC_XYZ,
+                                                      {3, 3, 3}, {"Pair"});
+    for (auto& c : calcs) c->disableAutoSave();
+    engine.compute(calcs, view, types.data(), 50);
+    Tensor<double> p0(0.0);
+    for (auto& c : calcs) p0 += c->stress_dist(0).sum();
+    for (int32_t e = 0; e < D * D; e++) ASSERT_NEAR(p0[e], p1[e], 1.0e-12 * std::max(1.0, std::abs(p1[e])));
+  }
+}
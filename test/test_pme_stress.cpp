@@ -0,0 +1,149 @@
+#include "gtest/gtest.h"
+#include "../ls_calculator.hpp"
+
+#include <random>
+
+using namespace LS;
+
+namespace {
+  typedef std::complex<double> Complex;
+
+  std::vector<Complex> naive_dft(const std::vector<Complex>& x, const double sign) {
+    const int n = x.size();
+    const double pi = std::acos(-1.0);
+    std::vector<Complex> y(n);
+    for (int m = 0; m < n; m++) {
+      for (int k = 0; k < n; k++) y[m] += x[k] * std::polar(1.0, sign * 2.0 * pi * m * k / n);
+    }
+    return y;
+  }
+
+  // NOTE: direct Ewald sum in reciprocal space, energy and virial.
+  void ewald_reciprocal(const Boundary<double>& box, const std::vector<Vector3<double>>& r,
+                        const std::vector<double>& q, const double beta, const int mmax,
+                        double& energy, Tensor<double>& virial) {
+    const double pi = std::acos(-1.0);
+    std::array<Vector3<double>, D> recip;
+    for (int32_t b = 0; b < D; b++) {
+      Vector3<double> e;
+      e[b] = 1.0;
+      const auto f = box.toFractional(e);
+      for (int32_t a = 0; a < D; a++) recip[a][b] = f[a];
+    }
+    energy = 0.0;
+    virial = Tensor<double>(0.0);
+    for (int mx = -mmax; mx <= mmax; mx++) {
+      for (int my = -mmax; my <= mmax; my++) {
+        for (int mz = -mmax; mz <= mmax; mz++) {
+          if (mx == 0 && my == 0 && mz == 0) continue;
+          const auto m = recip[0] * double(mx) + recip[1] * double(my) + recip[2] * double(mz);
+          const double m2 = m * m, x = pi * pi * m2 / (beta * beta);
+          Complex s(0.0);
+          for (std::size_t i = 0; i < r.size(); i++) s += q[i] * std::polar(1.0, 2.0 * pi * (m * (r[i] - box.low())));
+          const double e = std::exp(-x) / m2 * std::norm(s) / (2.0 * pi * box.box_volume());
+          energy += e;
+          for (int32_t a = 0; a < D; a++) {
+            for (int32_t b = 0; b < D; b++) {
+              virial[a * D + b] += e * (double(a == b) - 2.0 * (1.0 + x) * m[a] * m[b] / m2);
+            }
+          }
+        }
+      }
+    }
+  }
+
+  void check_pme(LSCalculator<double>& calc, const std::array<int32_t, D>& grid) {
+    const auto& box = calc.boundary();
+    std::mt19937 mt(17);
+    std::uniform_real_distribution<> urd(0.0, 1.0);
+    std::vector<Vector3<double>> r;
+    std::vector<double> q, buf;
+    for (int i = 0; i < 24; i++) {
+      // fractional coordinates mapped into the (possibly tilted) box
+      auto s = Vector3<double>(urd(mt), urd(mt), urd(mt));
+      Vector3<double> ri = box.low();
+      const auto& L = box.box_length();
+      const auto& t = box.tilt_factors();
+      ri.x += L.x * s.x + t[0] * s.y + t[1] * s.z;
+      ri.y += L.y * s.y + t[2] * s.z;
+      ri.z += L.z * s.z;
+      r.push_back(ri);
+      q.push_back((i % 2 == 0) ? 1.0 : -1.0);
+      buf.push_back(ri.x); buf.push_back(ri.y); buf.push_back(ri.z);
+    }
+
+    const double beta = 2.0;
+    calc.enableAtomVirial(q.size());
+    PMEStress<double> pme(grid, beta, 6, 0);
+    pme.compute(calc, VecArrayView<double>(buf.data()), q.data(), q.size());
+    calc.nextStep();
+
+    double energy;
+    Tensor<double> virial;
+    ewald_reciprocal(box, r, q, beta, 10, energy, virial);
+    ASSERT_NEAR(pme.energy(), energy, 1.0e-4 * std::abs(energy));
+    double scale = 0.0;
+    for (int32_t e = 0; e < D * D; e++) scale = std::max(scale, std::abs(virial[e]));
+    for (int32_t e = 0; e < D * D; e++) ASSERT_NEAR(pme.virial()[e], virial[e], 1.0e-4 * scale);
+
+    // the per-atom parts sum up to the virial
+    const auto sum = calc.stress_dist(0).sum();
+    Tensor<double> atom_sum(0.0);
+    for (std::size_t i = 0; i < q.size(); i++) atom_sum += calc.atom_virial(i);
+    for (int32_t e = 0; e < D * D; e++) {
+      ASSERT_NEAR(sum[e], pme.virial()[e], 1.0e-10 * scale);
+      ASSERT_NEAR(atom_sum[e], pme.virial()[e], 1.0e-10 * scale);
+    }
+  }
+}
+
+TEST(FFT, any_length) {
+  std::mt19937 mt(3);
+  std::uniform_real_distribution<> urd(-1.0, 1.0);
+  for (const int n : {1, 2, 8, 6, 7, 30}) {
+    std::vector<Complex> x(n);
+    for (auto& v : x) v = Complex(urd(mt), urd(mt));
+    FFT1D<double> fft(n);
+    auto y = x;
+    fft.transform(y.data(), 1, false);
+    const auto ref = naive_dft(x, -1.0);
+    for (int k = 0; k < n; k++) ASSERT_NEAR(std::abs(y[k] - ref[k]), 0.0, 1.0e-10);
+    fft.transform(y.data(), 1, true);
+    for (int k = 0; k < n; k++) ASSERT_NEAR(std::abs(y[k] - x[k] * double(n)), 0.0, 1.0e-10);
+  }
+}
+
+TEST(FFT, three_dimensions) {
+  const std::array<int32_t, 3> dim {4, 3, 5};
+  FFT3D<double> fft(dim);
+  std::vector<Complex> a(fft.size(), Complex(0.0));
+  a[1 + 4 * (2 + 3 * 3)] = Complex(1.0);
+  fft.forward(a);
+  const double pi = std::acos(-1.0);
+  for (int k = 0; k < 5; k++) {
+    for (int j = 0; j < 3; j++) {
+      for (int i = 0; i < 4; i++) {
+        const auto ref = std::polar(1.0, -2.0 * pi * (i * 1.0 / 4 + j * 2.0 / 3 + k * 3.0 / 5));
+        ASSERT_NEAR(std::abs(a[i + 4 * (j + 3 * k)] - ref), 0.0, 1.0e-12);
+      }
+    }
+  }
+}
+
+TEST(PMEStress, orthorhombic) {
+  auto calc = CalculatorFactory<double>::create({0.0, 0.0, 0.0}, {3.0, 3.5, 4.0},
+                                                BoundaryType::PERIODIC_XYZ,
+                                                {3, 3, 4}, {"Coulomb(rec)"});
+  calc->disableAutoSave();
+  check_pme(*calc, {32, 30, 36});
+}
+
+TEST(PMEStress, triclinic) {
+  auto calc = CalculatorFactory<double>::create({0.0, 0.0, 0.0}, {3.0, 3.5, 4.0},
+                                                BoundaryType::PERIODIC_XYZ,
+                                                {3, 3, 4}, {"Coulomb(rec)"});
+  calc->disableAutoSave();
+  const std::array<double, 3> tilt {{0.5, -0.3, 0.4}};
+  calc->updateBox(Vector3<double>(-1.0, 0.0, 0.5), Vector3<double>(2.0, 3.5, 4.5), tilt);
+  check_pme(*calc, {32, 32, 36});
+}
@@ -0,0 +1,237 @@
+#include "gtest/gtest.h"
+#include "../ls_calculator.hpp"
+
+#include <random>
+
+using namespace LS;
+
+namespace {
+  constexpr double err_fp = 1.0e-12;
+
+  std::vector<Vector3<double>> make_positions(const int n, const double len, const int seed) {
+    std::mt19937 mt(seed);
+    std::uniform_real_distribution<> urd(0.0, len);
+    std::vector<Vector3<double>> r(n);
+    for (auto& ri : r) ri = Vector3<double>(urd(mt), urd(mt), urd(mt));
+    return r;
+  }
+}
+
+TEST(SphericalShells, radial_contour) {
+  const SphericalShells<double> shells(4.0, 4);
+  const auto segs = shells.getDividedLineRatio(Vector3<double>(0.5, 0.0, 0.0),
+                                               Vector3<double>(3.0, 0.0, 0.0));
+  ASSERT_EQ(segs.size(), 4u);
+  const double ref[] = {1.0 / 6.0, 1.0 / 3.0, 1.0 / 3.0, 1.0 / 6.0};
+  for (int32_t k = 0; k < 4; k++) {
+    ASSERT_EQ(segs[k].cell, k);
+    ASSERT_NEAR(segs[k].ratio, ref[k], err_fp);
+  }
+}
+
+TEST(SphericalShells, chord) {
+  const SphericalShells<double> shells(3.0, 3);
+  const auto segs = shells.getDividedLineRatio(Vector3<double>(-2.0, 1.5, 0.0),
+                                               Vector3<double>(4.0, 0.0, 0.0));
+  ASSERT_EQ(segs.size(), 3u);
+  const double t = (2.0 - std::sqrt(4.0 - 2.25)) / 4.0;
+  ASSERT_EQ(segs[0].cell, 2);
+  ASSERT_EQ(segs[1].cell, 1);
+  ASSERT_EQ(segs[2].cell, 2);
+  ASSERT_NEAR(segs[0].ratio, t, err_fp);
+  ASSERT_NEAR(segs[1].ratio, 1.0 - 2.0 * t, err_fp);
+  ASSERT_NEAR(segs[2].ratio, t, err_fp);
+
+  // the part beyond the outermost shell is dropped
+  const SphericalShells<double> inner(2.0, 2);
+  const auto segs_in = inner.getDividedLineRatio(Vector3<double>(-2.0, 1.5, 0.0),
+                                                 Vector3<double>(4.0, 0.0, 0.0));
+  ASSERT_EQ(segs_in.size(), 1u);
+  ASSERT_EQ(segs_in[0].cell, 1);
+}
+
+TEST(SphericalShells, local_frame) {
+  const SphericalShells<double> shells(1.0, 1);
+  const Vector3<double> p(1.0, 2.0, -0.5), v(0.3, -1.2, 0.7);
+  const auto vl = shells.toLocal(p, v);
+  ASSERT_NEAR(vl.norm2(), v.norm2(), err_fp);
+  ASSERT_NEAR(vl.x, v * p / p.norm(), err_fp);
+  ASSERT_NEAR(shells.toLocal(p, p).x, p.norm(), err_fp);
+  ASSERT_NEAR(shells.toLocal(p, p).y, 0.0, err_fp);
+  ASSERT_NEAR(shells.toLocal(p, p).z, 0.0, err_fp);
+  ASSERT_NEAR(shells.toLocal(p, Vector3<double>(0.0, 0.0, 1.0)).z, 0.0, err_fp);
+}
+
+TEST(SphericalShells, clipped_volume) {
+  Boundary<double> cube(BoundaryType::PERIODIC_XYZ, {1, 1, 1});
+  cube.setBox(Vector3<double>(0.0), Vector3<double>(4.0));
+  // the inner shell fits into the minimum-image cell, the outer one covers the rest of it
+  const SphericalShells<double> shells(4.0, 2);
+  ASSERT_NEAR(shells.cell_volume(0, cube), 32.0 * M_PI / 3.0, 1.0e-10);
+  ASSERT_NEAR(shells.cell_volume(1, cube), 64.0 - 32.0 * M_PI / 3.0, 1.0e-6);
+
+  // radius 2.5 in a cube of half width 2: six disjoint caps of height 0.5 are cut off
+  const SphericalShells<double> one(2.5, 1);
+  const double cap = M_PI * 0.25 * (3.0 * 2.5 - 0.5) / 3.0;
+  ASSERT_NEAR(one.cell_volume(0, cube), 4.0 * M_PI / 3.0 * 2.5 * 2.5 * 2.5 - 6.0 * cap, 1.0e-6);
+}
+
+TEST(ShellCalculator, trace_matches_cartesian) {
+  const double len = 6.0;
+  auto cart = CalculatorFactory<double>::create({0.0, 0.0, 0.0}, {len, len, len},
+                                                BoundaryType::PERIODIC_XYZ,
+                                                {4, 4, 4}, {"Pair"});
+  ShellCalculator<double, SphericalShells<double>> shell({0.0, 0.0, 0.0}, {len, len, len},
+                                                         BoundaryType::PERIODIC_XYZ,
+                                                         SphericalShells<double>(2.0 * len, 12),
+                                                         {"Pair"});
+  cart->disableAutoSave();
+  shell.disableAutoSave();
+  shell.setCenter(Vector3<double>(2.5, 3.0, 3.5));
+
+  const auto r = make_positions(12, len, 3);
+  for (std::size_t i = 0; i < r.size(); i++) {
+    for (std::size_t j = i + 1; j < r.size(); j++) {
+      auto dr = r[i] - r[j];
+      cart->boundary().applyMinimumImage(dr);
+      const auto F = dr * 0.4;
+      cart->calcLocalStressPot2(r[i], r[j], F, -F, 0);
+      shell.calcLocalStressPot2(r[i], r[j], F, -F, 0);
+    }
+    shell.calcLocalStressKin(r[i], r[i] * 0.1, 2.0, 0);
+    cart->calcLocalStressKin(r[i], r[i] * 0.1, 2.0, 0);
+  }
+
+  const auto ref = cart->stress_dist(0).sum();
+  const auto sum = shell.stress_dist(0).sum();
+  ASSERT_NEAR(sum.xx + sum.yy + sum.zz, ref.xx + ref.yy + ref.zz, 1.0e-10);
+}
+
+TEST(ShellCalculator, moving_center) {
+  const double len = 8.0;
+  typedef ShellCalculator<double, SphericalShells<double>> Calc;
+  Calc sc0({0.0, 0.0, 0.0}, {len, len, len}, BoundaryType::PERIODIC_XYZ,
+           SphericalShells<double>(3.0, 6), {"Pair"});
+  Calc sc1({0.0, 0.0, 0.0}, {len, len, len}, BoundaryType::PERIODIC_XYZ,
+           SphericalShells<double>(3.0, 6), {"Pair"});
+  sc0.disableAutoSave();
+  sc1.disableAutoSave();
+
+  const Vector3<double> c0(4.0, 4.0, 4.0), shift(3.0, -2.5, 1.25);
+  sc0.setCenter(c0);
+  sc1.setCenter(c0 + shift);
+  const auto r = make_positions(10, len, 5);
+  for (std::size_t i = 0; i < r.size(); i++) {
+    for (std::size_t j = i + 1; j < r.size(); j++) {
+      const auto F = (r[i] - r[j]) * 0.2;
+      auto ri = r[i] + shift, rj = r[j] + shift;
+      sc1.boundary().adjustBoundary(ri);
+      sc1.boundary().adjustBoundary(rj);
+      sc0.calcLocalStressPot2NoCheck(r[i], r[j], F, -F, 0);
+      sc1.calcLocalStressPot2NoCheck(ri, rj, F, -F, 0);
+    }
+  }
+  sc0.nextStep();
+  sc1.nextStep();
+  for (int32_t k = 0; k < 6; k++) {
+    const auto p0 = sc0.pressure(k), p1 = sc1.pressure(k);
+    for (int32_t e = 0; e < D * D; e++) ASSERT_NEAR(p0[e], p1[e], 1.0e-10);
+  }
+}
+
+TEST(ShellCalculator, radial_kinetic) {
+  ShellCalculator<double, SphericalShells<double>> sc({0.0, 0.0, 0.0}, {4.0, 4.0, 4.0},
+                                                      BoundaryType::PERIODIC_XYZ,
+                                                      SphericalShells<double>(2.0, 2), {"Kin"});
+  sc.setCenter(Vector3<double>(2.0, 2.0, 2.0));
+  sc.calcLocalStressKin(Vector3<double>(2.3, 2.4, 2.0), Vector3<double>(0.6, 0.8, 0.0), 2.0, 0);
+  sc.nextStep();
+  const auto p = sc.pressure(0);
+  const double vol = 4.0 * M_PI / 3.0;
+  ASSERT_NEAR(p.xx, 2.0 / vol, err_fp);
+  for (int32_t e = 1; e < D * D; e++) ASSERT_NEAR(p[e], 0.0, err_fp);
+  ASSERT_NEAR(sc.pressure(1).xx, 0.0, err_fp);
+
+  sc.setSaveDir(".");
+  sc.saveLocalStressDist();
+  sc.disableAutoSave();
+  std::ifstream fin("./local_stress_shell.bin", std::ios::binary);
+  ASSERT_TRUE(fin.good());
+  fin.seekg(0, std::ios::end);
+  const std::size_t header = 3 * sizeof(uint32_t) + sizeof(double) + sizeof(int32_t)
+    + 2 * sizeof(double) + sizeof(uint32_t) + sizeof(uint32_t) + 3;
+  ASSERT_EQ(std::size_t(fin.tellg()), header + 2 * D * D * sizeof(double));
+}
+
+TEST(CylindricalShells, radial_contour) {
+  const CylindricalShells<double> shells(Vector3<double>(0.0, 0.0, 2.0), 4.0, 4);
+  const auto segs = shells.getDividedLineRatio(Vector3<double>(0.5, 0.0, -3.0),
+                                               Vector3<double>(3.0, 0.0, 6.0));
+  ASSERT_EQ(segs.size(), 4u);
+  const double ref[] = {1.0 / 6.0, 1.0 / 3.0, 1.0 / 3.0, 1.0 / 6.0};
+  for (int32_t k = 0; k < 4; k++) {
+    ASSERT_EQ(segs[k].cell, k);
+    ASSERT_NEAR(segs[k].ratio, ref[k], err_fp);
+  }
+
+  const auto axial = shells.getDividedLineRatio(Vector3<double>(0.0, 1.2, 0.0),
+                                                Vector3<double>(0.0, 0.0, 5.0));
+  ASSERT_EQ(axial.size(), 1u);
+  ASSERT_EQ(axial[0].cell, 1);
+  ASSERT_DOUBLE_EQ(axial[0].ratio, 1.0);
+}
+
+TEST(CylindricalShells, local_frame) {
+  const CylindricalShells<double> shells(Vector3<double>(1.0, 1.0, 0.0), 1.0, 1);
+  const Vector3<double> p(1.0, -1.0, 0.5), v(0.3, -1.2, 0.7);
+  const auto vl = shells.toLocal(p, v);
+  ASSERT_NEAR(vl.norm2(), v.norm2(), err_fp);
+  ASSERT_NEAR(vl.z, (v.x + v.y) / std::sqrt(2.0), err_fp);
+  const auto q = p - shells.axis() * (p * shells.axis());
+  ASSERT_NEAR(vl.x, v * q / q.norm(), err_fp);
+  // on the axis the frame is still orthonormal
+  ASSERT_NEAR(shells.toLocal(Vector3<double>(0.0), v).norm2(), v.norm2(), err_fp);
+}
+
+TEST(ShellCalculator, cylinder_trace_and_axis_image) {
+  const double len = 6.0;
+  auto cart = CalculatorFactory<double>::create({0.0, 0.0, 0.0}, {len, len, len},
+                                                BoundaryType::PERIODIC_XYZ,
+                                                {3, 3, 3}, {"Pair"});
+  typedef ShellCalculator<double, CylindricalShells<double>> Calc;
+  Calc cyl({0.0, 0.0, 0.0}, {len, len, len}, BoundaryType::PERIODIC_XYZ,
+           CylindricalShells<double>(Vector3<double>(0.0, 0.0, 1.0), 2.0 * len, 12), {"Pair"});
+  cart->disableAutoSave();
+  cyl.disableAutoSave();
+  cyl.setCenter(Vector3<double>(3.0, 2.5, 0.0));
+
+  const auto r = make_positions(12, len, 9);
+  for (std::size_t i = 0; i < r.size(); i++) {
+    for (std::size_t j = i + 1; j < r.size(); j++) {
+      auto dr = r[i] - r[j];
+      cart->boundary().applyMinimumImage(dr);
+      const auto F = dr * 0.4;
+      cart->calcLocalStressPot2(r[i], r[j], F, -F, 0);
+      cyl.calcLocalStressPot2(r[i], r[j], F, -F, 0);
+    }
+  }
+  const auto ref = cart->stress_dist(0).sum();
+  const auto sum = cyl.stress_dist(0).sum();
+  ASSERT_NEAR(sum.xx + sum.yy + sum.zz, ref.xx + ref.yy + ref.zz, 1.0e-10);
+  ASSERT_NEAR(sum.zz, ref.zz, 1.0e-10);
+
+  // a bond across the periodic boundary along the axis
+  Calc tube({0.0, 0.0, 0.0}, {len, len, len}, BoundaryType::PERIODIC_XYZ,
+            CylindricalShells<double>(Vector3<double>(0.0, 0.0, 1.0), 2.0, 2), {"Pair"});
+  tube.disableAutoSave();
+  tube.setCenter(Vector3<double>(3.0, 3.0, 3.0));
+  const Vector3<double> F(0.0, 0.0, 1.5);
+  tube.calcLocalStressPot2(Vector3<double>(4.5, 3.0, 0.1), Vector3<double>(4.5, 3.0, len - 0.1),
+                           F, -F, 0);
+  tube.nextStep();
+  const auto p = tube.pressure(0, 1);
+  const double vol = M_PI * (4.0 - 1.0) * len;
+  ASSERT_NEAR(tube.geometry().cell_volume(1, tube.boundary()), vol, err_fp);
+  ASSERT_NEAR(p.zz, 0.2 * 1.5 / vol, err_fp);
+  for (int32_t e = 0; e < D * D - 1; e++) ASSERT_NEAR(p[e], 0.0, err_fp);
+}
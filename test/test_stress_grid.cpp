@@ -0,0 +1,189 @@
+#include "gtest/gtest.h"
+#include "../ls_calculator.hpp"
+
+#include <random>
+
+using namespace LS;
+
+template <typename T>
+static std::vector<T> random_vector(const std::size_t n, const int seed) {
+  std::mt19937 mt(seed);
+  std::uniform_real_distribution<T> urd(-1.0, 1.0);
+  std::vector<T> v(n);
+  for (auto& x : v) x = urd(mt);
+  return v;
+}
+
+template <typename T>
+static void check_kernels(const T err) {
+  const auto max_level = static_cast<int32_t>(detectSimdLevel());
+  const auto ref = gridKernels<T>(SimdLevel::SCALAR);
+  for (int32_t lv = 0; lv <= max_level; lv++) {
+    const auto ker = gridKernels<T>(static_cast<SimdLevel>(lv));
+    for (const std::size_t n : {0, 1, 7, 33, 1000}) {
+      const auto x = random_vector<T>(n, 1);
+      auto y0 = random_vector<T>(n, 2);
+      auto y1 = y0;
+
+      ref.axpy(y0.data(), x.data(), n, T(0.25));
+      ker.axpy(y1.data(), x.data(), n, T(0.25));
+      for (std::size_t i = 0; i < n; i++) ASSERT_NEAR(y0[i], y1[i], err);
+
+      ref.scale(y0.data(), n, T(-3.0));
+      ker.scale(y1.data(), n, T(-3.0));
+      for (std::size_t i = 0; i < n; i++) ASSERT_NEAR(y0[i], y1[i], err);
+
+      ASSERT_NEAR(ref.sum(y0.data(), n), ker.sum(y1.data(), n), err * n);
+    }
+  }
+}
+
+TEST(GridKernels, double) {
+  check_kernels<double>(1.0e-13);
+}
+
+TEST(GridKernels, float) {
+  check_kernels<float>(1.0e-5f);
+}
+
+TEST(GridKernels, huge_page_allocation) {
+  const std::size_t small = 100, large = huge_page_bytes / sizeof(double) + 3;
+  const auto ps = make_aligned_zero<double>(small);
+  EXPECT_EQ(reinterpret_cast<std::uintptr_t>(ps.get()) % 64, 0u);
+  const auto pl = make_aligned_zero<double>(large);
+  EXPECT_EQ(reinterpret_cast<std::uintptr_t>(pl.get()) % huge_page_bytes, 0u);
+  for (std::size_t i = 0; i < large; i++) ASSERT_EQ(pl[i], 0.0);
+}
+
+TEST(StressGrid, add_and_sum) {
+  constexpr int32_t num_cell = 37;
+  StressGrid<double> grid(num_cell);
+  Tensor<double> ref(0.0);
+  for (int32_t i = 0; i < num_cell; i++) {
+    const Tensor<double> t(1.0 * i, 2.0, 3.0,
+                           4.0, 5.0 * i, 6.0,
+                           7.0, 8.0, 9.0 * i);
+    grid.add(i, t, 0.5);
+    ref += t * 0.5;
+  }
+  const auto s = grid.sum();
+  for (int32_t e = 0; e < D * D; e++) ASSERT_DOUBLE_EQ(s[e], ref[e]);
+  ASSERT_DOUBLE_EQ(grid[3].xx, 1.5);
+  ASSERT_DOUBLE_EQ(grid[3].zy, 4.0);
+}
+
+TEST(StressGrid, scale_accumulate_clear) {
+  constexpr int32_t num_cell = 20;
+  StressGrid<double> g0(num_cell), g1(num_cell);
+  for (int32_t i = 0; i < num_cell; i++) {
+    g0.add(i, Tensor<double>(1.0));
+    g1.add(i, Tensor<double>(2.0));
+  }
+  g0.accumulate(g1);
+  g0.scale(-0.5);
+  for (int32_t i = 0; i < num_cell; i++) {
+    for (int32_t e = 0; e < D * D; e++) ASSERT_DOUBLE_EQ(g0[i][e], -1.5);
+  }
+  g0.clear();
+  for (int32_t e = 0; e < D * D; e++) ASSERT_EQ(g0.sum()[e], 0.0);
+}
+
+TEST(StressGrid, symmetric) {
+  constexpr int32_t num_cell = 5;
+  StressGrid<double> full(num_cell), sym(num_cell, TensorStorage::SYMMETRIC);
+  ASSERT_EQ(sym.number_of_elem(), D * (D + 1) / 2);
+
+  const Vector3<double> a {1.0, -2.0, 3.0}, b {0.5, 4.0, -1.5};
+  const auto t = tensor_dot(a, b) + tensor_dot(b, a);
+  full.add(2, t, 2.0);
+  sym.add(2, t, 2.0);
+
+  for (int32_t e = 0; e < D * D; e++) {
+    ASSERT_DOUBLE_EQ(sym[2][e], full[2][e]);
+    ASSERT_DOUBLE_EQ(sym.sum()[e], full.sum()[e]);
+  }
+  ASSERT_DOUBLE_EQ(sym.plane(1)[2], 2.0 * t.xy);
+  ASSERT_DOUBLE_EQ(sym.plane(3)[2], 2.0 * t.yy);
+  ASSERT_DOUBLE_EQ(sym.plane(5)[2], 2.0 * t.zz);
+}
+
+TEST(StressGrid, compensated) {
+  constexpr int n_add = 1000000;
+  StressGrid<float> naive(1);
+  StressGrid<Compensated<float>> kahan(1);
+  StressGrid<double> ref(1);
+  const Tensor<float> t(0.1f);
+  for (int i = 0; i < n_add; i++) {
+    naive.add(0, t);
+    kahan.add(0, t);
+    ref.add(0, t);
+  }
+  const double exact = ref[0].xx;
+  ASSERT_GT(std::abs(naive[0].xx - exact), 1.0e-3 * exact);
+  ASSERT_NEAR(kahan[0].xx, exact, 1.0e-6 * exact);
+  ASSERT_NEAR(kahan.sum().zz, exact, 1.0e-6 * exact);
+
+  kahan.scale(0.5f);
+  ASSERT_NEAR(kahan[0].yy, 0.5 * exact, 1.0e-6 * exact);
+  kahan.accumulate(kahan);
+  ASSERT_NEAR(kahan[0].yy, exact, 1.0e-6 * exact);
+}
+
+TEST(StressGrid, sparse) {
+  constexpr int32_t num_cell = 1000;
+  StressGrid<double> dense(num_cell), sparse(num_cell, TensorStorage::FULL, 4);
+  ASSERT_TRUE(sparse.is_sparse());
+  ASSERT_EQ(sparse.number_of_page(), (num_cell + 15) / 16);
+  ASSERT_EQ(sparse.number_of_allocated_page(), 0);
+
+  for (const int32_t i : {3, 5, 517, 999}) {
+    const Tensor<double> t(1.0 * i, 2.0, 3.0,
+                           4.0, 5.0, 6.0 * i,
+                           7.0, 8.0, 9.0);
+    dense.add(i, t, 0.5);
+    sparse.add(i, t, 0.5);
+  }
+  ASSERT_EQ(sparse.number_of_allocated_page(), 3);
+  ASSERT_FALSE(sparse.isAllocated(100));
+  for (int32_t i = 0; i < num_cell; i++) {
+    for (int32_t e = 0; e < D * D; e++) ASSERT_EQ(sparse.elem(e, i), dense.elem(e, i));
+  }
+  for (int32_t e = 0; e < D * D; e++) ASSERT_DOUBLE_EQ(sparse.sum()[e], dense.sum()[e]);
+
+  StressGrid<double> other(num_cell, TensorStorage::FULL, 4);
+  other.add(100, Tensor<double>(1.0));
+  sparse.accumulate(other);
+  sparse.scale(2.0);
+  ASSERT_EQ(sparse.number_of_allocated_page(), 4);
+  ASSERT_DOUBLE_EQ(sparse[100].yz, 2.0);
+  ASSERT_DOUBLE_EQ(sparse[517].xx, 517.0);
+
+  sparse.clear(517);
+  ASSERT_DOUBLE_EQ(sparse[517].xx, 0.0);
+  sparse.clear();
+  ASSERT_EQ(sparse.number_of_allocated_page(), 0);
+  ASSERT_EQ(sparse.allocated_bytes(), 0u);
+}
+
+TEST(StressGrid, vector) {
+  constexpr int32_t num_cell = 70;
+  StressGrid<double> dense(num_cell, TensorStorage::VECTOR);
+  StressGrid<Compensated<double>> sparse(num_cell, TensorStorage::VECTOR, 4);
+  ASSERT_EQ(dense.number_of_elem(), D);
+  ASSERT_TRUE(dense.is_vector());
+  Vector3<double> ref;
+  for (int32_t i = 0; i < num_cell; i += 3) {
+    const Vector3<double> v(1.0 * i, -2.0, 0.5 * i);
+    dense.add(i, v, 0.5);
+    sparse.add(i, v, 0.5);
+    ref += v * 0.5;
+  }
+  const auto s0 = dense.vector_sum(), s1 = sparse.vector_sum();
+  for (int32_t a = 0; a < D; a++) {
+    ASSERT_DOUBLE_EQ(s0[a], ref[a]);
+    ASSERT_DOUBLE_EQ(s1[a], ref[a]);
+  }
+  ASSERT_DOUBLE_EQ(dense.vector(3).x, 1.5);
+  ASSERT_DOUBLE_EQ(sparse.vector(3).y, -1.0);
+  ASSERT_DOUBLE_EQ(sparse.vector(4).z, 0.0);
+}
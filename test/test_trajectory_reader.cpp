@@ -0,0 +1,114 @@
+#include "gtest/gtest.h"
+#include "../ls_calculator.hpp"
+#include "../trajectory_reader.hpp"
+
+#include <fstream>
+
+using namespace LS;
+
+namespace {
+  void write_file(const std::string& fname, const std::string& content) {
+    std::ofstream fout(fname);
+    fout << content;
+  }
+}
+
+TEST(TrajectoryReader, lammps_dump) {
+  write_file("traj_test.dump",
+             "ITEM: TIMESTEP\n"
+             "0\n"
+             "ITEM: NUMBER OF ATOMS\n"
+             "3\n"
+             "ITEM: BOX BOUNDS pp pp ff\n"
+             "0.0 10.0\n"
+             "-1.0 9.0\n"
+             "0.0 5.0\n"
+             "ITEM: ATOMS id type x y z vx vy vz\n"
+             "2 1 1.0 2.0 3.0 0.1 0.2 0.3\n"
+             "1 2 11.0 -2.0 4.0 -0.1 -0.2 -0.3\n"
+             "3 1 5.0 5.0 2.5 0.0 0.0 0.0\n"
+             "ITEM: TIMESTEP\n"
+             "100\n"
+             "ITEM: NUMBER OF ATOMS\n"
+             "2\n"
+             "ITEM: BOX BOUNDS xy xz yz pp pp pp\n"
+             "-1.0 12.0 2.0\n"
+             "0.0 10.0 -1.0\n"
+             "0.0 10.0 0.0\n"
+             "ITEM: ATOMS id type xs ys zs\n"
+             "1 1 0.5 0.5 0.5\n"
+             "2 2 0.0 0.0 0.0\n");
+
+  TrajectoryReader<double> reader("traj_test.dump", TrajectoryFormat::LAMMPS_DUMP);
+  ASSERT_EQ(reader.number_of_frames(), 2);
+
+  TrajectoryFrame<double> frame;
+  reader.readFrame(0, frame);
+  EXPECT_EQ(frame.step, 0);
+  ASSERT_EQ(frame.number_of_atoms(), 3);
+  EXPECT_TRUE(frame.periodic[0]);
+  EXPECT_FALSE(frame.periodic[2]);
+  EXPECT_DOUBLE_EQ(frame.low.y, -1.0);
+  EXPECT_DOUBLE_EQ(frame.high.z, 5.0);
+  EXPECT_EQ(frame.ids[1], 1);
+  EXPECT_EQ(frame.types[1], 1);
+  ASSERT_TRUE(frame.has_velocity());
+  EXPECT_DOUBLE_EQ(frame.vel[5], -0.3);
+
+  frame.wrap();
+  EXPECT_DOUBLE_EQ(frame.pos[3], 1.0);
+  EXPECT_DOUBLE_EQ(frame.pos[4], 8.0);
+  EXPECT_DOUBLE_EQ(frame.pos[5], 4.0);
+
+  // BOX BOUNDS of a triclinic box are those of its bounding box
+  reader.readFrame(1, frame);
+  EXPECT_EQ(frame.step, 100);
+  ASSERT_EQ(frame.number_of_atoms(), 2);
+  EXPECT_FALSE(frame.has_velocity());
+  EXPECT_DOUBLE_EQ(frame.low.x, 0.0);
+  EXPECT_DOUBLE_EQ(frame.high.x, 10.0);
+  EXPECT_DOUBLE_EQ(frame.tilt[0], 2.0);
+  EXPECT_DOUBLE_EQ(frame.tilt[1], -1.0);
+  EXPECT_DOUBLE_EQ(frame.pos[0], 5.0 + 1.0 - 0.5);
+  EXPECT_DOUBLE_EQ(frame.pos[1], 5.0);
+  EXPECT_DOUBLE_EQ(frame.pos[3], 0.0);
+
+  std::remove("traj_test.dump");
+}
+
+TEST(TrajectoryReader, extended_xyz) {
+  write_file("traj_test.xyz",
+             "2\n"
+             "Lattice=\"10.0 0.0 0.0 1.0 8.0 0.0 0.0 0.0 6.0\" "
+             "Properties=species:S:1:pos:R:3:velo:R:3 step=5 pbc=\"T T F\"\n"
+             "Ar 1.0 2.0 3.0 0.5 0.0 0.0\n"
+             "Ne 4.0 5.0 6.0 0.0 0.5 0.0\n"
+             "1\n"
+             "Lattice=\"10.0 0.0 0.0 0.0 10.0 0.0 0.0 0.0 10.0\" Origin=\"-5.0 -5.0 -5.0\"\n"
+             "Ne 0.0 0.0 0.0\n");
+
+  TrajectoryReader<double> reader("traj_test.xyz",
+                                  TrajectoryReader<double>::guessFormat("traj_test.xyz"),
+                                  {"Ne", "Ar"});
+  ASSERT_EQ(reader.number_of_frames(), 2);
+
+  TrajectoryFrame<double> frame;
+  reader.readFrame(0, frame);
+  EXPECT_EQ(frame.step, 5);
+  ASSERT_EQ(frame.number_of_atoms(), 2);
+  EXPECT_EQ(frame.types[0], 1);
+  EXPECT_EQ(frame.types[1], 0);
+  EXPECT_DOUBLE_EQ(frame.high.y, 8.0);
+  EXPECT_DOUBLE_EQ(frame.tilt[0], 1.0);
+  EXPECT_FALSE(frame.periodic[2]);
+  EXPECT_DOUBLE_EQ(frame.pos[4], 5.0);
+  EXPECT_DOUBLE_EQ(frame.vel[4], 0.5);
+
+  reader.readFrame(1, frame);
+  ASSERT_EQ(frame.number_of_atoms(), 1);
+  EXPECT_FALSE(frame.has_velocity());
+  EXPECT_DOUBLE_EQ(frame.low.z, -5.0);
+  EXPECT_DOUBLE_EQ(frame.high.z, 5.0);
+
+  std::remove("traj_test.xyz");
+}
@@ -0,0 +1,8 @@
+// lscmd-analyze: local stress of stored trajectories (see lscmd_analyze.hpp).
+
+#include "lscmd_analyze.hpp"
+
+int main(int argc, char* argv[]) {
+  auto calcs = LSCmd::analyze(LSCmd::parseOptions(argc, argv));
+  LS::LSHelpers<LSCmd::Real>::saveLocalStressDistFrames(calcs);
+}
@@ -0,0 +1,502 @@
+#if !defined LSCMD_ANALYZE_HPP
+#define LSCMD_ANALYZE_HPP
+
+// lscmd-analyze: local stress of stored trajectories.
+//
+// usage: lscmd-analyze -i traj -f force_field -m nx,ny,nz [-o dir] [-j workers]
+//                      [--format lammps|xyz] [--begin n] [--end n] [--every n]
+//
+// The trajectory (LAMMPS text dump or extended XYZ) is memory-mapped and
+// frames are parsed by the workers themselves, so only one frame per worker
+// is held in memory. Each worker creates its own LSCalculator on its thread,
+// so that the grids are first touched there, and the results are reduced
+// into dir/local_stress.bin at the end.
+//
+// Force field file (one directive per line, # starts a comment):
+//   cutoff rc                  cut-off length of pair forces
+//   types A B ...              type names (species of extended XYZ files);
+//                              LAMMPS dumps use numeric types 1, 2, ...
+//   pair ti tj lj eps sigma    Lennard-Jones, truncated at rc
+//   pair ti tj table file      two columns "r F(r)" with F = -dU/dr
+//   mass t m                   mass of type t (kinetic term, needs velocities)
+//   bond b harmonic k r0       F = -k (r - r0) for bond type b
+//   bonds file                 bond topology, lines "id_i id_j b"
+//   angle a harmonic k theta0  E = k (theta - theta0)^2, theta0 in degrees
+//   angles file                angle topology, lines "id_i id_j id_k a" (j central)
+//   dihedral d harmonic k s n  E = k (1 + s cos(n phi)), s = +1 or -1
+//   dihedrals file             dihedral topology, lines "id_i id_j id_k id_l d"
+// Types are given by number (from 1) or by name. Other directives, e.g.
+// styles that are not listed, are errors rather than silently ignored.
+// Interaction types of the output are "Kinetic", "Pair", "Bond", "Angle"
+// and "Dihedral".
+
+#include <fstream>
+#include <functional>
+#include <sstream>
+#include <thread>
+#include <unordered_map>
+
+#include "ls_calculator.hpp"
+#include "trajectory_reader.hpp"
+
+namespace LSCmd {
+  typedef double Real;
+  typedef LS::Vec<Real> Vec_t;
+
+  enum InteractionType : int32_t {
+    KINETIC = 0,
+    PAIR,
+    BOND,
+    ANGLE,
+    DIHEDRAL,
+  };
+
+  struct Bond {
+    int64_t i, j;
+    int32_t type;
+  };
+
+  struct HarmonicBond {
+    Real k = 0, r0 = 0;
+  };
+
+  // NOTE: ids[1] is the central atom.
+  struct Angle {
+    std::array<int64_t, 3> ids;
+    int32_t type;
+  };
+
+  struct HarmonicAngle {
+    Real k = 0, theta0 = 0;
+  };
+
+  struct Dihedral {
+    std::array<int64_t, 4> ids;
+    int32_t type;
+  };
+
+  struct HarmonicDihedral {
+    Real k = 0, sign = 1;
+    int32_t n = 0;
+  };
+
+  struct ForceField {
+    Real r_cut = 0;
+    std::vector<std::string> type_names;
+    int32_t num_types = 0;
+    std::vector<std::array<std::string, 4>> pairs;  // ti, tj, style, arguments
+    std::vector<Real> mass;
+    std::vector<HarmonicBond> bond_styles;
+    std::vector<Bond> bonds;
+    std::vector<HarmonicAngle> angle_styles;
+    std::vector<Angle> angles;
+    std::vector<HarmonicDihedral> dihedral_styles;
+    std::vector<Dihedral> dihedrals;
+
+    int32_t typeIndex(const std::string& name) const {
+      const auto it = std::find(type_names.cbegin(), type_names.cend(), name);
+      if (it != type_names.cend()) return it - type_names.cbegin();
+      const int32_t t = std::atoi(name.c_str()) - 1;
+      if (t < 0) {
+        LOCAL_STRESS_ERR("Unknown type " << name);
+      }
+      return t;
+    }
+  };
+
+  inline std::vector<std::vector<std::string>> readDirectives(const std::string& fname) {
+    std::ifstream fin(fname);
+    if (!fin) {
+      LOCAL_STRESS_ERR("Cannot open " << fname);
+    }
+    std::vector<std::vector<std::string>> lines;
+    std::string line;
+    while (std::getline(fin, line)) {
+      const auto hash = line.find('#');
+      if (hash != std::string::npos) line.erase(hash);
+      auto words = LS::splitWords(line);
+      if (!words.empty()) lines.push_back(std::move(words));
+    }
+    return lines;
+  }
+
+  inline ForceField readForceField(const std::string& fname) {
+    ForceField ff;
+    const auto lines = readDirectives(fname);
+    for (const auto& w : lines) {
+      if (w[0] == "types") ff.type_names.assign(w.begin() + 1, w.end());
+    }
+    ff.num_types = ff.type_names.size();
+    auto useType = [&ff](const std::string& name) {
+      const auto t = ff.typeIndex(name);
+      ff.num_types = std::max(ff.num_types, t + 1);
+      return t;
+    };
+
+    for (const auto& w : lines) {
+      if (w[0] == "cutoff" && w.size() == 2) {
+        ff.r_cut = std::atof(w[1].c_str());
+      } else if (w[0] == "types") {
+        continue;
+      } else if (w[0] == "pair" && w.size() >= 5) {
+        useType(w[1]); useType(w[2]);
+        std::string args;
+        for (std::size_t k = 4; k < w.size(); k++) args += w[k] + " ";
+        ff.pairs.push_back({{w[1], w[2], w[3], args}});
+      } else if (w[0] == "mass" && w.size() == 3) {
+        const auto t = useType(w[1]);
+        if (int32_t(ff.mass.size()) <= t) ff.mass.resize(t + 1, 0);
+        ff.mass[t] = std::atof(w[2].c_str());
+      } else if (w[0] == "bond" && w.size() == 5 && w[2] == "harmonic") {
+        const int32_t b = std::atoi(w[1].c_str()) - 1;
+        if (b < 0) {
+          LOCAL_STRESS_ERR("Bond types start from 1.");
+        }
+        if (int32_t(ff.bond_styles.size()) <= b) ff.bond_styles.resize(b + 1);
+        ff.bond_styles[b].k  = std::atof(w[3].c_str());
+        ff.bond_styles[b].r0 = std::atof(w[4].c_str());
+      } else if (w[0] == "bonds" && w.size() == 2) {
+        for (const auto& bw : readDirectives(w[1])) {
+          if (bw.size() < 3) {
+            LOCAL_STRESS_ERR("Bond lines should be \"id_i id_j type\".");
+          }
+          ff.bonds.push_back({std::atoll(bw[0].c_str()), std::atoll(bw[1].c_str()),
+                              std::atoi(bw[2].c_str()) - 1});
+        }
+      } else if (w[0] == "angle" && w.size() == 5 && w[2] == "harmonic") {
+        const int32_t a = std::atoi(w[1].c_str()) - 1;
+        if (a < 0) {
+          LOCAL_STRESS_ERR("Angle types start from 1.");
+        }
+        if (int32_t(ff.angle_styles.size()) <= a) ff.angle_styles.resize(a + 1);
+        ff.angle_styles[a].k      = std::atof(w[3].c_str());
+        ff.angle_styles[a].theta0 = std::atof(w[4].c_str()) * std::acos(Real(-1)) / 180;
+      } else if (w[0] == "angles" && w.size() == 2) {
+        for (const auto& aw : readDirectives(w[1])) {
+          if (aw.size() < 4) {
+            LOCAL_STRESS_ERR("Angle lines should be \"id_i id_j id_k type\".");
+          }
+          ff.angles.push_back({{{std::atoll(aw[0].c_str()), std::atoll(aw[1].c_str()),
+                                 std::atoll(aw[2].c_str())}}, std::atoi(aw[3].c_str()) - 1});
+        }
+      } else if (w[0] == "dihedral" && w.size() == 6 && w[2] == "harmonic") {
+        const int32_t d = std::atoi(w[1].c_str()) - 1;
+        if (d < 0) {
+          LOCAL_STRESS_ERR("Dihedral types start from 1.");
+        }
+        if (int32_t(ff.dihedral_styles.size()) <= d) ff.dihedral_styles.resize(d + 1);
+        ff.dihedral_styles[d].k    = std::atof(w[3].c_str());
+        ff.dihedral_styles[d].sign = std::atof(w[4].c_str());
+        ff.dihedral_styles[d].n    = std::atoi(w[5].c_str());
+      } else if (w[0] == "dihedrals" && w.size() == 2) {
+        for (const auto& dw : readDirectives(w[1])) {
+          if (dw.size() < 5) {
+            LOCAL_STRESS_ERR("Dihedral lines should be \"id_i id_j id_k id_l type\".");
+          }
+          ff.dihedrals.push_back({{{std::atoll(dw[0].c_str()), std::atoll(dw[1].c_str()),
+                                    std::atoll(dw[2].c_str()), std::atoll(dw[3].c_str())}},
+                                  std::atoi(dw[4].c_str()) - 1});
+        }
+      } else {
+        LOCAL_STRESS_ERR("Unknown directive " << w[0] << " in " << fname);
+      }
+    }
+    for (const auto& b : ff.bonds) {
+      if (b.type < 0 || b.type >= int32_t(ff.bond_styles.size())) {
+        LOCAL_STRESS_ERR("Bond type " << b.type + 1 << " has no coefficients.");
+      }
+    }
+    for (const auto& a : ff.angles) {
+      if (a.type < 0 || a.type >= int32_t(ff.angle_styles.size())) {
+        LOCAL_STRESS_ERR("Angle type " << a.type + 1 << " has no coefficients.");
+      }
+    }
+    for (const auto& d : ff.dihedrals) {
+      if (d.type < 0 || d.type >= int32_t(ff.dihedral_styles.size())) {
+        LOCAL_STRESS_ERR("Dihedral type " << d.type + 1 << " has no coefficients.");
+      }
+    }
+    if (ff.r_cut <= 0 && !ff.pairs.empty()) {
+      LOCAL_STRESS_ERR("cutoff should be given for pair forces.");
+    }
+    ff.mass.resize(ff.num_types, 0);
+    return ff;
+  }
+
+  // NOTE: F(r) of a two-column table, linearly interpolated in r.
+  inline std::function<Real(Real)> readForceTable(const std::string& fname) {
+    std::vector<Real> rs, fs;
+    for (const auto& w : readDirectives(fname)) {
+      if (w.size() < 2) continue;
+      rs.push_back(std::atof(w[0].c_str()));
+      fs.push_back(std::atof(w[1].c_str()));
+    }
+    if (rs.size() < 2) {
+      LOCAL_STRESS_ERR(fname << " should have at least two rows.");
+    }
+    return [rs, fs](const Real r) {
+      if (r <= rs.front()) return fs.front();
+      if (r >= rs.back()) return fs.back();
+      const auto k = std::upper_bound(rs.cbegin(), rs.cend(), r) - rs.cbegin() - 1;
+      const Real t = (r - rs[k]) / (rs[k + 1] - rs[k]);
+      return fs[k] + (fs[k + 1] - fs[k]) * t;
+    };
+  }
+
+  inline LS::PairTable<Real> makePairTable(const ForceField& ff) {
+    LS::PairTable<Real> table(std::max(ff.num_types, 1), (ff.r_cut > 0) ? ff.r_cut : Real(1));
+    for (const auto& p : ff.pairs) {
+      const auto ti = ff.typeIndex(p[0]), tj = ff.typeIndex(p[1]);
+      std::istringstream args(p[3]);
+      if (p[2] == "lj") {
+        Real eps, sigma;
+        args >> eps >> sigma;
+        table.setForce(ti, tj, [eps, sigma](const Real r) {
+          const Real sr6 = std::pow(sigma / r, 6);
+          return 24.0 * eps * (2.0 * sr6 * sr6 - sr6) / r;
+        });
+      } else if (p[2] == "table") {
+        std::string fname;
+        args >> fname;
+        table.setForce(ti, tj, readForceTable(fname));
+      } else {
+        LOCAL_STRESS_ERR("Unknown pair style " << p[2]);
+      }
+    }
+    return table;
+  }
+
+  inline Vec_t cross(const Vec_t& a, const Vec_t& b) {
+    return Vec_t(a.y * b.z - a.z * b.y, a.z * b.x - a.x * b.z, a.x * b.y - a.y * b.x);
+  }
+
+  // NOTE:
+  // Forces of E = k (theta - theta0)^2 on atoms i, j (central), k, from
+  // rij = ri - rj and rkj = rk - rj (minimum-imaged).
+  inline std::array<Vec_t, 3> angleForces(const HarmonicAngle& st, const Vec_t& rij, const Vec_t& rkj) {
+    const Real ri = rij.norm(), rk = rkj.norm();
+    const Real c = std::max(Real(-1), std::min(Real(1), (rij * rkj) / (ri * rk)));
+    const Real s = std::max(std::sqrt(1 - c * c), Real(1.0e-8));
+    // F = -dE/dtheta dtheta/dr, dtheta/dr = -(1 / sin theta) dcos(theta)/dr
+    const Real f = 2 * st.k * (std::acos(c) - st.theta0) / s;
+    const auto Fi = (rkj / (ri * rk) - rij * (c / (ri * ri))) * f;
+    const auto Fk = (rij / (ri * rk) - rkj * (c / (rk * rk))) * f;
+    return {{Fi, -(Fi + Fk), Fk}};
+  }
+
+  // NOTE:
+  // Forces of E = k (1 + s cos(n phi)) on atoms i, j, k, l from the
+  // minimum-imaged bond vectors b1 = rj - ri, b2 = rk - rj, b3 = rl - rk
+  // (Blondel and Karplus, J. Comput. Chem. 17, 1132 (1996)).
+  inline std::array<Vec_t, 4> dihedralForces(const HarmonicDihedral& st,
+                                      const Vec_t& b1, const Vec_t& b2, const Vec_t& b3) {
+    const auto m = cross(b1, b2), n = cross(b2, b3);
+    const Real m2 = m * m, n2 = n * n, lb2 = b2.norm();
+    const Real phi = std::atan2(lb2 * (b1 * n), m * n);
+    // F = -dE/dphi dphi/dr
+    const Real f = st.k * st.sign * st.n * std::sin(st.n * phi);
+    const auto Fi = m * (-f * lb2 / m2);
+    const auto Fl = n * (f * lb2 / n2);
+    const Real p = (b1 * b2) / (lb2 * lb2), q = (b3 * b2) / (lb2 * lb2);
+    const auto Fj = Fl * q - Fi * (p + 1);
+    const auto Fk = Fi * p - Fl * (q + 1);
+    return {{Fi, Fj, Fk, Fl}};
+  }
+
+  inline LS::BoundaryType boundaryType(const std::array<bool, 3>& periodic) {
+    static const LS::BoundaryType types[8] = {
+      LS::BoundaryType::FIXED,         LS::BoundaryType::PERIODIC_X,
+      LS::BoundaryType::PERIODIC_Y,    LS::BoundaryType::PERIODIC_XY,
+      LS::BoundaryType::PERIODIC_Z,    LS::BoundaryType::PERIODIC_ZX,
+      LS::BoundaryType::PERIODIC_YZ,   LS::BoundaryType::PERIODIC_XYZ,
+    };
+    return types[int(periodic[0]) | (int(periodic[1]) << 1) | (int(periodic[2]) << 2)];
+  }
+
+  struct Options {
+    std::string traj, force_field, out_dir = "./", format;
+    std::array<int32_t, 3> mesh {{0, 0, 0}};
+    int32_t workers = std::max(1u, std::thread::hardware_concurrency());
+    int32_t begin = 0, end = -1, every = 1;
+  };
+
+  inline void usage(void) {
+    std::cerr << "usage: lscmd-analyze -i traj -f force_field -m nx,ny,nz [-o dir] [-j workers]\n"
+              << "                     [--format lammps|xyz] [--begin n] [--end n] [--every n]\n";
+    std::exit(1);
+  }
+
+  inline Options parseOptions(int argc, char* argv[]) {
+    Options opt;
+    for (int i = 1; i < argc; i++) {
+      const std::string key = argv[i];
+      if (i + 1 >= argc) usage();
+      const std::string val = argv[++i];
+      if (key == "-i") opt.traj = val;
+      else if (key == "-f") opt.force_field = val;
+      else if (key == "-o") opt.out_dir = val;
+      else if (key == "-j") opt.workers = std::atoi(val.c_str());
+      else if (key == "--format") opt.format = val;
+      else if (key == "--begin") opt.begin = std::atoi(val.c_str());
+      else if (key == "--end") opt.end = std::atoi(val.c_str());
+      else if (key == "--every") opt.every = std::atoi(val.c_str());
+      else if (key == "-m") {
+        if (std::sscanf(val.c_str(), "%d,%d,%d", &opt.mesh[0], &opt.mesh[1], &opt.mesh[2]) != 3) usage();
+      } else {
+        usage();
+      }
+    }
+    if (opt.traj.empty() || opt.force_field.empty() || opt.mesh[0] <= 0 ||
+        opt.mesh[1] <= 0 || opt.mesh[2] <= 0 || opt.workers <= 0 || opt.every <= 0) {
+      usage();
+    }
+    return opt;
+  }
+
+  class Worker {
+    const ForceField& ff_;
+    LS::LSCalculator<Real>& calc_;
+    LS::PairEngine<Real> engine_;
+    LS::TrajectoryFrame<Real> frame_;
+    std::unordered_map<int64_t, int32_t> id_to_index_;
+
+    void calcBonds(const LS::VecArrayView<Real>& pos) {
+      const auto& box = calc_.boundary();
+      for (const auto& b : ff_.bonds) {
+        const auto it = id_to_index_.find(b.i), jt = id_to_index_.find(b.j);
+        if (it == id_to_index_.end() || jt == id_to_index_.end()) continue;
+        const int32_t i = it->second, j = jt->second;
+        auto dr = pos[i] - pos[j];
+        box.applyMinimumImage(dr);
+        const Real r = dr.norm();
+        const auto& st = ff_.bond_styles[b.type];
+        const auto F = dr * (-st.k * (r - st.r0) / r);
+        calc_.calcLocalStressPot2NoCheck(pos, i, j, F, -F, BOND);
+      }
+    }
+
+    template <std::size_t N>
+    bool lookup(const std::array<int64_t, N>& ids, std::array<int32_t, N>& idx) const {
+      for (std::size_t a = 0; a < N; a++) {
+        const auto it = id_to_index_.find(ids[a]);
+        if (it == id_to_index_.end()) return false;
+        idx[a] = it->second;
+      }
+      return true;
+    }
+
+    void calcAngles(const LS::VecArrayView<Real>& pos) {
+      const auto& box = calc_.boundary();
+      std::array<int32_t, 3> idx;
+      for (const auto& a : ff_.angles) {
+        if (!lookup(a.ids, idx)) continue;
+        auto rij = pos[idx[0]] - pos[idx[1]], rkj = pos[idx[2]] - pos[idx[1]];
+        box.applyMinimumImage(rij);
+        box.applyMinimumImage(rkj);
+        const auto F = angleForces(ff_.angle_styles[a.type], rij, rkj);
+        calc_.calcLocalStressPot3NoCheck(pos, idx[0], idx[1], idx[2], F[0], F[1], F[2], ANGLE);
+      }
+    }
+
+    void calcDihedrals(const LS::VecArrayView<Real>& pos) {
+      const auto& box = calc_.boundary();
+      std::array<int32_t, 4> idx;
+      for (const auto& d : ff_.dihedrals) {
+        if (!lookup(d.ids, idx)) continue;
+        auto b1 = pos[idx[1]] - pos[idx[0]], b2 = pos[idx[2]] - pos[idx[1]], b3 = pos[idx[3]] - pos[idx[2]];
+        box.applyMinimumImage(b1);
+        box.applyMinimumImage(b2);
+        box.applyMinimumImage(b3);
+        const auto F = dihedralForces(ff_.dihedral_styles[d.type], b1, b2, b3);
+        calc_.calcLocalStressPot4NoCheck(pos, idx[0], idx[1], idx[2], idx[3],
+                                         F[0], F[1], F[2], F[3], DIHEDRAL);
+      }
+    }
+
+  public:
+    Worker(const ForceField& ff, const LS::PairTable<Real>& table, LS::LSCalculator<Real>& calc)
+      : ff_(ff), calc_(calc), engine_(table, PAIR) {}
+
+    void process(const LS::TrajectoryReader<Real>& reader, const int32_t f) {
+      reader.readFrame(f, frame_);
+      calc_.setFrameIndex(f);
+      const int32_t num = frame_.number_of_atoms();
+      for (const auto t : frame_.types) {
+        if (t < 0 || t >= ff_.num_types) {
+          LOCAL_STRESS_ERR("Atom type " << t + 1 << " is not in the force field.");
+        }
+      }
+      calc_.updateBox(frame_.low, frame_.high, frame_.tilt);
+      frame_.wrap();
+      LS::VecArrayView<Real> pos(frame_.pos.data());
+
+      if (!ff_.pairs.empty()) {
+        engine_.compute(calc_, pos, frame_.types.data(), num);
+      } else {
+        calc_.prepareFrame(pos, num);
+      }
+      if (!ff_.bonds.empty() || !ff_.angles.empty() || !ff_.dihedrals.empty()) {
+        id_to_index_.clear();
+        for (int32_t i = 0; i < num; i++) id_to_index_[frame_.ids[i]] = i;
+      }
+      if (!ff_.bonds.empty()) calcBonds(pos);
+      if (!ff_.angles.empty()) calcAngles(pos);
+      if (!ff_.dihedrals.empty()) calcDihedrals(pos);
+      if (frame_.has_velocity()) {
+        LS::VecArrayView<Real> vel(frame_.vel.data());
+        for (int32_t i = 0; i < num; i++) {
+          const Real m = ff_.mass[frame_.types[i]];
+          if (m > 0) calc_.calcLocalStressKin(pos[i], vel[i], m, KINETIC);
+        }
+      }
+      calc_.nextStep();
+    }
+  };
+
+  // NOTE:
+  // Runs the workers over the frames selected by opt and returns their
+  // calculators, each holding a disjoint set of frames (see
+  // LSHelpers::saveLocalStressDistFrames).
+  inline std::vector<std::unique_ptr<LS::LSCalculator<Real>>> analyze(const Options& opt) {
+    const auto ff = readForceField(opt.force_field);
+
+    const auto format = opt.format.empty() ? LS::TrajectoryReader<Real>::guessFormat(opt.traj)
+                        : (opt.format == "xyz") ? LS::TrajectoryFormat::EXTENDED_XYZ
+                        : LS::TrajectoryFormat::LAMMPS_DUMP;
+    const LS::TrajectoryReader<Real> reader(opt.traj, format, ff.type_names);
+    const int32_t num_frames = reader.number_of_frames();
+    const int32_t end = (opt.end < 0) ? num_frames : std::min(opt.end, num_frames);
+    std::vector<int32_t> frames;
+    for (int32_t f = opt.begin; f < end; f += opt.every) frames.push_back(f);
+    if (frames.empty()) {
+      LOCAL_STRESS_ERR("No frames to analyze in " << opt.traj);
+    }
+
+    // the first frame defines the reference box of the cells
+    LS::TrajectoryFrame<Real> first;
+    reader.readFrame(frames[0], first);
+    const int32_t num_workers = std::min<int32_t>(opt.workers, frames.size());
+    const auto table = makePairTable(ff);
+
+    std::vector<std::unique_ptr<LS::LSCalculator<Real>>> calcs(num_workers);
+    std::vector<std::thread> threads;
+    for (int32_t w = 0; w < num_workers; w++) {
+      threads.emplace_back([&, w]() {
+        calcs[w] = LS::CalculatorFactory<Real>::create(Vec_t(first.low), Vec_t(first.high),
+                                                       boundaryType(first.periodic),
+                                                       std::array<int32_t, 3>(opt.mesh),
+                                                       {"Kinetic", "Pair", "Bond", "Angle", "Dihedral"});
+        calcs[w]->setSaveDir(opt.out_dir);
+        Worker worker(ff, table, *calcs[w]);
+        for (std::size_t k = w; k < frames.size(); k += num_workers) {
+          worker.process(reader, frames[k]);
+        }
+      });
+    }
+    for (auto& th : threads) th.join();
+
+    std::cout << frames.size() << " frames analyzed with " << num_workers << " workers.\n";
+    return calcs;
+  }
+}
+#endif
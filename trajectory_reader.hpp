@@ -0,0 +1,448 @@
+#if !defined TRAJECTORY_READER_HPP
+#define TRAJECTORY_READER_HPP
+
+#include <array>
+#include <cctype>
+#include <cmath>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <vector>
+#include <algorithm>
+
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+namespace LocalStress {
+  // NOTE: read-only memory map of a whole file.
+  class MappedFile final {
+    const char* data_ = nullptr;
+    std::size_t size_ = 0;
+
+  public:
+    explicit MappedFile(const std::string& fname) {
+      const int fd = open(fname.c_str(), O_RDONLY);
+      if (fd < 0) {
+        LOCAL_STRESS_ERR("Cannot open " << fname);
+      }
+      struct stat st;
+      fstat(fd, &st);
+      size_ = st.st_size;
+      if (size_ > 0) {
+        void* ptr = mmap(nullptr, size_, PROT_READ, MAP_PRIVATE, fd, 0);
+        if (ptr == MAP_FAILED) {
+          LOCAL_STRESS_ERR("Cannot map " << fname);
+        }
+        data_ = static_cast<const char*>(ptr);
+      }
+      close(fd);
+    }
+
+    ~MappedFile(void) {
+      if (data_) munmap(const_cast<char*>(data_), size_);
+    }
+
+    MappedFile(const MappedFile&) = delete;
+    MappedFile& operator = (const MappedFile&) = delete;
+
+    const char* data(void) const { return data_; }
+    std::size_t size(void) const { return size_; }
+  };
+
+  // NOTE: line and token scanner over [begin, end) which need not be NUL terminated.
+  class TextCursor final {
+    const char *p_, *end_;
+
+  public:
+    TextCursor(const char* begin, const char* end) : p_(begin), end_(end) {}
+
+    const char* pos(void) const { return p_; }
+    bool eof(void) const { return p_ >= end_; }
+
+    void skipLine(void) {
+      const void* nl = std::memchr(p_, '\n', end_ - p_);
+      p_ = nl ? static_cast<const char*>(nl) + 1 : end_;
+    }
+
+    void skipLines(int64_t n) {
+      while (n-- > 0 && !eof()) skipLine();
+    }
+
+    // NOTE: rest of the current line without the newline; moves to the next line.
+    std::string line(void) {
+      const void* nl = std::memchr(p_, '\n', end_ - p_);
+      const char* e = nl ? static_cast<const char*>(nl) : end_;
+      std::string ret(p_, e);
+      if (!ret.empty() && ret.back() == '\r') ret.pop_back();
+      p_ = nl ? e + 1 : end_;
+      return ret;
+    }
+
+    // NOTE: next whitespace separated token of the current line. Returns false at the end of line.
+    bool token(const char*& b, const char*& e) {
+      while (p_ < end_ && (*p_ == ' ' || *p_ == '\t' || *p_ == '\r')) p_++;
+      if (p_ >= end_ || *p_ == '\n') return false;
+      b = p_;
+      while (p_ < end_ && !std::isspace(static_cast<unsigned char>(*p_))) p_++;
+      e = p_;
+      return true;
+    }
+
+    static double toDouble(const char* b, const char* e) {
+      char buf[64];
+      const std::size_t n = std::min<std::size_t>(e - b, sizeof(buf) - 1);
+      std::memcpy(buf, b, n);
+      buf[n] = '\0';
+      return std::strtod(buf, nullptr);
+    }
+
+    static int64_t toInt(const char* b, const char* e) {
+      char buf[32];
+      const std::size_t n = std::min<std::size_t>(e - b, sizeof(buf) - 1);
+      std::memcpy(buf, b, n);
+      buf[n] = '\0';
+      return std::strtoll(buf, nullptr, 10);
+    }
+  };
+
+  static inline std::vector<std::string> splitWords(const std::string& str) {
+    std::vector<std::string> words;
+    std::size_t i = 0;
+    while (i < str.size()) {
+      while (i < str.size() && std::isspace(static_cast<unsigned char>(str[i]))) i++;
+      std::size_t j = i;
+      while (j < str.size() && !std::isspace(static_cast<unsigned char>(str[j]))) j++;
+      if (j > i) words.push_back(str.substr(i, j - i));
+      i = j;
+    }
+    return words;
+  }
+
+  // NOTE:
+  // One frame of a trajectory. The box is low + h s (s in [0, 1)^3) with the
+  // upper-triangular h-matrix of diagonal high - low and tilt (xy, xz, yz).
+  // Positions and velocities are stored as xyz triplets, types are 0-based.
+  template <typename T>
+  struct TrajectoryFrame {
+    int64_t step = 0;
+    Vec<T> low, high;
+    std::array<T, 3> tilt {{0, 0, 0}};
+    std::array<bool, 3> periodic {{true, true, true}};
+    std::vector<int64_t> ids;
+    std::vector<int32_t> types;
+    std::vector<T> pos, vel;
+
+    int32_t number_of_atoms(void) const { return types.size(); }
+    bool has_velocity(void) const { return !vel.empty(); }
+
+    // NOTE: maps positions into the box along periodic axes.
+    void wrap(void) {
+      const auto len = high - low;
+      for (std::size_t i = 0; i < types.size(); i++) {
+        T* r = &pos[3 * i];
+        T s[3];
+        s[2] = (r[2] - low[2]) / len[2];
+        s[1] = (r[1] - low[1] - tilt[2] * s[2]) / len[1];
+        s[0] = (r[0] - low[0] - tilt[0] * s[1] - tilt[1] * s[2]) / len[0];
+        bool moved = false;
+        for (int32_t a = 0; a < 3; a++) {
+          if (periodic[a] && (s[a] < T(0) || s[a] >= T(1))) {
+            s[a] -= std::floor(s[a]);
+            if (s[a] >= T(1)) s[a] = T(0);
+            moved = true;
+          }
+        }
+        if (!moved) continue;
+        r[0] = low[0] + len[0] * s[0] + tilt[0] * s[1] + tilt[1] * s[2];
+        r[1] = low[1] + len[1] * s[1] + tilt[2] * s[2];
+        r[2] = low[2] + len[2] * s[2];
+      }
+    }
+  };
+
+  enum class TrajectoryFormat : int32_t {
+    LAMMPS_DUMP = 0,
+    EXTENDED_XYZ,
+  };
+
+  // NOTE:
+  // Memory-mapped LAMMPS dump (text) or extended XYZ trajectory.
+  // The constructor only scans line breaks to index the frames; readFrame
+  // parses one frame and may be called concurrently from several threads.
+  // type_names maps species of extended XYZ files to type ids.
+  template <typename T>
+  class TrajectoryReader final {
+    static_assert(D == 3, "TrajectoryReader supports 3D trajectories only.");
+
+    MappedFile file_;
+    TrajectoryFormat format_;
+    std::vector<std::string> type_names_;
+    std::vector<std::size_t> offsets_;
+
+    const char* begin(void) const { return file_.data(); }
+    const char* end(void) const { return file_.data() + file_.size(); }
+
+    static bool startsWith(const std::string& str, const char* prefix) {
+      return str.compare(0, std::strlen(prefix), prefix) == 0;
+    }
+
+    void indexLammps(void) {
+      TextCursor cur(begin(), end());
+      while (!cur.eof()) {
+        const std::size_t ofs = cur.pos() - begin();
+        const auto head = cur.line();
+        if (head.empty()) continue;
+        if (!startsWith(head, "ITEM: TIMESTEP")) {
+          LOCAL_STRESS_ERR("Broken LAMMPS dump: " << head);
+        }
+        offsets_.push_back(ofs);
+        cur.skipLine();
+        if (!startsWith(cur.line(), "ITEM: NUMBER OF ATOMS")) {
+          LOCAL_STRESS_ERR("Broken LAMMPS dump: NUMBER OF ATOMS expected.");
+        }
+        const auto num = std::strtoll(cur.line().c_str(), nullptr, 10);
+        cur.skipLines(4);
+        cur.skipLines(num + 1);
+      }
+    }
+
+    void indexXYZ(void) {
+      TextCursor cur(begin(), end());
+      while (!cur.eof()) {
+        const std::size_t ofs = cur.pos() - begin();
+        const auto words = splitWords(cur.line());
+        if (words.empty()) continue;
+        offsets_.push_back(ofs);
+        cur.skipLines(std::strtoll(words[0].c_str(), nullptr, 10) + 1);
+      }
+    }
+
+    void setLammpsBox(TrajectoryFrame<T>& frame, const std::string& head,
+                      const std::array<std::vector<double>, 3>& bounds) const {
+      const auto words = splitWords(head);
+      const bool triclinic = (head.find("xy xz yz") != std::string::npos);
+      for (int32_t a = 0; a < 3; a++) {
+        frame.periodic[a] = (words[words.size() - 3 + a] == "pp");
+        frame.low[a]  = bounds[a][0];
+        frame.high[a] = bounds[a][1];
+      }
+      frame.tilt.fill(0);
+      if (triclinic) {
+        // bounds of the triclinic box are those of its bounding box
+        const T xy = bounds[0][2], xz = bounds[1][2], yz = bounds[2][2];
+        frame.tilt = {{xy, xz, yz}};
+        frame.low[0]  -= std::min({T(0), xy, xz, xy + xz});
+        frame.high[0] -= std::max({T(0), xy, xz, xy + xz});
+        frame.low[1]  -= std::min(T(0), yz);
+        frame.high[1] -= std::max(T(0), yz);
+      }
+    }
+
+    void readLammps(TextCursor& cur, TrajectoryFrame<T>& frame) const {
+      cur.skipLine();
+      frame.step = std::strtoll(cur.line().c_str(), nullptr, 10);
+      cur.skipLine();
+      const int32_t num = std::strtol(cur.line().c_str(), nullptr, 10);
+      const auto box_head = cur.line();
+      std::array<std::vector<double>, 3> bounds;
+      for (int32_t a = 0; a < 3; a++) {
+        for (const auto& w : splitWords(cur.line())) bounds[a].push_back(std::strtod(w.c_str(), nullptr));
+        bounds[a].resize(3, 0.0);
+      }
+      setLammpsBox(frame, box_head, bounds);
+
+      const auto cols = splitWords(cur.line());
+      int32_t c_id = -1, c_type = -1;
+      std::array<int32_t, 3> c_pos {{-1, -1, -1}}, c_vel {{-1, -1, -1}};
+      bool scaled = false;
+      const char* axes = "xyz";
+      for (std::size_t c = 2; c < cols.size(); c++) {
+        const auto& name = cols[c];
+        const int32_t col = c - 2;
+        if (name == "id")   c_id = col;
+        if (name == "type") c_type = col;
+        for (int32_t a = 0; a < 3; a++) {
+          const std::string ax(1, axes[a]);
+          if (name == ax || name == ax + "u") c_pos[a] = col;
+          if (name == ax + "s" || name == ax + "su") { c_pos[a] = col; scaled = true; }
+          if (name == "v" + ax) c_vel[a] = col;
+        }
+      }
+      if (c_type < 0 || c_pos[0] < 0 || c_pos[1] < 0 || c_pos[2] < 0) {
+        LOCAL_STRESS_ERR("LAMMPS dump should have type and x y z columns.");
+      }
+      const bool has_vel = (c_vel[0] >= 0 && c_vel[1] >= 0 && c_vel[2] >= 0);
+
+      frame.ids.resize(num);
+      frame.types.resize(num);
+      frame.pos.resize(3 * num);
+      frame.vel.resize(has_vel ? 3 * num : 0);
+      const auto len = frame.high - frame.low;
+      std::vector<double> vals(cols.size() - 2);
+      for (int32_t i = 0; i < num; i++) {
+        const char *b, *e;
+        std::size_t n = 0;
+        while (n < vals.size() && cur.token(b, e)) vals[n++] = TextCursor::toDouble(b, e);
+        cur.skipLine();
+        if (n < vals.size()) {
+          LOCAL_STRESS_ERR("LAMMPS dump: too few columns at step " << frame.step);
+        }
+        frame.ids[i]   = (c_id >= 0) ? int64_t(vals[c_id]) : i + 1;
+        frame.types[i] = int32_t(vals[c_type]) - 1;
+        T* r = &frame.pos[3 * i];
+        for (int32_t a = 0; a < 3; a++) r[a] = vals[c_pos[a]];
+        if (scaled) {
+          const T s[3] = {r[0], r[1], r[2]};
+          r[0] = frame.low[0] + len[0] * s[0] + frame.tilt[0] * s[1] + frame.tilt[1] * s[2];
+          r[1] = frame.low[1] + len[1] * s[1] + frame.tilt[2] * s[2];
+          r[2] = frame.low[2] + len[2] * s[2];
+        }
+        if (has_vel) {
+          for (int32_t a = 0; a < 3; a++) frame.vel[3 * i + a] = vals[c_vel[a]];
+        }
+      }
+    }
+
+    // NOTE: value of key="..." or key=... in an extended XYZ comment line.
+    static bool findKey(const std::string& comment, const std::string& key, std::string& value) {
+      std::size_t p = 0;
+      while ((p = comment.find(key + "=", p)) != std::string::npos) {
+        if (p == 0 || std::isspace(static_cast<unsigned char>(comment[p - 1]))) break;
+        p += key.size();
+      }
+      if (p == std::string::npos) return false;
+      p += key.size() + 1;
+      if (p < comment.size() && comment[p] == '"') {
+        const auto q = comment.find('"', p + 1);
+        value = comment.substr(p + 1, q - p - 1);
+      } else {
+        const auto q = comment.find_first_of(" \t", p);
+        value = comment.substr(p, q == std::string::npos ? std::string::npos : q - p);
+      }
+      return true;
+    }
+
+    void readXYZ(TextCursor& cur, TrajectoryFrame<T>& frame) const {
+      const int32_t num = std::strtol(cur.line().c_str(), nullptr, 10);
+      const auto comment = cur.line();
+
+      std::string value;
+      if (!findKey(comment, "Lattice", value)) {
+        LOCAL_STRESS_ERR("Extended XYZ frames should have a Lattice.");
+      }
+      std::vector<double> lat;
+      for (const auto& w : splitWords(value)) lat.push_back(std::strtod(w.c_str(), nullptr));
+      if (lat.size() != 9) {
+        LOCAL_STRESS_ERR("Lattice should have 9 elements.");
+      }
+      const double eps = 1.0e-10 * (std::abs(lat[0]) + std::abs(lat[4]) + std::abs(lat[8]));
+      if (std::abs(lat[1]) > eps || std::abs(lat[2]) > eps || std::abs(lat[5]) > eps) {
+        LOCAL_STRESS_ERR("Lattice vectors should be a = (ax, 0, 0), b = (bx, by, 0), c = (cx, cy, cz).");
+      }
+      std::vector<double> origin(3, 0.0);
+      if (findKey(comment, "Origin", value)) {
+        const auto w = splitWords(value);
+        for (int32_t a = 0; a < 3 && a < int32_t(w.size()); a++) origin[a] = std::strtod(w[a].c_str(), nullptr);
+      }
+      for (int32_t a = 0; a < 3; a++) {
+        frame.low[a]  = origin[a];
+        frame.high[a] = origin[a] + lat[4 * a];
+      }
+      frame.tilt = {{T(lat[3]), T(lat[6]), T(lat[7])}};
+      frame.periodic.fill(true);
+      if (findKey(comment, "pbc", value)) {
+        const auto w = splitWords(value);
+        for (int32_t a = 0; a < 3 && a < int32_t(w.size()); a++) frame.periodic[a] = (w[a] == "T");
+      }
+      frame.step = findKey(comment, "step", value) ? std::strtoll(value.c_str(), nullptr, 10) : 0;
+
+      // column layout from Properties=name:type:count:...
+      int32_t c_species = 0, c_pos = 1, c_vel = -1, ncols = 4;
+      if (findKey(comment, "Properties", value)) {
+        std::vector<std::string> f;
+        std::size_t p = 0;
+        while (p <= value.size()) {
+          const auto q = value.find(':', p);
+          f.push_back(value.substr(p, q == std::string::npos ? std::string::npos : q - p));
+          if (q == std::string::npos) break;
+          p = q + 1;
+        }
+        c_species = c_pos = -1;
+        int32_t col = 0;
+        for (std::size_t k = 0; k + 2 < f.size(); k += 3) {
+          if (f[k] == "species") c_species = col;
+          if (f[k] == "pos") c_pos = col;
+          if (f[k] == "velo" || f[k] == "vel" || f[k] == "velocities") c_vel = col;
+          col += std::atoi(f[k + 2].c_str());
+        }
+        ncols = col;
+        if (c_species < 0 || c_pos < 0) {
+          LOCAL_STRESS_ERR("Extended XYZ Properties should have species and pos.");
+        }
+      }
+
+      frame.ids.resize(num);
+      frame.types.resize(num);
+      frame.pos.resize(3 * num);
+      frame.vel.resize(c_vel >= 0 ? 3 * num : 0);
+      for (int32_t i = 0; i < num; i++) {
+        const char *b, *e;
+        int32_t col = 0;
+        while (col < ncols && cur.token(b, e)) {
+          if (col == c_species) {
+            const auto it = std::find(type_names_.cbegin(), type_names_.cend(), std::string(b, e));
+            if (it == type_names_.cend()) {
+              LOCAL_STRESS_ERR("Unknown species " << std::string(b, e));
+            }
+            frame.types[i] = it - type_names_.cbegin();
+          } else if (col >= c_pos && col < c_pos + 3) {
+            frame.pos[3 * i + col - c_pos] = TextCursor::toDouble(b, e);
+          } else if (c_vel >= 0 && col >= c_vel && col < c_vel + 3) {
+            frame.vel[3 * i + col - c_vel] = TextCursor::toDouble(b, e);
+          }
+          col++;
+        }
+        cur.skipLine();
+        if (col < ncols) {
+          LOCAL_STRESS_ERR("Extended XYZ: too few columns in atom " << i);
+        }
+        frame.ids[i] = i + 1;
+      }
+    }
+
+  public:
+    TrajectoryReader(const std::string& fname,
+                     const TrajectoryFormat format,
+                     const std::vector<std::string>& type_names = {})
+      : file_(fname), format_(format), type_names_(type_names) {
+      if (format_ == TrajectoryFormat::LAMMPS_DUMP) {
+        indexLammps();
+      } else {
+        indexXYZ();
+      }
+      offsets_.push_back(file_.size());
+    }
+
+    // NOTE: *.xyz and *.extxyz are extended XYZ, anything else a LAMMPS dump.
+    static TrajectoryFormat guessFormat(const std::string& fname) {
+      const auto dot = fname.rfind('.');
+      const auto ext = (dot == std::string::npos) ? std::string() : fname.substr(dot + 1);
+      return (ext == "xyz" || ext == "extxyz") ? TrajectoryFormat::EXTENDED_XYZ
+                                               : TrajectoryFormat::LAMMPS_DUMP;
+    }
+
+    int32_t number_of_frames(void) const { return offsets_.size() - 1; }
+
+    void readFrame(const int32_t i, TrajectoryFrame<T>& frame) const {
+      TextCursor cur(begin() + offsets_[i], begin() + offsets_[i + 1]);
+      if (format_ == TrajectoryFormat::LAMMPS_DUMP) {
+        readLammps(cur, frame);
+      } else {
+        readXYZ(cur, frame);
+      }
+    }
+  };
+}
+#endif
@@ -1,6 +1,7 @@
 #if !defined UTILS_HPP
 #define UTILS_HPP
 
+#include <cstdint>
 #include <iostream>
 #include <memory>
 #include <type_traits>
@@ -38,5 +39,21 @@ namespace LocalStress {
   make_unique(std::size_t N) {
     return std::unique_ptr<T>(new remove_extent_t<T> [N]);
   }
+
+  // NOTE:
+  // Counter-based random numbers: a stateless function of (key, counter),
+  // so every draw is reproducible without carrying generator state around.
+  // Built on the SplitMix64 finalizer.
+  inline uint64_t mix64(uint64_t x) {
+    x += 0x9e3779b97f4a7c15ull;
+    x = (x ^ (x >> 30)) * 0xbf58476d1ce4e5b9ull;
+    x = (x ^ (x >> 27)) * 0x94d049bb133111ebull;
+    return x ^ (x >> 31);
+  }
+
+  // NOTE: uniform in [0, 1).
+  inline double counter_uniform(const uint64_t key, const uint64_t counter) {
+    return (mix64(mix64(key) ^ counter) >> 11) * (1.0 / 9007199254740992.0);
+  }
 }
 #endif
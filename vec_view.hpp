@@ -0,0 +1,57 @@
+#if !defined VEC_VIEW_HPP
+#define VEC_VIEW_HPP
+
+#include <cstddef>
+#include <array>
+
+namespace LocalStress {
+  // NOTE:
+  // Read-only view of D-component vectors living in caller memory.
+  // Component a of element i is read from (char*)base_[a] + i * stride_.
+  //
+  // AoS: struct Atom {double qx, qy, qz, px, py, pz;} atoms[N];
+  //   VecArrayView<double> q(&atoms[0].qx, sizeof(Atom));
+  //   VecArrayView<double> p(&atoms[0].px, sizeof(Atom));
+  // SoA: double x[N], y[N], z[N];
+  //   VecArrayView<double> q({x, y, z});
+  template <typename T>
+  class VecArrayView final {
+    typedef Vec<T> Vec_t;
+
+    std::array<const char*, D> base_;
+    std::ptrdiff_t stride_;
+
+  public:
+    VecArrayView(const T* first, const std::ptrdiff_t stride_bytes = D * sizeof(T))
+      : stride_(stride_bytes) {
+      for (int32_t a = 0; a < D; a++) {
+        base_[a] = reinterpret_cast<const char*>(first + a);
+      }
+    }
+
+    VecArrayView(const std::array<const T*, D>& comps,
+                 const std::ptrdiff_t stride_bytes = sizeof(T))
+      : stride_(stride_bytes) {
+      for (int32_t a = 0; a < D; a++) {
+        base_[a] = reinterpret_cast<const char*>(comps[a]);
+      }
+    }
+
+    T operator () (const std::ptrdiff_t i, const int32_t axis) const {
+      return *reinterpret_cast<const T*>(base_[axis] + i * stride_);
+    }
+
+    const Vec_t operator [] (const std::ptrdiff_t i) const {
+      Vec_t ret;
+      for (int32_t a = 0; a < D; a++) ret[a] = (*this)(i, a);
+      return ret;
+    }
+
+    std::ptrdiff_t stride(void) const { return stride_; }
+
+    bool operator == (const VecArrayView& rhs) const {
+      return (base_ == rhs.base_) && (stride_ == rhs.stride_);
+    }
+  };
+}
+#endif